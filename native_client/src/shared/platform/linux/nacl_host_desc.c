@@ -411,6 +411,12 @@ void NaClHostDescStatCommon(struct nacl_abi_stat  *nasp,
       /* stdin/out/err can be inherited, so this is okay */
       m = NACL_ABI_S_IFCHR;
       break;
+#endif
+#if defined(S_IFSOCK)
+    case S_IFSOCK:
+      /* from the socket syscalls; see nacl_desc_socket.c */
+      m = NACL_ABI_S_IFSOCK;
+      break;
 #endif
     default:
       NaClLog(LOG_ERROR,
@@ -38,15 +38,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
 #include <limits.h>
-
-//@ nizam: I commented this to make nacl output info
-//#define NON_THREAD_SAFE_DETAIL_CHECK  1
-/*
- * If set, check detail_level without grabbing a mutex.  This makes
- * logging much cheaper, but implies that the verbosity level should
- * only be changed prior to going multithreaded.
- */
+#if !NACL_WINDOWS
+# include <sys/time.h>
+# include <time.h>
+#endif
 
 #include "native_client/src/shared/platform/nacl_log.h"
 #include "native_client/src/shared/platform/nacl_log_intern.h"
@@ -54,6 +51,7 @@
 #include "native_client/src/shared/platform/nacl_threads.h"
 #include "native_client/src/shared/platform/nacl_timestamp.h"
 #include "native_client/src/trusted/service_runtime/gio.h"
+#include "native_client/src/trusted/service_runtime/nacl_config.h"
 
 /*
  * All logging is protected by this mutex.
@@ -64,19 +62,47 @@ static int              abort_on_unlock = 0;
 
 #define NACL_VERBOSITY_UNSET INT_MAX
 
-static int              verbosity = NACL_VERBOSITY_UNSET;
+/* Written under log_mu, but read without it by NaClLogV. */
+static volatile int     verbosity = NACL_VERBOSITY_UNSET;
 static struct Gio       *log_stream = NULL;
 static struct GioFile   log_file_stream;
 static int              timestamp_enabled = 1;
 
+/*
+ * Set while NaClLogEnableBuffering is in effect.  log_buffered is read
+ * without the lock on every NaClLog call; log_binary changes only
+ * under log_mu.
+ */
+static volatile int     log_buffered = 0;
+static int              log_binary = 0;
+
 /* global, but explicitly not exposed in non-test header file */
 void (*gNaClLogAbortBehavior)(void) = abort;
 
+static struct NaClMutex   flush_mu;
+static struct NaClCondVar flush_cv;
+
 void NaClLogModuleInit(void) {
+  char  *env_buffer;
+
   NaClMutexCtor(&log_mu);
+  NaClMutexCtor(&flush_mu);
+  NaClCondVarCtor(&flush_cv);
+
+  env_buffer = getenv("NACLLOG_BUFFER");
+  if (NULL != env_buffer) {
+    if (0 == strcmp(env_buffer, "binary")) {
+      (void) NaClLogEnableBuffering(1);
+    } else if (0 == strcmp(env_buffer, "text")) {
+      (void) NaClLogEnableBuffering(0);
+    }
+  }
 }
 
 void NaClLogModuleFini(void) {
+  NaClLogDisableBuffering();
+  NaClCondVarDtor(&flush_cv);
+  NaClMutexDtor(&flush_mu);
   NaClMutexDtor(&log_mu);
 }
 
@@ -119,6 +145,24 @@ void  NaClLogIncrVerbosity(void) {
   NaClLogUnlock();
 }
 
+/*
+ * Caller holds log_mu.
+ */
+static void NaClLogInitVerbosity_mu(void) {
+  if (NACL_VERBOSITY_UNSET == verbosity) {
+    char *env_verbosity = getenv("NACLVERBOSITY");
+    if (NULL != env_verbosity) {
+      int v = strtol(env_verbosity, (char **) NULL, 0);
+      if (v < 0) {
+        v = 0;
+      }
+      verbosity = v;
+    } else {
+      verbosity = 0;
+    }
+  }
+}
+
 int NaClLogGetVerbosity(void) {
   int v;
 
@@ -132,6 +176,15 @@ int NaClLogGetVerbosity(void) {
   return v;
 }
 
+int NaClLogLevelEnabled(int detail_level) {
+  if (NACL_VERBOSITY_UNSET == verbosity) {
+    NaClLogLock();
+    NaClLogInitVerbosity_mu();
+    NaClLogUnlock();
+  }
+  return detail_level <= verbosity;
+}
+
 void  NaClLogSetGio(struct Gio *stream) {
   NaClLogLock();
   if (NULL != log_stream) {
@@ -173,6 +226,346 @@ static void NaClLogOutputTag_mu(struct Gio *s) {
   }
 }
 
+#if NACL_WINDOWS
+
+static void NaClLogDrain_mu(void) {
+}
+
+static int NaClLogBufferV(int         detail_level,
+                          char const  *fmt,
+                          va_list     ap) {
+  UNREFERENCED_PARAMETER(detail_level);
+  UNREFERENCED_PARAMETER(fmt);
+  UNREFERENCED_PARAMETER(ap);
+  return 0;
+}
+
+static void NaClLogWriteBinaryV_mu(struct Gio   *s,
+                                   int          detail_level,
+                                   char const   *fmt,
+                                   va_list      ap) {
+  UNREFERENCED_PARAMETER(detail_level);
+  (void) gvprintf(s, fmt, ap);
+}
+
+int NaClLogEnableBuffering(int binary) {
+  UNREFERENCED_PARAMETER(binary);
+  return 0;
+}
+
+void NaClLogDisableBuffering(void) {
+}
+
+#else
+
+/*
+ * Buffered messages go to one of NACL_LOG_RINGS byte rings.  A writer
+ * claims a ring with a compare-and-swap on its busy word -- normally
+ * the ring its thread id hashes to, else the next free one -- so a
+ * ring has one writer at a time and the flusher is its only reader:
+ * head is advanced only by the writer, and tail only by the flusher,
+ * which holds log_mu.  Each message is a struct NaClLogRecord followed
+ * by its text, padded to 8 bytes.  The rings are allocated on first
+ * use and never freed, since a writer may still hold one after
+ * buffering is turned off.
+ */
+#define NACL_LOG_RINGS          64
+#define NACL_LOG_RING_SHIFT     6     /* log2(NACL_LOG_RINGS) */
+#define NACL_LOG_RING_BYTES     (32 << 10)  /* power of two */
+#define NACL_LOG_MAX_MESSAGE    1024
+#define NACL_LOG_FLUSH_MSEC     100
+
+struct NaClLogRing {
+  volatile uint32_t busy;
+  volatile uint32_t head;     /* bytes ever written */
+  volatile uint32_t tail;     /* bytes ever read */
+  volatile uint32_t dropped;  /* messages that did not fit */
+  char              buf[NACL_LOG_RING_BYTES];
+};
+
+static struct NaClLogRing *log_rings = NULL;
+static struct NaClThread  flusher;
+static int                flusher_running = 0;
+static int                flusher_stop = 0;
+
+static uint32_t NaClLogRecordBytes(uint32_t length) {
+  return (sizeof(struct NaClLogRecord) + length + 7) & ~7;
+}
+
+static uint64_t NaClLogNowUsec(void) {
+  struct timeval  tv;
+
+  if (-1 == gettimeofday(&tv, (struct timezone *) NULL)) {
+    return 0;
+  }
+  return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Same format as NaClTimeStampString, but for a recorded time. */
+static char *NaClLogTimeString(char     *buffer,
+                               size_t   buffer_size,
+                               uint64_t time_usec) {
+  time_t    sec = (time_t) (time_usec / 1000000);
+  struct tm bdt;  /* broken down time */
+
+  (void) localtime_r(&sec, &bdt);
+  snprintf(buffer, buffer_size, "%02d:%02d:%02d.%06d",
+           bdt.tm_hour, bdt.tm_min, bdt.tm_sec,
+           (int32_t) (time_usec % 1000000));
+  return buffer;
+}
+
+static void NaClLogRingPut(struct NaClLogRing *ring,
+                           uint32_t           pos,
+                           void const         *src,
+                           uint32_t           count) {
+  uint32_t  off = pos & (NACL_LOG_RING_BYTES - 1);
+  uint32_t  first = NACL_LOG_RING_BYTES - off;
+
+  if (first > count) {
+    first = count;
+  }
+  memcpy(ring->buf + off, src, first);
+  memcpy(ring->buf, (char const *) src + first, count - first);
+}
+
+static void NaClLogRingGet(struct NaClLogRing *ring,
+                           uint32_t           pos,
+                           void               *dst,
+                           uint32_t           count) {
+  uint32_t  off = pos & (NACL_LOG_RING_BYTES - 1);
+  uint32_t  first = NACL_LOG_RING_BYTES - off;
+
+  if (first > count) {
+    first = count;
+  }
+  memcpy(dst, ring->buf + off, first);
+  memcpy((char *) dst + first, ring->buf, count - first);
+}
+
+static uint32_t NaClLogFormat(char        *msg,
+                              size_t      size,
+                              char const  *fmt,
+                              va_list     ap) {
+  int len = vsnprintf(msg, size, fmt, ap);
+
+  if (len < 0) {
+    return 0;
+  }
+  return ((size_t) len >= size) ? (uint32_t) size - 1 : (uint32_t) len;
+}
+
+static void NaClLogWriteRecord_mu(struct Gio                  *s,
+                                  struct NaClLogRecord const  *rec,
+                                  char const                  *msg) {
+  char timestamp[128];
+
+  if (log_binary) {
+    (void) (*s->vtbl->Write)(s, (void *) rec, sizeof *rec);
+  } else if (timestamp_enabled) {
+    gprintf(s, "[%d,%u:%s] ",
+            GETPID(),
+            rec->thread_id,
+            NaClLogTimeString(timestamp, sizeof timestamp, rec->time_usec));
+  }
+  (void) (*s->vtbl->Write)(s, (void *) msg, rec->length);
+}
+
+static void NaClLogWriteBinaryV_mu(struct Gio   *s,
+                                   int          detail_level,
+                                   char const   *fmt,
+                                   va_list      ap) {
+  char                  msg[NACL_LOG_MAX_MESSAGE];
+  struct NaClLogRecord  rec;
+
+  rec.magic = NACL_LOG_RECORD_MAGIC;
+  rec.detail_level = detail_level;
+  rec.thread_id = NaClThreadId();
+  rec.length = NaClLogFormat(msg, sizeof msg, fmt, ap);
+  rec.time_usec = NaClLogNowUsec();
+  NaClLogWriteRecord_mu(s, &rec, msg);
+  tag_output = 0;
+}
+
+/*
+ * Returns 0 if every ring was busy, in which case the caller should
+ * log synchronously; ap is not consumed.
+ */
+static int NaClLogBufferV(int         detail_level,
+                          char const  *fmt,
+                          va_list     ap) {
+  char                  msg[NACL_LOG_MAX_MESSAGE];
+  struct NaClLogRecord  rec;
+  struct NaClLogRing    *ring = NULL;
+  uint32_t              home;
+  uint32_t              need;
+  uint32_t              i;
+  va_list               ap_copy;
+
+  rec.magic = NACL_LOG_RECORD_MAGIC;
+  rec.detail_level = detail_level;
+  rec.thread_id = NaClThreadId();
+  rec.time_usec = NaClLogNowUsec();
+  va_copy(ap_copy, ap);
+  rec.length = NaClLogFormat(msg, sizeof msg, fmt, ap_copy);
+  va_end(ap_copy);
+  need = NaClLogRecordBytes(rec.length);
+
+  home = (rec.thread_id * 2654435761u) >> (32 - NACL_LOG_RING_SHIFT);
+  for (i = 0; i < NACL_LOG_RINGS; ++i) {
+    ring = &log_rings[(home + i) & (NACL_LOG_RINGS - 1)];
+    if (0 == ring->busy && __sync_bool_compare_and_swap(&ring->busy, 0, 1)) {
+      break;
+    }
+  }
+  if (NACL_LOG_RINGS == i) {
+    return 0;
+  }
+
+  if (NACL_LOG_RING_BYTES - (ring->head - ring->tail) < need) {
+    __sync_fetch_and_add(&ring->dropped, 1);
+  } else {
+    NaClLogRingPut(ring, ring->head, &rec, sizeof rec);
+    NaClLogRingPut(ring, ring->head + sizeof rec, msg, rec.length);
+    /* the record must be visible before the flusher sees the new head */
+    __sync_synchronize();
+    ring->head += need;
+  }
+  __sync_lock_release(&ring->busy);
+  return 1;
+}
+
+/*
+ * Writes out everything in the rings.  Caller holds log_mu.
+ */
+static void NaClLogDrain_mu(void) {
+  struct Gio            *s;
+  struct NaClLogRing    *ring;
+  struct NaClLogRecord  rec;
+  char                  msg[NACL_LOG_MAX_MESSAGE];
+  uint32_t              head;
+  uint32_t              tail;
+  uint32_t              dropped;
+  int                   i;
+  int                   wrote = 0;
+
+  if (NULL == log_rings) {
+    return;
+  }
+  s = NaClLogGetGio_mu();
+  for (i = 0; i < NACL_LOG_RINGS; ++i) {
+    ring = &log_rings[i];
+    head = ring->head;
+    __sync_synchronize();
+    for (tail = ring->tail; tail != head; ) {
+      NaClLogRingGet(ring, tail, &rec, sizeof rec);
+      NaClLogRingGet(ring, tail + sizeof rec, msg, rec.length);
+      NaClLogWriteRecord_mu(s, &rec, msg);
+      tail += NaClLogRecordBytes(rec.length);
+      wrote = 1;
+    }
+    /* done reading before the writer may reuse the space */
+    __sync_synchronize();
+    ring->tail = tail;
+
+    dropped = __sync_lock_test_and_set(&ring->dropped, 0);
+    if (0 != dropped) {
+      rec.magic = NACL_LOG_RECORD_MAGIC;
+      rec.detail_level = LOG_WARNING;
+      rec.thread_id = NaClThreadId();
+      rec.time_usec = NaClLogNowUsec();
+      rec.length = snprintf(msg, sizeof msg,
+                            "NaClLog: dropped %u messages, ring %d full\n",
+                            dropped, i);
+      NaClLogWriteRecord_mu(s, &rec, msg);
+      wrote = 1;
+    }
+  }
+  if (wrote) {
+    (void) (*s->vtbl->Flush)(s);
+  }
+}
+
+static void WINAPI NaClLogFlusher(void *state) {
+  struct nacl_abi_timespec  interval;
+
+  UNREFERENCED_PARAMETER(state);
+  interval.tv_sec = 0;
+  interval.tv_nsec = NACL_LOG_FLUSH_MSEC * 1000 * 1000;
+
+  NaClMutexLock(&flush_mu);
+  while (!flusher_stop) {
+    (void) NaClCondVarTimedWaitRelative(&flush_cv, &flush_mu, &interval);
+    NaClMutexUnlock(&flush_mu);
+
+    NaClLogLock();
+    NaClLogDrain_mu();
+    NaClLogUnlock();
+
+    NaClMutexLock(&flush_mu);
+  }
+  flusher_running = 0;
+  NaClCondVarBroadcast(&flush_cv);
+  NaClMutexUnlock(&flush_mu);
+}
+
+int NaClLogEnableBuffering(int binary) {
+  NaClLogLock();
+  NaClLogInitVerbosity_mu();
+  if (NULL == log_rings) {
+    log_rings = calloc(NACL_LOG_RINGS, sizeof *log_rings);
+    if (NULL == log_rings) {
+      NaClLogUnlock();
+      return 0;
+    }
+  }
+  log_binary = binary;
+  NaClLogUnlock();
+
+  NaClMutexLock(&flush_mu);
+  if (!flusher_running) {
+    flusher_stop = 0;
+    if (!NaClThreadCtor(&flusher, NaClLogFlusher, NULL,
+                        NACL_KERN_STACK_SIZE)) {
+      NaClMutexUnlock(&flush_mu);
+      NaClLogLock();
+      log_binary = 0;
+      NaClLogUnlock();
+      return 0;
+    }
+    flusher_running = 1;
+  }
+  NaClMutexUnlock(&flush_mu);
+
+  log_buffered = 1;
+  return 1;
+}
+
+void NaClLogDisableBuffering(void) {
+  log_buffered = 0;
+
+  NaClMutexLock(&flush_mu);
+  flusher_stop = 1;
+  NaClCondVarBroadcast(&flush_cv);
+  while (flusher_running) {
+    NaClCondVarWait(&flush_cv, &flush_mu);
+  }
+  NaClMutexUnlock(&flush_mu);
+
+  NaClLogLock();
+  NaClLogDrain_mu();
+  log_binary = 0;
+  NaClLogUnlock();
+}
+
+#endif
+
+void NaClLogFlush(void) {
+  NaClLogLock();
+  NaClLogDrain_mu();
+  NaClLogUnlock();
+}
+
 /*
  * Output a printf-style formatted message if the log verbosity level
  * is set higher than the log output's detail level.  Note that since
@@ -199,22 +592,15 @@ void  NaClLogV_mu(int         detail_level,
 
   s = NaClLogGetGio_mu();
 
-  if (NACL_VERBOSITY_UNSET == verbosity) {
-    char *env_verbosity = getenv("NACLVERBOSITY");
-    if (NULL != env_verbosity) {
-      int v = strtol(env_verbosity, (char **) NULL, 0);
-      if (v < 0) {
-        v = 0;
-      }
-      verbosity = v;
-    } else {
-      verbosity = 0;
-    }
-  }
+  NaClLogInitVerbosity_mu();
 
   if (detail_level <= verbosity) {
-    NaClLogOutputTag_mu(s);
-    (void) gvprintf(s, fmt, ap);
+    if (log_binary) {
+      NaClLogWriteBinaryV_mu(s, detail_level, fmt, ap);
+    } else {
+      NaClLogOutputTag_mu(s);
+      (void) gvprintf(s, fmt, ap);
+    }
     (void) (*s->vtbl->Flush)(s);
   }
 
@@ -223,15 +609,26 @@ void  NaClLogV_mu(int         detail_level,
   }
 }
 
+/*
+ * The detail level is checked without the lock, before any
+ * formatting.  Until the verbosity is first set it reads as INT_MAX,
+ * so the locked path sets it.  A verbosity change made while other
+ * threads are logging may take a moment to reach them.
+ */
 void NaClLogV(int         detail_level,
               char const  *fmt,
               va_list     ap) {
-#if NON_THREAD_SAFE_DETAIL_CHECK
   if (detail_level > verbosity) {
     return;
   }
-#endif
+  if (log_buffered && detail_level > LOG_ERROR
+      && NaClLogBufferV(detail_level, fmt, ap)) {
+    return;
+  }
   NaClLogLock();
+  if (log_buffered) {
+    NaClLogDrain_mu();
+  }
   NaClLogV_mu(detail_level, fmt, ap);
   NaClLogUnlock();
 }
@@ -241,17 +638,9 @@ void  NaClLog(int         detail_level,
               ...) {
   va_list ap;
 
-#if NON_THREAD_SAFE_DETAIL_CHECK
-  if (detail_level > verbosity) {
-    return;
-  }
-#endif
-
-  NaClLogLock();
   va_start(ap, fmt);
-  NaClLogV_mu(detail_level, fmt, ap);
+  NaClLogV(detail_level, fmt, ap);
   va_end(ap);
-  NaClLogUnlock();
 }
 
 void  NaClLog_mu(int         detail_level,
@@ -259,12 +648,6 @@ void  NaClLog_mu(int         detail_level,
                  ...) {
   va_list ap;
 
-#if NON_THREAD_SAFE_DETAIL_CHECK
-  if (detail_level > verbosity) {
-    return;
-  }
-#endif
-
   va_start(ap, fmt);
   NaClLogV_mu(detail_level, fmt, ap);
   va_end(ap);
@@ -70,6 +70,51 @@ void  NaClLogEnableTimestamp(void);
 
 void  NaClLogDisableTimestamp(void);
 
+/*
+ * Returns non-zero if a message at detail_level would be written.
+ * Once the verbosity is set it takes no lock, so it is cheap enough to
+ * guard building expensive log arguments; the first call before then
+ * takes the log lock to read NACLVERBOSITY.
+ */
+int NaClLogLevelEnabled(int detail_level);
+
+/*
+ * Buffered logging.  While enabled, NaClLog and NaClLogV messages less
+ * severe than LOG_ERROR are formatted into lock-free ring buffers and
+ * written out by a background thread, so the logging thread never
+ * waits for the log mutex or the log stream.  Each thread normally
+ * uses the same ring, so its messages stay in order; messages from
+ * different threads may interleave out of order, but each carries the
+ * time it was logged.  A message that finds its ring full is dropped,
+ * and the drops are reported.  Errors, fatal messages and the
+ * NaClLog_mu family are written synchronously, after what is already
+ * buffered.
+ *
+ * In binary mode every message, buffered or not, is written as a
+ * struct NaClLogRecord followed by the unterminated message text,
+ * instead of a text tag and the message.
+ *
+ * NaClLogModuleInit enables buffering if the NACLLOG_BUFFER
+ * environment variable is "text" or "binary".  NaClLogEnableBuffering
+ * returns non-zero on success; buffering is not available on Windows.
+ * NaClLogFlush writes out everything buffered so far.
+ */
+#define NACL_LOG_RECORD_MAGIC 0x474f4c4e  /* "NLOG" on little-endian */
+
+struct NaClLogRecord {
+  uint32_t  magic;
+  int32_t   detail_level;
+  uint32_t  thread_id;
+  uint32_t  length;     /* of the message text that follows */
+  uint64_t  time_usec;  /* since the epoch */
+};
+
+int   NaClLogEnableBuffering(int binary);
+
+void  NaClLogDisableBuffering(void);
+
+void  NaClLogFlush(void);
+
 /*
  * Users of NaClLogV should add ATTRIBUTE_FORMAT_PRINTF(m,n) to their
  * function prototype, where m is the argument position of the format
@@ -29,6 +29,7 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <limits.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -44,6 +45,7 @@
 struct worker_state {
   int d;
   int is_privileged;
+  double queued_usec;
 };
 
 static pthread_mutex_t shutdown_wait_mu = PTHREAD_MUTEX_INITIALIZER;
@@ -100,31 +102,254 @@ static NaClSrpcError srpc_shutdown_request(NaClSrpcChannel* channel,
  */
 NACL_SRPC_METHOD("__shutdown::", srpc_shutdown_request);
 
+/*
+ * Connections after the first are served by a pool of worker threads
+ * fed from a bounded queue.  IMC descriptors cannot be polled from
+ * untrusted code, so a worker serves one connection until it closes
+ * and then takes the next.  So that a few long-lived connections do
+ * not leave the rest unserved, a connection that arrives while every
+ * worker is busy gets an overflow thread of its own, up to a cap; an
+ * overflow thread serves whatever is queued when its connection closes,
+ * and exits once the queue is empty.  Past the cap, connections are
+ * queued, and when the queue is full the acceptor stops accepting,
+ * leaving further clients waiting in the bound socket's backlog.
+ * NACL_SRPC_WORKERS, NACL_SRPC_OVERFLOW and NACL_SRPC_QUEUE override
+ * the default sizes.
+ */
+#define SRPC_DEFAULT_WORKERS  16
+#define SRPC_DEFAULT_OVERFLOW 48
+#define SRPC_DEFAULT_QUEUE    16
+#define SRPC_MAX_QUEUE        256
+
+static pthread_mutex_t pool_mu = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_nonempty_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_nonfull_cv = PTHREAD_COND_INITIALIZER;
+static struct worker_state *pool_queue[SRPC_MAX_QUEUE];
+static int pool_queue_size = SRPC_DEFAULT_QUEUE;
+static int pool_head = 0;
+static int pool_depth = 0;
+static int pool_max_workers = SRPC_DEFAULT_WORKERS;
+static int pool_workers = 0;
+static int pool_idle = 0;
+static int pool_max_overflow = SRPC_DEFAULT_OVERFLOW;
+static int pool_overflow_threads = 0;
+
+/* Statistics, under pool_mu. */
+static int pool_max_depth = 0;
+static int pool_served = 0;
+static int pool_overflows = 0;
+static int pool_full_waits = 0;
+static double pool_full_usec = 0.0;
+static double pool_queue_usec = 0.0;
+static double pool_service_usec = 0.0;
+static double pool_max_service_usec = 0.0;
+
+static int env_int(const char *name, int dflt, int max) {
+  char  *env = getenv(name);
+  int   val;
+
+  if (NULL == env) {
+    return dflt;
+  }
+  val = atoi(env);
+  if (val < 1) {
+    return dflt;
+  }
+  return (val > max) ? max : val;
+}
+
 /**
- * Basic SRPC worker thread: run the NaClSrpcServerLoop.
+ * Report the worker pool statistics: the number of worker threads,
+ * current and largest queue depth, connections served, the number
+ * given overflow threads and the number of times the acceptor found
+ * the queue full; then, in microseconds,
+ * the total time the acceptor was blocked, the total time connections
+ * spent queued, and the total and longest service times.
  */
-static void *srpc_worker(void *arg) {
-  struct worker_state *state = (struct worker_state *) arg;
+static NaClSrpcError srpc_pool_stats(NaClSrpcChannel* channel,
+                                     NaClSrpcArg **in_args,
+                                     NaClSrpcArg **out_args) {
+  pthread_mutex_lock(&pool_mu);
+  out_args[0]->u.ival = pool_workers;
+  out_args[1]->u.ival = pool_depth;
+  out_args[2]->u.ival = pool_max_depth;
+  out_args[3]->u.ival = pool_served;
+  out_args[4]->u.ival = pool_overflows;
+  out_args[5]->u.ival = pool_full_waits;
+  out_args[6]->u.dval = pool_full_usec;
+  out_args[7]->u.dval = pool_queue_usec;
+  out_args[8]->u.dval = pool_service_usec;
+  out_args[9]->u.dval = pool_max_service_usec;
+  pthread_mutex_unlock(&pool_mu);
+  return NACL_SRPC_RESULT_OK;
+}
+
+NACL_SRPC_METHOD("__srpc_pool_stats::iiiiiidddd", srpc_pool_stats);
 
-  NaClSrpcServerLoop(state->d, __kNaClSrpcHandlers, (void*) arg);
+/**
+ * Basic SRPC worker: run the NaClSrpcServerLoop for one connection.
+ */
+static void srpc_serve(struct worker_state *state) {
+  NaClSrpcServerLoop(state->d, __kNaClSrpcHandlers, (void*) state);
 
   (void) close(state->d);
   if (state->is_privileged) {
     mark_shutdown_done();
     _exit(0);
   }
-  free(arg);
+  free(state);
+}
+
+/**
+ * The privileged connection gets a thread of its own, so that the
+ * plugin is never queued behind other clients.
+ */
+static void *srpc_worker(void *arg) {
+  srpc_serve((struct worker_state *) arg);
+  return 0;
+}
+
+/* Account for a connection served in usec.  Caller holds pool_mu. */
+static void pool_served_mu(double usec) {
+  ++pool_served;
+  pool_service_usec += usec;
+  if (usec > pool_max_service_usec) {
+    pool_max_service_usec = usec;
+  }
+}
+
+/*
+ * Take the oldest queued connection, setting *start_usec to when its
+ * service starts.  Caller holds pool_mu and has seen pool_depth > 0.
+ */
+static struct worker_state *pool_take_mu(double *start_usec) {
+  struct worker_state *state = pool_queue[pool_head];
+
+  pool_head = (pool_head + 1) % pool_queue_size;
+  --pool_depth;
+  pthread_cond_signal(&pool_nonfull_cv);
+  *start_usec = __NaClSrpcGetUsec();
+  pool_queue_usec += *start_usec - state->queued_usec;
+  return state;
+}
+
+/**
+ * Overflow worker: serve a connection that arrived while every pool
+ * worker was busy, then any that were queued meanwhile, and exit when
+ * the queue is empty.
+ */
+static void *srpc_overflow_worker(void *arg) {
+  struct worker_state *state = (struct worker_state *) arg;
+  double              start_usec = __NaClSrpcGetUsec();
+  double              usec;
+
+  for (;;) {
+    srpc_serve(state);
+    usec = __NaClSrpcGetUsec() - start_usec;
+
+    pthread_mutex_lock(&pool_mu);
+    pool_served_mu(usec);
+    if (0 == pool_depth) {
+      --pool_overflow_threads;
+      pthread_mutex_unlock(&pool_mu);
+      return 0;
+    }
+    state = pool_take_mu(&start_usec);
+    pthread_mutex_unlock(&pool_mu);
+  }
+}
+
+/**
+ * Pool worker: serve queued connections for the life of the module.
+ */
+static void *srpc_pool_worker(void *arg) {
+  struct worker_state *state;
+  double              start_usec;
+  double              usec;
+
+  pthread_mutex_lock(&pool_mu);
+  for (;;) {
+    while (0 == pool_depth) {
+      ++pool_idle;
+      pthread_cond_wait(&pool_nonempty_cv, &pool_mu);
+      --pool_idle;
+    }
+    state = pool_take_mu(&start_usec);
+    pthread_mutex_unlock(&pool_mu);
+
+    srpc_serve(state);
+    usec = __NaClSrpcGetUsec() - start_usec;
+
+    pthread_mutex_lock(&pool_mu);
+    pool_served_mu(usec);
+  }
+  /* NOTREACHED */
   return 0;
 }
 
 /**
- * Acceptor loop: accept client connections, and for each, spawn a
- * worker thread that invokes NaClSrpcServerLoop.
+ * Queue a connection for the pool, starting another worker if none is
+ * idle and the pool is not yet at its size.  If every worker is busy
+ * and the pool is at its size, the connection gets an overflow thread
+ * instead, while there are fewer than pool_max_overflow of them.
+ * Blocks while the queue is full.
+ */
+static void srpc_pool_submit(struct worker_state *state) {
+  pthread_t worker_tid;
+  double    start_usec;
+
+  pthread_mutex_lock(&pool_mu);
+  if (pool_depth >= pool_idle && pool_workers >= pool_max_workers
+      && pool_overflow_threads < pool_max_overflow
+      && 0 == pthread_create(&worker_tid, NULL, srpc_overflow_worker, state)) {
+    pthread_detach(worker_tid);
+    ++pool_overflow_threads;
+    ++pool_overflows;
+    pthread_mutex_unlock(&pool_mu);
+    return;
+  }
+  if (pool_depth == pool_queue_size) {
+    ++pool_full_waits;
+    start_usec = __NaClSrpcGetUsec();
+    while (pool_depth == pool_queue_size) {
+      pthread_cond_wait(&pool_nonfull_cv, &pool_mu);
+    }
+    pool_full_usec += __NaClSrpcGetUsec() - start_usec;
+  }
+  state->queued_usec = __NaClSrpcGetUsec();
+  pool_queue[(pool_head + pool_depth) % pool_queue_size] = state;
+  ++pool_depth;
+  if (pool_depth > pool_max_depth) {
+    pool_max_depth = pool_depth;
+  }
+  /*
+   * If a worker cannot be started now, the next submission tries
+   * again; queued connections wait for whichever worker comes first.
+   */
+  if (pool_depth > pool_idle && pool_workers < pool_max_workers
+      && 0 == pthread_create(&worker_tid, NULL, srpc_pool_worker, NULL)) {
+    pthread_detach(worker_tid);
+    ++pool_workers;
+  }
+  pthread_cond_signal(&pool_nonempty_cv);
+  pthread_mutex_unlock(&pool_mu);
+}
+
+/**
+ * Acceptor loop: accept client connections.  The first gets a worker
+ * thread of its own; the rest are queued for the worker pool.
  */
 static void *srpc_default_acceptor(void *arg) {
   int       first = (int) arg;
   int       d;
 
+  pool_max_workers = env_int("NACL_SRPC_WORKERS", SRPC_DEFAULT_WORKERS,
+                             INT_MAX);
+  pool_max_overflow = env_int("NACL_SRPC_OVERFLOW", SRPC_DEFAULT_OVERFLOW,
+                              INT_MAX);
+  pool_queue_size = env_int("NACL_SRPC_QUEUE", SRPC_DEFAULT_QUEUE,
+                            SRPC_MAX_QUEUE);
+
   while (-1 != (d = imc_accept(BOUND_SOCKET))) {
     struct worker_state *state = malloc(sizeof *state);
     pthread_t           worker_tid;
@@ -139,9 +364,14 @@ static void *srpc_default_acceptor(void *arg) {
     }
     state->d = d;
     state->is_privileged = first;
-    /* worker thread is responsible for state and d. */
-    pthread_create(&worker_tid, NULL, srpc_worker, state);
-    first = 0;
+    if (first) {
+      /* worker thread is responsible for state and d. */
+      pthread_create(&worker_tid, NULL, srpc_worker, state);
+      pthread_detach(worker_tid);
+      first = 0;
+    } else {
+      srpc_pool_submit(state);
+    }
   }
   return NULL;
 }
@@ -152,9 +382,9 @@ static void *srpc_default_acceptor(void *arg) {
  * First we check to see if we are running embedded in the browser. If
  * not, we simply return, as there will be no SRPC connections. If
  * embedded we spawn a thread which is our main accept loop. The accept
- * loop spawns worker threads on a per-client-connection basis.
- * (We could use a thread pool, but do not at this point.)  The
- * worker threads just handle RPC requests using NaClSrpcServerLoop().
+ * loop hands client connections to a pool of worker threads, or to
+ * overflow threads when every worker is busy, which just handle RPC
+ * requests using NaClSrpcServerLoop().
  * The first worker thread is "privileged", in that it is responsible
  * for shutting down the NaCl app, and we expect that this first
  * connection comes from the browser plugin.
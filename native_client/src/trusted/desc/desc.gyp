@@ -112,9 +112,15 @@
       'conditions': [
         ['OS=="linux"', { 'sources': [
             'linux/nacl_desc.c',
+            'linux/nacl_desc_epoll.c',
+            'linux/nacl_desc_epoll.h',
+            'nacl_desc_socket.c',
+            'nacl_desc_socket.h',
         ]}],
         ['OS=="mac"', { 'sources': [
             'linux/nacl_desc.c',
+            'nacl_desc_socket.c',
+            'nacl_desc_socket.h',
         ]}],
         ['OS=="win"', { 'sources': [
             'win/nacl_desc.c',
@@ -0,0 +1,177 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl Service Runtime.  Host epoll descriptor abstraction.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/trusted/desc/nacl_desc_base.h"
+#include "native_client/src/trusted/desc/linux/nacl_desc_epoll.h"
+
+#include "native_client/src/shared/platform/nacl_host_desc.h"
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/internal_errno.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+
+/*
+ * This file contains the implementation for the NaClDescEpoll
+ * subclass of NaClDesc, which lets the epoll syscalls keep their
+ * instances in the app's descriptor table.  The instance is an
+ * ordinary host epoll descriptor, so one wait covers any number of
+ * sockets and a blocked thread costs the host nothing extra.
+ */
+
+int NaClDescEpollCtor(struct NaClDescEpoll  *self,
+                      int                   d) {
+  struct NaClDesc *basep = (struct NaClDesc *) self;
+
+  basep->vtbl = (struct NaClDescVtbl *) NULL;
+  if (!NaClDescCtor(basep)) {
+    return 0;
+  }
+  self->d = d;
+  basep->vtbl = &kNaClDescEpollVtbl;
+  return 1;
+}
+
+void NaClDescEpollDtor(struct NaClDesc *vself) {
+  struct NaClDescEpoll *self = (struct NaClDescEpoll *) vself;
+
+  NaClLog(4, "NaClDescEpollDtor(0x%08"PRIxPTR"), d %d.\n",
+          (uintptr_t) vself, self->d);
+  if (-1 != self->d) {
+    (void) close(self->d);
+  }
+  self->d = -1;
+  vself->vtbl = (struct NaClDescVtbl *) NULL;
+  NaClDescDtor(&self->base);
+}
+
+struct NaClDescEpoll *NaClDescEpollMake(void) {
+  struct NaClDescEpoll  *ndp;
+  int                   d;
+
+  if (-1 == (d = epoll_create1(EPOLL_CLOEXEC))) {
+    return NULL;
+  }
+  ndp = malloc(sizeof *ndp);
+  if (NULL == ndp) {
+    NaClLog(LOG_FATAL, "NaClDescEpollMake: no memory\n");
+  }
+  if (!NaClDescEpollCtor(ndp, d)) {
+    NaClLog(LOG_FATAL,
+            "NaClDescEpollMake: NaClDescEpollCtor(0x%08"PRIxPTR",%d) failed\n",
+            (uintptr_t) ndp,
+            d);
+  }
+  return ndp;
+}
+
+int NaClDescEpollTargetFd(struct NaClDesc *ndp) {
+  enum NaClDescTypeTag  type_tag = ndp->vtbl->typeTag;
+
+  if (NACL_DESC_HOST_SOCKET == type_tag) {
+    return ((struct NaClDescSocket *) ndp)->d;
+  } else if (NACL_DESC_HOST_IO == type_tag) {
+    return ((struct NaClDescIoDesc *) ndp)->hd->d;
+  } else if (NACL_DESC_HOST_EPOLL == type_tag) {
+    return ((struct NaClDescEpoll *) ndp)->d;
+  }
+  return -1;
+}
+
+int NaClDescEpollCtl(struct NaClDescEpoll *self,
+                     int                  op,
+                     int                  fd,
+                     struct epoll_event   *event) {
+  if (-1 == epoll_ctl(self->d, op, fd, event)) {
+    return -NaClXlateErrno(errno);
+  }
+  return 0;
+}
+
+int NaClDescEpollWait(struct NaClDescEpoll  *self,
+                      struct epoll_event    *events,
+                      int                   maxevents,
+                      int                   timeout) {
+  int n;
+
+  n = epoll_wait(self->d, events, maxevents, timeout);
+  return (-1 == n) ? -NaClXlateErrno(errno) : n;
+}
+
+int NaClDescEpollClose(struct NaClDesc          *vself,
+                       struct NaClDescEffector  *effp) {
+  UNREFERENCED_PARAMETER(effp);
+
+  NaClDescUnref(vself);
+  return 0;
+}
+
+struct NaClDescVtbl const kNaClDescEpollVtbl = {
+  NaClDescEpollDtor,
+  NaClDescMapNotImplemented,
+  NaClDescUnmapUnsafeNotImplemented,
+  NaClDescUnmapNotImplemented,
+  NaClDescReadNotImplemented,
+  NaClDescWriteNotImplemented,
+  NaClDescSeekNotImplemented,
+  NaClDescIoctlNotImplemented,
+  NaClDescFstatNotImplemented,
+  NaClDescEpollClose,
+  NaClDescGetdentsNotImplemented,
+  NACL_DESC_HOST_EPOLL,
+  NaClDescExternalizeSizeNotImplemented,
+  NaClDescExternalizeNotImplemented,
+  NaClDescLockNotImplemented,
+  NaClDescTryLockNotImplemented,
+  NaClDescUnlockNotImplemented,
+  NaClDescWaitNotImplemented,
+  NaClDescTimedWaitAbsNotImplemented,
+  NaClDescSignalNotImplemented,
+  NaClDescBroadcastNotImplemented,
+  NaClDescSendMsgNotImplemented,
+  NaClDescRecvMsgNotImplemented,
+  NaClDescConnectAddrNotImplemented,
+  NaClDescAcceptConnNotImplemented,
+  NaClDescPostNotImplemented,
+  NaClDescSemWaitNotImplemented,
+  NaClDescGetValueNotImplemented,
+};
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime.  NaClDescEpoll subclass of NaClDesc.  Linux only.
+ */
+#ifndef NATIVE_CLIENT_SRC_TRUSTED_DESC_LINUX_NACL_DESC_EPOLL_H_
+#define NATIVE_CLIENT_SRC_TRUSTED_DESC_LINUX_NACL_DESC_EPOLL_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/trusted/desc/nacl_desc_base.h"
+
+EXTERN_C_BEGIN
+
+struct epoll_event;
+
+extern struct NaClDescVtbl const kNaClDescEpollVtbl;
+
+/*
+ * A host epoll instance.  Descriptors are registered with it by their
+ * host descriptor; the caller's event data is kept by the host and
+ * handed back untouched.
+ */
+struct NaClDescEpoll {
+  struct NaClDesc base;
+  int             d;
+};
+
+/*
+ * Takes ownership of the host epoll descriptor d, which the Dtor closes.
+ */
+int NaClDescEpollCtor(struct NaClDescEpoll  *self,
+                      int                   d);
+
+void NaClDescEpollDtor(struct NaClDesc *vself);
+
+/*
+ * Makes a new host epoll instance; returns NULL and sets errno if the
+ * host cannot.
+ */
+struct NaClDescEpoll *NaClDescEpollMake(void);
+
+/*
+ * The host descriptor epoll should watch for ndp: that of a socket,
+ * host I/O descriptor or other epoll instance.  Returns -1 for
+ * descriptors that have none, such as IMC objects.
+ */
+int NaClDescEpollTargetFd(struct NaClDesc *ndp);
+
+/*
+ * epoll_ctl and epoll_wait on the host instance.  Both return
+ * negative NACL_ABI_ errno values on failure.
+ */
+int NaClDescEpollCtl(struct NaClDescEpoll *self,
+                     int                  op,
+                     int                  fd,
+                     struct epoll_event   *event);
+
+int NaClDescEpollWait(struct NaClDescEpoll  *self,
+                      struct epoll_event    *events,
+                      int                   maxevents,
+                      int                   timeout);
+
+int NaClDescEpollClose(struct NaClDesc          *vself,
+                       struct NaClDescEffector  *effp);
+
+EXTERN_C_END
+
+#endif  // NATIVE_CLIENT_SRC_TRUSTED_DESC_LINUX_NACL_DESC_EPOLL_H_
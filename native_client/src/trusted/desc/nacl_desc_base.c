@@ -139,6 +139,9 @@ int (*NaClDescInternalize[NACL_DESC_TYPE_MAX])(struct NaClDesc **,
   NaClDescInternalizeNotImplemented,  /* semaphore */
   NaClDescXferableDataDescInternalize,
   NaClDescInternalizeNotImplemented,  /* imc socket */
+  NaClDescInternalizeNotImplemented,  /* host socket; checked for its app */
+  NaClDescInternalizeNotImplemented,  /* epoll; registrations don't travel */
+  NaClDescInternalizeNotImplemented,  /* socket ring; tied to its app */
 };
 
 char const *NaClDescTypeString(enum NaClDescTypeTag type_tag) {
@@ -156,6 +159,9 @@ char const *NaClDescTypeString(enum NaClDescTypeTag type_tag) {
     MAP(NACL_DESC_SEMAPHORE);
     MAP(NACL_DESC_TRANSFERABLE_DATA_SOCKET);
     MAP(NACL_DESC_IMC_SOCKET);
+    MAP(NACL_DESC_HOST_SOCKET);
+    MAP(NACL_DESC_HOST_EPOLL);
+    MAP(NACL_DESC_SOCK_RING);
   }
   return "BAD TYPE TAG";
 }
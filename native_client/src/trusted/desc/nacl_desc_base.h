@@ -101,7 +101,10 @@ enum NaClDescTypeTag {
   NACL_DESC_CONDVAR,
   NACL_DESC_SEMAPHORE,
   NACL_DESC_TRANSFERABLE_DATA_SOCKET,
-  NACL_DESC_IMC_SOCKET
+  NACL_DESC_IMC_SOCKET,
+  NACL_DESC_HOST_SOCKET,
+  NACL_DESC_HOST_EPOLL,
+  NACL_DESC_SOCK_RING
   /*
    * Add new NaCDesc subclasses here.
    *
@@ -109,7 +112,7 @@ enum NaClDescTypeTag {
    * also be updated to add new internalization functions.
    */
 };
-#define NACL_DESC_TYPE_MAX      (NACL_DESC_IMC_SOCKET + 1)
+#define NACL_DESC_TYPE_MAX      (NACL_DESC_SOCK_RING + 1)
 #define NACL_DESC_TYPE_END_TAG  (0xff)
 
 struct NaClInternalRealHeader {
@@ -477,6 +480,17 @@ extern int NaClDescSemaphoreInternalize(struct NaClDesc          **baseptr,
                                         struct NaClDescXferState *xfer)
 NACL_WUR;
 
+extern struct NaClDescVtbl const kNaClDescSocketVtbl;
+
+/*
+ * A host BSD socket, as made by the socket syscalls.  Not available
+ * on Windows, where sockets are not descriptors.
+ */
+struct NaClDescSocket {
+  struct NaClDesc base;
+  int             d;
+};
+
 /* utility routines */
 
 struct NaClDescIoDesc *NaClDescIoDescMake(struct NaClHostDesc *nhdp);
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl Service Runtime.  Host socket descriptor abstraction.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/trusted/desc/nacl_desc_base.h"
+#include "native_client/src/trusted/desc/nacl_desc_socket.h"
+
+#include "native_client/src/shared/platform/nacl_host_desc.h"
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/internal_errno.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+
+/*
+ * This file contains the implementation for the NaClDescSocket
+ * subclass of NaClDesc.
+ *
+ * NaClDescSocket wraps a host socket made by the socket, accept and
+ * socketpair syscalls, so that the socket lives in the app's
+ * descriptor table like any other descriptor: read, write, fstat and
+ * close work on it, and it is closed when the last reference goes.
+ * The socket syscalls themselves use NaClDescSocketHostFd.  It cannot
+ * be sent to another module: its peer was checked against the
+ * sender's network policy, not the receiver's.
+ */
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0  /* OSX; SO_NOSIGPIPE would be needed there */
+#endif
+
+int NaClDescSocketCtor(struct NaClDescSocket  *self,
+                       int                    d) {
+  struct NaClDesc *basep = (struct NaClDesc *) self;
+
+  basep->vtbl = (struct NaClDescVtbl *) NULL;
+  if (!NaClDescCtor(basep)) {
+    return 0;
+  }
+  self->d = d;
+  basep->vtbl = &kNaClDescSocketVtbl;
+  return 1;
+}
+
+void NaClDescSocketDtor(struct NaClDesc *vself) {
+  struct NaClDescSocket *self = (struct NaClDescSocket *) vself;
+
+  NaClLog(4, "NaClDescSocketDtor(0x%08"PRIxPTR"), d %d.\n",
+          (uintptr_t) vself, self->d);
+  if (-1 != self->d && 0 != close(self->d)) {
+    NaClLog(LOG_WARNING, "NaClDescSocketDtor: close(%d) failed, errno %d\n",
+            self->d, errno);
+  }
+  self->d = -1;
+  vself->vtbl = (struct NaClDescVtbl *) NULL;
+  NaClDescDtor(&self->base);
+}
+
+struct NaClDescSocket *NaClDescSocketMake(int d) {
+  struct NaClDescSocket *ndp;
+
+  ndp = malloc(sizeof *ndp);
+  if (NULL == ndp) {
+    NaClLog(LOG_FATAL, "NaClDescSocketMake: no memory for socket %d\n", d);
+  }
+  if (!NaClDescSocketCtor(ndp, d)) {
+    NaClLog(LOG_FATAL,
+            ("NaClDescSocketMake:"
+             " NaClDescSocketCtor(0x%08"PRIxPTR",%d) failed\n"),
+            (uintptr_t) ndp,
+            d);
+  }
+  return ndp;
+}
+
+int NaClDescSocketHostFd(struct NaClDesc *ndp) {
+  if (NACL_DESC_HOST_SOCKET != ndp->vtbl->typeTag) {
+    return -1;
+  }
+  return ((struct NaClDescSocket *) ndp)->d;
+}
+
+ssize_t NaClDescSocketRead(struct NaClDesc          *vself,
+                           struct NaClDescEffector  *effp,
+                           void                     *buf,
+                           size_t                   len) {
+  struct NaClDescSocket *self = (struct NaClDescSocket *) vself;
+  ssize_t               got;
+
+  UNREFERENCED_PARAMETER(effp);
+
+  got = recv(self->d, buf, len, 0);
+  return (-1 == got) ? -NaClXlateErrno(errno) : got;
+}
+
+ssize_t NaClDescSocketWrite(struct NaClDesc         *vself,
+                            struct NaClDescEffector *effp,
+                            void const              *buf,
+                            size_t                  len) {
+  struct NaClDescSocket *self = (struct NaClDescSocket *) vself;
+  ssize_t               sent;
+
+  UNREFERENCED_PARAMETER(effp);
+
+  /* a peer that went away is an EPIPE for the app, not a SIGPIPE for us */
+  sent = send(self->d, buf, len, MSG_NOSIGNAL);
+  return (-1 == sent) ? -NaClXlateErrno(errno) : sent;
+}
+
+int NaClDescSocketFstat(struct NaClDesc         *vself,
+                        struct NaClDescEffector *effp,
+                        struct nacl_abi_stat    *statbuf) {
+  struct NaClDescSocket *self = (struct NaClDescSocket *) vself;
+  struct NaClHostDesc   hd;
+
+  UNREFERENCED_PARAMETER(effp);
+
+  /* borrowed, not taken: hd is never closed */
+  hd.d = self->d;
+  return NaClHostDescFstat(&hd, statbuf);
+}
+
+int NaClDescSocketClose(struct NaClDesc         *vself,
+                        struct NaClDescEffector *effp) {
+  UNREFERENCED_PARAMETER(effp);
+
+  NaClDescUnref(vself);
+  return 0;
+}
+
+struct NaClDescVtbl const kNaClDescSocketVtbl = {
+  NaClDescSocketDtor,
+  NaClDescMapNotImplemented,
+  NaClDescUnmapUnsafeNotImplemented,
+  NaClDescUnmapNotImplemented,
+  NaClDescSocketRead,
+  NaClDescSocketWrite,
+  NaClDescSeekNotImplemented,
+  NaClDescIoctlNotImplemented,
+  NaClDescSocketFstat,
+  NaClDescSocketClose,
+  NaClDescGetdentsNotImplemented,
+  NACL_DESC_HOST_SOCKET,
+  NaClDescExternalizeSizeNotImplemented,
+  NaClDescExternalizeNotImplemented,
+  NaClDescLockNotImplemented,
+  NaClDescTryLockNotImplemented,
+  NaClDescUnlockNotImplemented,
+  NaClDescWaitNotImplemented,
+  NaClDescTimedWaitAbsNotImplemented,
+  NaClDescSignalNotImplemented,
+  NaClDescBroadcastNotImplemented,
+  NaClDescSendMsgNotImplemented,
+  NaClDescRecvMsgNotImplemented,
+  NaClDescConnectAddrNotImplemented,
+  NaClDescAcceptConnNotImplemented,
+  NaClDescPostNotImplemented,
+  NaClDescSemWaitNotImplemented,
+  NaClDescGetValueNotImplemented,
+};
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime.  NaClDescSocket subclass of NaClDesc.
+ */
+#ifndef NATIVE_CLIENT_SRC_TRUSTED_DESC_NACL_DESC_SOCKET_H_
+#define NATIVE_CLIENT_SRC_TRUSTED_DESC_NACL_DESC_SOCKET_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+EXTERN_C_BEGIN
+
+struct NaClDesc;
+struct NaClDescEffector;
+struct NaClDescSocket;
+struct NaClDescXferState;
+struct nacl_abi_stat;
+
+/*
+ * Takes ownership of the host socket d, which the Dtor closes.
+ */
+int NaClDescSocketCtor(struct NaClDescSocket  *self,
+                       int                    d);
+
+void NaClDescSocketDtor(struct NaClDesc *vself);
+
+struct NaClDescSocket *NaClDescSocketMake(int d);
+
+/*
+ * Returns the host socket behind ndp, or -1 if ndp is not a
+ * NaClDescSocket.  ndp's reference keeps the socket open.
+ */
+int NaClDescSocketHostFd(struct NaClDesc *ndp);
+
+/*
+ * Read and Write are recv and send on the host socket, straight
+ * to and from the caller's buffer.
+ */
+ssize_t NaClDescSocketRead(struct NaClDesc          *vself,
+                           struct NaClDescEffector  *effp,
+                           void                     *buf,
+                           size_t                   len);
+
+ssize_t NaClDescSocketWrite(struct NaClDesc         *vself,
+                            struct NaClDescEffector *effp,
+                            void const              *buf,
+                            size_t                  len);
+
+int NaClDescSocketFstat(struct NaClDesc         *vself,
+                        struct NaClDescEffector *effp,
+                        struct nacl_abi_stat    *statbuf);
+
+int NaClDescSocketClose(struct NaClDesc         *vself,
+                        struct NaClDescEffector *effp);
+
+EXTERN_C_END
+
+#endif  // NATIVE_CLIENT_SRC_TRUSTED_DESC_NACL_DESC_SOCKET_H_
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise NaClDescSocket: reads and writes through the vtbl, fstat,
+ * EPIPE instead of SIGPIPE, and closing the host socket with the
+ * last reference; and waiting on sockets with NaClDescEpoll.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/desc/nacl_desc_base.h"
+#include "native_client/src/trusted/desc/nacl_desc_socket.h"
+#include "native_client/src/trusted/desc/linux/nacl_desc_epoll.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/include/sys/stat.h"
+
+
+static int ReadWriteTest(void) {
+  struct NaClDesc       *a;
+  struct NaClDesc       *b;
+  struct nacl_abi_stat  st;
+  int                   sv[2];
+  char                  buf[16];
+  ssize_t               n;
+  int                   errors = 0;
+
+  if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+    printf("ERROR: socketpair failed, errno %d\n", errno);
+    return 1;
+  }
+  a = (struct NaClDesc *) NaClDescSocketMake(sv[0]);
+  b = (struct NaClDesc *) NaClDescSocketMake(sv[1]);
+
+  if (NaClDescSocketHostFd(a) != sv[0]) {
+    printf("ERROR: host fd %d, expected %d\n", NaClDescSocketHostFd(a), sv[0]);
+    ++errors;
+  }
+  n = (*a->vtbl->Write)(a, NULL, "hello", 5);
+  if (5 != n) {
+    printf("ERROR: write returned %d\n", (int) n);
+    ++errors;
+  }
+  n = (*b->vtbl->Read)(b, NULL, buf, sizeof buf);
+  if (5 != n || 0 != memcmp(buf, "hello", 5)) {
+    printf("ERROR: read returned %d\n", (int) n);
+    ++errors;
+  }
+  if (0 != (*b->vtbl->Fstat)(b, NULL, &st)
+      || NACL_ABI_S_IFSOCK != (st.nacl_abi_st_mode & NACL_ABI_S_IFMT)) {
+    printf("ERROR: fstat does not report a socket\n");
+    ++errors;
+  }
+
+  /* the last reference closes the host socket */
+  (*b->vtbl->Close)(b, NULL);
+  if (-1 != fcntl(sv[1], F_GETFD)) {
+    printf("ERROR: socket %d still open\n", sv[1]);
+    ++errors;
+  }
+  n = (*a->vtbl->Read)(a, NULL, buf, sizeof buf);
+  if (0 != n) {
+    printf("ERROR: read after peer close returned %d\n", (int) n);
+    ++errors;
+  }
+  n = (*a->vtbl->Write)(a, NULL, "x", 1);
+  if (-NACL_ABI_EPIPE != n) {
+    printf("ERROR: write to closed peer returned %d\n", (int) n);
+    ++errors;
+  }
+  NaClDescUnref(a);
+  return errors;
+}
+
+
+static int EpollTest(void) {
+  struct NaClDescEpoll  *ep;
+  struct NaClDesc       *a;
+  struct NaClDesc       *b;
+  struct epoll_event    ev;
+  struct epoll_event    out[4];
+  int                   sv[2];
+  int                   n;
+  int                   errors = 0;
+
+  if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+    printf("ERROR: socketpair failed, errno %d\n", errno);
+    return 1;
+  }
+  a = (struct NaClDesc *) NaClDescSocketMake(sv[0]);
+  b = (struct NaClDesc *) NaClDescSocketMake(sv[1]);
+  if (NULL == (ep = NaClDescEpollMake())) {
+    printf("ERROR: NaClDescEpollMake failed, errno %d\n", errno);
+    return 1;
+  }
+
+  if (NaClDescEpollTargetFd(a) != sv[0]
+      || NaClDescEpollTargetFd((struct NaClDesc *) ep) != ep->d) {
+    printf("ERROR: wrong epoll target descriptors\n");
+    ++errors;
+  }
+  ev.events = EPOLLIN;
+  ev.data.u64 = 0x0123456789abcdefULL;
+  if (0 != NaClDescEpollCtl(ep, EPOLL_CTL_ADD, sv[0], &ev)) {
+    printf("ERROR: epoll_ctl ADD failed\n");
+    ++errors;
+  }
+  if (-NACL_ABI_EEXIST != NaClDescEpollCtl(ep, EPOLL_CTL_ADD, sv[0], &ev)) {
+    printf("ERROR: second ADD did not fail with EEXIST\n");
+    ++errors;
+  }
+  n = NaClDescEpollWait(ep, out, 4, 0);
+  if (0 != n) {
+    printf("ERROR: idle wait returned %d\n", n);
+    ++errors;
+  }
+  (void) (*b->vtbl->Write)(b, NULL, "x", 1);
+  n = NaClDescEpollWait(ep, out, 4, 1000);
+  if (1 != n || EPOLLIN != out[0].events
+      || 0x0123456789abcdefULL != out[0].data.u64) {
+    printf("ERROR: wait returned %d, events 0x%x\n", n, out[0].events);
+    ++errors;
+  }
+
+  /* closing the socket drops its registration */
+  NaClDescUnref(a);
+  n = NaClDescEpollWait(ep, out, 4, 0);
+  if (0 != n) {
+    printf("ERROR: wait after close returned %d\n", n);
+    ++errors;
+  }
+  NaClDescUnref(b);
+  NaClDescUnref((struct NaClDesc *) ep);
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+
+  errors += ReadWriteTest();
+  errors += EpollTest();
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
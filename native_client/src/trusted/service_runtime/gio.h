@@ -133,6 +133,32 @@ struct GioMemoryFileSnapshot {
 int GioMemoryFileSnapshotCtor(struct GioMemoryFileSnapshot  *self,
                               char                          *fn);
 
+/*
+ * As GioMemoryFileSnapshotCtor, but also feed the file's contents, in
+ * order, to digest as they are read, so that a checksum of the file
+ * costs no second pass over it.
+ */
+int GioMemoryFileSnapshotDigestCtor(struct GioMemoryFileSnapshot  *self,
+                                    char                          *fn,
+                                    void                          (*digest)(
+                                        void        *digest_state,
+                                        void const  *buf,
+                                        size_t      count),
+                                    void                          *digest_state);
+
+/*
+ * As GioMemoryFileSnapshotDigestCtor, but read from iop, which is
+ * positioned at the start of the file and is left open.  Lets the
+ * caller fstat() the very file that was read.
+ */
+int GioMemoryFileSnapshotStreamCtor(struct GioMemoryFileSnapshot  *self,
+                                    FILE                          *iop,
+                                    void                          (*digest)(
+                                        void        *digest_state,
+                                        void const  *buf,
+                                        size_t      count),
+                                    void                          *digest_state);
+
 void  GioMemoryFileSnapshotDtor(struct Gio                    *vself);
 
 #define ggetc(gp) ({ char ch; (*gp->vtbl->Read)(gp, &ch, 1) == 1 ? ch : EOF;})
@@ -50,33 +50,72 @@ struct GioVtbl const  kGioMemoryFileSnapshotVtbl = {
 };
 
 
+/* read in pieces that stay in cache for the digest */
+#define GIO_SNAPSHOT_CHUNK_BYTES  (64 << 10)
+
+
 int   GioMemoryFileSnapshotCtor(struct GioMemoryFileSnapshot  *self,
                                 char                          *fn) {
-  FILE            *iop;
-  struct stat     stbuf;
-  char            *buffer;
+  return GioMemoryFileSnapshotDigestCtor(self, fn, NULL, NULL);
+}
+
+
+int   GioMemoryFileSnapshotDigestCtor(struct GioMemoryFileSnapshot  *self,
+                                      char                          *fn,
+                                      void                          (*digest)(
+                                          void        *digest_state,
+                                          void const  *buf,
+                                          size_t      count),
+                                      void                          *digest_state) {
+  FILE  *iop;
+  int   rv;
 
   ((struct Gio *) self)->vtbl = (struct GioVtbl *) NULL;
   if (0 == (iop = fopen(fn, "rb"))) {
     return 0;
   }
+  rv = GioMemoryFileSnapshotStreamCtor(self, iop, digest, digest_state);
+  (void) fclose(iop);
+  return rv;
+}
+
+
+int   GioMemoryFileSnapshotStreamCtor(struct GioMemoryFileSnapshot  *self,
+                                      FILE                          *iop,
+                                      void                          (*digest)(
+                                          void        *digest_state,
+                                          void const  *buf,
+                                          size_t      count),
+                                      void                          *digest_state) {
+  struct stat     stbuf;
+  char            *buffer;
+  size_t          pos;
+  size_t          chunk;
+
+  ((struct Gio *) self)->vtbl = (struct GioVtbl *) NULL;
   if (fstat(fileno(iop), &stbuf) == -1) {
- abort0:
-    fclose(iop);
     return 0;
   }
   if (0 == (buffer = malloc(stbuf.st_size))) {
-    goto abort0;
+    return 0;
   }
-  if (fread(buffer, 1, stbuf.st_size, iop) != (size_t) stbuf.st_size) {
- abort1:
-    free(buffer);
-    goto abort0;
+  for (pos = 0; pos < (size_t) stbuf.st_size; pos += chunk) {
+    chunk = (size_t) stbuf.st_size - pos;
+    if (chunk > GIO_SNAPSHOT_CHUNK_BYTES) {
+      chunk = GIO_SNAPSHOT_CHUNK_BYTES;
+    }
+    if (fread(buffer + pos, 1, chunk, iop) != chunk) {
+      goto abort0;
+    }
+    if (NULL != digest) {
+      (*digest)(digest_state, buffer + pos, chunk);
+    }
   }
   if (GioMemoryFileCtor(&self->base, buffer, stbuf.st_size) == 0) {
-    goto abort1;
+ abort0:
+    free(buffer);
+    return 0;
   }
-  (void) fclose(iop);
 
   ((struct Gio *) self)->vtbl = &kGioMemoryFileSnapshotVtbl;
   return 1;
@@ -191,4 +191,54 @@ TEST(GioMemTest, SeekTest) {
   EXPECT_EQ(31, out_char);
 }
 
+struct DigestState {
+  size_t calls;
+  size_t total;
+  int out_of_order;
+};
+
+void CheckDigestInput(void *vstate, void const *buf, size_t count) {
+  DigestState *state = reinterpret_cast<DigestState *>(vstate);
+  unsigned char const *bytes = reinterpret_cast<unsigned char const *>(buf);
+
+  for (size_t i = 0; i < count; ++i) {
+    if (bytes[i] != static_cast<unsigned char>((state->total + i) % 251))
+      state->out_of_order = 1;
+  }
+  state->total += count;
+  ++state->calls;
+}
+
+TEST(GioMemTest, SnapshotDigestTest) {
+  char const *fname = "gio_mem_test_snapshot.tmp";
+  size_t const file_size = 300 * 1024 + 7;  // several read chunks
+  struct GioMemoryFileSnapshot snap;
+  DigestState state = { 0, 0, 0 };
+  char out_char;
+
+  FILE *iop = fopen(fname, "wb");
+  ASSERT_TRUE(NULL != iop);
+  for (size_t i = 0; i < file_size; ++i)
+    fputc(static_cast<int>(i % 251), iop);
+  fclose(iop);
+
+  // the digest sees every byte once, in file order
+  ASSERT_EQ(1, GioMemoryFileSnapshotDigestCtor(&snap,
+                                               const_cast<char *>(fname),
+                                               CheckDigestInput,
+                                               &state));
+  EXPECT_EQ(file_size, state.total);
+  EXPECT_LT(1u, state.calls);
+  EXPECT_EQ(0, state.out_of_order);
+
+  // and the snapshot reads back the same contents
+  EXPECT_EQ(static_cast<off_t>(file_size - 1),
+            GioMemoryFileSeek(&snap.base.base, -1, SEEK_END));
+  EXPECT_EQ(1, GioMemoryFileRead(&snap.base.base, &out_char, 1));
+  EXPECT_EQ(static_cast<char>((file_size - 1) % 251), out_char);
+
+  GioMemoryFileSnapshotDtor(&snap.base.base);
+  remove(fname);
+}
+
 }  // namespace
@@ -126,7 +126,21 @@
 #define NACL_sys_shutdown				124
 #define NACL_sys_socket					125
 #define NACL_sys_socketpair				126
-
-#define NACL_MAX_SYSCALLS               130
+#define NACL_sys_epoll_create           127
+#define NACL_sys_epoll_ctl              128
+#define NACL_sys_epoll_wait             129
+#define NACL_sys_recvmmsg               130
+#define NACL_sys_sendmmsg               131
+#define NACL_sys_sendfile               132
+#define NACL_sys_accept4                133
+#define NACL_sys_accept_batch           134
+#define NACL_sys_sockring_create        135
+#define NACL_sys_sockring_enter         136
+#define NACL_sys_batch                  137
+#define NACL_sys_getaddrinfo            138
+#define NACL_sys_futex_wait             139
+#define NACL_sys_futex_wake             140
+
+#define NACL_MAX_SYSCALLS               141
 
 #endif /* NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_BITS_NACL_SYSCALLS_H_ */
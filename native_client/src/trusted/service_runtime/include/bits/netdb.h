@@ -0,0 +1,19 @@
+//@author nizam
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_BITS_NETDB_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_BITS_NETDB_H_
+
+/* <netdb.h> includes this for `struct netent'; there is no networks
+   database, but getaddrinfo and friends need the rest of <netdb.h>.  */
+
+/* Description of data base entry for a single network.  NOTE: here a
+   poor assumption is made.  The network number is expected to fit
+   into an unsigned long int variable.  */
+struct netent
+{
+  char *n_name;			/* Official name of network.  */
+  char **n_aliases;		/* Alias list.  */
+  int n_addrtype;		/* Net address type.  */
+  uint32_t n_net;		/* Network number.  */
+};
+
+#endif	/* NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_BITS_NETDB_H_ */
@@ -198,6 +198,14 @@ struct msghdr
     int msg_flags;		/* Flags on received message.  */
   };
 
+/* For `recvmmsg' and `sendmmsg'.  */
+struct mmsghdr
+  {
+    struct msghdr msg_hdr;	/* Actual message header.  */
+    unsigned int msg_len;	/* Number of received or sent bytes for
+				   the entry.  */
+  };
+
 /* Structure used for storage of ancillary data object information.  */
 struct cmsghdr
   {
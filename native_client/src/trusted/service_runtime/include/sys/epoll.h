@@ -0,0 +1,95 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl kernel / service run-time system call ABI.  epoll.
+ *
+ * Readiness notification for sockets and host descriptors, backed by
+ * the host's epoll.  The values and layout follow Linux, so that
+ * events and the caller's data pass through the service runtime
+ * unchanged.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_EPOLL_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_EPOLL_H_
+
+#include "native_client/src/trusted/service_runtime/include/machine/_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NACL_ABI_EPOLLIN       0x001
+#define NACL_ABI_EPOLLPRI      0x002
+#define NACL_ABI_EPOLLOUT      0x004
+#define NACL_ABI_EPOLLERR      0x008
+#define NACL_ABI_EPOLLHUP      0x010
+#define NACL_ABI_EPOLLRDNORM   0x040
+#define NACL_ABI_EPOLLRDBAND   0x080
+#define NACL_ABI_EPOLLWRNORM   0x100
+#define NACL_ABI_EPOLLWRBAND   0x200
+#define NACL_ABI_EPOLLMSG      0x400
+#define NACL_ABI_EPOLLRDHUP    0x2000
+#define NACL_ABI_EPOLLONESHOT  (1u << 30)
+#define NACL_ABI_EPOLLET       (1u << 31)
+
+#define NACL_ABI_EPOLL_CTL_ADD 1
+#define NACL_ABI_EPOLL_CTL_DEL 2
+#define NACL_ABI_EPOLL_CTL_MOD 3
+
+/* the only flag; accepted for compatibility, there being no exec */
+#define NACL_ABI_EPOLL_CLOEXEC 02000000
+
+typedef union nacl_abi_epoll_data {
+  void      *ptr;
+  int       fd;
+  uint32_t  u32;
+  uint64_t  u64;
+} nacl_abi_epoll_data_t;
+
+struct nacl_abi_epoll_event {
+  uint32_t              events;
+  nacl_abi_epoll_data_t data;
+} __attribute__((packed));  /* 12 bytes, as on x86 Linux */
+
+#ifdef __native_client__
+int epoll_create(int size);
+int epoll_create1(int flags);
+int epoll_ctl(int epfd, int op, int fd, struct nacl_abi_epoll_event *event);
+int epoll_wait(int epfd, struct nacl_abi_epoll_event *events,
+               int maxevents, int timeout);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
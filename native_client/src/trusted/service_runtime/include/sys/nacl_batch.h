@@ -0,0 +1,77 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl kernel / service run-time system call ABI.  System call batches.
+ *
+ * A batch runs a vector of system calls, given by their NACL_sys_
+ * numbers and 32-bit argument words, for the price of one trip into
+ * the service runtime.  Each record gets its call's return value.  By
+ * default the batch stops after the first call that fails.  exit,
+ * thread_exit, mmap, munmap, sysbrk and batch itself cannot be batched;
+ * their records fail with NACL_ABI_EINVAL.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_NACL_BATCH_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_NACL_BATCH_H_
+
+#include "native_client/src/trusted/service_runtime/include/machine/_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NACL_ABI_BATCH_MAX_ARGS   6
+#define NACL_ABI_BATCH_MAX        1024  /* records per call */
+
+/* flags */
+#define NACL_ABI_BATCH_CONTINUE   0x1  /* run the rest after a failure */
+
+struct nacl_abi_syscall_record {
+  uint32_t  sysnum;
+  uint32_t  args[NACL_ABI_BATCH_MAX_ARGS];
+  int32_t   result;  /* as the call would return; set by the batch */
+};
+
+#ifdef __native_client__
+/*
+ * Returns the number of records run, including a failed last one; a
+ * record that was not run keeps its old result.
+ */
+int syscall_batch(struct nacl_abi_syscall_record *records, unsigned int n,
+                  int flags);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl kernel / service run-time system call ABI.  Socket rings.
+ *
+ * A ring lets an application queue socket operations in shared memory
+ * and collect their results there, so that a burst of sends and
+ * receives costs no system call per operation.  The memory is an IMC
+ * shared memory object mapped by the application; the service runtime
+ * maps it too, and a service runtime thread performs the operations,
+ * with the same checks as the system calls.
+ *
+ * The object holds, in order: the header, the submission queue of
+ * entries submission entries, and the completion queue of twice as
+ * many completion entries.  entries is a power of 2.  Each queue is
+ * indexed by free-running 32-bit head and tail counters; the producer
+ * advances the tail, the consumer the head.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_NACL_SOCKRING_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_NACL_SOCKRING_H_
+
+#include "native_client/src/trusted/service_runtime/include/machine/_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NACL_ABI_SOCKRING_MAX_ENTRIES 1024
+
+/* opcodes */
+#define NACL_ABI_SOCKRING_OP_NOP      0
+#define NACL_ABI_SOCKRING_OP_SEND     1  /* addr, len: the buffer */
+#define NACL_ABI_SOCKRING_OP_RECV     2
+#define NACL_ABI_SOCKRING_OP_SENDMSG  3  /* addr: a struct msghdr */
+#define NACL_ABI_SOCKRING_OP_RECVMSG  4
+
+/*
+ * ioflags.  An operation that cannot complete at once waits for its
+ * socket to become ready, after any earlier waiting operation on the
+ * same socket; with NOWAIT it completes with -EAGAIN instead.
+ */
+#define NACL_ABI_SOCKRING_NOWAIT      0x01
+
+/* header flags, set by the service runtime */
+#define NACL_ABI_SOCKRING_NEED_WAKEUP 0x01  /* call sockring_enter to submit */
+
+struct nacl_abi_sockring_hdr {
+  uint32_t  sq_head;      /* advanced by the service runtime */
+  uint32_t  sq_tail;      /* advanced by the application */
+  uint32_t  cq_head;      /* advanced by the application */
+  uint32_t  cq_tail;      /* advanced by the service runtime */
+  uint32_t  entries;
+  uint32_t  flags;
+  uint32_t  reserved[10];
+};
+
+struct nacl_abi_sockring_sqe {
+  uint8_t   opcode;
+  uint8_t   ioflags;
+  uint16_t  reserved0;
+  int32_t   fd;
+  uint32_t  addr;
+  uint32_t  len;
+  int32_t   msg_flags;    /* as for send and recv */
+  uint32_t  reserved1;
+  uint64_t  user_data;    /* returned in the completion */
+};
+
+struct nacl_abi_sockring_cqe {
+  uint64_t  user_data;
+  int32_t   res;          /* as the system call would return */
+  uint32_t  reserved;
+};
+
+#define NACL_ABI_SOCKRING_BYTES(entries)                      \
+  (sizeof(struct nacl_abi_sockring_hdr)                       \
+   + (entries) * sizeof(struct nacl_abi_sockring_sqe)         \
+   + 2 * (entries) * sizeof(struct nacl_abi_sockring_cqe))
+
+#ifdef __native_client__
+/*
+ * The application's view of a ring.  nacl_sockring_setup makes the
+ * shared memory, maps it and starts the ring; the rest need no system
+ * call except to wake an idle ring or to wait.
+ */
+struct nacl_sockring {
+  int                                   d;
+  struct nacl_abi_sockring_hdr          *hdr;
+  struct nacl_abi_sockring_sqe          *sqes;
+  struct nacl_abi_sockring_cqe          *cqes;
+  uint32_t                              mask;
+  uint32_t                              sq_local_tail;
+};
+
+int sockring_create(int shm_d, unsigned int entries);
+int sockring_enter(int ring_d, unsigned int min_complete, int timeout_ms);
+
+int nacl_sockring_setup(struct nacl_sockring *ring, unsigned int entries);
+void nacl_sockring_teardown(struct nacl_sockring *ring);
+/* NULL if the submission queue is full */
+struct nacl_abi_sockring_sqe *nacl_sockring_get_sqe(struct nacl_sockring *ring);
+/* publishes the entries got since the last submit; returns how many */
+int nacl_sockring_submit(struct nacl_sockring *ring);
+/* NULL if there is no completion; call nacl_sockring_cqe_seen when done */
+struct nacl_abi_sockring_cqe *nacl_sockring_peek_cqe(
+    struct nacl_sockring *ring);
+void nacl_sockring_cqe_seen(struct nacl_sockring *ring);
+/* waits up to timeout_ms (-1: no limit) for a completion */
+int nacl_sockring_wait_cqe(struct nacl_sockring *ring,
+                           struct nacl_abi_sockring_cqe **cqep,
+                           int timeout_ms);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
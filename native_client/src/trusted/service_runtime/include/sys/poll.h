@@ -0,0 +1,73 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl kernel / service run-time system call ABI.  poll.
+ *
+ * poll is implemented by the untrusted library on top of epoll (see
+ * epoll.h), so the event bits are the same.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_POLL_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_INCLUDE_SYS_POLL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NACL_ABI_POLLIN      0x001
+#define NACL_ABI_POLLPRI     0x002
+#define NACL_ABI_POLLOUT     0x004
+#define NACL_ABI_POLLERR     0x008
+#define NACL_ABI_POLLHUP     0x010
+#define NACL_ABI_POLLNVAL    0x020
+#define NACL_ABI_POLLRDNORM  0x040
+#define NACL_ABI_POLLRDBAND  0x080
+#define NACL_ABI_POLLWRNORM  0x100
+#define NACL_ABI_POLLWRBAND  0x200
+
+typedef unsigned int nacl_abi_nfds_t;
+
+struct nacl_abi_pollfd {
+  int   fd;
+  short events;
+  short revents;
+};
+
+#ifdef __native_client__
+int poll(struct nacl_abi_pollfd *fds, nacl_abi_nfds_t nfds, int timeout);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
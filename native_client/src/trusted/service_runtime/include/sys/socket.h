@@ -110,6 +110,28 @@ extern ssize_t sendmsg (int __fd, __const struct msghdr *__message,
    __THROW.  */
 extern ssize_t recvmsg (int __fd, struct msghdr *__message, int __flags);
 
+struct timespec;
+
+/* Send VLEN messages as described by VMESSAGES to socket FD.
+   Returns the number of datagrams successfully written or -1 for errors.
+
+   This function is a cancellation point and therefore not marked with
+   __THROW.  */
+extern int sendmmsg (int __fd, struct mmsghdr *__vmessages,
+		     unsigned int __vlen, int __flags);
+
+/* Receive up to VLEN messages as described by VMESSAGES from socket FD.
+   Returns the number of messages received or -1 for errors.  If TMO is
+   not NULL, it bounds how long to wait for the messages after the first.
+   Datagrams from peers the network policy refuses are dropped, and the
+   rest fill VMESSAGES in order; if all are refused, this fails.
+
+   This function is a cancellation point and therefore not marked with
+   __THROW.  */
+extern int recvmmsg (int __fd, struct mmsghdr *__vmessages,
+		     unsigned int __vlen, int __flags,
+		     struct timespec *__tmo);
+
 
 /* Put the current value for socket FD's option OPTNAME at protocol level LEVEL
    into OPTVAL (which is *OPTLEN bytes long), and set *OPTLEN to the value's
@@ -141,6 +163,18 @@ extern int listen (int __fd, int __n);
 extern int accept (int __fd, __SOCKADDR_ARG __addr,
 		   socklen_t *__addr_len);
 
+/* Similar to 'accept' but takes an additional parameter to specify flags:
+   SOCK_NONBLOCK and SOCK_CLOEXEC set those on the new descriptor.  */
+extern int accept4 (int __fd, __SOCKADDR_ARG __addr,
+		    socklen_t *__addr_len, int __flags);
+
+/* Accept up to N connections on socket FD, putting their descriptors in
+   FDS[0] to FDS[N-1], with FLAGS as for 'accept4'.  Only the first
+   waits, and only if FD blocks; the rest are connections already
+   pending.  Returns the number accepted, or -1 for errors.  */
+extern int accept_batch (int __fd, int *__fds, unsigned int __n,
+			 int __flags);
+
 /* Shut down all or part of the connection open on socket FD.
    HOW determines what to shut down:
      SHUT_RD   = No more receptions;
@@ -0,0 +1,223 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime futexes.
+ */
+
+#include <string.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_futex.h"
+
+
+static struct NaClFutexTable nacl_futex_table;
+
+
+static struct NaClFutexBucket *NaClFutexBucketOf(struct NaClFutexTable *self,
+                                                 uintptr_t             addr) {
+  uint32_t h = (uint32_t) (addr >> 2);
+
+  h *= 0x9e3779b1U;  /* Fibonacci hashing: words in a struct spread out */
+  return &self->buckets[(h >> 16) & (NACL_FUTEX_BUCKETS - 1)];
+}
+
+
+/*
+ * Unlinks w from b, if it is still queued.  b->mu is held.
+ */
+static void NaClFutexUnlink(struct NaClFutexBucket  *b,
+                            struct NaClFutexWaiter  *w) {
+  struct NaClFutexWaiter **pp;
+
+  for (pp = &b->head; NULL != *pp; pp = &(*pp)->next) {
+    if (*pp == w) {
+      *pp = w->next;
+      if (NULL == *pp) {
+        b->tail = pp;
+      }
+      return;
+    }
+  }
+}
+
+
+int NaClFutexTableCtor(struct NaClFutexTable *self) {
+  int i;
+
+  for (i = 0; i < NACL_FUTEX_BUCKETS; ++i) {
+    if (!NaClMutexCtor(&self->buckets[i].mu)) {
+      while (--i >= 0) {
+        NaClMutexDtor(&self->buckets[i].mu);
+      }
+      return 0;
+    }
+    self->buckets[i].head = NULL;
+    self->buckets[i].tail = &self->buckets[i].head;
+  }
+  memset(&self->stats, 0, sizeof self->stats);
+  return 1;
+}
+
+
+void NaClFutexTableDtor(struct NaClFutexTable *self) {
+  int i;
+
+  for (i = 0; i < NACL_FUTEX_BUCKETS; ++i) {
+    if (NULL != self->buckets[i].head) {
+      NaClLog(LOG_WARNING, "futex: bucket %d still has waiters\n", i);
+    }
+    NaClMutexDtor(&self->buckets[i].mu);
+  }
+}
+
+
+int32_t NaClFutexTableWait(struct NaClFutexTable           *self,
+                           volatile int32_t                *addr,
+                           int32_t                         val,
+                           struct nacl_abi_timespec const  *abstime) {
+  struct NaClFutexBucket  *b;
+  struct NaClFutexWaiter  w;
+  int32_t                 retval = 0;
+
+  b = NaClFutexBucketOf(self, (uintptr_t) addr);
+  NaClXMutexLock(&b->mu);
+  /*
+   * The waker changes the word before taking b->mu, so either we see
+   * the new value here or we are on the queue before it looks.
+   */
+  if (*addr != val) {
+    NaClXMutexUnlock(&b->mu);
+    __sync_fetch_and_add(&self->stats.mismatches, 1);
+    return -NACL_ABI_EAGAIN;
+  }
+  if (!NaClCondVarCtor(&w.cv)) {
+    NaClXMutexUnlock(&b->mu);
+    return -NACL_ABI_ENOMEM;
+  }
+  w.next = NULL;
+  w.addr = (uintptr_t) addr;
+  w.woken = 0;
+  *b->tail = &w;
+  b->tail = &w.next;
+  __sync_fetch_and_add(&self->stats.waits, 1);
+
+  while (!w.woken) {
+    if (NULL == abstime) {
+      NaClXCondVarWait(&w.cv, &b->mu);
+    } else if (NACL_SYNC_CONDVAR_TIMEDOUT ==
+               NaClCondVarTimedWaitAbsolute(&w.cv, &b->mu, abstime)) {
+      if (!w.woken) {
+        NaClFutexUnlink(b, &w);
+        __sync_fetch_and_add(&self->stats.timeouts, 1);
+        retval = -NACL_ABI_ETIMEDOUT;
+      }
+      break;
+    }
+  }
+  NaClXMutexUnlock(&b->mu);
+  NaClCondVarDtor(&w.cv);
+  return retval;
+}
+
+
+int32_t NaClFutexTableWake(struct NaClFutexTable  *self,
+                           volatile int32_t       *addr,
+                           int32_t                nwake) {
+  struct NaClFutexBucket  *b;
+  struct NaClFutexWaiter  **pp;
+  struct NaClFutexWaiter  *w;
+  int32_t                 woken = 0;
+
+  b = NaClFutexBucketOf(self, (uintptr_t) addr);
+  NaClXMutexLock(&b->mu);
+  pp = &b->head;
+  while (woken < nwake && NULL != (w = *pp)) {
+    if (w->addr != (uintptr_t) addr) {
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    if (NULL == *pp) {
+      b->tail = pp;
+    }
+    w->woken = 1;
+    NaClXCondVarSignal(&w->cv);
+    ++woken;
+  }
+  NaClXMutexUnlock(&b->mu);
+  if (woken > 0) {
+    __sync_fetch_and_add(&self->stats.wakes, woken);
+  }
+  return woken;
+}
+
+
+void NaClFutexTableGetStats(struct NaClFutexTable *self,
+                            struct NaClFutexStats *stats) {
+  stats->waits = __sync_fetch_and_add(&self->stats.waits, 0);
+  stats->mismatches = __sync_fetch_and_add(&self->stats.mismatches, 0);
+  stats->timeouts = __sync_fetch_and_add(&self->stats.timeouts, 0);
+  stats->wakes = __sync_fetch_and_add(&self->stats.wakes, 0);
+}
+
+
+void NaClFutexModuleInit(void) {
+  if (!NaClFutexTableCtor(&nacl_futex_table)) {
+    NaClLog(LOG_FATAL, "Could not initialize the futex table\n");
+  }
+}
+
+
+void NaClFutexModuleFini(void) {
+  struct NaClFutexStats stats;
+
+  NaClFutexTableGetStats(&nacl_futex_table, &stats);
+  NaClLog(1, ("futex: %"PRIuPTR" waits, %"PRIuPTR" mismatches,"
+              " %"PRIuPTR" timeouts, %"PRIuPTR" wakes\n"),
+          stats.waits, stats.mismatches, stats.timeouts, stats.wakes);
+  NaClFutexTableDtor(&nacl_futex_table);
+}
+
+
+int32_t NaClFutexModuleWait(volatile int32_t                *addr,
+                            int32_t                         val,
+                            struct nacl_abi_timespec const  *abstime) {
+  return NaClFutexTableWait(&nacl_futex_table, addr, val, abstime);
+}
+
+
+int32_t NaClFutexModuleWake(volatile int32_t *addr, int32_t nwake) {
+  return NaClFutexTableWake(&nacl_futex_table, addr, nwake);
+}
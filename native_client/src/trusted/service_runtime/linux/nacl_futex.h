@@ -0,0 +1,134 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime futexes.
+ *
+ * Wait queues keyed on the address of a 32-bit word in the sandbox,
+ * for the futex_wait and futex_wake system calls.  Untrusted code
+ * keeps the state of its mutexes, condition variables and semaphores
+ * in such words, changes it with atomic instructions, and only comes
+ * here when it has to sleep or to wake a sleeper.
+ *
+ * NaClFutexWait sleeps only if the word still holds the value the
+ * caller last saw, checked under the lock of the word's hash bucket;
+ * NaClFutexWake takes the same lock, so a wake that follows a change
+ * to the word can never be lost.  Waiters are woken in the order in
+ * which they went to sleep.  The key is the trusted address of the
+ * word, which is unique across all the sandboxes in the process.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_FUTEX_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_FUTEX_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_sync.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/time.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_FUTEX_BUCKETS  256  /* power of 2 */
+
+struct NaClFutexWaiter {
+  struct NaClFutexWaiter  *next;
+  uintptr_t               addr;
+  int                     woken;
+  struct NaClCondVar      cv;
+};
+
+struct NaClFutexBucket {
+  struct NaClMutex        mu;
+  struct NaClFutexWaiter  *head;
+  struct NaClFutexWaiter  **tail;
+};
+
+struct NaClFutexStats {
+  uintptr_t waits;        /* calls that went to sleep */
+  uintptr_t mismatches;   /* calls that found the word changed */
+  uintptr_t timeouts;
+  uintptr_t wakes;        /* waiters woken */
+};
+
+struct NaClFutexTable {
+  struct NaClFutexBucket  buckets[NACL_FUTEX_BUCKETS];
+  struct NaClFutexStats   stats;
+};
+
+/*
+ * Returns non-zero on success.
+ */
+int NaClFutexTableCtor(struct NaClFutexTable *self);
+
+void NaClFutexTableDtor(struct NaClFutexTable *self);
+
+/*
+ * Sleeps until woken by NaClFutexTableWake on addr, if *addr == val.
+ * abstime is an absolute deadline, or NULL to wait forever.  Returns
+ * 0 when woken, -NACL_ABI_EAGAIN if *addr != val and
+ * -NACL_ABI_ETIMEDOUT if the deadline passed first.  addr must be
+ * 4-byte aligned.  Wake-ups may be spurious, as when another thread
+ * changed the word and woke everyone, so callers recheck the word.
+ */
+int32_t NaClFutexTableWait(struct NaClFutexTable           *self,
+                           volatile int32_t                *addr,
+                           int32_t                         val,
+                           struct nacl_abi_timespec const  *abstime);
+
+/*
+ * Wakes up to nwake of the threads waiting on addr, longest waiting
+ * first.  Returns the number woken.
+ */
+int32_t NaClFutexTableWake(struct NaClFutexTable  *self,
+                           volatile int32_t       *addr,
+                           int32_t                nwake);
+
+void NaClFutexTableGetStats(struct NaClFutexTable *self,
+                            struct NaClFutexStats *stats);
+
+/*
+ * The table used by the futex system calls.
+ */
+void NaClFutexModuleInit(void);
+
+void NaClFutexModuleFini(void);
+
+int32_t NaClFutexModuleWait(volatile int32_t                *addr,
+                            int32_t                         val,
+                            struct nacl_abi_timespec const  *abstime);
+
+int32_t NaClFutexModuleWake(volatile int32_t *addr, int32_t nwake);
+
+EXTERN_C_END
+
+#endif  /* NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_FUTEX_H_ */
@@ -0,0 +1,361 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the futex wait queues: a wait on a word that has changed,
+ * timeouts, waking a given number of waiters in order, waiters on
+ * different words sharing a bucket, and a mutex built the way the
+ * untrusted pthread library builds one, under contention.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+#include "native_client/src/shared/platform/nacl_time.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_futex.h"
+
+#define TEST_STACK_BYTES  (128 << 10)
+#define TEST_WAITERS      3
+#define TEST_LOCKERS      4
+#define TEST_LOCKS        20000  /* per locker */
+
+static struct NaClFutexTable  table;
+static int                    finished;
+
+struct Waiter {
+  struct NaClThread thread;
+  volatile int32_t  *word;
+  int32_t           val;
+  int32_t           result;
+  int               done;   /* order in which the waiters returned */
+};
+
+
+static struct nacl_abi_timespec Deadline(int ms) {
+  struct nacl_abi_timeval   now;
+  struct nacl_abi_timespec  ts;
+
+  NaClGetTimeOfDay(&now);
+  ts.tv_sec = now.nacl_abi_tv_sec + ms / 1000;
+  ts.tv_nsec = (now.nacl_abi_tv_usec + (ms % 1000) * 1000) * 1000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec += 1;
+    ts.tv_nsec -= 1000000000;
+  }
+  return ts;
+}
+
+
+static void WINAPI WaiterThread(void *arg) {
+  struct Waiter *w = (struct Waiter *) arg;
+
+  w->result = NaClFutexTableWait(&table, w->word, w->val, NULL);
+  w->done = __sync_add_and_fetch(&finished, 1);
+  NaClThreadExit();
+}
+
+
+/*
+ * Starts a waiter, and returns once it is asleep.
+ */
+static int StartWaiter(struct Waiter *w, volatile int32_t *word) {
+  struct NaClFutexStats stats;
+  struct NaClFutexStats now;
+
+  NaClFutexTableGetStats(&table, &stats);
+  w->word = word;
+  w->val = *word;
+  w->done = 0;
+  if (!NaClThreadCtor(&w->thread, WaiterThread, w, TEST_STACK_BYTES)) {
+    printf("ERROR: could not start a waiter\n");
+    return 1;
+  }
+  do {
+    usleep(1000);
+    NaClFutexTableGetStats(&table, &now);
+  } while (now.waits == stats.waits);
+  return 0;
+}
+
+
+static int WaitDone(struct Waiter *w) {
+  int i;
+
+  for (i = 0; i < 2000 && 0 == __sync_fetch_and_add(&w->done, 0); ++i) {
+    usleep(1000);
+  }
+  return w->done;
+}
+
+
+static int MismatchTest(void) {
+  volatile int32_t          word = 1;
+  struct nacl_abi_timespec  ts = Deadline(1000);
+  int                       errors = 0;
+
+  printf("MismatchTest\n");
+  if (-NACL_ABI_EAGAIN != NaClFutexTableWait(&table, &word, 0, NULL)) {
+    printf("ERROR: wait on a changed word slept\n");
+    ++errors;
+  }
+  if (-NACL_ABI_EAGAIN != NaClFutexTableWait(&table, &word, 2, &ts)) {
+    printf("ERROR: timed wait on a changed word slept\n");
+    ++errors;
+  }
+  if (0 != NaClFutexTableWake(&table, &word, 1)) {
+    printf("ERROR: woke a waiter that does not exist\n");
+    ++errors;
+  }
+  return errors;
+}
+
+
+static int TimeoutTest(void) {
+  volatile int32_t          word = 0;
+  struct nacl_abi_timespec  ts = Deadline(100);
+  struct nacl_abi_timeval   before;
+  struct nacl_abi_timeval   after;
+  int64_t                   ms;
+  int32_t                   r;
+  int                       errors = 0;
+
+  printf("TimeoutTest\n");
+  NaClGetTimeOfDay(&before);
+  r = NaClFutexTableWait(&table, &word, 0, &ts);
+  NaClGetTimeOfDay(&after);
+  ms = ((int64_t) after.nacl_abi_tv_sec - before.nacl_abi_tv_sec) * 1000 +
+       ((int64_t) after.nacl_abi_tv_usec - before.nacl_abi_tv_usec) / 1000;
+  if (-NACL_ABI_ETIMEDOUT != r || ms < 90 || ms > 1000) {
+    printf("ERROR: timed wait returned %d after %dms\n", (int) r, (int) ms);
+    ++errors;
+  }
+  /* A timed out waiter must be off the queue */
+  if (0 != NaClFutexTableWake(&table, &word, 1)) {
+    printf("ERROR: timed out waiter still queued\n");
+    ++errors;
+  }
+  return errors;
+}
+
+
+static int WakeTest(void) {
+  volatile int32_t  word = 7;
+  struct Waiter     waiters[TEST_WAITERS];
+  int               errors = 0;
+  int               i;
+  int32_t           n;
+
+  printf("WakeTest\n");
+  finished = 0;
+  for (i = 0; i < TEST_WAITERS; ++i) {
+    if (0 != StartWaiter(&waiters[i], &word)) {
+      return errors + 1;
+    }
+  }
+  n = NaClFutexTableWake(&table, &word, TEST_WAITERS - 1);
+  if (TEST_WAITERS - 1 != n) {
+    printf("ERROR: woke %d\n", (int) n);
+    ++errors;
+  }
+  for (i = 0; i < TEST_WAITERS - 1; ++i) {
+    if (0 == WaitDone(&waiters[i]) || 0 != waiters[i].result) {
+      printf("ERROR: waiter %d not woken in order\n", i);
+      ++errors;
+    }
+  }
+  usleep(20 * 1000);
+  if (0 != waiters[TEST_WAITERS - 1].done) {
+    printf("ERROR: woke too many\n");
+    ++errors;
+  }
+  n = NaClFutexTableWake(&table, &word, 100);
+  if (1 != n || 0 == WaitDone(&waiters[TEST_WAITERS - 1])) {
+    printf("ERROR: last waiter not woken (%d)\n", (int) n);
+    ++errors;
+  }
+  return errors;
+}
+
+
+static int BucketTest(void) {
+  static int32_t  words[4096];
+  struct Waiter   a;
+  struct Waiter   b;
+  int             errors = 0;
+  int             i;
+
+  printf("BucketTest\n");
+  finished = 0;
+  if (0 != StartWaiter(&a, &words[0])) {
+    return 1;
+  }
+  for (i = 1; i < 4096; ++i) {
+    /*
+     * Waking a word that shares a's bucket walks past a; waking any
+     * other word never sees it.  Either way a must stay asleep.
+     */
+    if (0 != NaClFutexTableWake(&table, &words[i], 1)) {
+      printf("ERROR: waking word %d woke another word's waiter\n", i);
+      ++errors;
+      break;
+    }
+  }
+  if (0 != StartWaiter(&b, &words[1])) {
+    return errors + 1;
+  }
+  if (1 != NaClFutexTableWake(&table, &words[1], 10) || 0 == WaitDone(&b)) {
+    printf("ERROR: second waiter not woken\n");
+    ++errors;
+  }
+  if (0 != a.done) {
+    printf("ERROR: first waiter woken by the second's word\n");
+    ++errors;
+  }
+  if (1 != NaClFutexTableWake(&table, &words[0], 10) || 0 == WaitDone(&a)) {
+    printf("ERROR: first waiter not woken\n");
+    ++errors;
+  }
+  return errors;
+}
+
+
+/*
+ * 0: unlocked, 1: locked, 2: locked and maybe contended, as in
+ * untrusted/pthread/nc_mutex.c.
+ */
+static void Lock(volatile int32_t *state) {
+  int32_t c = __sync_val_compare_and_swap(state, 0, 1);
+
+  if (0 == c) {
+    return;
+  }
+  if (2 != c) {
+    c = __sync_lock_test_and_set(state, 2);
+  }
+  while (0 != c) {
+    NaClFutexTableWait(&table, state, 2, NULL);
+    c = __sync_lock_test_and_set(state, 2);
+  }
+}
+
+
+static void Unlock(volatile int32_t *state) {
+  if (2 == __sync_fetch_and_sub(state, 1)) {
+    *state = 0;
+    NaClFutexTableWake(&table, state, 1);
+  }
+}
+
+
+static volatile int32_t lock_state;
+static int              counter;
+
+
+static void WINAPI LockerThread(void *arg) {
+  struct Waiter *w = (struct Waiter *) arg;
+  int           i;
+
+  for (i = 0; i < TEST_LOCKS; ++i) {
+    Lock(&lock_state);
+    ++counter;
+    Unlock(&lock_state);
+  }
+  w->done = __sync_add_and_fetch(&finished, 1);
+  NaClThreadExit();
+}
+
+
+static int MutexTest(void) {
+  struct Waiter lockers[TEST_LOCKERS];
+  int           errors = 0;
+  int           i;
+
+  printf("MutexTest\n");
+  finished = 0;
+  memset(lockers, 0, sizeof lockers);
+  for (i = 0; i < TEST_LOCKERS; ++i) {
+    if (!NaClThreadCtor(&lockers[i].thread, LockerThread, &lockers[i],
+                        TEST_STACK_BYTES)) {
+      printf("ERROR: could not start a locker\n");
+      return errors + 1;
+    }
+  }
+  for (i = 0; i < TEST_LOCKERS; ++i) {
+    while (0 == __sync_fetch_and_add(&lockers[i].done, 0)) {
+      usleep(1000);
+    }
+  }
+  if (TEST_LOCKERS * TEST_LOCKS != counter || 0 != lock_state) {
+    printf("ERROR: counter %d, state %d\n", counter, (int) lock_state);
+    ++errors;
+  }
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+  if (!NaClFutexTableCtor(&table)) {
+    printf("ERROR: NaClFutexTableCtor failed\n");
+    return 1;
+  }
+
+  errors += MismatchTest();
+  errors += TimeoutTest();
+  errors += WakeTest();
+  errors += BucketTest();
+  errors += MutexTest();
+
+  NaClFutexTableDtor(&table);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
@@ -0,0 +1,482 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Benchmark of what the network sandbox adds to making a connection.
+ *
+ * Starts a stand-in validation server (nacl_socks_server.h) and a
+ * target service that accepts and drops connections, then has
+ * threads repeatedly either ask NaClIsConnectionOk about a peer
+ * ("check") or run a non-blocking connect to the target through
+ * NaClSysSocket and NaClSysConnect ("connect"), which adds the
+ * descriptor table, address translation, the per-socket state and
+ * the connect() itself.  Peers are distinct
+ * loopback addresses, 127.0.0.1 up, so each is cached separately;
+ * both listeners therefore bind to every interface while the
+ * benchmark runs.
+ *
+ * Cache states:
+ *   cold   caching disabled, so every operation is a handshake
+ *   warm   every peer validated before timing starts
+ *   evict  a cache of a quarter as many entries as there are peers
+ *
+ * Reports operations and handshakes per second and the median, 99th
+ * percentile and worst latency of one operation.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/nacl_macros.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+
+#include "native_client/src/trusted/service_runtime/nacl_app_thread.h"
+#include "native_client/src/trusted/service_runtime/sel_ldr.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_state.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_server.h"
+
+/* from nacl_syscall_impl.c; the generated handlers declare them the same way */
+int32_t NaClSysSocket(struct NaClAppThread  *natp,
+                      int                   domain,
+                      int                   type,
+                      int                   protocol);
+
+int32_t NaClSysConnect(struct NaClAppThread   *natp,
+                       int                    fd,
+                       const struct sockaddr  *addr,
+                       socklen_t              len);
+
+#define BENCH_STACK_BYTES   (256 << 10)
+#define BENCH_ADDR_BITS     16
+#define BENCH_MAX_THREADS   256
+
+enum BenchMode { kBenchCheck, kBenchConnect };
+enum BenchCache { kBenchCold, kBenchWarm, kBenchEvict };
+
+static char const *const kModeNames[] = { "check", "connect" };
+static char const *const kCacheNames[] = { "cold", "warm", "evict" };
+
+struct BenchConfig {
+  enum BenchMode  mode;
+  enum BenchCache cache;
+  uint32_t        peers;
+  uint32_t        threads;
+  uint32_t        ops;  /* per thread */
+};
+
+struct Bench {
+  struct BenchConfig        cfg;
+  struct NaClApp            app;  /* just enough for the socket syscalls */
+  char                      *arena;
+  uint32_t                  *latency_ns;  /* cfg.threads * cfg.ops */
+  uint32_t                  failures;
+  struct NaClMutex          mu;
+  struct NaClCondVar        cv;
+  uint32_t                  running;
+};
+
+struct BenchThread {
+  struct Bench          *b;
+  uint32_t              index;
+  struct NaClThread     thread;
+  struct NaClAppThread  natp;
+};
+
+/* The stand-in servers run until stop is set. */
+static struct NaClValidateServer  gServer;
+static int                        gTargetFd = -1;
+static uint16_t                   gTargetPort;
+static volatile int               gStop = 0;
+
+
+static uint64_t NowNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void WINAPI ServerThread(void *arg) {
+  UNREFERENCED_PARAMETER(arg);
+  while (!gStop) {
+    NaClValidateServerPoll(&gServer, 100);
+  }
+}
+
+
+static void WINAPI TargetThread(void *arg) {
+  int fd;
+
+  UNREFERENCED_PARAMETER(arg);
+  while (!gStop) {
+    if ((fd = accept(gTargetFd, NULL, NULL)) >= 0) {
+      close(fd);
+    }
+  }
+}
+
+
+static void PeerAddr(struct sockaddr_in *addr, uint32_t peer, uint16_t port) {
+  memset(addr, 0, sizeof *addr);
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK + peer);
+  addr->sin_port = htons(port);
+}
+
+
+/* Returns 0 if the sandbox let the operation through. */
+static int BenchOp(struct BenchThread *t, uint32_t peer) {
+  struct Bench        *b = t->b;
+  struct sockaddr_in  addr;
+  uintptr_t           uaddr;
+  int                 d;
+  int                 r;
+
+  if (kBenchCheck == b->cfg.mode) {
+    PeerAddr(&addr, peer, 80);
+    return NaClIsConnectionOk((struct sockaddr *) &addr, b->app.app_hash);
+  }
+
+  /* each thread's sockaddr lives at its own untrusted address */
+  uaddr = 64 + t->index * sizeof addr;
+  PeerAddr((struct sockaddr_in *) (b->arena + uaddr), peer, gTargetPort);
+  d = NaClSysSocket(&t->natp, AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (d < 0) {
+    return -1;
+  }
+  r = NaClSysConnect(&t->natp, d, (struct sockaddr *) uaddr, sizeof addr);
+  NaClSetDesc(&b->app, d, NULL);  /* closes the socket */
+  return (0 == r || -NACL_ABI_EINPROGRESS == r) ? 0 : r;
+}
+
+
+static void WINAPI BenchWorker(void *arg) {
+  struct BenchThread  *t = (struct BenchThread *) arg;
+  struct Bench        *b = t->b;
+  uint32_t            *lat = b->latency_ns + t->index * b->cfg.ops;
+  uint32_t            seed = 2654435761U * (t->index + 1);
+  uint32_t            failures = 0;
+  uint64_t            start;
+  uint32_t            i;
+
+  for (i = 0; i < b->cfg.ops; ++i) {
+    /* xorshift; a uniformly random peer each time */
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    start = NowNs();
+    if (0 != BenchOp(t, 1 + seed % b->cfg.peers)) {
+      ++failures;
+    }
+    lat[i] = (uint32_t) (NowNs() - start);
+  }
+
+  NaClXMutexLock(&b->mu);
+  b->failures += failures;
+  if (0 == --b->running) {
+    NaClXCondVarBroadcast(&b->cv);
+  }
+  NaClXMutexUnlock(&b->mu);
+}
+
+
+static int CompareU32(void const *a, void const *b) {
+  uint32_t x = *(uint32_t const *) a;
+  uint32_t y = *(uint32_t const *) b;
+
+  return (x > y) - (x < y);
+}
+
+
+static void SetEnvNum(char const *name, uint32_t v) {
+  char buf[16];
+
+  snprintf(buf, sizeof buf, "%u", v);
+  setenv(name, buf, 1);
+}
+
+
+static int RunBench(struct BenchConfig const *cfg) {
+  struct Bench              b;
+  struct BenchThread        *t;
+  struct NaClHandshakeStats before;
+  struct NaClHandshakeStats after;
+  struct BenchThread        warm;
+  uint64_t                  start;
+  uint64_t                  elapsed;
+  size_t                    total;
+  uint32_t                  i;
+
+  memset(&b, 0, sizeof b);
+  b.cfg = *cfg;
+
+  /* the client reads its knobs at module init */
+  unsetenv("NACL_PEER_CACHE_ALLOW_TTL");
+  unsetenv("NACL_PEER_CACHE_ENTRIES");
+  if (kBenchCold == cfg->cache) {
+    setenv("NACL_PEER_CACHE_ALLOW_TTL", "0", 1);
+  } else if (kBenchEvict == cfg->cache) {
+    SetEnvNum("NACL_PEER_CACHE_ENTRIES", (cfg->peers + 3) / 4);
+  }
+  NaClSockStateModuleInit();
+  NaClSocksClientModuleInit();
+
+  b.arena = calloc(1, 1 << BENCH_ADDR_BITS);
+  b.latency_ns = malloc(sizeof *b.latency_ns * cfg->threads * cfg->ops);
+  t = calloc(cfg->threads, sizeof *t);
+  if (NULL == b.arena || NULL == b.latency_ns || NULL == t) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  b.app.addr_bits = BENCH_ADDR_BITS;
+  b.app.xlate_base = (uintptr_t) b.arena;
+  memset(b.app.app_hash, 0x5a, sizeof b.app.app_hash);
+  if (!NaClMutexCtor(&b.app.desc_mu) || !DynArrayCtor(&b.app.desc_tbl, 16)) {
+    fprintf(stderr, "could not create the descriptor table\n");
+    return 1;
+  }
+  if (!NaClMutexCtor(&b.mu) || !NaClCondVarCtor(&b.cv)) {
+    fprintf(stderr, "could not create synchronization objects\n");
+    return 1;
+  }
+
+  if (kBenchWarm == cfg->cache) {
+    memset(&warm, 0, sizeof warm);
+    warm.b = &b;
+    warm.natp.nap = &b.app;
+    for (i = 1; i <= cfg->peers; ++i) {
+      (void) BenchOp(&warm, i);
+    }
+  }
+
+  NaClSocksClientGetHandshakeStats(&before);
+  b.running = cfg->threads;
+  start = NowNs();
+  for (i = 0; i < cfg->threads; ++i) {
+    t[i].b = &b;
+    t[i].index = i;
+    t[i].natp.nap = &b.app;
+    if (!NaClThreadCtor(&t[i].thread, BenchWorker, &t[i], BENCH_STACK_BYTES)) {
+      NaClLog(LOG_FATAL, "could not create benchmark thread\n");
+    }
+  }
+  NaClXMutexLock(&b.mu);
+  while (0 != b.running) {
+    NaClXCondVarWait(&b.cv, &b.mu);
+  }
+  NaClXMutexUnlock(&b.mu);
+  elapsed = NowNs() - start;
+  NaClSocksClientGetHandshakeStats(&after);
+
+  total = (size_t) cfg->threads * cfg->ops;
+  qsort(b.latency_ns, total, sizeof *b.latency_ns, CompareU32);
+  printf("%-7s %-5s %6u %7u %9.0f %10.0f %9.1f %9.1f %9.1f %8u\n",
+         kModeNames[cfg->mode], kCacheNames[cfg->cache],
+         cfg->peers, cfg->threads,
+         total * 1e9 / elapsed,
+         (after.handshakes - before.handshakes) * 1e9 / elapsed,
+         b.latency_ns[total / 2] / 1e3,
+         b.latency_ns[total - 1 - total / 100] / 1e3,
+         b.latency_ns[total - 1] / 1e3,
+         b.failures);
+  fflush(stdout);
+
+  NaClCondVarDtor(&b.cv);
+  NaClMutexDtor(&b.mu);
+  DynArrayDtor(&b.app.desc_tbl);
+  NaClMutexDtor(&b.app.desc_mu);
+  free(t);
+  free(b.latency_ns);
+  free(b.arena);
+  NaClSocksClientModuleFini();
+  NaClSockStateModuleFini();
+  return 0;
+}
+
+
+static int StartServers(void) {
+  struct NaClValidateServerConfig cfg;
+  struct sockaddr_in              addr;
+  socklen_t                       len = sizeof addr;
+  static char                     policy[] = "/tmp/nacl_handshake_bench.XXXXXX";
+  static struct NaClThread        server_thread;
+  static struct NaClThread        target_thread;
+  FILE                            *iop;
+  int                             fd;
+
+  if ((fd = mkstemp(policy)) < 0 || NULL == (iop = fdopen(fd, "w"))) {
+    fprintf(stderr, "could not write the policy file\n");
+    return 0;
+  }
+  /* every application may use every port */
+  fprintf(iop, "* 1-65535\n");
+  fclose(iop);
+
+  memset(&cfg, 0, sizeof cfg);
+  cfg.policy_path = policy;
+  cfg.bind_ip = htonl(INADDR_ANY);
+  cfg.max_conns = 65536;
+  if (!NaClValidateServerCtor(&gServer, &cfg)) {
+    unlink(policy);
+    return 0;
+  }
+  unlink(policy);
+  SetEnvNum("NACL_VALIDATE_PORT", gServer.port);
+
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  gTargetFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (gTargetFd < 0
+      || 0 != bind(gTargetFd, (struct sockaddr *) &addr, sizeof addr)
+      || 0 != listen(gTargetFd, SOMAXCONN)
+      || 0 != getsockname(gTargetFd, (struct sockaddr *) &addr, &len)) {
+    fprintf(stderr, "could not start the target service\n");
+    return 0;
+  }
+  gTargetPort = ntohs(addr.sin_port);
+
+  if (!NaClThreadCtor(&server_thread, ServerThread, NULL, BENCH_STACK_BYTES)
+      || !NaClThreadCtor(&target_thread, TargetThread, NULL,
+                         BENCH_STACK_BYTES)) {
+    fprintf(stderr, "could not start the server threads\n");
+    return 0;
+  }
+  return 1;
+}
+
+
+static int ParseName(char const *arg, char const *const *names, int count) {
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    if (0 == strcmp(arg, names[i])) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+static void Usage(char const *argv0) {
+  fprintf(stderr,
+          "Usage: %s [-m check|connect] [-c cold|warm|evict] [-p peers]"
+          " [-t threads] [-n ops_per_thread]\n"
+          "Without -m or -c, runs every combination.\n",
+          argv0);
+}
+
+
+int main(int ac, char **av) {
+  struct BenchConfig  cfg;
+  int                 mode = -1;
+  int                 cache = -1;
+  int                 m;
+  int                 c;
+  int                 opt;
+  int                 bad = 0;
+
+  cfg.peers = 64;
+  cfg.threads = 4;
+  cfg.ops = 1000;
+  while (-1 != (opt = getopt(ac, av, "m:c:p:t:n:"))) {
+    switch (opt) {
+      case 'm':
+        mode = ParseName(optarg, kModeNames,
+                         NACL_ARRAY_SIZE_UNSAFE(kModeNames));
+        bad |= (mode < 0);
+        break;
+      case 'c':
+        cache = ParseName(optarg, kCacheNames,
+                          NACL_ARRAY_SIZE_UNSAFE(kCacheNames));
+        bad |= (cache < 0);
+        break;
+      case 'p':
+        cfg.peers = strtoul(optarg, (char **) 0, 0);
+        break;
+      case 't':
+        cfg.threads = strtoul(optarg, (char **) 0, 0);
+        break;
+      case 'n':
+        cfg.ops = strtoul(optarg, (char **) 0, 0);
+        break;
+      default:
+        Usage(av[0]);
+        return 1;
+    }
+  }
+  if (bad || 0 == cfg.peers || cfg.peers > 65000 || 0 == cfg.threads
+      || cfg.threads > BENCH_MAX_THREADS || 0 == cfg.ops || optind != ac) {
+    Usage(av[0]);
+    return 1;
+  }
+
+  NaClLogModuleInit();
+  if (!StartServers()) {
+    return 1;
+  }
+  printf("%-7s %-5s %6s %7s %9s %10s %9s %9s %9s %8s\n",
+         "mode", "cache", "peers", "threads", "ops/s", "handshk/s",
+         "p50_us", "p99_us", "max_us", "failures");
+  for (m = 0; m < (int) NACL_ARRAY_SIZE_UNSAFE(kModeNames); ++m) {
+    for (c = 0; c < (int) NACL_ARRAY_SIZE_UNSAFE(kCacheNames); ++c) {
+      if ((mode < 0 || mode == m) && (cache < 0 || cache == c)) {
+        cfg.mode = (enum BenchMode) m;
+        cfg.cache = (enum BenchCache) c;
+        if (0 != RunBench(&cfg)) {
+          return 1;
+        }
+      }
+    }
+  }
+  /* the server threads are detached and die with us */
+  NaClLogModuleFini();
+  return 0;
+}
@@ -0,0 +1,312 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime on-disk cache of application hashes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_hash_store.h"
+
+#define NACL_HASH_STORE_READ_RETRIES 4
+
+/*
+ * Timestamps are only as fine as the kernel's clock tick, so a file
+ * written twice within one tick keeps its times.  Anything changed
+ * this close to now is hashed but not stored.
+ */
+#define NACL_HASH_STORE_RACY_SECONDS 2
+
+
+/* See nacl_peer_cache.c for why these are gcc builtins. */
+static INLINE void NaClHashStoreBarrier(void) {
+  __sync_synchronize();
+}
+
+
+static INLINE uint32_t NaClHashStoreHash(struct NaClHashStoreKey const *key) {
+  uint32_t h;
+
+  h = (uint32_t) (key->ino ^ (key->ino >> 32) ^ key->dev) * 2654435761U;
+  return h ^ (h >> 16);
+}
+
+
+/* Same file, any version of it. */
+static INLINE int NaClHashStoreSameFile(struct NaClHashStoreKey const  *a,
+                                        struct NaClHashStoreKey const  *b) {
+  return a->dev == b->dev && a->ino == b->ino;
+}
+
+
+void NaClHashStoreKeyFromStat(struct NaClHashStoreKey *key,
+                              struct stat const       *st) {
+  memset(key, 0, sizeof *key);
+  key->dev = st->st_dev;
+  key->ino = st->st_ino;
+  key->size = st->st_size;
+  key->mtime_sec = st->st_mtim.tv_sec;
+  key->mtime_nsec = st->st_mtim.tv_nsec;
+  key->ctime_sec = st->st_ctim.tv_sec;
+  key->ctime_nsec = st->st_ctim.tv_nsec;
+}
+
+
+int NaClHashStoreKeyRacy(struct NaClHashStoreKey const  *key,
+                         int64_t                        now) {
+  return (key->mtime_sec > now - NACL_HASH_STORE_RACY_SECONDS
+          || key->ctime_sec > now - NACL_HASH_STORE_RACY_SECONDS);
+}
+
+
+static size_t NaClHashStoreBytes(uint32_t num_slots) {
+  return sizeof(struct NaClHashStoreHeader)
+      + (size_t) num_slots * sizeof(struct NaClHashStoreSlot);
+}
+
+
+/*
+ * Called with the file locked.  Lay out an empty file, or check that
+ * an existing one is ours; leaves hsp mapped on success.
+ */
+static int NaClHashStoreMapLocked(struct NaClHashStore  *hsp,
+                                  char const            *path,
+                                  uint32_t              num_slots) {
+  struct stat                 st;
+  struct NaClHashStoreHeader  hdr;
+  void                        *map;
+  int                         fresh;
+
+  if (0 != fstat(hsp->fd, &st)) {
+    NaClLog(LOG_WARNING, "NaClHashStore: fstat %s: errno %d\n", path, errno);
+    return 0;
+  }
+  if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()
+      || 0 != (st.st_mode & (S_IWGRP | S_IWOTH))) {
+    NaClLog(LOG_WARNING,
+            "NaClHashStore: %s is not a private file owned by us; ignoring\n",
+            path);
+    return 0;
+  }
+
+  fresh = (0 == st.st_size);
+  if (fresh) {
+    if (0 != ftruncate(hsp->fd, NaClHashStoreBytes(num_slots))) {
+      NaClLog(LOG_WARNING, "NaClHashStore: ftruncate %s: errno %d\n",
+              path, errno);
+      return 0;
+    }
+  } else {
+    if ((size_t) st.st_size < sizeof hdr
+        || sizeof hdr != pread(hsp->fd, &hdr, sizeof hdr, 0)
+        || NACL_HASH_STORE_MAGIC != hdr.magic
+        || NACL_HASH_STORE_VERSION != hdr.version
+        || sizeof(struct NaClHashStoreSlot) != hdr.slot_bytes
+        || hdr.num_slots < NACL_HASH_STORE_PROBES
+        || hdr.num_slots > NACL_HASH_STORE_MAX_SLOTS
+        || (size_t) st.st_size != NaClHashStoreBytes(hdr.num_slots)) {
+      NaClLog(LOG_WARNING,
+              "NaClHashStore: %s has the wrong format; ignoring\n", path);
+      return 0;
+    }
+    num_slots = hdr.num_slots;
+  }
+
+  hsp->map_bytes = NaClHashStoreBytes(num_slots);
+  map = mmap(NULL, hsp->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+             hsp->fd, 0);
+  if (MAP_FAILED == map) {
+    NaClLog(LOG_WARNING, "NaClHashStore: mmap %s: errno %d\n", path, errno);
+    return 0;
+  }
+  hsp->hdr = (struct NaClHashStoreHeader *) map;
+  hsp->slots = (struct NaClHashStoreSlot *) (hsp->hdr + 1);
+  hsp->num_slots = num_slots;
+
+  if (fresh) {
+    /* ftruncate zero-filled the slots; publish the header last */
+    hsp->hdr->version = NACL_HASH_STORE_VERSION;
+    hsp->hdr->num_slots = num_slots;
+    hsp->hdr->slot_bytes = sizeof(struct NaClHashStoreSlot);
+    NaClHashStoreBarrier();
+    hsp->hdr->magic = NACL_HASH_STORE_MAGIC;
+  }
+  return 1;
+}
+
+
+int NaClHashStoreCtor(struct NaClHashStore  *hsp,
+                      char const            *path,
+                      uint32_t              num_slots) {
+  int ok;
+
+  if (num_slots < NACL_HASH_STORE_PROBES) {
+    num_slots = NACL_HASH_STORE_PROBES;
+  } else if (num_slots > NACL_HASH_STORE_MAX_SLOTS) {
+    num_slots = NACL_HASH_STORE_MAX_SLOTS;
+  }
+  hsp->hdr = NULL;
+  hsp->slots = NULL;
+  hsp->num_slots = 0;
+  hsp->map_bytes = 0;
+
+  if (!NaClMutexCtor(&hsp->mu)) {
+    return 0;
+  }
+  hsp->fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (hsp->fd < 0) {
+    NaClLog(LOG_WARNING, "NaClHashStore: open %s: errno %d\n", path, errno);
+    NaClMutexDtor(&hsp->mu);
+    return 0;
+  }
+  /* whoever gets here first lays out the file */
+  if (0 != flock(hsp->fd, LOCK_EX)) {
+    NaClLog(LOG_WARNING, "NaClHashStore: flock %s: errno %d\n", path, errno);
+    ok = 0;
+  } else {
+    ok = NaClHashStoreMapLocked(hsp, path, num_slots);
+    (void) flock(hsp->fd, LOCK_UN);
+  }
+  if (!ok) {
+    (void) close(hsp->fd);
+    NaClMutexDtor(&hsp->mu);
+    return 0;
+  }
+  return 1;
+}
+
+
+void NaClHashStoreDtor(struct NaClHashStore *hsp) {
+  (void) munmap((void *) hsp->hdr, hsp->map_bytes);
+  (void) close(hsp->fd);
+  NaClMutexDtor(&hsp->mu);
+}
+
+
+int NaClHashStoreLookup(struct NaClHashStore           *hsp,
+                        struct NaClHashStoreKey const  *key,
+                        unsigned char                  *app_hash) {
+  struct NaClHashStoreSlot  *s;
+  unsigned char             copy[20];
+  uint32_t                  h;
+  uint32_t                  i;
+  uint32_t                  seq;
+  int                       match;
+  int                       tries;
+
+  if (0 == key->ino) {
+    return 0;
+  }
+  h = NaClHashStoreHash(key);
+  for (i = 0; i < NACL_HASH_STORE_PROBES; ++i) {
+    s = &hsp->slots[(h + i) % hsp->num_slots];
+    for (tries = 0; tries < NACL_HASH_STORE_READ_RETRIES; ++tries) {
+      seq = s->seq;
+      if (0 != (seq & 1)) {
+        continue;
+      }
+      NaClHashStoreBarrier();
+      match = (0 == memcmp(&s->key, key, sizeof *key));
+      if (match) {
+        memcpy(copy, s->app_hash, sizeof copy);
+      }
+      NaClHashStoreBarrier();
+      if (seq == s->seq) {
+        break;
+      }
+    }
+    if (NACL_HASH_STORE_READ_RETRIES == tries) {
+      /* being rewritten; the caller will hash the file */
+      return 0;
+    }
+    if (match) {
+      memcpy(app_hash, copy, sizeof copy);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+int NaClHashStoreInsert(struct NaClHashStore           *hsp,
+                        struct NaClHashStoreKey const  *key,
+                        unsigned char const            *app_hash) {
+  struct NaClHashStoreSlot  *s;
+  struct NaClHashStoreSlot  *victim = NULL;
+  uint32_t                  h;
+  uint32_t                  i;
+
+  if (0 == key->ino) {
+    return 0;
+  }
+  NaClXMutexLock(&hsp->mu);
+  if (0 != flock(hsp->fd, LOCK_EX)) {
+    NaClXMutexUnlock(&hsp->mu);
+    return 0;
+  }
+
+  h = NaClHashStoreHash(key);
+  for (i = 0; i < NACL_HASH_STORE_PROBES; ++i) {
+    s = &hsp->slots[(h + i) % hsp->num_slots];
+    if (NaClHashStoreSameFile(&s->key, key)) {
+      victim = s;
+      break;
+    }
+    if (NULL != victim && 0 == victim->key.ino) {
+      continue;
+    }
+    if (NULL == victim || 0 == s->key.ino || 0 != (s->seq & 1)
+        || s->key.ctime_sec < victim->key.ctime_sec) {
+      victim = s;
+    }
+  }
+
+  /* force the counter odd even if a dead writer left it odd */
+  victim->seq = (victim->seq + 1) | 1;
+  NaClHashStoreBarrier();
+  victim->key = *key;
+  memcpy(victim->app_hash, app_hash, sizeof victim->app_hash);
+  NaClHashStoreBarrier();
+  ++victim->seq;
+
+  (void) flock(hsp->fd, LOCK_UN);
+  NaClXMutexUnlock(&hsp->mu);
+  return 1;
+}
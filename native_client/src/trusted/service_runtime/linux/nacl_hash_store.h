@@ -0,0 +1,155 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime on-disk cache of application hashes.
+ *
+ * Every launch needs the SHA-1 of the nexe for the validation
+ * handshake (see nacl_socks_client.h), and for a large nexe that is
+ * a noticeable share of startup.  The store remembers the hash of
+ * each file it has seen, keyed by the file's identity: device,
+ * inode, size, and modification and status change times to the
+ * nanosecond.  Writing the file or replacing it changes the key, so
+ * a changed file misses and is hashed again.
+ *
+ * The layout and locking follow nacl_peer_store.h: a header and an
+ * open addressed table of slots in a file mapped shared by every
+ * sel_ldr on the host, read without locks under per-slot sequence
+ * counters, written under a mutex and flock().
+ *
+ * The store is trusted: anyone who can write it can make one nexe
+ * run under another's hash.  It is created mode 0600, and an
+ * existing file is only used if it is a regular file owned by the
+ * effective user.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_HASH_STORE_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_HASH_STORE_H_
+
+#include <sys/stat.h>
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_sync.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_HASH_STORE_MAGIC         0x4e485331  /* "NHS1" */
+#define NACL_HASH_STORE_VERSION       1
+#define NACL_HASH_STORE_DEFAULT_SLOTS 256
+#define NACL_HASH_STORE_MAX_SLOTS     (1 << 16)
+#define NACL_HASH_STORE_PROBES        4
+
+/*
+ * A file's identity.  Built only by NaClHashStoreKeyFromStat, which
+ * zeroes it first, so keys compare with memcmp.
+ */
+struct NaClHashStoreKey {
+  uint64_t  dev;
+  uint64_t  ino;  /* 0 if the slot is empty */
+  int64_t   size;
+  int64_t   mtime_sec;
+  int64_t   mtime_nsec;
+  int64_t   ctime_sec;
+  int64_t   ctime_nsec;
+};
+
+struct NaClHashStoreHeader {
+  uint32_t  magic;  /* written last, so a half-made file is rejected */
+  uint32_t  version;
+  uint32_t  num_slots;
+  uint32_t  slot_bytes;
+  uint8_t   reserved[48];
+};
+
+struct NaClHashStoreSlot {
+  volatile uint32_t       seq;  /* odd while being written */
+  uint32_t                pad;
+  struct NaClHashStoreKey key;
+  uint8_t                 app_hash[20];
+  uint8_t                 pad2[4];
+};
+
+struct NaClHashStore {
+  struct NaClMutex            mu;  /* serializes writers in this process */
+  int                         fd;
+  size_t                      map_bytes;
+  struct NaClHashStoreHeader  *hdr;
+  struct NaClHashStoreSlot    *slots;
+  uint32_t                    num_slots;
+};
+
+void NaClHashStoreKeyFromStat(struct NaClHashStoreKey *key,
+                              struct stat const       *st);
+
+/*
+ * True if the file was changed so recently, by the clock reading now,
+ * that it could change again without its times moving.  Such keys are
+ * not worth storing.
+ */
+int NaClHashStoreKeyRacy(struct NaClHashStoreKey const  *key,
+                         int64_t                        now);
+
+/*
+ * Open, creating if necessary, the store at path.  A new file gets
+ * num_slots slots, clamped to [NACL_HASH_STORE_PROBES,
+ * NACL_HASH_STORE_MAX_SLOTS]; an existing one keeps its size.
+ * Returns non-zero on success.  Failure is logged, and leaves the
+ * caller to hash the file itself.
+ */
+int NaClHashStoreCtor(struct NaClHashStore  *hsp,
+                      char const            *path,
+                      uint32_t              num_slots) NACL_WUR;
+
+void NaClHashStoreDtor(struct NaClHashStore *hsp);
+
+/*
+ * Copy the stored hash of the file with identity key into app_hash.
+ * Returns 1 on a hit and 0 on a miss.
+ */
+int NaClHashStoreLookup(struct NaClHashStore           *hsp,
+                        struct NaClHashStoreKey const  *key,
+                        unsigned char                  *app_hash);
+
+/*
+ * Record app_hash for key.  Replaces an entry for an older version of
+ * the same file, else an empty slot, else the entry in the key's
+ * probe sequence whose file changed longest ago.  Returns non-zero on
+ * success.
+ */
+int NaClHashStoreInsert(struct NaClHashStore           *hsp,
+                        struct NaClHashStoreKey const  *key,
+                        unsigned char const            *app_hash);
+
+EXTERN_C_END
+
+#endif
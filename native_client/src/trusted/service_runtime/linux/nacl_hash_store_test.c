@@ -0,0 +1,249 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the on-disk application hash store: lookups keyed by file
+ * identity, misses once the file changes, replacement, and sharing
+ * between independent mappings.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_hash_store.h"
+
+#define TEST_NOW  1000000
+
+static char gPath[] = "/tmp/nacl_hash_store_test.XXXXXX";
+static unsigned char gHash[20] = "application hash 01";
+static unsigned char gOtherHash[20] = "application hash 02";
+
+
+/* A key for version v of file ino, last changed well before TEST_NOW. */
+static void MakeKey(struct NaClHashStoreKey *key, uint64_t ino, int64_t v) {
+  struct stat st;
+
+  memset(&st, 0, sizeof st);
+  st.st_dev = 3;
+  st.st_ino = ino;
+  st.st_size = 4096 + v;
+  st.st_mtim.tv_sec = TEST_NOW - 100 + v;
+  st.st_mtim.tv_nsec = 500;
+  st.st_ctim = st.st_mtim;
+  NaClHashStoreKeyFromStat(key, &st);
+}
+
+
+/* Start each test from an empty file. */
+static int OpenStore(struct NaClHashStore *hsp, uint32_t num_slots) {
+  if (0 != truncate(gPath, 0)) {
+    printf("ERROR: could not truncate %s\n", gPath);
+    return 0;
+  }
+  if (!NaClHashStoreCtor(hsp, gPath, num_slots)) {
+    printf("ERROR: ctor failed\n");
+    return 0;
+  }
+  return 1;
+}
+
+
+static int ExpectLookup(struct NaClHashStore           *hsp,
+                        struct NaClHashStoreKey const  *key,
+                        unsigned char const            *want_hash) {
+  unsigned char hash[20];
+  int           hit;
+
+  hit = NaClHashStoreLookup(hsp, key, hash);
+  if (hit != (NULL != want_hash)
+      || (hit && 0 != memcmp(hash, want_hash, sizeof hash))) {
+    printf("ERROR: inode %"PRIu64" size %"PRId64": hit %d, expected %d\n",
+           key->ino, key->size, hit, NULL != want_hash);
+    return 1;
+  }
+  return 0;
+}
+
+
+int BasicTest(void) {
+  struct NaClHashStore    hs;
+  struct NaClHashStoreKey key;
+  struct NaClHashStoreKey changed;
+  int                     errors = 0;
+
+  printf("\nBasicTest\n");
+  if (!OpenStore(&hs, 16)) {
+    return 1;
+  }
+  MakeKey(&key, 42, 0);
+  errors += ExpectLookup(&hs, &key, NULL);
+  NaClHashStoreInsert(&hs, &key, gHash);
+  errors += ExpectLookup(&hs, &key, gHash);
+
+  /* any change to the file's identity misses */
+  changed = key;
+  changed.ctime_nsec += 1;
+  errors += ExpectLookup(&hs, &changed, NULL);
+  changed = key;
+  changed.size += 1;
+  errors += ExpectLookup(&hs, &changed, NULL);
+  MakeKey(&changed, 43, 0);
+  errors += ExpectLookup(&hs, &changed, NULL);
+
+  /* a new version of the file replaces the old one's entry */
+  MakeKey(&changed, 42, 1);
+  NaClHashStoreInsert(&hs, &changed, gOtherHash);
+  errors += ExpectLookup(&hs, &changed, gOtherHash);
+  errors += ExpectLookup(&hs, &key, NULL);
+
+  NaClHashStoreDtor(&hs);
+  return errors;
+}
+
+
+int RacyTest(void) {
+  struct NaClHashStoreKey key;
+  int                     errors = 0;
+
+  printf("\nRacyTest\n");
+  MakeKey(&key, 42, 0);
+  if (NaClHashStoreKeyRacy(&key, TEST_NOW)) {
+    printf("ERROR: an old file is racy\n");
+    ++errors;
+  }
+  if (!NaClHashStoreKeyRacy(&key, key.ctime_sec)) {
+    printf("ERROR: a file changed just now is not racy\n");
+    ++errors;
+  }
+  return errors;
+}
+
+
+int ReplacementTest(void) {
+  struct NaClHashStore    hs;
+  struct NaClHashStoreKey key;
+  uint64_t                ino;
+  int                     errors = 0;
+
+  printf("\nReplacementTest\n");
+  if (!OpenStore(&hs, NACL_HASH_STORE_PROBES)) {
+    return 1;
+  }
+  /*
+   * Every key probes the whole table.  Filling it makes the next
+   * insert replace the file that changed longest ago, inode 1.
+   */
+  for (ino = 1; ino <= NACL_HASH_STORE_PROBES; ++ino) {
+    MakeKey(&key, ino, ino);
+    NaClHashStoreInsert(&hs, &key, gHash);
+  }
+  MakeKey(&key, 100, 50);
+  NaClHashStoreInsert(&hs, &key, gOtherHash);
+  errors += ExpectLookup(&hs, &key, gOtherHash);
+  MakeKey(&key, 1, 1);
+  errors += ExpectLookup(&hs, &key, NULL);
+  MakeKey(&key, 2, 2);
+  errors += ExpectLookup(&hs, &key, gHash);
+
+  NaClHashStoreDtor(&hs);
+  return errors;
+}
+
+
+int SharingTest(void) {
+  struct NaClHashStore    hs;
+  struct NaClHashStore    other;
+  struct NaClHashStoreKey key;
+  int                     errors = 0;
+
+  printf("\nSharingTest\n");
+  if (!OpenStore(&hs, 16)) {
+    return 1;
+  }
+  /* a second opener adopts the existing size */
+  if (!NaClHashStoreCtor(&other, gPath, 1024)) {
+    printf("ERROR: second ctor failed\n");
+    NaClHashStoreDtor(&hs);
+    return 1;
+  }
+  if (other.num_slots != hs.num_slots) {
+    printf("ERROR: second mapping has %u slots\n", other.num_slots);
+    ++errors;
+  }
+  MakeKey(&key, 9, 0);
+  NaClHashStoreInsert(&hs, &key, gHash);
+  errors += ExpectLookup(&other, &key, gHash);
+
+  NaClHashStoreDtor(&other);
+  NaClHashStoreDtor(&hs);
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+  int fd;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+
+  if ((fd = mkstemp(gPath)) < 0) {
+    printf("ERROR: could not create a temporary file\n");
+    return 1;
+  }
+  close(fd);
+
+  errors += BasicTest();
+  errors += RacyTest();
+  errors += ReplacementTest();
+  errors += SharingTest();
+
+  unlink(gPath);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
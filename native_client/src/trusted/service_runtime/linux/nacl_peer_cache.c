@@ -0,0 +1,452 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime cache of remote peer port policies.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_peer_cache.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+
+
+/*
+ * atomic_ops.h has neither a fence nor C-callable word-sized ops on
+ * x86-64, and this file is only built on linux, where gcc is the
+ * compiler, so use the gcc builtins directly.
+ */
+static INLINE void NaClPeerCacheBarrier(void) {
+  __sync_synchronize();
+}
+
+
+static INLINE void NaClPeerCacheCount(uintptr_t *counter) {
+  __sync_fetch_and_add(counter, 1);
+}
+
+
+static INLINE uint32_t NaClPeerCacheBucket(struct NaClPeerCache *pcp,
+                                           uint32_t             ip) {
+  uint32_t h = ip * 2654435761U;  /* Knuth's multiplicative hash */
+
+  return (h ^ (h >> 16)) & pcp->bucket_mask;
+}
+
+
+/* Wrap-safe: the caller's clock need not start at zero. */
+static INLINE int NaClPeerCacheStale(struct NaClPeerCacheEntry  *e,
+                                     uint32_t                   now) {
+  return (int32_t) (now - e->expires) >= 0;
+}
+
+
+static INLINE int NaClPeerCacheVerdict(struct NaClPeerCacheEntry  *e,
+                                       uint16_t                   port) {
+  if (0 != e->error) {
+    return e->error;
+  }
+  return NaClPortPolicyAllows(e->ports, port) ? 0 : -NACL_ABI_EACCES;
+}
+
+
+static INLINE void NaClPeerCacheBeginWriteMu(struct NaClPeerCacheEntry *e) {
+  ++e->seq;
+  NaClPeerCacheBarrier();
+}
+
+
+static INLINE void NaClPeerCacheEndWriteMu(struct NaClPeerCacheEntry *e) {
+  NaClPeerCacheBarrier();
+  ++e->seq;
+}
+
+
+int NaClPeerCacheCtor(struct NaClPeerCache  *pcp,
+                      uint32_t              capacity) {
+  uint32_t  nbuckets;
+  uint32_t  i;
+
+  if (capacity < 1) {
+    capacity = 1;
+  } else if (capacity > NACL_PEER_CACHE_MAX_ENTRIES) {
+    capacity = NACL_PEER_CACHE_MAX_ENTRIES;
+  }
+  /* keep chains short: at least two buckets per entry, power of two */
+  for (nbuckets = 1; nbuckets < 2 * capacity; nbuckets <<= 1) {
+  }
+
+  memset(&pcp->stats, 0, sizeof pcp->stats);
+  pcp->capacity = capacity;
+  pcp->bucket_mask = nbuckets - 1;
+  pcp->num_used = 0;
+  pcp->clock_hand = 0;
+  pcp->buckets = NULL;
+  pcp->entries = NULL;
+  pcp->retired = NULL;
+
+  if (!NaClMutexCtor(&pcp->mu)) {
+    return 0;
+  }
+  pcp->buckets = malloc(nbuckets * sizeof *pcp->buckets);
+  pcp->entries = calloc(capacity, sizeof *pcp->entries);
+  if (NULL == pcp->buckets || NULL == pcp->entries) {
+    free((void *) pcp->buckets);
+    free(pcp->entries);
+    NaClMutexDtor(&pcp->mu);
+    return 0;
+  }
+  for (i = 0; i < nbuckets; ++i) {
+    pcp->buckets[i] = -1;
+  }
+  for (i = 0; i < capacity; ++i) {
+    pcp->entries[i].next = -1;
+  }
+  return 1;
+}
+
+
+void NaClPeerCacheDtor(struct NaClPeerCache *pcp) {
+  struct NaClPeerCacheRetired *r;
+  uint32_t                    i;
+
+  for (i = 0; i < pcp->capacity; ++i) {
+    free(pcp->entries[i].ports);
+  }
+  while (NULL != (r = pcp->retired)) {
+    pcp->retired = r->next;
+    free(r->buf);
+    free(r);
+  }
+  free(pcp->entries);
+  free((void *) pcp->buckets);
+  NaClMutexDtor(&pcp->mu);
+}
+
+
+/*
+ * Lock-free probe.  Returns 1 on a hit, 0 on a clean miss, and -1 if
+ * a concurrent writer got in the way and the caller should retry with
+ * the writer lock held.  A stale entry is reported as a miss with
+ * *stale set.
+ */
+static int NaClPeerCacheProbe(struct NaClPeerCache  *pcp,
+                              uint32_t              ip,
+                              uint16_t              port,
+                              uint32_t              now,
+                              int                   *result,
+                              int                   *stale) {
+  struct NaClPeerCacheEntry *e;
+  uint32_t                  seq;
+  int32_t                   idx;
+  int32_t                   next;
+  uint32_t                  steps;
+  int                       verdict;
+  int                       expired;
+
+  idx = pcp->buckets[NaClPeerCacheBucket(pcp, ip)];
+  for (steps = 0; idx >= 0; ++steps) {
+    if (steps >= pcp->capacity) {
+      return -1;  /* chain mutated under us into a cycle */
+    }
+    e = &pcp->entries[idx];
+    seq = e->seq;
+    NaClPeerCacheBarrier();
+    if (0 != (seq & 1)) {
+      return -1;
+    }
+    if (e->in_use && e->ip == ip) {
+      expired = NaClPeerCacheStale(e, now);
+      verdict = expired ? 0 : NaClPeerCacheVerdict(e, port);
+      NaClPeerCacheBarrier();
+      if (e->seq != seq) {
+        return -1;
+      }
+      if (expired) {
+        *stale = 1;
+        return 0;
+      }
+      if (!e->referenced) {
+        e->referenced = 1;
+      }
+      *result = verdict;
+      return 1;
+    }
+    next = e->next;
+    NaClPeerCacheBarrier();
+    if (e->seq != seq) {
+      return -1;
+    }
+    idx = next;
+  }
+  return 0;
+}
+
+
+static int32_t NaClPeerCacheFindMu(struct NaClPeerCache *pcp,
+                                   uint32_t             ip) {
+  int32_t idx;
+
+  for (idx = pcp->buckets[NaClPeerCacheBucket(pcp, ip)];
+       idx >= 0;
+       idx = pcp->entries[idx].next) {
+    if (pcp->entries[idx].in_use && pcp->entries[idx].ip == ip) {
+      return idx;
+    }
+  }
+  return -1;
+}
+
+
+int NaClPeerCacheLookup(struct NaClPeerCache  *pcp,
+                        uint32_t              ip,
+                        uint16_t              port,
+                        uint32_t              now,
+                        int                   *result) {
+  struct NaClPeerCacheEntry *e;
+  int                       rv;
+  int                       stale = 0;
+  int32_t                   idx;
+
+  rv = NaClPeerCacheProbe(pcp, ip, port, now, result, &stale);
+  if (rv < 0) {
+    /*
+     * Lost a race with a writer, or missed an entry that was linked
+     * in after we read the bucket head.  Either way the locked search
+     * is authoritative.
+     */
+    rv = 0;
+    NaClXMutexLock(&pcp->mu);
+    idx = NaClPeerCacheFindMu(pcp, ip);
+    if (idx >= 0) {
+      e = &pcp->entries[idx];
+      if (NaClPeerCacheStale(e, now)) {
+        stale = 1;
+      } else {
+        e->referenced = 1;
+        *result = NaClPeerCacheVerdict(e, port);
+        rv = 1;
+      }
+    }
+    NaClXMutexUnlock(&pcp->mu);
+  }
+  if (rv) {
+    NaClPeerCacheCount(&pcp->stats.hits);
+  } else {
+    NaClPeerCacheCount(stale ? &pcp->stats.expirations : &pcp->stats.misses);
+  }
+  return rv;
+}
+
+
+static void NaClPeerCacheUnlinkMu(struct NaClPeerCache  *pcp,
+                                  int32_t               idx) {
+  volatile int32_t  *linkp;
+
+  linkp = &pcp->buckets[NaClPeerCacheBucket(pcp, pcp->entries[idx].ip)];
+  while (*linkp != idx) {
+    if (*linkp < 0) {
+      NaClLog(LOG_FATAL, "NaClPeerCacheUnlinkMu: entry %d not on its chain\n",
+              idx);
+    }
+    linkp = &pcp->entries[*linkp].next;
+  }
+  *linkp = pcp->entries[idx].next;
+}
+
+
+/*
+ * Pick the slot for a new peer: an unused one while the cache is
+ * filling, afterwards the first entry the CLOCK hand finds that is
+ * either stale or without its referenced bit set.
+ */
+static int32_t NaClPeerCacheVictimMu(struct NaClPeerCache *pcp,
+                                     uint32_t             now) {
+  struct NaClPeerCacheEntry *e;
+  int32_t                   idx;
+
+  if (pcp->num_used < pcp->capacity) {
+    return pcp->num_used++;
+  }
+  for (;;) {
+    idx = pcp->clock_hand;
+    e = &pcp->entries[idx];
+    if (++pcp->clock_hand == pcp->capacity) {
+      pcp->clock_hand = 0;
+    }
+    if (!e->referenced || NaClPeerCacheStale(e, now)) {
+      return idx;
+    }
+    e->referenced = 0;
+  }
+}
+
+
+/*
+ * Make sure e->ports can hold bytes bytes of policy.  The old buffer
+ * is retired, not freed, as lock-free readers may be using it.  The
+ * caller must have begun a write on e, so that readers cannot take a
+ * verdict from the new buffer before the policy is copied in.
+ * Returns non-zero on success.
+ */
+static int NaClPeerCacheReserveMu(struct NaClPeerCache      *pcp,
+                                  struct NaClPeerCacheEntry *e,
+                                  size_t                    bytes) {
+  struct NaClPeerCacheRetired *r = NULL;
+  void                        *buf;
+  uint32_t                    size;
+
+  if (bytes <= e->ports_bytes) {
+    return 1;
+  }
+  for (size = 64; size < bytes; size <<= 1) {
+  }
+  if (size > sizeof(struct NaClRemoteServerPorts)) {
+    size = sizeof(struct NaClRemoteServerPorts);
+  }
+  if (NULL != e->ports && NULL == (r = malloc(sizeof *r))) {
+    return 0;
+  }
+  if (NULL == (buf = malloc(size))) {
+    free(r);
+    return 0;
+  }
+  if (NULL != r) {
+    r->buf = e->ports;
+    r->next = pcp->retired;
+    pcp->retired = r;
+  }
+  /*
+   * Readers that read the sequence number before the write began may
+   * still see the new pointer; they are turned away when they check
+   * the sequence number again, but must not run off a garbage policy
+   * first.
+   */
+  ((struct NaClRemoteServerPorts *) buf)->num_ranges = 0;
+  NaClPeerCacheBarrier();
+  e->ports = (struct NaClRemoteServerPorts *) buf;
+  e->ports_bytes = size;
+  return 1;
+}
+
+
+/*
+ * Common insert path.  ports is NULL for negative entries.
+ */
+static int NaClPeerCacheUpdate(struct NaClPeerCache                *pcp,
+                               uint32_t                            ip,
+                               struct NaClRemoteServerPorts const  *ports,
+                               int32_t                             error,
+                               uint32_t                            now,
+                               uint32_t                            ttl) {
+  struct NaClPeerCacheEntry *e;
+  int32_t                   idx;
+  uint32_t                  bucket;
+
+  NaClXMutexLock(&pcp->mu);
+  idx = NaClPeerCacheFindMu(pcp, ip);
+  if (idx >= 0) {
+    e = &pcp->entries[idx];
+  } else {
+    idx = NaClPeerCacheVictimMu(pcp, now);
+    e = &pcp->entries[idx];
+  }
+  NaClPeerCacheBeginWriteMu(e);
+  if (NULL != ports && !NaClPeerCacheReserveMu(pcp, e,
+                                                NaClPortPolicyBytes(ports))) {
+    NaClPeerCacheEndWriteMu(e);
+    if (!e->in_use) {
+      --pcp->num_used;
+    }
+    NaClXMutexUnlock(&pcp->mu);
+    return 0;
+  }
+  if (NULL != ports) {
+    memcpy(e->ports, ports, NaClPortPolicyBytes(ports));
+  }
+  e->error = error;
+  e->expires = now + ttl;
+  if (!e->in_use || e->ip != ip) {
+    bucket = NaClPeerCacheBucket(pcp, ip);
+    if (e->in_use) {
+      NaClPeerCacheUnlinkMu(pcp, idx);
+      NaClPeerCacheCount(&pcp->stats.evictions);
+    }
+    e->ip = ip;
+    e->in_use = 1;
+    e->referenced = 1;
+    e->next = pcp->buckets[bucket];
+    NaClPeerCacheEndWriteMu(e);
+
+    /* publish only after the entry is complete */
+    NaClPeerCacheBarrier();
+    pcp->buckets[bucket] = idx;
+  } else {
+    NaClPeerCacheEndWriteMu(e);
+  }
+  NaClXMutexUnlock(&pcp->mu);
+  NaClPeerCacheCount(&pcp->stats.inserts);
+  return 1;
+}
+
+
+int NaClPeerCacheInsert(struct NaClPeerCache                *pcp,
+                        struct NaClRemoteServerPorts const  *ports,
+                        uint32_t                            now,
+                        uint32_t                            ttl) {
+  return NaClPeerCacheUpdate(pcp, ports->ip, ports, 0, now, ttl);
+}
+
+
+int NaClPeerCacheInsertError(struct NaClPeerCache *pcp,
+                             uint32_t             ip,
+                             int32_t              error,
+                             uint32_t             now,
+                             uint32_t             ttl) {
+  if (0 == error) {
+    NaClLog(LOG_FATAL, "NaClPeerCacheInsertError: error must be non-zero\n");
+  }
+  return NaClPeerCacheUpdate(pcp, ip, NULL, error, now, ttl);
+}
+
+
+void NaClPeerCacheGetStats(struct NaClPeerCache       *pcp,
+                           struct NaClPeerCacheStats  *stats) {
+  stats->hits = pcp->stats.hits;
+  stats->misses = pcp->stats.misses;
+  stats->inserts = pcp->stats.inserts;
+  stats->evictions = pcp->stats.evictions;
+  stats->expirations = pcp->stats.expirations;
+}
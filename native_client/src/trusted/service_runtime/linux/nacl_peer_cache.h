@@ -0,0 +1,180 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime cache of remote peer port policies.
+ *
+ * Maps a peer IPv4 address to the set of ports that the validation
+ * server on that peer (see nacl_socks_client.h) said the application
+ * may use.  The cache is consulted on every connect/sendto, so the
+ * lookup path takes no locks: each entry is protected by a sequence
+ * counter that writers bump to an odd value while the entry is being
+ * changed, and readers retry under the writer mutex if they observe
+ * an odd or changed counter.  Writers are serialized by a mutex.
+ *
+ * Entries live in a fixed array sized at construction time and are
+ * indexed by a chained hash table of entry indices.  When the array
+ * is full a CLOCK sweep picks the victim: lookups set an entry's
+ * referenced bit, and the sweep clears referenced bits until it finds
+ * an entry that has not been used since the hand last passed it.
+ * Entry memory is never freed while the cache is alive, so a reader
+ * racing with eviction can only see a changed sequence number, never
+ * a dangling pointer.
+ *
+ * Each entry keeps its policy in the compact form of nacl_port_policy.h,
+ * in a buffer sized to a power of two that only grows.  A buffer that
+ * is outgrown is retired rather than freed, as a reader may still be
+ * looking at it; retired buffers are freed by the destructor.  Since
+ * sizes double, retired memory is bounded by the live buffer's size.
+ *
+ * Every entry carries an expiry time, so policy changes on the server
+ * are picked up without restarting sel_ldr.  Failed or refused
+ * handshakes are cached as negative entries holding the error to
+ * report, so that an application retrying an unreachable peer does
+ * not cause a validation connection per attempt.  Expired entries
+ * read as misses and are the first candidates for eviction.  Times
+ * are in seconds on an arbitrary monotonic scale chosen by the
+ * caller.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_PEER_CACHE_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_PEER_CACHE_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_sync.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_PEER_CACHE_DEFAULT_ENTRIES 1024
+#define NACL_PEER_CACHE_MAX_ENTRIES     (1 << 20)
+
+#define NACL_PEER_CACHE_DEFAULT_ALLOW_TTL 300  /* seconds */
+#define NACL_PEER_CACHE_DEFAULT_DENY_TTL  30
+
+/*
+ * Counters are bumped with atomic adds and may be read at any time; a
+ * snapshot is not guaranteed to be mutually consistent.
+ */
+struct NaClPeerCacheStats {
+  uintptr_t hits;
+  uintptr_t misses;
+  uintptr_t inserts;
+  uintptr_t evictions;
+  uintptr_t expirations;  /* lookups that found only a stale entry */
+};
+
+struct NaClPeerCacheEntry {
+  volatile uint32_t             seq;         /* odd while being written */
+  volatile int32_t              next;        /* hash chain; -1 terminates */
+  volatile int                  in_use;
+  volatile int                  referenced;  /* CLOCK bit */
+  volatile uint32_t             ip;          /* network byte order */
+  volatile uint32_t             expires;     /* stale once now >= expires */
+  volatile int32_t              error;       /* non-zero: negative entry */
+  struct NaClRemoteServerPorts  *volatile ports;  /* valid iff !error */
+  uint32_t                      ports_bytes;     /* allocated size */
+};
+
+struct NaClPeerCacheRetired {
+  struct NaClPeerCacheRetired *next;
+  void                        *buf;
+};
+
+struct NaClPeerCache {
+  struct NaClMutex            mu;  /* serializes writers */
+  uint32_t                    capacity;
+  uint32_t                    bucket_mask;
+  volatile int32_t            *buckets;  /* entry index or -1 */
+  struct NaClPeerCacheEntry   *entries;
+  uint32_t                    num_used;
+  uint32_t                    clock_hand;
+  struct NaClPeerCacheRetired *retired;
+  struct NaClPeerCacheStats   stats;
+};
+
+/*
+ * Placement new style constructor.  capacity is the maximum number
+ * of peers remembered; it is clamped to [1, NACL_PEER_CACHE_MAX_ENTRIES].
+ * Returns non-zero on success.
+ */
+int NaClPeerCacheCtor(struct NaClPeerCache  *pcp,
+                      uint32_t              capacity) NACL_WUR;
+
+/*
+ * Must not be invoked while other threads may still use the cache.
+ */
+void NaClPeerCacheDtor(struct NaClPeerCache *pcp);
+
+/*
+ * Look up ip (network byte order) as of time now and check port (host
+ * byte order) against its policy.  Returns 0 on a miss.  On a hit
+ * returns 1 and sets *result to 0 if the port is allowed,
+ * -NACL_ABI_EACCES if it is not, or the error cached for a failed
+ * handshake.
+ */
+int NaClPeerCacheLookup(struct NaClPeerCache  *pcp,
+                        uint32_t              ip,
+                        uint16_t              port,
+                        uint32_t              now,
+                        int                   *result);
+
+/*
+ * Insert or replace the policy for ports->ip, valid for ttl seconds
+ * from now, evicting another peer if the cache is full.  The policy
+ * is copied, taking only as much memory as its representation needs.
+ * Returns non-zero on success, 0 if memory for the entry could not be
+ * allocated.
+ */
+int NaClPeerCacheInsert(struct NaClPeerCache                *pcp,
+                        struct NaClRemoteServerPorts const  *ports,
+                        uint32_t                            now,
+                        uint32_t                            ttl);
+
+/*
+ * Remember for ttl seconds from now that validating ip failed with
+ * error, a negative NACL_ABI_ errno value.
+ */
+int NaClPeerCacheInsertError(struct NaClPeerCache *pcp,
+                             uint32_t             ip,
+                             int32_t              error,
+                             uint32_t             now,
+                             uint32_t             ttl);
+
+void NaClPeerCacheGetStats(struct NaClPeerCache       *pcp,
+                           struct NaClPeerCacheStats  *stats);
+
+EXTERN_C_END
+
+#endif
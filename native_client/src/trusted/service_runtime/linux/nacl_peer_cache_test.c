@@ -0,0 +1,339 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the peer policy cache: basic lookups, replacement, CLOCK
+ * eviction, expiry and negative entries, and readers racing with
+ * writers.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_peer_cache.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+
+#define NUM_STRESS_PEERS    64
+#define NUM_STRESS_READERS  4
+#define NUM_STRESS_ROUNDS   20000
+
+#define TEST_NOW  1000
+#define TEST_TTL  60
+
+static struct NaClRemoteServerPorts gPorts;
+
+
+/* Each test peer allows exactly one port, derived from its address. */
+static uint16_t PortForIp(uint32_t ip) {
+  return (uint16_t) (1 + (ip % 60000));
+}
+
+
+static void MakePolicy(uint32_t ip) {
+  uint16_t port = PortForIp(ip);
+
+  gPorts.ip = ip;
+  gPorts.num_ranges = 1;
+  gPorts.u.ranges[0].lo = port;
+  gPorts.u.ranges[0].hi = port;
+}
+
+
+static void InsertPolicy(struct NaClPeerCache *pcp, uint32_t ip) {
+  MakePolicy(ip);
+  if (!NaClPeerCacheInsert(pcp, &gPorts, TEST_NOW, TEST_TTL)) {
+    printf("ERROR: insert of 0x%08x failed\n", ip);
+  }
+}
+
+
+static int ExpectLookupAt(struct NaClPeerCache  *pcp,
+                          uint32_t              ip,
+                          uint16_t              port,
+                          uint32_t              now,
+                          int                   want_hit,
+                          int                   want_result) {
+  int result = 1;
+  int hit;
+
+  hit = NaClPeerCacheLookup(pcp, ip, port, now, &result);
+  if (hit != want_hit || (hit && result != want_result)) {
+    printf("ERROR: ip 0x%08x port %u at %u: hit %d result %d,"
+           " expected hit %d result %d\n",
+           ip, port, now, hit, result, want_hit, want_result);
+    return 1;
+  }
+  return 0;
+}
+
+
+static int ExpectLookup(struct NaClPeerCache  *pcp,
+                        uint32_t              ip,
+                        uint16_t              port,
+                        int                   want_hit,
+                        int                   want_allowed) {
+  return ExpectLookupAt(pcp, ip, port, TEST_NOW, want_hit,
+                        want_allowed ? 0 : -NACL_ABI_EACCES);
+}
+
+
+int BasicTest(void) {
+  struct NaClPeerCache  pc;
+  uint8_t               bitmap[NACL_PORT_POLICY_BITMAP_BYTES];
+  int                   errors = 0;
+
+  printf("\nBasicTest\n");
+  if (!NaClPeerCacheCtor(&pc, 16)) {
+    printf("ERROR: ctor failed\n");
+    return 1;
+  }
+  errors += ExpectLookup(&pc, 7, PortForIp(7), 0, 0);
+
+  InsertPolicy(&pc, 7);
+  errors += ExpectLookup(&pc, 7, PortForIp(7), 1, 1);
+  errors += ExpectLookup(&pc, 7, PortForIp(7) + 1, 1, 0);
+  errors += ExpectLookup(&pc, 8, PortForIp(7), 0, 0);
+
+  /*
+   * replacing a peer's policy takes effect immediately, even when it
+   * needs a bigger buffer
+   */
+  memset(bitmap, 0xaa, sizeof bitmap);
+  NaClPortPolicySetBitmap(&gPorts, bitmap, sizeof bitmap);
+  gPorts.ip = 7;
+  if (NACL_PORT_POLICY_BITMAP != gPorts.num_ranges) {
+    printf("ERROR: alternate ports are not stored as a bitmap\n");
+    ++errors;
+  }
+  NaClPeerCacheInsert(&pc, &gPorts, TEST_NOW, TEST_TTL);
+  errors += ExpectLookup(&pc, 7, 3, 1, 1);
+  errors += ExpectLookup(&pc, 7, 4, 1, 0);
+  errors += ExpectLookup(&pc, 7, PortForIp(7), 1, PortForIp(7) & 1);
+
+  /* and when it shrinks back */
+  InsertPolicy(&pc, 7);
+  errors += ExpectLookup(&pc, 7, 3, 1, 0);
+  errors += ExpectLookup(&pc, 7, PortForIp(7), 1, 1);
+
+  NaClPeerCacheDtor(&pc);
+  return errors;
+}
+
+
+int EvictionTest(void) {
+  struct NaClPeerCache      pc;
+  struct NaClPeerCacheStats stats;
+  uint32_t                  ip;
+  int                       errors = 0;
+
+  printf("\nEvictionTest\n");
+  if (!NaClPeerCacheCtor(&pc, 4)) {
+    printf("ERROR: ctor failed\n");
+    return 1;
+  }
+  for (ip = 1; ip <= 4; ++ip) {
+    InsertPolicy(&pc, ip);
+  }
+  /* first insert clears all referenced bits and evicts peer 1 */
+  InsertPolicy(&pc, 5);
+  errors += ExpectLookup(&pc, 1, PortForIp(1), 0, 0);
+
+  /* peers 3 and 4 are used, so 2 goes next, then 5 */
+  errors += ExpectLookup(&pc, 3, PortForIp(3), 1, 1);
+  errors += ExpectLookup(&pc, 4, PortForIp(4), 1, 1);
+  InsertPolicy(&pc, 6);
+  errors += ExpectLookup(&pc, 2, PortForIp(2), 0, 0);
+  errors += ExpectLookup(&pc, 3, PortForIp(3), 1, 1);
+  errors += ExpectLookup(&pc, 6, PortForIp(6), 1, 1);
+
+  NaClPeerCacheGetStats(&pc, &stats);
+  if (6 != stats.inserts || 2 != stats.evictions) {
+    printf("ERROR: %"PRIuPTR" inserts, %"PRIuPTR" evictions\n",
+           stats.inserts, stats.evictions);
+    ++errors;
+  }
+  NaClPeerCacheDtor(&pc);
+  return errors;
+}
+
+
+int ExpiryTest(void) {
+  struct NaClPeerCache      pc;
+  struct NaClPeerCacheStats stats;
+  int                       errors = 0;
+
+  printf("\nExpiryTest\n");
+  if (!NaClPeerCacheCtor(&pc, 2)) {
+    printf("ERROR: ctor failed\n");
+    return 1;
+  }
+  InsertPolicy(&pc, 1);
+  errors += ExpectLookupAt(&pc, 1, PortForIp(1), TEST_NOW + TEST_TTL - 1,
+                           1, 0);
+  errors += ExpectLookupAt(&pc, 1, PortForIp(1), TEST_NOW + TEST_TTL, 0, 0);
+
+  /* negative entries report the cached error for every port */
+  NaClPeerCacheInsertError(&pc, 2, -NACL_ABI_ECONNREFUSED, TEST_NOW, 5);
+  errors += ExpectLookupAt(&pc, 2, 80, TEST_NOW + 1,
+                           1, -NACL_ABI_ECONNREFUSED);
+  errors += ExpectLookupAt(&pc, 2, 80, TEST_NOW + 5, 0, 0);
+
+  /* a fresh answer replaces the negative entry in place */
+  InsertPolicy(&pc, 2);
+  errors += ExpectLookup(&pc, 2, PortForIp(2), 1, 1);
+
+  /* stale peer 1 is evicted ahead of recently used peer 2 */
+  errors += ExpectLookup(&pc, 2, PortForIp(2), 1, 1);
+  MakePolicy(3);
+  NaClPeerCacheInsert(&pc, &gPorts, TEST_NOW + TEST_TTL, TEST_TTL);
+  errors += ExpectLookupAt(&pc, 2, PortForIp(2), TEST_NOW + 1, 1, 0);
+  errors += ExpectLookupAt(&pc, 3, PortForIp(3), TEST_NOW + TEST_TTL, 1, 0);
+
+  NaClPeerCacheGetStats(&pc, &stats);
+  if (2 != stats.expirations || 1 != stats.evictions) {
+    printf("ERROR: %"PRIuPTR" expirations, %"PRIuPTR" evictions\n",
+           stats.expirations, stats.evictions);
+    ++errors;
+  }
+  NaClPeerCacheDtor(&pc);
+  return errors;
+}
+
+
+struct StressState {
+  struct NaClPeerCache  *pcp;
+  struct NaClMutex      mu;
+  int                   errors;
+  int                   readers_done;
+};
+
+
+static void WINAPI StressReader(void *arg) {
+  struct StressState  *ssp = (struct StressState *) arg;
+  int                 round;
+  uint32_t            ip;
+  int                 result;
+  int                 errors = 0;
+
+  for (round = 0; round < NUM_STRESS_ROUNDS; ++round) {
+    ip = 1 + round % NUM_STRESS_PEERS;
+    if (NaClPeerCacheLookup(ssp->pcp, ip, PortForIp(ip), TEST_NOW, &result)
+        && 0 != result) {
+      ++errors;
+    }
+    if (NaClPeerCacheLookup(ssp->pcp, ip, PortForIp(ip) + 1, TEST_NOW,
+                            &result)
+        && -NACL_ABI_EACCES != result) {
+      ++errors;
+    }
+  }
+  NaClXMutexLock(&ssp->mu);
+  ssp->errors += errors;
+  ++ssp->readers_done;
+  NaClXMutexUnlock(&ssp->mu);
+}
+
+
+/*
+ * Readers must never see a torn entry, i.e., a port verdict that
+ * belongs to a different peer, while the writer continually evicts.
+ */
+int StressTest(void) {
+  struct NaClPeerCache  pc;
+  struct StressState    ss;
+  struct NaClThread     thr[NUM_STRESS_READERS];
+  int                   i;
+  int                   done;
+  uint32_t              ip = 0;
+
+  printf("\nStressTest\n");
+  if (!NaClPeerCacheCtor(&pc, NUM_STRESS_PEERS / 4)) {
+    printf("ERROR: ctor failed\n");
+    return 1;
+  }
+  ss.pcp = &pc;
+  ss.errors = 0;
+  ss.readers_done = 0;
+  NaClMutexCtor(&ss.mu);
+
+  for (i = 0; i < NUM_STRESS_READERS; ++i) {
+    if (!NaClThreadCtor(&thr[i], StressReader, &ss, 128 << 10)) {
+      printf("ERROR: could not create reader thread\n");
+      return 1;
+    }
+  }
+  do {
+    ip = 1 + (ip + 7) % NUM_STRESS_PEERS;
+    InsertPolicy(&pc, ip);
+    NaClXMutexLock(&ss.mu);
+    done = (NUM_STRESS_READERS == ss.readers_done);
+    NaClXMutexUnlock(&ss.mu);
+  } while (!done);
+
+  if (0 != ss.errors) {
+    printf("ERROR: %d inconsistent lookups\n", ss.errors);
+  }
+  NaClMutexDtor(&ss.mu);
+  NaClPeerCacheDtor(&pc);
+  return ss.errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+
+  errors += BasicTest();
+  errors += EvictionTest();
+  errors += ExpiryTest();
+  errors += StressTest();
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
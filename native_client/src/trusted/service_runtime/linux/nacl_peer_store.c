@@ -0,0 +1,339 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime on-disk store of remote peer port policies.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_peer_store.h"
+
+#define NACL_PEER_STORE_READ_RETRIES 4
+
+
+/* See nacl_peer_cache.c for why these are gcc builtins. */
+static INLINE void NaClPeerStoreBarrier(void) {
+  __sync_synchronize();
+}
+
+
+static INLINE uint32_t NaClPeerStoreHash(unsigned char const  *app_hash,
+                                         uint32_t             ip) {
+  uint32_t h;
+
+  memcpy(&h, app_hash, sizeof h);
+  h = (h ^ ip) * 2654435761U;
+  return h ^ (h >> 16);
+}
+
+
+static INLINE int NaClPeerStoreStale(int64_t inserted,
+                                     int64_t expires,
+                                     int64_t now) {
+  return now < inserted || now >= expires;
+}
+
+
+/* Called with the store locked; true if s may be reused without loss. */
+static INLINE int NaClPeerStoreFreeMu(struct NaClPeerStoreSlot  *s,
+                                      int64_t                   now) {
+  return (0 == s->ip || 0 != (s->seq & 1)
+          || NaClPeerStoreStale(s->inserted, s->expires, now));
+}
+
+
+static size_t NaClPeerStoreBytes(uint32_t num_slots) {
+  return sizeof(struct NaClPeerStoreHeader)
+      + (size_t) num_slots * sizeof(struct NaClPeerStoreSlot);
+}
+
+
+/*
+ * Called with the file locked.  Lay out an empty file, or check that
+ * an existing one is ours; leaves psp mapped on success.
+ */
+static int NaClPeerStoreMapLocked(struct NaClPeerStore  *psp,
+                                  char const            *path,
+                                  uint32_t              num_slots) {
+  struct stat                 st;
+  struct NaClPeerStoreHeader  hdr;
+  void                        *map;
+  int                         fresh;
+
+  if (0 != fstat(psp->fd, &st)) {
+    NaClLog(LOG_WARNING, "NaClPeerStore: fstat %s: errno %d\n", path, errno);
+    return 0;
+  }
+  if (!S_ISREG(st.st_mode) || st.st_uid != geteuid()
+      || 0 != (st.st_mode & (S_IWGRP | S_IWOTH))) {
+    NaClLog(LOG_WARNING,
+            "NaClPeerStore: %s is not a private file owned by us; ignoring\n",
+            path);
+    return 0;
+  }
+
+  fresh = (0 == st.st_size);
+  if (fresh) {
+    if (0 != ftruncate(psp->fd, NaClPeerStoreBytes(num_slots))) {
+      NaClLog(LOG_WARNING, "NaClPeerStore: ftruncate %s: errno %d\n",
+              path, errno);
+      return 0;
+    }
+  } else {
+    if ((size_t) st.st_size < sizeof hdr
+        || sizeof hdr != pread(psp->fd, &hdr, sizeof hdr, 0)
+        || NACL_PEER_STORE_MAGIC != hdr.magic
+        || NACL_PEER_STORE_VERSION != hdr.version
+        || sizeof(struct NaClPeerStoreSlot) != hdr.slot_bytes
+        || hdr.num_slots < NACL_PEER_STORE_PROBES
+        || hdr.num_slots > NACL_PEER_STORE_MAX_SLOTS
+        || (size_t) st.st_size != NaClPeerStoreBytes(hdr.num_slots)) {
+      NaClLog(LOG_WARNING,
+              "NaClPeerStore: %s has the wrong format; ignoring\n", path);
+      return 0;
+    }
+    num_slots = hdr.num_slots;
+  }
+
+  psp->map_bytes = NaClPeerStoreBytes(num_slots);
+  map = mmap(NULL, psp->map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+             psp->fd, 0);
+  if (MAP_FAILED == map) {
+    NaClLog(LOG_WARNING, "NaClPeerStore: mmap %s: errno %d\n", path, errno);
+    return 0;
+  }
+  psp->hdr = (struct NaClPeerStoreHeader *) map;
+  psp->slots = (struct NaClPeerStoreSlot *) (psp->hdr + 1);
+  psp->num_slots = num_slots;
+
+  if (fresh) {
+    /* ftruncate zero-filled the slots; publish the header last */
+    psp->hdr->version = NACL_PEER_STORE_VERSION;
+    psp->hdr->num_slots = num_slots;
+    psp->hdr->slot_bytes = sizeof(struct NaClPeerStoreSlot);
+    NaClPeerStoreBarrier();
+    psp->hdr->magic = NACL_PEER_STORE_MAGIC;
+  }
+  return 1;
+}
+
+
+int NaClPeerStoreCtor(struct NaClPeerStore  *psp,
+                      char const            *path,
+                      uint32_t              num_slots) {
+  int ok;
+
+  if (num_slots < NACL_PEER_STORE_PROBES) {
+    num_slots = NACL_PEER_STORE_PROBES;
+  } else if (num_slots > NACL_PEER_STORE_MAX_SLOTS) {
+    num_slots = NACL_PEER_STORE_MAX_SLOTS;
+  }
+  psp->hdr = NULL;
+  psp->slots = NULL;
+  psp->num_slots = 0;
+  psp->map_bytes = 0;
+
+  if (!NaClMutexCtor(&psp->mu)) {
+    return 0;
+  }
+  psp->fd = open(path, O_RDWR | O_CREAT | O_NOFOLLOW | O_CLOEXEC, 0600);
+  if (psp->fd < 0) {
+    NaClLog(LOG_WARNING, "NaClPeerStore: open %s: errno %d\n", path, errno);
+    NaClMutexDtor(&psp->mu);
+    return 0;
+  }
+  /* whoever gets here first lays out the file */
+  if (0 != flock(psp->fd, LOCK_EX)) {
+    NaClLog(LOG_WARNING, "NaClPeerStore: flock %s: errno %d\n", path, errno);
+    ok = 0;
+  } else {
+    ok = NaClPeerStoreMapLocked(psp, path, num_slots);
+    (void) flock(psp->fd, LOCK_UN);
+  }
+  if (!ok) {
+    (void) close(psp->fd);
+    NaClMutexDtor(&psp->mu);
+    return 0;
+  }
+  return 1;
+}
+
+
+void NaClPeerStoreDtor(struct NaClPeerStore *psp) {
+  (void) munmap((void *) psp->hdr, psp->map_bytes);
+  (void) close(psp->fd);
+  NaClMutexDtor(&psp->mu);
+}
+
+
+/*
+ * Copy out slot s if it holds (app_hash, ip).  Returns 1 if it does,
+ * 0 if not, and -1 if a writer kept interfering.
+ */
+static int NaClPeerStoreReadSlot(struct NaClPeerStoreSlot      *s,
+                                 unsigned char const           *app_hash,
+                                 uint32_t                      ip,
+                                 struct NaClRemoteServerPorts  *ports,
+                                 int32_t                       *error,
+                                 int64_t                       *inserted,
+                                 int64_t                       *expires) {
+  uint32_t  seq;
+  int       match;
+  int       tries;
+
+  for (tries = 0; tries < NACL_PEER_STORE_READ_RETRIES; ++tries) {
+    seq = s->seq;
+    if (0 != (seq & 1)) {
+      continue;
+    }
+    NaClPeerStoreBarrier();
+    match = (ip == s->ip && 0 == memcmp(s->app_hash, app_hash, 20));
+    if (match) {
+      *error = s->error;
+      *inserted = s->inserted;
+      *expires = s->expires;
+      if (0 == *error) {
+        /* in bounds even if torn; see NaClPortPolicyAllows */
+        memcpy(ports, &s->policy, NaClPortPolicyBytes(&s->policy));
+      }
+    }
+    NaClPeerStoreBarrier();
+    if (seq == s->seq) {
+      return match;
+    }
+  }
+  return -1;
+}
+
+
+int NaClPeerStoreLookup(struct NaClPeerStore          *psp,
+                        unsigned char const           *app_hash,
+                        uint32_t                      ip,
+                        int64_t                       now,
+                        struct NaClRemoteServerPorts  *ports,
+                        int32_t                       *error,
+                        uint32_t                      *ttl) {
+  uint32_t  h;
+  uint32_t  i;
+  int64_t   inserted;
+  int64_t   expires;
+
+  if (0 == ip) {
+    return 0;
+  }
+  h = NaClPeerStoreHash(app_hash, ip);
+  for (i = 0; i < NACL_PEER_STORE_PROBES; ++i) {
+    switch (NaClPeerStoreReadSlot(&psp->slots[(h + i) % psp->num_slots],
+                                  app_hash, ip, ports, error,
+                                  &inserted, &expires)) {
+      case 0:
+        continue;
+      case 1:
+        if (NaClPeerStoreStale(inserted, expires, now)) {
+          return 0;
+        }
+        ports->ip = ip;
+        *ttl = (uint32_t) (expires - now);
+        return 1;
+      default:
+        /* being rewritten; the caller will ask the peer */
+        return 0;
+    }
+  }
+  return 0;
+}
+
+
+int NaClPeerStoreInsert(struct NaClPeerStore                *psp,
+                        unsigned char const                 *app_hash,
+                        uint32_t                            ip,
+                        int32_t                             error,
+                        struct NaClRemoteServerPorts const  *ports,
+                        int64_t                             now,
+                        uint32_t                            ttl) {
+  struct NaClPeerStoreSlot  *s;
+  struct NaClPeerStoreSlot  *victim = NULL;
+  uint32_t                  h;
+  uint32_t                  i;
+
+  if (0 == ip) {
+    return 0;
+  }
+  NaClXMutexLock(&psp->mu);
+  if (0 != flock(psp->fd, LOCK_EX)) {
+    NaClXMutexUnlock(&psp->mu);
+    return 0;
+  }
+
+  h = NaClPeerStoreHash(app_hash, ip);
+  for (i = 0; i < NACL_PEER_STORE_PROBES; ++i) {
+    s = &psp->slots[(h + i) % psp->num_slots];
+    if (ip == s->ip && 0 == memcmp(s->app_hash, app_hash, 20)) {
+      victim = s;
+      break;
+    }
+    if (NULL != victim && NaClPeerStoreFreeMu(victim, now)) {
+      continue;
+    }
+    if (NULL == victim || NaClPeerStoreFreeMu(s, now)
+        || s->expires < victim->expires) {
+      victim = s;
+    }
+  }
+
+  /* force the counter odd even if a dead writer left it odd */
+  victim->seq = (victim->seq + 1) | 1;
+  NaClPeerStoreBarrier();
+  victim->ip = ip;
+  memcpy(victim->app_hash, app_hash, 20);
+  victim->error = error;
+  victim->inserted = now;
+  victim->expires = now + ttl;
+  if (0 == error) {
+    memcpy(&victim->policy, ports, NaClPortPolicyBytes(ports));
+  }
+  NaClPeerStoreBarrier();
+  ++victim->seq;
+
+  (void) flock(psp->fd, LOCK_UN);
+  NaClXMutexUnlock(&psp->mu);
+  return 1;
+}
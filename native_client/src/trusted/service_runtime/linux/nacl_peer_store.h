@@ -0,0 +1,154 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime on-disk store of remote peer port policies.
+ *
+ * The in-process peer cache (nacl_peer_cache.h) starts out empty in
+ * every sel_ldr, so each new instance would otherwise repeat the
+ * validation handshake with every peer it talks to.  The store is an
+ * optional second level behind it: a fixed-size file, mapped shared
+ * by every sel_ldr on the host, that maps (application hash, peer
+ * IPv4 address) to the policy or error the peer last gave, with an
+ * expiry time.
+ *
+ * The file is a header followed by an open addressed table of slots;
+ * a key may live in any of NACL_PEER_STORE_PROBES consecutive slots
+ * starting at its hash.  Each slot carries a sequence counter that is
+ * odd while the slot is being written.  Readers take no locks: they
+ * copy a slot and retry if the counter was odd or changed.  Writers
+ * in this process are serialized by a mutex, and writers in different
+ * processes by flock() on the file.  A writer that dies mid-update
+ * leaves an odd counter, so the slot reads as empty until it is next
+ * written.
+ *
+ * Times are wall-clock seconds, since entries outlive the processes
+ * and possibly the boot that wrote them.  An entry whose insertion
+ * time is in the future is treated as stale, so setting the clock
+ * back cannot extend a policy's life.
+ *
+ * The store is trusted: anyone who can write it can grant ports to
+ * any application.  It is created mode 0600, and an existing file is
+ * only used if it is a regular file owned by the effective user.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_PEER_STORE_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_PEER_STORE_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_sync.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_PEER_STORE_MAGIC         0x4e505331  /* "NPS1" */
+#define NACL_PEER_STORE_VERSION       2
+#define NACL_PEER_STORE_DEFAULT_SLOTS 256
+#define NACL_PEER_STORE_MAX_SLOTS     (1 << 16)
+#define NACL_PEER_STORE_PROBES        8
+
+struct NaClPeerStoreHeader {
+  uint32_t  magic;  /* written last, so a half-made file is rejected */
+  uint32_t  version;
+  uint32_t  num_slots;
+  uint32_t  slot_bytes;
+  uint8_t   reserved[48];
+};
+
+struct NaClPeerStoreSlot {
+  volatile uint32_t seq;      /* odd while being written */
+  uint32_t          ip;       /* network byte order; 0 if empty */
+  int32_t           error;    /* non-zero: negative entry */
+  uint32_t          pad;
+  int64_t           inserted;
+  int64_t           expires;  /* stale once now >= expires */
+  uint8_t           app_hash[20];
+  uint8_t           pad2[12];
+  /* valid iff !error; only the first NaClPortPolicyBytes() are written */
+  struct NaClRemoteServerPorts  policy;
+};
+
+struct NaClPeerStore {
+  struct NaClMutex            mu;  /* serializes writers in this process */
+  int                         fd;
+  size_t                      map_bytes;
+  struct NaClPeerStoreHeader  *hdr;
+  struct NaClPeerStoreSlot    *slots;
+  uint32_t                    num_slots;
+};
+
+/*
+ * Open, creating if necessary, the store at path.  A new file gets
+ * num_slots slots, clamped to [NACL_PEER_STORE_PROBES,
+ * NACL_PEER_STORE_MAX_SLOTS]; an existing one keeps its size.
+ * Returns non-zero on success.  Failure is logged, and leaves the
+ * caller to run without a store.
+ */
+int NaClPeerStoreCtor(struct NaClPeerStore  *psp,
+                      char const            *path,
+                      uint32_t              num_slots) NACL_WUR;
+
+void NaClPeerStoreDtor(struct NaClPeerStore *psp);
+
+/*
+ * Look up the entry for (app_hash, ip) as of now.  Returns 0 on a
+ * miss.  On a hit returns 1, sets *error to the cached error (zero
+ * for a policy, which is then copied to *ports) and *ttl to the
+ * seconds the entry has left.
+ */
+int NaClPeerStoreLookup(struct NaClPeerStore          *psp,
+                        unsigned char const           *app_hash,
+                        uint32_t                      ip,
+                        int64_t                       now,
+                        struct NaClRemoteServerPorts  *ports,
+                        int32_t                       *error,
+                        uint32_t                      *ttl);
+
+/*
+ * Record ports (if error is zero) or error for (app_hash, ip), valid
+ * for ttl seconds from now.  Replaces the key's old entry, else an
+ * empty or stale slot, else the slot nearest expiry among the key's
+ * probe sequence.  Returns non-zero on success.
+ */
+int NaClPeerStoreInsert(struct NaClPeerStore                *psp,
+                        unsigned char const                 *app_hash,
+                        uint32_t                            ip,
+                        int32_t                             error,
+                        struct NaClRemoteServerPorts const  *ports,
+                        int64_t                             now,
+                        uint32_t                            ttl);
+
+EXTERN_C_END
+
+#endif
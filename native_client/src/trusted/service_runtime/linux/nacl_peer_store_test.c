@@ -0,0 +1,304 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the on-disk peer policy store: lookups, replacement,
+ * expiry, sharing between independent mappings, and a reader in one
+ * process racing a writer in another.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_peer_store.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+
+#define NUM_STRESS_PEERS   64
+#define NUM_STRESS_ROUNDS  20000
+
+#define TEST_NOW  1000000
+#define TEST_TTL  60
+
+static char gPath[] = "/tmp/nacl_peer_store_test.XXXXXX";
+static unsigned char gHash[20] = "application hash 01";
+static unsigned char gOtherHash[20] = "application hash 02";
+static struct NaClRemoteServerPorts gPorts;
+static struct NaClRemoteServerPorts gOut;
+
+
+/* Each test peer allows exactly one port, derived from its address. */
+static uint16_t PortForIp(uint32_t ip) {
+  return (uint16_t) (1 + (ip % 60000));
+}
+
+
+static void MakePolicy(uint32_t ip) {
+  uint16_t port = PortForIp(ip);
+
+  gPorts.ip = ip;
+  gPorts.num_ranges = 1;
+  gPorts.u.ranges[0].lo = port;
+  gPorts.u.ranges[0].hi = port;
+}
+
+
+/* Start each test from an empty file. */
+static int OpenStore(struct NaClPeerStore *psp, uint32_t num_slots) {
+  if (0 != truncate(gPath, 0)) {
+    printf("ERROR: could not truncate %s\n", gPath);
+    return 0;
+  }
+  if (!NaClPeerStoreCtor(psp, gPath, num_slots)) {
+    printf("ERROR: ctor failed\n");
+    return 0;
+  }
+  return 1;
+}
+
+
+static int ExpectLookup(struct NaClPeerStore  *psp,
+                        unsigned char const   *hash,
+                        uint32_t              ip,
+                        int64_t               now,
+                        int                   want_hit,
+                        int32_t               want_error) {
+  int32_t   error = 1;
+  uint32_t  ttl = 0;
+  uint16_t  port = PortForIp(ip);
+  int       hit;
+
+  hit = NaClPeerStoreLookup(psp, hash, ip, now, &gOut, &error, &ttl);
+  if (hit != want_hit || (hit && error != want_error)) {
+    printf("ERROR: ip 0x%08x at %"PRId64": hit %d error %d,"
+           " expected hit %d error %d\n",
+           ip, now, hit, error, want_hit, want_error);
+    return 1;
+  }
+  if (hit && 0 == error
+      && (gOut.ip != ip || !NaClPortPolicyAllows(&gOut, port))) {
+    printf("ERROR: ip 0x%08x: wrong policy\n", ip);
+    return 1;
+  }
+  return 0;
+}
+
+
+int BasicTest(void) {
+  struct NaClPeerStore  ps;
+  int                   errors = 0;
+
+  printf("\nBasicTest\n");
+  if (!OpenStore(&ps, 16)) {
+    return 1;
+  }
+  errors += ExpectLookup(&ps, gHash, 7, TEST_NOW, 0, 0);
+
+  MakePolicy(7);
+  NaClPeerStoreInsert(&ps, gHash, 7, 0, &gPorts, TEST_NOW, TEST_TTL);
+  errors += ExpectLookup(&ps, gHash, 7, TEST_NOW, 1, 0);
+  errors += ExpectLookup(&ps, gHash, 8, TEST_NOW, 0, 0);
+  /* the policy belongs to one application only */
+  errors += ExpectLookup(&ps, gOtherHash, 7, TEST_NOW, 0, 0);
+
+  /* replacing the entry takes effect immediately */
+  NaClPeerStoreInsert(&ps, gHash, 7, -NACL_ABI_ECONNREFUSED, NULL,
+                      TEST_NOW, TEST_TTL);
+  errors += ExpectLookup(&ps, gHash, 7, TEST_NOW, 1, -NACL_ABI_ECONNREFUSED);
+
+  NaClPeerStoreDtor(&ps);
+  return errors;
+}
+
+
+int ExpiryTest(void) {
+  struct NaClPeerStore  ps;
+  int32_t               error;
+  uint32_t              ttl = 0;
+  uint32_t              ip;
+  int                   errors = 0;
+
+  printf("\nExpiryTest\n");
+  if (!OpenStore(&ps, NACL_PEER_STORE_PROBES)) {
+    return 1;
+  }
+  MakePolicy(1);
+  NaClPeerStoreInsert(&ps, gHash, 1, 0, &gPorts, TEST_NOW, TEST_TTL);
+  if (!NaClPeerStoreLookup(&ps, gHash, 1, TEST_NOW + 10, &gOut, &error, &ttl)
+      || TEST_TTL - 10 != ttl) {
+    printf("ERROR: remaining ttl %u\n", ttl);
+    ++errors;
+  }
+  errors += ExpectLookup(&ps, gHash, 1, TEST_NOW + TEST_TTL, 0, 0);
+  /* a clock set back to before the insertion does not revive it */
+  errors += ExpectLookup(&ps, gHash, 1, TEST_NOW - 1, 0, 0);
+
+  /*
+   * Every key probes the whole table.  Filling it with live entries
+   * makes the next insert replace the one nearest expiry, peer 2.
+   */
+  for (ip = 2; ip < 2 + NACL_PEER_STORE_PROBES; ++ip) {
+    MakePolicy(ip);
+    NaClPeerStoreInsert(&ps, gHash, ip, 0, &gPorts, TEST_NOW, TEST_TTL + ip);
+  }
+  MakePolicy(100);
+  NaClPeerStoreInsert(&ps, gHash, 100, 0, &gPorts, TEST_NOW, TEST_TTL);
+  errors += ExpectLookup(&ps, gHash, 2, TEST_NOW, 0, 0);
+  errors += ExpectLookup(&ps, gHash, 3, TEST_NOW, 1, 0);
+  errors += ExpectLookup(&ps, gHash, 100, TEST_NOW, 1, 0);
+
+  NaClPeerStoreDtor(&ps);
+  return errors;
+}
+
+
+int SharingTest(void) {
+  struct NaClPeerStore  ps;
+  struct NaClPeerStore  other;
+  int                   errors = 0;
+
+  printf("\nSharingTest\n");
+  if (!OpenStore(&ps, 16)) {
+    return 1;
+  }
+  /* a second opener adopts the existing size */
+  if (!NaClPeerStoreCtor(&other, gPath, 1024)) {
+    printf("ERROR: second ctor failed\n");
+    NaClPeerStoreDtor(&ps);
+    return 1;
+  }
+  if (other.num_slots != ps.num_slots) {
+    printf("ERROR: second mapping has %u slots\n", other.num_slots);
+    ++errors;
+  }
+  MakePolicy(9);
+  NaClPeerStoreInsert(&ps, gHash, 9, 0, &gPorts, TEST_NOW, TEST_TTL);
+  errors += ExpectLookup(&other, gHash, 9, TEST_NOW, 1, 0);
+
+  NaClPeerStoreDtor(&other);
+  NaClPeerStoreDtor(&ps);
+  return errors;
+}
+
+
+/*
+ * A reader must never see a torn slot, i.e., a policy belonging to a
+ * different peer, while a writer in another process churns entries.
+ */
+int StressTest(void) {
+  struct NaClPeerStore  ps;
+  pid_t                 pid;
+  int                   status;
+  int                   round;
+  uint32_t              ip;
+  int32_t               error;
+  uint32_t              ttl;
+  int                   errors = 0;
+
+  printf("\nStressTest\n");
+  if (!OpenStore(&ps, NUM_STRESS_PEERS / 4)) {
+    return 1;
+  }
+  fflush(stdout);
+  pid = fork();
+  if (pid < 0) {
+    printf("ERROR: fork failed\n");
+    NaClPeerStoreDtor(&ps);
+    return 1;
+  }
+  if (0 == pid) {
+    for (round = 0; round < NUM_STRESS_ROUNDS; ++round) {
+      ip = 1 + (round * 7) % NUM_STRESS_PEERS;
+      MakePolicy(ip);
+      NaClPeerStoreInsert(&ps, gHash, ip, 0, &gPorts, TEST_NOW, TEST_TTL);
+    }
+    _exit(0);
+  }
+  for (round = 0; round < NUM_STRESS_ROUNDS; ++round) {
+    ip = 1 + round % NUM_STRESS_PEERS;
+    if (NaClPeerStoreLookup(&ps, gHash, ip, TEST_NOW, &gOut, &error, &ttl)
+        && (0 != error || gOut.ip != ip
+            || !NaClPortPolicyAllows(&gOut, PortForIp(ip)))) {
+      ++errors;
+    }
+  }
+  if (0 != errors) {
+    printf("ERROR: %d inconsistent lookups\n", errors);
+  }
+  if (pid != waitpid(pid, &status, 0) || !WIFEXITED(status)
+      || 0 != WEXITSTATUS(status)) {
+    printf("ERROR: writer failed\n");
+    ++errors;
+  }
+  NaClPeerStoreDtor(&ps);
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+  int fd;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+
+  if ((fd = mkstemp(gPath)) < 0) {
+    printf("ERROR: could not create a temporary file\n");
+    return 1;
+  }
+  close(fd);
+
+  errors += BasicTest();
+  errors += ExpiryTest();
+  errors += SharingTest();
+  errors += StressTest();
+
+  unlink(gPath);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
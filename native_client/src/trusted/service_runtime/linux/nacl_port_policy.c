@@ -0,0 +1,144 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime representation of a remote peer's port policy.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_port_policy.h"
+
+
+size_t NaClPortPolicyBytes(struct NaClRemoteServerPorts const *p) {
+  uint32_t  n = *(uint32_t const volatile *) &p->num_ranges;
+
+  if (NACL_PORT_POLICY_BITMAP == n || n > NACL_PORT_POLICY_MAX_RANGES) {
+    return sizeof *p;
+  }
+  return offsetof(struct NaClRemoteServerPorts, u)
+      + n * sizeof(struct NaClPortRange);
+}
+
+
+int NaClPortPolicyAllows(struct NaClRemoteServerPorts const *p,
+                         uint16_t                           port) {
+  uint32_t  n = *(uint32_t const volatile *) &p->num_ranges;  /* once */
+  uint32_t  lo;
+  uint32_t  hi;
+  uint32_t  mid;
+
+  if (NACL_PORT_POLICY_BITMAP == n) {
+    return 0 != (p->u.bitmap[port / 8] & (1 << (port % 8)));
+  }
+  if (n > NACL_PORT_POLICY_MAX_RANGES) {
+    return 0;
+  }
+  /* first range with hi >= port */
+  lo = 0;
+  hi = n;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (p->u.ranges[mid].hi < port) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < n && p->u.ranges[lo].lo <= port;
+}
+
+
+void NaClPortPolicySetBitmap(struct NaClRemoteServerPorts *p,
+                             uint8_t const                *bitmap,
+                             size_t                       bitmap_bytes) {
+  uint32_t  port;
+  uint32_t  n = 0;
+  int       in_run = 0;
+  int       bit;
+
+  if (bitmap_bytes > NACL_PORT_POLICY_BITMAP_BYTES) {
+    bitmap_bytes = NACL_PORT_POLICY_BITMAP_BYTES;
+  }
+  /*
+   * Build ranges in place while they fit; the union means the ranges
+   * must stop short of the bitmap, so fall back as soon as they would
+   * not be smaller.
+   */
+  for (port = 0; port < 8 * bitmap_bytes; ++port) {
+    bit = 0 != (bitmap[port / 8] & (1 << (port % 8)));
+    if (bit && !in_run) {
+      if (n + 1 >= NACL_PORT_POLICY_MAX_RANGES) {
+        p->num_ranges = NACL_PORT_POLICY_BITMAP;
+        memcpy(p->u.bitmap, bitmap, bitmap_bytes);
+        memset(p->u.bitmap + bitmap_bytes, 0,
+               NACL_PORT_POLICY_BITMAP_BYTES - bitmap_bytes);
+        return;
+      }
+      p->u.ranges[n].lo = (uint16_t) port;
+      ++n;
+    }
+    if (bit) {
+      p->u.ranges[n - 1].hi = (uint16_t) port;
+    }
+    in_run = bit;
+  }
+  p->num_ranges = n;
+}
+
+
+int NaClPortPolicySetRanges(struct NaClRemoteServerPorts  *p,
+                            uint8_t const                 *ranges,
+                            uint32_t                      num_ranges) {
+  uint32_t  i;
+  uint32_t  lo;
+  uint32_t  hi;
+  uint32_t  prev_hi = 0;
+
+  if (num_ranges > NACL_PORT_POLICY_MAX_RANGES) {
+    p->num_ranges = 0;
+    return -1;
+  }
+  for (i = 0; i < num_ranges; ++i) {
+    lo = (ranges[4 * i] << 8) | ranges[4 * i + 1];
+    hi = (ranges[4 * i + 2] << 8) | ranges[4 * i + 3];
+    if (lo > hi || (i > 0 && lo <= prev_hi)) {
+      p->num_ranges = 0;
+      return -1;
+    }
+    p->u.ranges[i].lo = (uint16_t) lo;
+    p->u.ranges[i].hi = (uint16_t) hi;
+    prev_hi = hi;
+  }
+  p->num_ranges = num_ranges;
+  return 0;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime representation of a remote peer's port policy.
+ *
+ * A validation server (see nacl_socks_client.h) tells us which ports
+ * on its host an application may use.  Most servers allow a handful
+ * of ports, so a policy is normally held as a sorted array of
+ * disjoint, inclusive port ranges and checked by binary search; only
+ * when the ranges would take more room than a bitmap of all 65536
+ * ports is the bitmap kept instead.
+ *
+ * The representation is a prefix of struct NaClRemoteServerPorts:
+ * the first NaClPortPolicyBytes(p) bytes hold the whole policy, so
+ * caches may keep a copy of just that many bytes.  Such a copy must
+ * only be accessed through the functions below.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_PORT_POLICY_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_PORT_POLICY_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_PORT_POLICY_BITMAP_BYTES (65536 / 8)
+#define NACL_PORT_POLICY_MAX_RANGES   (NACL_PORT_POLICY_BITMAP_BYTES / 4)
+
+/* num_ranges value marking a bitmap policy */
+#define NACL_PORT_POLICY_BITMAP       0xffffffffU
+
+struct NaClPortRange {
+  uint16_t  lo;  /* inclusive, host byte order */
+  uint16_t  hi;
+};
+
+struct NaClRemoteServerPorts {
+  uint32_t  ip;          /* network byte order */
+  uint32_t  num_ranges;  /* or NACL_PORT_POLICY_BITMAP */
+  union {
+    struct NaClPortRange  ranges[NACL_PORT_POLICY_MAX_RANGES];
+    uint8_t               bitmap[NACL_PORT_POLICY_BITMAP_BYTES];
+  } u;
+};
+
+/*
+ * Number of leading bytes of *p that hold the policy.
+ */
+size_t NaClPortPolicyBytes(struct NaClRemoteServerPorts const *p);
+
+/*
+ * Returns non-zero if port (host byte order) is allowed.  Reads at
+ * most NaClPortPolicyBytes(p) bytes, re-reading num_ranges only once,
+ * so it may be run on a copy that is concurrently overwritten with
+ * policies that fit in the same space; the answer is then garbage but
+ * the reads stay in bounds.
+ */
+int NaClPortPolicyAllows(struct NaClRemoteServerPorts const *p,
+                         uint16_t                           port);
+
+/*
+ * Set *p to the ports whose bits are set in bitmap (bit port % 8 of
+ * byte port / 8).  Ports past the first bitmap_bytes bytes are
+ * denied.  Picks ranges unless the bitmap is denser.  bitmap must not
+ * overlap *p.
+ */
+void NaClPortPolicySetBitmap(struct NaClRemoteServerPorts *p,
+                             uint8_t const                *bitmap,
+                             size_t                       bitmap_bytes);
+
+/*
+ * Set *p from num_ranges (lo, hi) pairs of 16-bit network byte order
+ * ports, as sent in a version 2 handshake reply.  Ranges must be
+ * sorted, disjoint and have lo <= hi.  Returns 0 on success, -1 if
+ * the ranges are malformed, in which case *p denies everything.
+ */
+int NaClPortPolicySetRanges(struct NaClRemoteServerPorts  *p,
+                            uint8_t const                 *ranges,
+                            uint32_t                      num_ranges);
+
+EXTERN_C_END
+
+#endif
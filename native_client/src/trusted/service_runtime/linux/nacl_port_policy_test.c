@@ -0,0 +1,231 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise port policies: choosing ranges or a bitmap, range lookup
+ * at the edges of the port space, and parsing both handshake reply
+ * versions into a policy.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_port_policy.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+
+#define TEST_IP     0x0100007f
+#define TEST_NONCE  (NACL_VALIDATE_VERSION << 24)
+
+static uint8_t gBitmap[NACL_PORT_POLICY_BITMAP_BYTES];
+static char gReply[NACL_VALIDATE_RESP_MAX_BYTES];
+static struct NaClRemoteServerPorts gPolicy;
+
+
+static void SetBit(uint8_t *bitmap, uint32_t port) {
+  bitmap[port / 8] |= 1 << (port % 8);
+}
+
+
+/* Check gPolicy against the ports set in gBitmap. */
+static int ExpectBitmap(char const *what) {
+  uint32_t  port;
+  int       want;
+
+  for (port = 0; port < 65536; ++port) {
+    want = 0 != (gBitmap[port / 8] & (1 << (port % 8)));
+    if (want != NaClPortPolicyAllows(&gPolicy, (uint16_t) port)) {
+      printf("ERROR: %s: port %u is %s\n", what, port,
+             want ? "denied" : "allowed");
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+int BitmapTest(void) {
+  uint32_t  port;
+  int       errors = 0;
+
+  printf("\nBitmapTest\n");
+
+  /* a few ports, including both ends of the range, become ranges */
+  memset(gBitmap, 0, sizeof gBitmap);
+  SetBit(gBitmap, 0);
+  SetBit(gBitmap, 80);
+  SetBit(gBitmap, 443);
+  for (port = 8000; port < 8100; ++port) {
+    SetBit(gBitmap, port);
+  }
+  SetBit(gBitmap, 65535);
+  NaClPortPolicySetBitmap(&gPolicy, gBitmap, sizeof gBitmap);
+  if (5 != gPolicy.num_ranges || 28 != NaClPortPolicyBytes(&gPolicy)) {
+    printf("ERROR: %u ranges in %u bytes\n", gPolicy.num_ranges,
+           (unsigned) NaClPortPolicyBytes(&gPolicy));
+    ++errors;
+  }
+  errors += ExpectBitmap("sparse");
+
+  /* alternating ports would need more room as ranges */
+  memset(gBitmap, 0x55, sizeof gBitmap);
+  NaClPortPolicySetBitmap(&gPolicy, gBitmap, sizeof gBitmap);
+  if (NACL_PORT_POLICY_BITMAP != gPolicy.num_ranges) {
+    printf("ERROR: dense policy kept as %u ranges\n", gPolicy.num_ranges);
+    ++errors;
+  }
+  errors += ExpectBitmap("dense");
+
+  /* a short bitmap denies everything past its end */
+  memset(gBitmap, 0xff, sizeof gBitmap);
+  NaClPortPolicySetBitmap(&gPolicy, gBitmap, 2);
+  memset(gBitmap + 2, 0, sizeof gBitmap - 2);
+  if (1 != gPolicy.num_ranges) {
+    printf("ERROR: short bitmap gave %u ranges\n", gPolicy.num_ranges);
+    ++errors;
+  }
+  errors += ExpectBitmap("short");
+  return errors;
+}
+
+
+static void PutWord(char *buf, uint32_t i, uint32_t w) {
+  w = htonl(w);
+  memcpy(buf + 4 * i, &w, 4);
+}
+
+
+static void PutRange(char *buf, uint32_t i, uint16_t lo, uint16_t hi) {
+  lo = htons(lo);
+  hi = htons(hi);
+  memcpy(buf + NACL_VALIDATE_REPLY_V2_HDR_BYTES + 4 * i, &lo, 2);
+  memcpy(buf + NACL_VALIDATE_REPLY_V2_HDR_BYTES + 4 * i + 2, &hi, 2);
+}
+
+
+static int ExpectParse(uint32_t len, int want_ok, char const *what) {
+  int ok;
+
+  ok = (0 == ParseNaClHashResp(gReply, len, TEST_IP, &gPolicy, TEST_NONCE));
+  if (ok != want_ok || (ok && TEST_IP != gPolicy.ip)) {
+    printf("ERROR: %s: parse %s\n", what, ok ? "succeeded" : "failed");
+    return 1;
+  }
+  if (len != NaClHashRespBytes(gReply, len)) {
+    printf("ERROR: %s: reply is %u bytes, expected %u\n", what, len,
+           NaClHashRespBytes(gReply, len));
+    return 1;
+  }
+  return ok ? ExpectBitmap(what) : 0;
+}
+
+
+int ReplyTest(void) {
+  int errors = 0;
+
+  printf("\nReplyTest\n");
+
+  /* version 1 */
+  memset(gReply, 0, sizeof gReply);
+  memset(gBitmap, 0, sizeof gBitmap);
+  PutWord(gReply, 1, TEST_NONCE);
+  SetBit((uint8_t *) gReply + 8, 22);
+  SetBit(gBitmap, 22);
+  errors += ExpectParse(NACL_VALIDATE_RESP_BYTES, 1, "v1");
+  PutWord(gReply, 1, 0);
+  errors += ExpectParse(NACL_VALIDATE_RESP_BYTES, 1, "v1 without version");
+  PutWord(gReply, 0, 1);
+  errors += ExpectParse(NACL_VALIDATE_RESP_BYTES, 0, "v1 refused");
+
+  /* version 2 ranges */
+  memset(gReply, 0, sizeof gReply);
+  memset(gBitmap, 0, sizeof gBitmap);
+  PutWord(gReply, 0, NACL_VALIDATE_REPLY_V2_MAGIC);
+  PutWord(gReply, 2, TEST_NONCE);
+  PutWord(gReply, 3, 2);
+  PutRange(gReply, 0, 80, 80);
+  PutRange(gReply, 1, 1024, 65535);
+  SetBit(gBitmap, 80);
+  memset(gBitmap + 128, 0xff, sizeof gBitmap - 128);
+  errors += ExpectParse(NACL_VALIDATE_REPLY_V2_HDR_BYTES + 8, 1, "v2 ranges");
+  if (NaClHashRespBytes(gReply, NACL_VALIDATE_REPLY_V2_HDR_BYTES - 1)
+      != NACL_VALIDATE_RESP_MAX_BYTES) {
+    printf("ERROR: reply length known before the header is complete\n");
+    ++errors;
+  }
+
+  /* overlapping or backwards ranges are rejected */
+  PutRange(gReply, 1, 80, 90);
+  errors += ExpectParse(NACL_VALIDATE_REPLY_V2_HDR_BYTES + 8, 0,
+                        "v2 overlapping");
+  PutRange(gReply, 1, 90, 85);
+  errors += ExpectParse(NACL_VALIDATE_REPLY_V2_HDR_BYTES + 8, 0,
+                        "v2 backwards");
+
+  /* version 2 bitmap */
+  memset(gBitmap, 0x33, sizeof gBitmap);
+  PutWord(gReply, 3, NACL_PORT_POLICY_BITMAP);
+  memcpy(gReply + NACL_VALIDATE_REPLY_V2_HDR_BYTES, gBitmap, sizeof gBitmap);
+  errors += ExpectParse(NACL_VALIDATE_RESP_MAX_BYTES, 1, "v2 bitmap");
+
+  /* wrong nonce */
+  PutWord(gReply, 2, TEST_NONCE + 1);
+  errors += ExpectParse(NACL_VALIDATE_RESP_MAX_BYTES, 0, "v2 nonce");
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+
+  errors += BitmapTest();
+  errors += ReplyTest();
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
@@ -0,0 +1,870 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime name resolver.
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "native_client/src/shared/platform/nacl_global_secure_random.h"
+#include "native_client/src/shared/platform/nacl_host_desc.h"
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_resolver.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+#include "native_client/src/trusted/service_runtime/nacl_config.h"
+
+
+#define NACL_DNS_PORT         53
+#define NACL_DNS_HDR_BYTES    12
+#define NACL_DNS_MAX_MSG      512   /* what a server sends over UDP */
+#define NACL_DNS_TYPE_A       1
+#define NACL_DNS_CLASS_IN     1
+#define NACL_DNS_FLAG_QR      0x8000
+#define NACL_DNS_FLAG_RD      0x0100
+#define NACL_DNS_RCODE_MASK   0x000f
+#define NACL_DNS_NXDOMAIN     3
+#define NACL_DNS_MAX_LABEL    63
+
+#define NACL_RESOLVER_MAX_PREWARM  4  /* handshake threads in flight */
+
+
+static INLINE void NaClResolverCount(uintptr_t *counter) {
+  __sync_fetch_and_add(counter, 1);
+}
+
+
+static uint64_t NaClResolverMilliTime(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static unsigned long NaClResolverEnv(const char *name, unsigned long dflt) {
+  char *env;
+
+  if (NULL != (env = getenv(name))) {
+    return strtoul(env, (char **) 0, 0);
+  }
+  return dflt;
+}
+
+
+/*
+ * Parses "ip[:port]", len bytes at s.
+ */
+static int NaClResolverParseServer(char const          *s,
+                                   size_t              len,
+                                   struct sockaddr_in  *sa) {
+  char          buf[32];
+  char          *colon;
+  char          *end;
+  unsigned long port = NACL_DNS_PORT;
+
+  if (len >= sizeof buf) {
+    return 0;
+  }
+  memcpy(buf, s, len);
+  buf[len] = '\0';
+  if (NULL != (colon = strchr(buf, ':'))) {
+    *colon = '\0';
+    port = strtoul(colon + 1, &end, 10);
+    if ('\0' != *end || 0 == port || port > 0xffff) {
+      return 0;
+    }
+  }
+  memset(sa, 0, sizeof *sa);
+  sa->sin_family = AF_INET;
+  sa->sin_port = htons((uint16_t) port);
+  return 1 == inet_pton(AF_INET, buf, &sa->sin_addr);
+}
+
+
+void NaClResolverConfigFromEnv(struct NaClResolverConfig *config) {
+  char const  *env;
+  char const  *p;
+  char const  *end;
+  FILE        *f;
+  char        line[256];
+  char        addr[64];
+
+  memset(config, 0, sizeof *config);
+  if (NULL != (env = getenv("NACL_RESOLVER_SERVERS"))) {
+    for (p = env; '\0' != *p; p = end + (',' == *end)) {
+      if (NULL == (end = strchr(p, ','))) {
+        end = p + strlen(p);
+      }
+      if (config->nservers == NACL_RESOLVER_MAX_SERVERS) {
+        NaClLog(LOG_WARNING, "NACL_RESOLVER_SERVERS: using the first %d\n",
+                NACL_RESOLVER_MAX_SERVERS);
+        break;
+      }
+      if (NaClResolverParseServer(p, end - p,
+                                  &config->servers[config->nservers])) {
+        ++config->nservers;
+      } else {
+        NaClLog(LOG_WARNING, "NACL_RESOLVER_SERVERS: bad entry \"%.*s\"\n",
+                (int) (end - p), p);
+      }
+    }
+  } else {
+    if (NULL == (env = getenv("NACL_RESOLVER_CONF"))) {
+      env = "/etc/resolv.conf";
+    }
+    if (NULL != (f = fopen(env, "r"))) {
+      /* IPv6 nameservers fail to parse and are skipped */
+      while (config->nservers < NACL_RESOLVER_MAX_SERVERS
+             && NULL != fgets(line, sizeof line, f)) {
+        if (1 == sscanf(line, " nameserver %63s", addr)
+            && NaClResolverParseServer(addr, strlen(addr),
+                                       &config->servers[config->nservers])) {
+          ++config->nservers;
+        }
+      }
+      fclose(f);
+    }
+  }
+  if (NULL == (env = getenv("NACL_RESOLVER_HOSTS"))) {
+    env = "/etc/hosts";
+  }
+  snprintf(config->hosts_path, sizeof config->hosts_path, "%s", env);
+
+  config->entries = NaClResolverEnv("NACL_RESOLVER_ENTRIES",
+                                    NACL_RESOLVER_DEFAULT_ENTRIES);
+  config->min_ttl = NaClResolverEnv("NACL_RESOLVER_MIN_TTL",
+                                    NACL_RESOLVER_DEFAULT_MIN_TTL);
+  config->max_ttl = NaClResolverEnv("NACL_RESOLVER_MAX_TTL",
+                                    NACL_RESOLVER_DEFAULT_MAX_TTL);
+  config->neg_ttl = NaClResolverEnv("NACL_RESOLVER_NEG_TTL",
+                                    NACL_RESOLVER_DEFAULT_NEG_TTL);
+  config->timeout_ms = NaClResolverEnv("NACL_RESOLVER_TIMEOUT_MS",
+                                       NACL_RESOLVER_DEFAULT_TIMEOUT_MS);
+  config->attempts = NaClResolverEnv("NACL_RESOLVER_ATTEMPTS",
+                                     NACL_RESOLVER_DEFAULT_ATTEMPTS);
+}
+
+
+int NaClResolverCtor(struct NaClResolver              *self,
+                     struct NaClResolverConfig const  *config) {
+  uint32_t nbuckets;
+
+  memset(self, 0, sizeof *self);
+  self->config = *config;
+  if (0 == self->config.entries) {
+    self->config.entries = 1;
+  } else if (self->config.entries > NACL_RESOLVER_MAX_ENTRIES) {
+    self->config.entries = NACL_RESOLVER_MAX_ENTRIES;
+  }
+  if (self->config.max_ttl < self->config.min_ttl) {
+    self->config.max_ttl = self->config.min_ttl;
+  }
+  if (0 == self->config.attempts) {
+    self->config.attempts = 1;
+  }
+  for (nbuckets = 1; nbuckets < self->config.entries; nbuckets <<= 1) {
+  }
+  self->bucket_mask = nbuckets - 1;
+  self->buckets = calloc(nbuckets, sizeof *self->buckets);
+  self->entries = calloc(self->config.entries, sizeof *self->entries);
+  if (NULL == self->buckets || NULL == self->entries) {
+    goto cleanup_tables;
+  }
+  if (!NaClMutexCtor(&self->mu)) {
+    goto cleanup_tables;
+  }
+  if (!NaClCondVarCtor(&self->cv)) {
+    goto cleanup_mu;
+  }
+  return 1;
+
+ cleanup_mu:
+  NaClMutexDtor(&self->mu);
+ cleanup_tables:
+  free(self->entries);
+  free(self->buckets);
+  return 0;
+}
+
+
+void NaClResolverDtor(struct NaClResolver *self) {
+  NaClCondVarDtor(&self->cv);
+  NaClMutexDtor(&self->mu);
+  free(self->entries);
+  free(self->buckets);
+  self->entries = NULL;
+  self->buckets = NULL;
+}
+
+
+void NaClResolverGetStats(struct NaClResolver       *self,
+                          struct NaClResolverStats  *stats) {
+  NaClXMutexLock(&self->mu);
+  *stats = self->stats;
+  NaClXMutexUnlock(&self->mu);
+}
+
+
+/*
+ * Lowercases name into canon without one trailing dot, checking that
+ * it is a host name: labels of 1 to 63 letters, digits, '-' or '_'.
+ */
+static int NaClResolverCanonName(char const *name, char *canon) {
+  size_t  len = strlen(name);
+  size_t  i;
+  size_t  label = 0;
+  int     c;
+
+  if (len > 0 && '.' == name[len - 1]) {
+    --len;
+  }
+  if (0 == len || len > NACL_RESOLVER_MAX_NAME) {
+    return 0;
+  }
+  for (i = 0; i < len; ++i) {
+    c = (unsigned char) name[i];
+    if ('.' == c) {
+      if (0 == label) {
+        return 0;
+      }
+      label = 0;
+    } else {
+      if (!isalnum(c) && '-' != c && '_' != c) {
+        return 0;
+      }
+      if (++label > NACL_DNS_MAX_LABEL) {
+        return 0;
+      }
+    }
+    canon[i] = (char) tolower(c);
+  }
+  canon[len] = '\0';
+  return 0 != label;
+}
+
+
+static uint32_t NaClResolverHash(char const *name) {
+  uint32_t h = 2166136261u;  /* FNV-1a */
+
+  while ('\0' != *name) {
+    h = (h ^ (unsigned char) *name++) * 16777619u;
+  }
+  return h;
+}
+
+
+static void NaClResolverAddAddr(uint32_t  *addrs,
+                                uint32_t  *naddrs,
+                                uint32_t  max,
+                                uint32_t  addr) {
+  uint32_t i;
+
+  for (i = 0; i < *naddrs; ++i) {
+    if (addrs[i] == addr) {
+      return;
+    }
+  }
+  if (*naddrs < max) {
+    addrs[(*naddrs)++] = addr;
+  }
+}
+
+
+/*
+ * Scans the hosts file for name; returns how many addresses it found.
+ * The file is small and only read on a cache miss, so it is not kept.
+ */
+static uint32_t NaClResolverHosts(char const  *path,
+                                  char const  *name,
+                                  uint32_t    *addrs) {
+  FILE            *f;
+  char            line[512];
+  char            *tok;
+  char            *save;
+  struct in_addr  a;
+  uint32_t        n = 0;
+
+  if ('\0' == path[0] || NULL == (f = fopen(path, "r"))) {
+    return 0;
+  }
+  while (n < NACL_RESOLVER_MAX_ADDRS && NULL != fgets(line, sizeof line, f)) {
+    if (NULL != (tok = strchr(line, '#'))) {
+      *tok = '\0';
+    }
+    tok = strtok_r(line, " \t\r\n", &save);
+    if (NULL == tok || 1 != inet_pton(AF_INET, tok, &a)) {
+      continue;
+    }
+    while (NULL != (tok = strtok_r(NULL, " \t\r\n", &save))) {
+      if (0 == strcasecmp(tok, name)) {
+        NaClResolverAddAddr(addrs, &n, NACL_RESOLVER_MAX_ADDRS, a.s_addr);
+        break;
+      }
+    }
+  }
+  fclose(f);
+  return n;
+}
+
+
+/*
+ * Builds a recursive query for name's A records; returns its length.
+ * name has been through NaClResolverCanonName, so it fits.
+ */
+static size_t NaClDnsQuery(unsigned char *buf, uint16_t id, char const *name) {
+  size_t      n = NACL_DNS_HDR_BYTES;
+  size_t      len;
+  char const  *dot;
+
+  memset(buf, 0, NACL_DNS_HDR_BYTES);
+  buf[0] = (unsigned char) (id >> 8);
+  buf[1] = (unsigned char) id;
+  buf[2] = NACL_DNS_FLAG_RD >> 8;
+  buf[5] = 1;  /* one question */
+  for (;;) {
+    dot = strchr(name, '.');
+    len = (NULL != dot) ? (size_t) (dot - name) : strlen(name);
+    buf[n++] = (unsigned char) len;
+    memcpy(&buf[n], name, len);
+    n += len;
+    if (NULL == dot) {
+      break;
+    }
+    name = dot + 1;
+  }
+  buf[n++] = 0;
+  buf[n++] = 0;
+  buf[n++] = NACL_DNS_TYPE_A;
+  buf[n++] = 0;
+  buf[n++] = NACL_DNS_CLASS_IN;
+  return n;
+}
+
+
+static uint32_t NaClDnsGet16(unsigned char const *p) {
+  return ((uint32_t) p[0] << 8) | p[1];
+}
+
+
+static uint32_t NaClDnsGet32(unsigned char const *p) {
+  return (NaClDnsGet16(p) << 16) | NaClDnsGet16(p + 2);
+}
+
+
+static int NaClDnsSkipName(unsigned char const  *msg,
+                           size_t               len,
+                           size_t               *off) {
+  size_t o = *off;
+
+  for (;;) {
+    if (o >= len) {
+      return 0;
+    }
+    if (0 == msg[o]) {
+      *off = o + 1;
+      return 1;
+    }
+    if (0xc0 == (msg[o] & 0xc0)) {  /* compression pointer ends the name */
+      if (o + 2 > len) {
+        return 0;
+      }
+      *off = o + 2;
+      return 1;
+    }
+    if (0 != (msg[o] & 0xc0)) {
+      return 0;
+    }
+    o += 1 + msg[o];
+  }
+}
+
+
+/*
+ * Returns 0 if msg is not a reply to query.  Otherwise sets *error to
+ * 0 and fills addrs, *naddrs and *ttl (the smallest of the answers'),
+ * or sets *error to -NACL_ABI_ENOENT if the name has no A records or
+ * -NACL_ABI_EIO if the server failed.
+ */
+static int NaClDnsParse(unsigned char const  *msg,
+                        size_t               len,
+                        unsigned char const  *query,
+                        size_t               qlen,
+                        uint32_t             *addrs,
+                        uint32_t             *naddrs,
+                        uint32_t             *ttl,
+                        int32_t              *error) {
+  uint32_t  flags;
+  uint32_t  nanswers;
+  uint32_t  i;
+  uint32_t  type;
+  uint32_t  klass;
+  uint32_t  rttl;
+  uint32_t  rdlen;
+  uint32_t  addr;
+  size_t    off;
+
+  if (len < qlen || msg[0] != query[0] || msg[1] != query[1]) {
+    return 0;
+  }
+  flags = NaClDnsGet16(&msg[2]);
+  if (0 == (flags & NACL_DNS_FLAG_QR) || 1 != NaClDnsGet16(&msg[4])) {
+    return 0;
+  }
+  /* The question must be echoed back; servers may change its case */
+  for (off = NACL_DNS_HDR_BYTES; off < qlen; ++off) {
+    if (tolower(msg[off]) != query[off]) {
+      return 0;
+    }
+  }
+  if (NACL_DNS_NXDOMAIN == (flags & NACL_DNS_RCODE_MASK)) {
+    *error = -NACL_ABI_ENOENT;
+    return 1;
+  }
+  if (0 != (flags & NACL_DNS_RCODE_MASK)) {
+    *error = -NACL_ABI_EIO;
+    return 1;
+  }
+  nanswers = NaClDnsGet16(&msg[6]);
+  *naddrs = 0;
+  *ttl = ~(uint32_t) 0;
+  for (i = 0; i < nanswers; ++i) {
+    if (!NaClDnsSkipName(msg, len, &off) || off + 10 > len) {
+      break;
+    }
+    type = NaClDnsGet16(&msg[off]);
+    klass = NaClDnsGet16(&msg[off + 2]);
+    rttl = NaClDnsGet32(&msg[off + 4]);
+    rdlen = NaClDnsGet16(&msg[off + 8]);
+    off += 10;
+    if (off + rdlen > len) {
+      break;
+    }
+    /* CNAMEs are followed by the server; take the A records it added */
+    if (NACL_DNS_TYPE_A == type && NACL_DNS_CLASS_IN == klass && 4 == rdlen) {
+      memcpy(&addr, &msg[off], sizeof addr);
+      NaClResolverAddAddr(addrs, naddrs, NACL_RESOLVER_MAX_ADDRS, addr);
+      if (rttl < *ttl) {
+        *ttl = rttl;
+      }
+    }
+    off += rdlen;
+  }
+  *error = (0 == *naddrs) ? -NACL_ABI_ENOENT : 0;
+  return 1;
+}
+
+
+static int NaClResolverFromServer(struct NaClResolverConfig const *config,
+                                  struct sockaddr_in const        *from) {
+  uint32_t i;
+
+  for (i = 0; i < config->nservers; ++i) {
+    if (config->servers[i].sin_addr.s_addr == from->sin_addr.s_addr
+        && config->servers[i].sin_port == from->sin_port) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+/*
+ * Asks every server at once, resending after each timeout_ms, and
+ * takes the first answer.  A server failure only counts once every
+ * server has failed, since another may still answer.
+ */
+static int32_t NaClResolverQuery(struct NaClResolver  *self,
+                                 char const           *name,
+                                 uint32_t             *addrs,
+                                 uint32_t             *naddrs,
+                                 uint32_t             *ttl) {
+  struct NaClResolverConfig const *config = &self->config;
+  unsigned char       query[NACL_DNS_MAX_MSG];
+  unsigned char       msg[NACL_DNS_MAX_MSG];
+  size_t              qlen;
+  struct sockaddr_in  from;
+  socklen_t           fromlen;
+  struct pollfd       pfd;
+  uint64_t            deadline;
+  int64_t             left;
+  ssize_t             got;
+  uint32_t            attempt;
+  uint32_t            i;
+  uint32_t            failures = 0;
+  int32_t             error;
+  int32_t             result = -NACL_ABI_ETIMEDOUT;
+  int                 d;
+
+  if (0 == config->nservers) {
+    return -NACL_ABI_ENOENT;
+  }
+  if (-1 == (d = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0))) {
+    return -NaClXlateErrno(errno);
+  }
+  for (attempt = 0;
+       attempt < config->attempts && -NACL_ABI_ETIMEDOUT == result;
+       ++attempt) {
+    /* A fresh id per attempt, so a late answer to the last one still fits */
+    qlen = NaClDnsQuery(query, (uint16_t) NaClGlobalSecureRngUniform(0x10000),
+                        name);
+    for (i = 0; i < config->nservers; ++i) {
+      (void) sendto(d, query, qlen, 0,
+                    (struct sockaddr const *) &config->servers[i],
+                    sizeof config->servers[i]);
+    }
+    NaClResolverCount(&self->stats.queries);
+    failures = 0;
+    deadline = NaClResolverMilliTime() + config->timeout_ms;
+    while (-NACL_ABI_ETIMEDOUT == result) {
+      left = (int64_t) (deadline - NaClResolverMilliTime());
+      if (left <= 0) {
+        break;
+      }
+      pfd.fd = d;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, (int) left) <= 0) {
+        if (EINTR == errno) {
+          continue;
+        }
+        break;
+      }
+      fromlen = sizeof from;
+      got = recvfrom(d, msg, sizeof msg, 0, (struct sockaddr *) &from,
+                     &fromlen);
+      if (got < 0 || sizeof from != fromlen
+          || !NaClResolverFromServer(config, &from)
+          || !NaClDnsParse(msg, (size_t) got, query, qlen,
+                           addrs, naddrs, ttl, &error)) {
+        continue;
+      }
+      if (-NACL_ABI_EIO == error && ++failures < config->nservers) {
+        continue;
+      }
+      result = error;
+    }
+    if (-NACL_ABI_ETIMEDOUT == result) {
+      NaClResolverCount(&self->stats.timeouts);
+    }
+  }
+  close(d);
+  if (-NACL_ABI_ETIMEDOUT == result && 0 != failures) {
+    result = -NACL_ABI_EIO;
+  }
+  return result;
+}
+
+
+/*
+ * Resolves canon without the cache.  *ttl is how long to keep the
+ * answer, 0 if it should not be kept.
+ */
+static int32_t NaClResolverResolve(struct NaClResolver  *self,
+                                   char const           *canon,
+                                   uint32_t             *addrs,
+                                   uint32_t             *naddrs,
+                                   uint32_t             *ttl) {
+  int32_t error;
+
+  *naddrs = NaClResolverHosts(self->config.hosts_path, canon, addrs);
+  if (0 != *naddrs) {
+    NaClResolverCount(&self->stats.hosts);
+    *ttl = NACL_RESOLVER_HOSTS_TTL;
+    return 0;
+  }
+  error = NaClResolverQuery(self, canon, addrs, naddrs, ttl);
+  if (0 == error) {
+    if (*ttl < self->config.min_ttl) {
+      *ttl = self->config.min_ttl;
+    } else if (*ttl > self->config.max_ttl) {
+      *ttl = self->config.max_ttl;
+    }
+  } else if (-NACL_ABI_ENOENT == error) {
+    *ttl = self->config.neg_ttl;
+  } else {
+    *ttl = 0;
+  }
+  return error;
+}
+
+
+static int NaClResolverCopy(int32_t         error,
+                            uint32_t const  *found,
+                            uint32_t        nfound,
+                            uint32_t        *addrs,
+                            uint32_t        max) {
+  if (0 != error) {
+    return error;
+  }
+  if (nfound > max) {
+    nfound = max;
+  }
+  memcpy(addrs, found, nfound * sizeof *addrs);
+  return (int) nfound;
+}
+
+
+/*
+ * Finds an entry for canon, taking an unused one or reusing the least
+ * recently used one that no lookup is using.  Returns NULL if every
+ * entry is in use.  Called with mu held.
+ */
+static struct NaClResolverEntry *NaClResolverAlloc(struct NaClResolver  *self,
+                                                   char const           *canon,
+                                                   uint32_t             bucket) {
+  struct NaClResolverEntry  *e = NULL;
+  struct NaClResolverEntry  *c;
+  struct NaClResolverEntry  **pp;
+  uint32_t                  i;
+
+  if (self->nused < self->config.entries) {
+    e = &self->entries[self->nused++];
+  } else {
+    for (i = 0; i < self->config.entries; ++i) {
+      c = &self->entries[i];
+      if (c->resolving || 0 != c->waiters) {
+        continue;
+      }
+      if (NULL == e || c->last_used < e->last_used) {
+        e = c;
+      }
+    }
+    if (NULL == e) {
+      return NULL;
+    }
+    pp = &self->buckets[NaClResolverHash(e->name) & self->bucket_mask];
+    while (*pp != e) {
+      pp = &(*pp)->next;
+    }
+    *pp = e->next;
+    ++self->stats.evictions;
+  }
+  memset(e, 0, sizeof *e);
+  strcpy(e->name, canon);
+  e->next = self->buckets[bucket];
+  self->buckets[bucket] = e;
+  return e;
+}
+
+
+int NaClResolverLookup(struct NaClResolver  *self,
+                       char const           *name,
+                       uint32_t             *addrs,
+                       uint32_t             max,
+                       uint32_t             now,
+                       int                  *fresh) {
+  char                      canon[NACL_RESOLVER_MAX_NAME + 1];
+  uint32_t                  found[NACL_RESOLVER_MAX_ADDRS];
+  uint32_t                  nfound = 0;
+  uint32_t                  ttl;
+  uint32_t                  bucket;
+  struct in_addr            a;
+  struct NaClResolverEntry  *e;
+  int32_t                   error;
+  int                       result;
+
+  *fresh = 0;
+  if (1 == inet_pton(AF_INET, name, &a)) {
+    return NaClResolverCopy(0, &a.s_addr, 1, addrs, max);
+  }
+  if (!NaClResolverCanonName(name, canon)) {
+    return -NACL_ABI_EINVAL;
+  }
+  bucket = NaClResolverHash(canon) & self->bucket_mask;
+
+  NaClXMutexLock(&self->mu);
+  for (e = self->buckets[bucket];
+       NULL != e && 0 != strcmp(e->name, canon);
+       e = e->next) {
+  }
+  if (NULL != e && e->resolving) {
+    /* The entry can't be reused while it has waiters */
+    ++self->stats.coalesced;
+    ++e->waiters;
+    while (e->resolving) {
+      NaClXCondVarWait(&self->cv, &self->mu);
+    }
+    --e->waiters;
+    e->last_used = now;
+    result = NaClResolverCopy(e->error, e->addrs, e->naddrs, addrs, max);
+    NaClXMutexUnlock(&self->mu);
+    return result;
+  }
+  if (NULL != e && now < e->expires) {
+    ++self->stats.hits;
+    e->last_used = now;
+    result = NaClResolverCopy(e->error, e->addrs, e->naddrs, addrs, max);
+    NaClXMutexUnlock(&self->mu);
+    return result;
+  }
+  ++self->stats.misses;
+  if (NULL == e) {
+    e = NaClResolverAlloc(self, canon, bucket);
+  }
+  if (NULL != e) {
+    e->resolving = 1;
+    e->last_used = now;
+  }
+  NaClXMutexUnlock(&self->mu);
+
+  *fresh = 1;
+  error = NaClResolverResolve(self, canon, found, &nfound, &ttl);
+  if (NULL == e) {
+    return NaClResolverCopy(error, found, nfound, addrs, max);
+  }
+
+  NaClXMutexLock(&self->mu);
+  e->resolving = 0;
+  e->error = error;
+  e->naddrs = (0 == error) ? nfound : 0;
+  memcpy(e->addrs, found, e->naddrs * sizeof *e->addrs);
+  e->expires = now + ttl;  /* ttl 0: waiters get it, later lookups don't */
+  NaClXCondVarBroadcast(&self->cv);
+  result = NaClResolverCopy(e->error, e->addrs, e->naddrs, addrs, max);
+  NaClXMutexUnlock(&self->mu);
+  return result;
+}
+
+
+static struct NaClResolver  nacl_resolver;
+static int                  nacl_resolver_prewarm;
+static int                  nacl_resolver_prewarming;  /* threads running */
+
+struct NaClResolverPrewarm {
+  uint32_t      addrs[NACL_RESOLVER_MAX_ADDRS];
+  uint32_t      naddrs;
+  unsigned char hash[20];
+};
+
+
+static void WINAPI NaClResolverPrewarmThread(void *arg) {
+  struct NaClResolverPrewarm  *p = (struct NaClResolverPrewarm *) arg;
+  struct sockaddr_in          sa;
+  uint32_t                    i;
+
+  /* Only the per-peer answer is wanted; it lands in the peer cache */
+  for (i = 0; i < p->naddrs; ++i) {
+    memset(&sa, 0, sizeof sa);
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = p->addrs[i];
+    (void) NaClIsConnectionOk((struct sockaddr const *) &sa, p->hash);
+  }
+  free(p);
+  __sync_fetch_and_sub(&nacl_resolver_prewarming, 1);
+  NaClThreadExit();
+}
+
+
+static void NaClResolverStartPrewarm(uint32_t const *addrs,
+                                     uint32_t       naddrs,
+                                     unsigned char  *hash) {
+  struct NaClResolverPrewarm  *p;
+  struct NaClThread           thread;  /* detached; the thread never uses it */
+
+  /* Best effort: the app's connect does the handshake if this doesn't */
+  if (__sync_fetch_and_add(&nacl_resolver_prewarming, 1)
+      >= NACL_RESOLVER_MAX_PREWARM) {
+    goto cleanup;
+  }
+  if (NULL == (p = malloc(sizeof *p))) {
+    goto cleanup;
+  }
+  if (naddrs > NACL_RESOLVER_MAX_ADDRS) {
+    naddrs = NACL_RESOLVER_MAX_ADDRS;
+  }
+  memcpy(p->addrs, addrs, naddrs * sizeof *addrs);
+  p->naddrs = naddrs;
+  memcpy(p->hash, hash, sizeof p->hash);
+  if (NaClThreadCtor(&thread, NaClResolverPrewarmThread, p,
+                     NACL_KERN_STACK_SIZE)) {
+    return;
+  }
+  free(p);
+ cleanup:
+  __sync_fetch_and_sub(&nacl_resolver_prewarming, 1);
+}
+
+
+void NaClResolverModuleInit(void) {
+  struct NaClResolverConfig config;
+
+  NaClResolverConfigFromEnv(&config);
+  if (!NaClResolverCtor(&nacl_resolver, &config)) {
+    NaClLog(LOG_FATAL, "Could not allocate the name resolver cache\n");
+  }
+  nacl_resolver_prewarm = NaClResolverEnv("NACL_RESOLVER_PREWARM", 1) != 0;
+  NaClLog(2, "resolver: %u servers, hosts file \"%s\"\n",
+          config.nservers, config.hosts_path);
+}
+
+
+void NaClResolverModuleFini(void) {
+  struct NaClResolverStats stats;
+
+  NaClResolverGetStats(&nacl_resolver, &stats);
+  NaClLog(1, ("resolver: %"PRIuPTR" hits, %"PRIuPTR" misses,"
+              " %"PRIuPTR" coalesced, %"PRIuPTR" from hosts,"
+              " %"PRIuPTR" queries, %"PRIuPTR" timeouts,"
+              " %"PRIuPTR" evictions\n"),
+          stats.hits, stats.misses, stats.coalesced, stats.hosts,
+          stats.queries, stats.timeouts, stats.evictions);
+  NaClResolverDtor(&nacl_resolver);
+}
+
+
+int NaClResolverModuleLookup(char const     *name,
+                             uint32_t       *addrs,
+                             uint32_t       max,
+                             unsigned char  *hash) {
+  int fresh;
+  int n;
+
+  n = NaClResolverLookup(&nacl_resolver, name, addrs, max,
+                         NaClSocksClientNow(), &fresh);
+  if (n > 0 && fresh && nacl_resolver_prewarm) {
+    NaClResolverStartPrewarm(addrs, (uint32_t) n, hash);
+  }
+  return n;
+}
@@ -0,0 +1,182 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime name resolver.
+ *
+ * Resolves host names to IPv4 addresses for the getaddrinfo system
+ * call, from a hosts file and then by asking DNS servers for A
+ * records over UDP.  A query goes to every configured server at once
+ * and the first usable answer wins; lookups of different names run
+ * in parallel, as no lock is held while waiting on the network.
+ *
+ * Answers are cached by name for their DNS TTL, clamped to
+ * [min_ttl, max_ttl]; names that do not exist or have no A records
+ * are cached for neg_ttl; timeouts and server failures are not
+ * cached.  A lookup of a name another thread is already resolving
+ * waits for that answer rather than sending its own query.  The cache
+ * is a fixed array of entries in a chained hash table; when it is
+ * full the least recently used entry that nobody is waiting on is
+ * reused.
+ *
+ * Servers and the hosts file come from NaClResolverConfigFromEnv, so
+ * that tests can point the resolver at a stand-in server or hosts
+ * file without touching the host's configuration.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_RESOLVER_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_RESOLVER_H_
+
+#include <netinet/in.h>
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_sync.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_RESOLVER_MAX_SERVERS         3
+#define NACL_RESOLVER_MAX_ADDRS           8   /* kept per name */
+#define NACL_RESOLVER_MAX_NAME            253
+#define NACL_RESOLVER_PATH_MAX            256
+
+#define NACL_RESOLVER_DEFAULT_ENTRIES     256
+#define NACL_RESOLVER_MAX_ENTRIES         (1 << 16)
+#define NACL_RESOLVER_DEFAULT_MIN_TTL     5     /* seconds */
+#define NACL_RESOLVER_DEFAULT_MAX_TTL     3600
+#define NACL_RESOLVER_DEFAULT_NEG_TTL     30
+#define NACL_RESOLVER_HOSTS_TTL           60    /* for hosts file answers */
+#define NACL_RESOLVER_DEFAULT_TIMEOUT_MS  1000  /* per attempt */
+#define NACL_RESOLVER_DEFAULT_ATTEMPTS    2
+
+struct NaClResolverConfig {
+  struct sockaddr_in  servers[NACL_RESOLVER_MAX_SERVERS];
+  uint32_t            nservers;
+  char                hosts_path[NACL_RESOLVER_PATH_MAX];  /* "": none */
+  uint32_t            entries;
+  uint32_t            min_ttl;
+  uint32_t            max_ttl;
+  uint32_t            neg_ttl;
+  uint32_t            timeout_ms;
+  uint32_t            attempts;
+};
+
+struct NaClResolverStats {
+  uintptr_t hits;
+  uintptr_t misses;
+  uintptr_t coalesced;   /* lookups that waited on another's query */
+  uintptr_t hosts;       /* answered from the hosts file */
+  uintptr_t queries;     /* DNS queries sent, per attempt */
+  uintptr_t timeouts;
+  uintptr_t evictions;
+};
+
+struct NaClResolverEntry {
+  struct NaClResolverEntry  *next;  /* hash chain */
+  char                      name[NACL_RESOLVER_MAX_NAME + 1];
+  int                       resolving;
+  int                       waiters;
+  int32_t                   error;  /* non-zero: negative entry */
+  uint32_t                  naddrs;
+  uint32_t                  addrs[NACL_RESOLVER_MAX_ADDRS];  /* net order */
+  uint32_t                  expires;
+  uint32_t                  last_used;
+};
+
+struct NaClResolver {
+  struct NaClMutex          mu;
+  struct NaClCondVar        cv;  /* a query finished */
+  struct NaClResolverConfig config;
+  uint32_t                  bucket_mask;
+  struct NaClResolverEntry  **buckets;
+  struct NaClResolverEntry  *entries;
+  uint32_t                  nused;
+  struct NaClResolverStats  stats;
+};
+
+/*
+ * Defaults, overridden by the environment: NACL_RESOLVER_SERVERS is a
+ * comma separated list of ip[:port]; otherwise the nameserver lines of
+ * NACL_RESOLVER_CONF (default /etc/resolv.conf) are used.
+ * NACL_RESOLVER_HOSTS names the hosts file (default /etc/hosts; empty
+ * for none).  NACL_RESOLVER_ENTRIES, NACL_RESOLVER_MIN_TTL,
+ * NACL_RESOLVER_MAX_TTL, NACL_RESOLVER_NEG_TTL,
+ * NACL_RESOLVER_TIMEOUT_MS and NACL_RESOLVER_ATTEMPTS set the rest.
+ */
+void NaClResolverConfigFromEnv(struct NaClResolverConfig *config);
+
+/*
+ * Returns non-zero on success.
+ */
+int NaClResolverCtor(struct NaClResolver              *self,
+                     struct NaClResolverConfig const  *config);
+
+void NaClResolverDtor(struct NaClResolver *self);
+
+/*
+ * Resolves name (a host name or dotted quad) as of now, in seconds on
+ * the caller's monotonic scale, and stores up to max of its addresses,
+ * in network byte order, in addrs.  Returns how many it stored, or a
+ * negative NACL_ABI_ errno value: ENOENT if the name has no addresses,
+ * ETIMEDOUT if no server answered, EIO if the servers failed, EINVAL
+ * if name is not a valid host name.  *fresh is set if the answer did
+ * not come from the cache.
+ */
+int NaClResolverLookup(struct NaClResolver  *self,
+                       char const           *name,
+                       uint32_t             *addrs,
+                       uint32_t             max,
+                       uint32_t             now,
+                       int                  *fresh);
+
+void NaClResolverGetStats(struct NaClResolver       *self,
+                          struct NaClResolverStats  *stats);
+
+/*
+ * The service runtime's resolver.  NaClResolverModuleLookup is
+ * NaClResolverLookup on it, and also starts validation handshakes with
+ * newly resolved addresses in the background (unless
+ * NACL_RESOLVER_PREWARM is 0), so that the app's first connect to one
+ * finds the peer policy cached; hash is the app's hash.
+ */
+void NaClResolverModuleInit(void);
+
+void NaClResolverModuleFini(void);
+
+int NaClResolverModuleLookup(char const     *name,
+                             uint32_t       *addrs,
+                             uint32_t       max,
+                             unsigned char  *hash);
+
+EXTERN_C_END
+
+#endif
@@ -0,0 +1,514 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the name resolver against a stand-in DNS server on the
+ * loopback interface and a scratch hosts file: TTL caching and its
+ * clamping, negative caching, coalescing of concurrent lookups,
+ * timeouts and server failures, a dead server alongside a live one,
+ * and reuse of entries when the cache is full.
+ */
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_global_secure_random.h"
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_secure_random.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_resolver.h"
+
+#define TEST_STACK_BYTES  (128 << 10)
+#define TEST_LOOKERS      4
+
+/* How the stand-in server answers each name */
+#define ANSWER_A          0
+#define ANSWER_NXDOMAIN   1
+#define ANSWER_SERVFAIL   2
+#define ANSWER_SILENT     3
+
+struct TestName {
+  char const  *name;
+  int         answer;
+  uint32_t    ttl;
+  uint32_t    delay_ms;
+  char const  *addrs[2];
+  int         queries;  /* seen by the server */
+};
+
+static struct TestName test_names[] = {
+  { "a.test",       ANSWER_A,        30,   0, { "10.0.0.1", "10.0.0.2" }, 0 },
+  { "short.test",   ANSWER_A,        1,    0, { "10.0.0.3", NULL }, 0 },
+  { "long.test",    ANSWER_A,        9999, 0, { "10.0.0.4", NULL }, 0 },
+  { "slow.test",    ANSWER_A,        30, 300, { "10.0.0.5", NULL }, 0 },
+  { "b.test",       ANSWER_A,        30,   0, { "10.0.0.6", NULL }, 0 },
+  { "c.test",       ANSWER_A,        30,   0, { "10.0.0.7", NULL }, 0 },
+  { "missing.test", ANSWER_NXDOMAIN, 0,    0, { NULL, NULL }, 0 },
+  { "broken.test",  ANSWER_SERVFAIL, 0,    0, { NULL, NULL }, 0 },
+  { "silent.test",  ANSWER_SILENT,   0,    0, { NULL, NULL }, 0 },
+};
+
+#define NUM_TEST_NAMES (sizeof test_names / sizeof test_names[0])
+
+static int                server_fd;
+static struct sockaddr_in server_addr;
+static int                dead_fd;  /* bound, never read */
+static struct sockaddr_in dead_addr;
+static volatile int       server_stop;
+static char               hosts_path[] = "/tmp/nacl_resolver_test_XXXXXX";
+
+
+static int Queries(char const *name) {
+  size_t i;
+
+  for (i = 0; i < NUM_TEST_NAMES; ++i) {
+    if (0 == strcmp(test_names[i].name, name)) {
+      return __sync_fetch_and_add(&test_names[i].queries, 0);
+    }
+  }
+  return -1;
+}
+
+
+static void ServerAnswer(unsigned char *msg, size_t len,
+                         struct sockaddr_in *from) {
+  char            name[256];
+  size_t          off = 12;
+  size_t          n = 0;
+  size_t          i;
+  uint32_t        nanswers = 0;
+  struct TestName *t = NULL;
+  struct in_addr  a;
+  int             rcode = 0;
+
+  while (off < len && 0 != msg[off] && n + msg[off] + 1 < sizeof name) {
+    if (0 != n) {
+      name[n++] = '.';
+    }
+    memcpy(&name[n], &msg[off + 1], msg[off]);
+    n += msg[off];
+    off += 1 + msg[off];
+  }
+  name[n] = '\0';
+  off += 5;  /* root label, type and class */
+  if (off > len) {
+    return;
+  }
+  for (i = 0; i < NUM_TEST_NAMES; ++i) {
+    if (0 == strcmp(test_names[i].name, name)) {
+      t = &test_names[i];
+    }
+  }
+  if (NULL == t) {
+    rcode = 3;
+  } else {
+    __sync_fetch_and_add(&t->queries, 1);
+    if (0 != t->delay_ms) {
+      usleep(t->delay_ms * 1000);
+    }
+    switch (t->answer) {
+      case ANSWER_NXDOMAIN:
+        rcode = 3;
+        break;
+      case ANSWER_SERVFAIL:
+        rcode = 2;
+        break;
+      case ANSWER_SILENT:
+        return;
+    }
+  }
+  for (i = 0; 0 == rcode && i < 2 && NULL != t->addrs[i]; ++i) {
+    inet_pton(AF_INET, t->addrs[i], &a);
+    msg[off++] = 0xc0;  /* pointer to the question's name */
+    msg[off++] = 12;
+    msg[off++] = 0;
+    msg[off++] = 1;     /* A */
+    msg[off++] = 0;
+    msg[off++] = 1;     /* IN */
+    msg[off++] = (unsigned char) (t->ttl >> 24);
+    msg[off++] = (unsigned char) (t->ttl >> 16);
+    msg[off++] = (unsigned char) (t->ttl >> 8);
+    msg[off++] = (unsigned char) t->ttl;
+    msg[off++] = 0;
+    msg[off++] = 4;
+    memcpy(&msg[off], &a, 4);
+    off += 4;
+    ++nanswers;
+  }
+  msg[2] |= 0x80;       /* QR */
+  msg[3] = (unsigned char) (0x80 | rcode);  /* RA */
+  msg[6] = 0;
+  msg[7] = (unsigned char) nanswers;
+  (void) sendto(server_fd, msg, off, 0, (struct sockaddr *) from,
+                sizeof *from);
+}
+
+
+static void WINAPI ServerThread(void *arg) {
+  unsigned char       msg[512 + 64];
+  struct sockaddr_in  from;
+  socklen_t           fromlen;
+  struct pollfd       pfd;
+  ssize_t             got;
+
+  UNREFERENCED_PARAMETER(arg);
+  while (!server_stop) {
+    pfd.fd = server_fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 50) <= 0) {
+      continue;
+    }
+    fromlen = sizeof from;
+    got = recvfrom(server_fd, msg, 512, 0, (struct sockaddr *) &from,
+                   &fromlen);
+    if (got >= 12) {
+      ServerAnswer(msg, (size_t) got, &from);
+    }
+  }
+  NaClThreadExit();
+}
+
+
+static int BindLoopback(struct sockaddr_in *sa) {
+  socklen_t len = sizeof *sa;
+  int       fd;
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(sa, 0, sizeof *sa);
+  sa->sin_family = AF_INET;
+  sa->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (fd < 0 || 0 != bind(fd, (struct sockaddr *) sa, sizeof *sa)
+      || 0 != getsockname(fd, (struct sockaddr *) sa, &len)) {
+    printf("ERROR: could not bind a loopback socket\n");
+    exit(1);
+  }
+  return fd;
+}
+
+
+static void TestConfig(struct NaClResolverConfig *config) {
+  memset(config, 0, sizeof *config);
+  config->servers[0] = server_addr;
+  config->nservers = 1;
+  snprintf(config->hosts_path, sizeof config->hosts_path, "%s", hosts_path);
+  config->entries = 16;
+  config->min_ttl = 5;
+  config->max_ttl = 60;
+  config->neg_ttl = 10;
+  config->timeout_ms = 100;
+  config->attempts = 2;
+}
+
+
+/*
+ * Looks name up at time now, and checks the result, the first address
+ * if any, whether the answer was fresh and how many queries the server
+ * has seen for it.
+ */
+static int Expect(struct NaClResolver *r, char const *name, uint32_t now,
+                  int want, char const *want_addr, int want_fresh,
+                  int want_queries) {
+  uint32_t        addrs[NACL_RESOLVER_MAX_ADDRS];
+  struct in_addr  a;
+  int             fresh;
+  int             n;
+  int             q;
+
+  n = NaClResolverLookup(r, name, addrs, NACL_RESOLVER_MAX_ADDRS, now,
+                         &fresh);
+  q = Queries(name);
+  if (n != want || fresh != want_fresh || (q >= 0 && q != want_queries)) {
+    printf("ERROR: %s at %u: got %d fresh %d queries %d,"
+           " want %d fresh %d queries %d\n",
+           name, now, n, fresh, q, want, want_fresh, want_queries);
+    return 1;
+  }
+  if (NULL != want_addr) {
+    inet_pton(AF_INET, want_addr, &a);
+    if (n < 1 || addrs[0] != a.s_addr) {
+      printf("ERROR: %s: wrong address\n", name);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static int CacheTest(void) {
+  struct NaClResolverConfig config;
+  struct NaClResolver       r;
+  struct NaClResolverStats  stats;
+  int                       errors = 0;
+
+  printf("CacheTest\n");
+  TestConfig(&config);
+  if (!NaClResolverCtor(&r, &config)) {
+    printf("ERROR: NaClResolverCtor failed\n");
+    return 1;
+  }
+  errors += Expect(&r, "a.test", 100, 2, "10.0.0.1", 1, 1);
+  errors += Expect(&r, "A.Test.", 129, 2, "10.0.0.1", 0, 1);
+  errors += Expect(&r, "a.test", 130, 2, "10.0.0.1", 1, 2);
+  /* TTLs of 1 and 9999 are clamped to 5 and 60 */
+  errors += Expect(&r, "short.test", 100, 1, "10.0.0.3", 1, 1);
+  errors += Expect(&r, "short.test", 104, 1, "10.0.0.3", 0, 1);
+  errors += Expect(&r, "short.test", 105, 1, "10.0.0.3", 1, 2);
+  errors += Expect(&r, "long.test", 100, 1, "10.0.0.4", 1, 1);
+  errors += Expect(&r, "long.test", 159, 1, "10.0.0.4", 0, 1);
+  errors += Expect(&r, "long.test", 160, 1, "10.0.0.4", 1, 2);
+  /* The hosts file comes first and is not sent to the server */
+  errors += Expect(&r, "local.test", 100, 1, "192.0.2.7", 1, -1);
+  errors += Expect(&r, "alias.local", 100, 1, "192.0.2.7", 1, -1);
+  errors += Expect(&r, "local.test", 101, 1, "192.0.2.7", 0, -1);
+  /* Dotted quads are not looked up at all */
+  errors += Expect(&r, "198.51.100.1", 100, 1, "198.51.100.1", 0, -1);
+  errors += Expect(&r, "bad..test", 100, -NACL_ABI_EINVAL, NULL, 0, -1);
+  errors += Expect(&r, "bad name", 100, -NACL_ABI_EINVAL, NULL, 0, -1);
+  NaClResolverGetStats(&r, &stats);
+  if (2 != stats.hosts || 4 != stats.hits) {
+    printf("ERROR: %u from hosts, %u hits\n",
+           (unsigned) stats.hosts, (unsigned) stats.hits);
+    ++errors;
+  }
+  NaClResolverDtor(&r);
+  return errors;
+}
+
+
+static int FailureTest(void) {
+  struct NaClResolverConfig config;
+  struct NaClResolver       r;
+  int                       errors = 0;
+
+  printf("FailureTest\n");
+  TestConfig(&config);
+  if (!NaClResolverCtor(&r, &config)) {
+    printf("ERROR: NaClResolverCtor failed\n");
+    return 1;
+  }
+  /* Names that don't exist are remembered for neg_ttl */
+  errors += Expect(&r, "missing.test", 100, -NACL_ABI_ENOENT, NULL, 1, 1);
+  errors += Expect(&r, "missing.test", 109, -NACL_ABI_ENOENT, NULL, 0, 1);
+  errors += Expect(&r, "missing.test", 110, -NACL_ABI_ENOENT, NULL, 1, 2);
+  /* Failures and timeouts are not; each attempt is a query */
+  errors += Expect(&r, "broken.test", 100, -NACL_ABI_EIO, NULL, 1, 1);
+  errors += Expect(&r, "broken.test", 100, -NACL_ABI_EIO, NULL, 1, 2);
+  errors += Expect(&r, "silent.test", 100, -NACL_ABI_ETIMEDOUT, NULL, 1, 2);
+  errors += Expect(&r, "silent.test", 100, -NACL_ABI_ETIMEDOUT, NULL, 1, 4);
+  NaClResolverDtor(&r);
+  return errors;
+}
+
+
+static int ServersTest(void) {
+  struct NaClResolverConfig config;
+  struct NaClResolver       r;
+  int                       errors = 0;
+
+  printf("ServersTest\n");
+  TestConfig(&config);
+  config.servers[0] = dead_addr;
+  config.servers[1] = server_addr;
+  config.nservers = 2;
+  config.attempts = 1;
+  if (!NaClResolverCtor(&r, &config)) {
+    printf("ERROR: NaClResolverCtor failed\n");
+    return 1;
+  }
+  /* The live server answers without waiting out the dead one */
+  errors += Expect(&r, "b.test", 100, 1, "10.0.0.6", 1, 1);
+  NaClResolverDtor(&r);
+  return errors;
+}
+
+
+struct Looker {
+  struct NaClThread   thread;
+  struct NaClResolver *r;
+  int                 n;
+  uint32_t            addr;
+  int                 done;
+};
+
+
+static void WINAPI LookerThread(void *arg) {
+  struct Looker *l = (struct Looker *) arg;
+  uint32_t      addrs[NACL_RESOLVER_MAX_ADDRS];
+  int           fresh;
+
+  l->n = NaClResolverLookup(l->r, "slow.test", addrs,
+                            NACL_RESOLVER_MAX_ADDRS, 100, &fresh);
+  l->addr = addrs[0];
+  __sync_fetch_and_add(&l->done, 1);
+  NaClThreadExit();
+}
+
+
+static int CoalesceTest(void) {
+  struct NaClResolverConfig config;
+  struct NaClResolver       r;
+  struct NaClResolverStats  stats;
+  struct Looker             lookers[TEST_LOOKERS];
+  struct in_addr            a;
+  int                       errors = 0;
+  int                       i;
+
+  printf("CoalesceTest\n");
+  TestConfig(&config);
+  config.timeout_ms = 2000;  /* the server takes 300ms to answer */
+  if (!NaClResolverCtor(&r, &config)) {
+    printf("ERROR: NaClResolverCtor failed\n");
+    return 1;
+  }
+  memset(lookers, 0, sizeof lookers);
+  for (i = 0; i < TEST_LOOKERS; ++i) {
+    lookers[i].r = &r;
+    if (!NaClThreadCtor(&lookers[i].thread, LookerThread, &lookers[i],
+                        TEST_STACK_BYTES)) {
+      printf("ERROR: could not start a lookup thread\n");
+      return errors + 1;
+    }
+  }
+  for (i = 0; i < TEST_LOOKERS; ++i) {
+    while (!__sync_fetch_and_add(&lookers[i].done, 0)) {
+      usleep(10 * 1000);
+    }
+  }
+  inet_pton(AF_INET, "10.0.0.5", &a);
+  for (i = 0; i < TEST_LOOKERS; ++i) {
+    if (1 != lookers[i].n || a.s_addr != lookers[i].addr) {
+      printf("ERROR: lookup %d got %d\n", i, lookers[i].n);
+      ++errors;
+    }
+  }
+  NaClResolverGetStats(&r, &stats);
+  if (1 != Queries("slow.test") || TEST_LOOKERS - 1 != stats.coalesced) {
+    printf("ERROR: %d queries, %u coalesced\n", Queries("slow.test"),
+           (unsigned) stats.coalesced);
+    ++errors;
+  }
+  NaClResolverDtor(&r);
+  return errors;
+}
+
+
+static int EvictionTest(void) {
+  struct NaClResolverConfig config;
+  struct NaClResolver       r;
+  struct NaClResolverStats  stats;
+  int                       errors = 0;
+  int                       before_a = Queries("a.test");
+  int                       before_b = Queries("b.test");
+  int                       before_c = Queries("c.test");
+
+  printf("EvictionTest\n");
+  TestConfig(&config);
+  config.entries = 2;
+  if (!NaClResolverCtor(&r, &config)) {
+    printf("ERROR: NaClResolverCtor failed\n");
+    return 1;
+  }
+  errors += Expect(&r, "a.test", 100, 2, NULL, 1, before_a + 1);
+  errors += Expect(&r, "b.test", 101, 1, NULL, 1, before_b + 1);
+  errors += Expect(&r, "a.test", 102, 2, NULL, 0, before_a + 1);
+  /* b.test is now the least recently used, so c.test takes its place */
+  errors += Expect(&r, "c.test", 103, 1, NULL, 1, before_c + 1);
+  errors += Expect(&r, "a.test", 104, 2, NULL, 0, before_a + 1);
+  errors += Expect(&r, "b.test", 105, 1, NULL, 1, before_b + 2);
+  NaClResolverGetStats(&r, &stats);
+  if (2 != stats.evictions) {
+    printf("ERROR: %u evictions\n", (unsigned) stats.evictions);
+    ++errors;
+  }
+  NaClResolverDtor(&r);
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  struct NaClThread server;
+  FILE              *f;
+  int               fd;
+  int               errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+  NaClSecureRngModuleInit();
+  NaClGlobalSecureRngInit();
+
+  if (-1 == (fd = mkstemp(hosts_path)) || NULL == (f = fdopen(fd, "w"))) {
+    printf("ERROR: could not create a hosts file\n");
+    return 1;
+  }
+  fprintf(f, "# scratch hosts file\n127.0.0.1 localhost\n"
+          "192.0.2.7\tLocal.Test alias.local  # comment\n");
+  fclose(f);
+
+  server_fd = BindLoopback(&server_addr);
+  dead_fd = BindLoopback(&dead_addr);
+  if (!NaClThreadCtor(&server, ServerThread, NULL, TEST_STACK_BYTES)) {
+    printf("ERROR: could not start the server\n");
+    return 1;
+  }
+
+  errors += CacheTest();
+  errors += FailureTest();
+  errors += ServersTest();
+  errors += CoalesceTest();
+  errors += EvictionTest();
+
+  server_stop = 1;
+  unlink(hosts_path);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClGlobalSecureRngFini();
+  NaClSecureRngModuleFini();
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
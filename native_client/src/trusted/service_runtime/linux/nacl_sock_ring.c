@@ -0,0 +1,518 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime socket rings.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+#include "native_client/src/shared/platform/nacl_time.h"
+
+#include "native_client/src/trusted/desc/linux/nacl_desc_epoll.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/internal_errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_ring.h"
+#include "native_client/src/trusted/service_runtime/nacl_app_thread.h"
+#include "native_client/src/trusted/service_runtime/nacl_config.h"
+#include "native_client/src/trusted/service_runtime/sel_ldr.h"
+
+
+static int NaClSockRingIsOut(struct nacl_abi_sockring_sqe const *sqe) {
+  return (NACL_ABI_SOCKRING_OP_SEND == sqe->opcode ||
+          NACL_ABI_SOCKRING_OP_SENDMSG == sqe->opcode);
+}
+
+
+static void NaClSockRingPost(struct NaClDescSockRing  *self,
+                             uint64_t                 user_data,
+                             int32_t                  res) {
+  struct nacl_abi_sockring_cqe *cqe;
+
+  cqe = &self->cqes[self->cq_tail & (2 * self->entries - 1)];
+  cqe->user_data = user_data;
+  cqe->res = res;
+  cqe->reserved = 0;
+  ++self->cq_tail;
+}
+
+
+/*
+ * Makes the posted completions visible: the entries before the tail,
+ * then the tail, then to waiters in sockring_enter.
+ */
+static void NaClSockRingPublish(struct NaClDescSockRing *self) {
+  __sync_synchronize();
+  self->hdr->cq_tail = self->cq_tail;
+  NaClXMutexLock(&self->mu);
+  self->cq_posted = self->cq_tail;
+  NaClXCondVarBroadcast(&self->cv);
+  NaClXMutexUnlock(&self->mu);
+}
+
+
+/*
+ * Returns non-zero if an earlier operation in the same direction on
+ * the same descriptor is parked, so that sqe must wait behind it.
+ */
+static int NaClSockRingBehind(struct NaClDescSockRing             *self,
+                              struct nacl_abi_sockring_sqe const  *sqe) {
+  uint32_t i;
+
+  if (NACL_ABI_SOCKRING_OP_NOP == sqe->opcode) {
+    return 0;
+  }
+  for (i = 0; i < self->nparked; ++i) {
+    if (self->parked[i].sqe.fd == sqe->fd &&
+        NaClSockRingIsOut(&self->parked[i].sqe) == NaClSockRingIsOut(sqe)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static void NaClSockRingStart(struct NaClDescSockRing             *self,
+                              struct nacl_abi_sockring_sqe const  *sqe) {
+  struct NaClSockRingParked *p;
+  struct NaClDesc           *ndp;
+  int32_t                   r;
+
+  if (NaClSockRingBehind(self, sqe)) {
+    r = -NACL_ABI_EAGAIN;
+  } else {
+    r = (*self->perform)(self->natp, sqe);
+  }
+  if (-NACL_ABI_EAGAIN != r ||
+      0 != (sqe->ioflags & NACL_ABI_SOCKRING_NOWAIT)) {
+    NaClSockRingPost(self, sqe->user_data, r);
+    return;
+  }
+  if (NULL == (ndp = NaClGetDesc(self->natp->nap, sqe->fd))) {
+    NaClSockRingPost(self, sqe->user_data, -NACL_ABI_EBADF);
+    return;
+  }
+  p = &self->parked[self->nparked++];
+  p->sqe = *sqe;
+  p->ndp = ndp;
+  p->pfd = -1;
+}
+
+
+/*
+ * Takes new submissions while the completion queue has room for them
+ * and for everything parked.  Returns how many were taken.
+ */
+static int NaClSockRingConsume(struct NaClDescSockRing *self) {
+  struct nacl_abi_sockring_sqe  sqe;
+  uint32_t                      tail;
+  uint32_t                      used;
+  uint32_t                      room;
+  int                           n = 0;
+
+  // Read once; the app may change them
+  tail = self->hdr->sq_tail;
+  used = self->cq_tail - self->hdr->cq_head;
+  __sync_synchronize();  // entries are read after the tail
+  if (tail - self->sq_head > self->entries) {
+    tail = self->sq_head + self->entries;
+  }
+  room = 2 * self->entries;
+  room = (used + self->nparked >= room) ? 0 : room - used - self->nparked;
+  while (self->sq_head != tail && room > 0) {
+    // Copy out; the app may change the entry under us
+    sqe = self->sqes[self->sq_head & (self->entries - 1)];
+    ++self->sq_head;
+    --room;
+    ++n;
+    NaClSockRingStart(self, &sqe);
+  }
+  if (0 != n) {
+    self->hdr->sq_head = self->sq_head;
+  }
+  return n;
+}
+
+
+/*
+ * Polls the event fd and each distinct socket a parked operation
+ * waits on, for up to timeout_ms.  Returns poll's count.
+ */
+static int NaClSockRingPoll(struct NaClDescSockRing *self, int timeout_ms) {
+  struct NaClSockRingParked *p;
+  uint32_t                  i;
+  int                       npfds = 1;
+  int                       j;
+  int                       fd;
+  short                     events;
+  int                       r;
+
+  self->pfds[0].fd = self->event_fd;
+  self->pfds[0].events = POLLIN;
+  for (i = 0; i < self->nparked; ++i) {
+    p = &self->parked[i];
+    if ((fd = NaClDescEpollTargetFd(p->ndp)) < 0) {
+      p->pfd = -1;  // nothing to wait for; just retry
+      continue;
+    }
+    events = NaClSockRingIsOut(&p->sqe) ? POLLOUT : POLLIN;
+    for (j = 1; j < npfds; ++j) {
+      if (self->pfds[j].fd == fd && self->pfds[j].events == events) {
+        break;
+      }
+    }
+    if (j == npfds) {
+      self->pfds[j].fd = fd;
+      self->pfds[j].events = events;
+      ++npfds;
+    }
+    p->pfd = j;
+  }
+  r = poll(self->pfds, npfds, timeout_ms);
+  return (r < 0) ? 0 : r;
+}
+
+
+/*
+ * Retries parked operations whose sockets the last poll found ready,
+ * oldest first.  Once one would still block, those behind it on the
+ * same socket are not tried.  Returns how many completed.
+ */
+static int NaClSockRingRetry(struct NaClDescSockRing *self) {
+  struct NaClSockRingParked *p;
+  uint32_t                  i;
+  uint32_t                  kept = 0;
+  int                       n = 0;
+  int32_t                   r;
+
+  for (i = 0; i < self->nparked; ++i) {
+    p = &self->parked[i];
+    if (p->pfd < 0 || 0 != self->pfds[p->pfd].revents) {
+      r = (*self->perform)(self->natp, &p->sqe);
+      if (-NACL_ABI_EAGAIN != r) {
+        NaClSockRingPost(self, p->sqe.user_data, r);
+        NaClDescUnref(p->ndp);
+        ++n;
+        continue;
+      }
+      if (p->pfd >= 0) {
+        self->pfds[p->pfd].revents = 0;
+      }
+    }
+    self->parked[kept++] = *p;
+  }
+  self->nparked = kept;
+  return n;
+}
+
+
+static void WINAPI NaClSockRingWorker(void *arg) {
+  struct NaClDescSockRing *self = (struct NaClDescSockRing *) arg;
+  uint64_t                count;
+  int                     exiting;
+  int                     n;
+
+  for (;;) {
+    NaClXMutexLock(&self->mu);
+    exiting = self->exiting;
+    NaClXMutexUnlock(&self->mu);
+    if (exiting) {
+      break;
+    }
+    n = NaClSockRingConsume(self);
+    if (0 != self->nparked && NaClSockRingPoll(self, 0) > 0) {
+      n += NaClSockRingRetry(self);
+    }
+    if (0 != n) {
+      NaClSockRingPublish(self);
+      continue;
+    }
+    /*
+     * Out of work.  Ask for a wakeup, then look again: a submission
+     * published before the app could see the flag would otherwise be
+     * stranded.
+     */
+    self->hdr->flags = NACL_ABI_SOCKRING_NEED_WAKEUP;
+    __sync_synchronize();
+    if (self->hdr->sq_tail == self->sq_head ||
+        self->cq_tail - self->hdr->cq_head + self->nparked
+        >= 2 * self->entries) {
+      if (NaClSockRingPoll(self, -1) > 0 && 0 != self->nparked) {
+        if (0 != NaClSockRingRetry(self)) {
+          NaClSockRingPublish(self);
+        }
+      }
+    }
+    self->hdr->flags = 0;
+    (void) read(self->event_fd, &count, sizeof count);
+  }
+
+  NaClLog(4, "NaClSockRingWorker(0x%08"PRIxPTR"): exiting\n",
+          (uintptr_t) self);
+  NaClXMutexLock(&self->mu);
+  self->exited = 1;
+  NaClXCondVarBroadcast(&self->cv);
+  NaClXMutexUnlock(&self->mu);
+  NaClThreadExit();
+}
+
+
+static void NaClSockRingWake(struct NaClDescSockRing *self) {
+  uint64_t one = 1;
+
+  (void) write(self->event_fd, &one, sizeof one);
+}
+
+
+int NaClDescSockRingCtor(struct NaClDescSockRing  *self,
+                         struct NaClApp           *nap,
+                         struct NaClDesc          *shm,
+                         uint32_t                 entries,
+                         NaClSockRingPerformFn    perform) {
+  struct NaClDesc *basep = (struct NaClDesc *) self;
+  size_t          bytes;
+  int             r;
+
+  basep->vtbl = (struct NaClDescVtbl *) NULL;
+  if (NACL_DESC_SHM != shm->vtbl->typeTag) {
+    return -NACL_ABI_EBADF;
+  }
+  if (0 == entries || entries > NACL_ABI_SOCKRING_MAX_ENTRIES ||
+      0 != (entries & (entries - 1))) {
+    return -NACL_ABI_EINVAL;
+  }
+  bytes = NACL_ABI_SOCKRING_BYTES(entries);
+  if ((off_t) bytes > ((struct NaClDescImcShm *) shm)->size) {
+    return -NACL_ABI_EINVAL;
+  }
+
+  self->map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   ((struct NaClDescImcShm *) shm)->h, 0);
+  if (MAP_FAILED == self->map) {
+    return -NaClXlateErrno(errno);
+  }
+  self->map_bytes = bytes;
+  self->hdr = (struct nacl_abi_sockring_hdr *) self->map;
+  self->sqes = (struct nacl_abi_sockring_sqe *) (self->hdr + 1);
+  self->cqes = (struct nacl_abi_sockring_cqe *) (self->sqes + entries);
+  self->entries = entries;
+  self->sq_head = 0;
+  self->cq_tail = 0;
+  self->perform = perform;
+  self->nparked = 0;
+  self->cq_posted = 0;
+  self->exiting = 0;
+  self->exited = 0;
+
+  r = -NACL_ABI_ENOMEM;
+  self->natp = NULL;
+  self->parked = NULL;
+  self->pfds = NULL;
+  if (-1 == (self->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))) {
+    r = -NaClXlateErrno(errno);
+    goto unmap;
+  }
+  /*
+   * The socket calls want a thread; they only use it to find the app.
+   */
+  if (NULL == (self->natp = calloc(1, sizeof *self->natp)) ||
+      NULL == (self->parked = calloc(2 * entries, sizeof *self->parked)) ||
+      NULL == (self->pfds = calloc(2 * entries + 1, sizeof *self->pfds))) {
+    goto free_mem;
+  }
+  self->natp->nap = nap;
+  if (!NaClMutexCtor(&self->mu)) {
+    goto free_mem;
+  }
+  if (!NaClCondVarCtor(&self->cv)) {
+    goto mutex_dtor;
+  }
+  if (!NaClDescCtor(basep)) {
+    goto cv_dtor;
+  }
+  self->shm = NaClDescRef(shm);
+
+  self->hdr->sq_head = 0;
+  self->hdr->sq_tail = 0;
+  self->hdr->cq_head = 0;
+  self->hdr->cq_tail = 0;
+  self->hdr->entries = entries;
+  self->hdr->flags = 0;
+  __sync_synchronize();
+
+  basep->vtbl = &kNaClDescSockRingVtbl;
+  if (!NaClThreadCtor(&self->thread, NaClSockRingWorker, self,
+                      NACL_KERN_STACK_SIZE)) {
+    self->exited = 1;
+    NaClDescSockRingDtor(basep);
+    return -NACL_ABI_EAGAIN;
+  }
+  return 0;
+
+ cv_dtor:
+  NaClCondVarDtor(&self->cv);
+ mutex_dtor:
+  NaClMutexDtor(&self->mu);
+ free_mem:
+  free(self->pfds);
+  free(self->parked);
+  free(self->natp);
+  (void) close(self->event_fd);
+ unmap:
+  (void) munmap(self->map, bytes);
+  return r;
+}
+
+
+void NaClDescSockRingDtor(struct NaClDesc *vself) {
+  struct NaClDescSockRing *self = (struct NaClDescSockRing *) vself;
+  uint32_t                i;
+
+  NaClLog(4, "NaClDescSockRingDtor(0x%08"PRIxPTR")\n", (uintptr_t) vself);
+  NaClXMutexLock(&self->mu);
+  self->exiting = 1;
+  NaClSockRingWake(self);
+  while (!self->exited) {
+    NaClXCondVarWait(&self->cv, &self->mu);
+  }
+  NaClXMutexUnlock(&self->mu);
+  NaClThreadDtor(&self->thread);
+
+  for (i = 0; i < self->nparked; ++i) {
+    NaClDescUnref(self->parked[i].ndp);
+  }
+  free(self->pfds);
+  free(self->parked);
+  free(self->natp);
+  (void) close(self->event_fd);
+  (void) munmap(self->map, self->map_bytes);
+  NaClDescUnref(self->shm);
+  NaClCondVarDtor(&self->cv);
+  NaClMutexDtor(&self->mu);
+  vself->vtbl = (struct NaClDescVtbl *) NULL;
+  NaClDescDtor(&self->base);
+}
+
+
+int NaClDescSockRingEnter(struct NaClDescSockRing *self,
+                          uint32_t                min_complete,
+                          int                     timeout_ms) {
+  struct nacl_abi_timeval   now;
+  struct nacl_abi_timespec  deadline;
+  uint32_t                  avail;
+  int                       timed_out = 0;
+
+  if (min_complete > 2 * self->entries) {
+    min_complete = 2 * self->entries;
+  }
+  NaClSockRingWake(self);
+  if (timeout_ms > 0) {
+    (void) NaClGetTimeOfDay(&now);
+    deadline.tv_sec = now.nacl_abi_tv_sec + timeout_ms / 1000;
+    deadline.tv_nsec = (now.nacl_abi_tv_usec + (timeout_ms % 1000) * 1000)
+        * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      ++deadline.tv_sec;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  NaClXMutexLock(&self->mu);
+  for (;;) {
+    // Read once; the app may change it
+    avail = self->cq_posted - self->hdr->cq_head;
+    if (avail > 2 * self->entries) {
+      avail = 0;
+    }
+    if (avail >= min_complete || 0 == timeout_ms || timed_out ||
+        self->exiting) {
+      break;
+    }
+    if (timeout_ms < 0) {
+      NaClXCondVarWait(&self->cv, &self->mu);
+    } else {
+      timed_out = (NACL_SYNC_CONDVAR_TIMEDOUT ==
+                   NaClCondVarTimedWaitAbsolute(&self->cv, &self->mu,
+                                                &deadline));
+    }
+  }
+  NaClXMutexUnlock(&self->mu);
+  return (int) avail;
+}
+
+
+int NaClDescSockRingClose(struct NaClDesc          *vself,
+                          struct NaClDescEffector  *effp) {
+  UNREFERENCED_PARAMETER(effp);
+
+  NaClDescUnref(vself);
+  return 0;
+}
+
+
+struct NaClDescVtbl const kNaClDescSockRingVtbl = {
+  NaClDescSockRingDtor,
+  NaClDescMapNotImplemented,
+  NaClDescUnmapUnsafeNotImplemented,
+  NaClDescUnmapNotImplemented,
+  NaClDescReadNotImplemented,
+  NaClDescWriteNotImplemented,
+  NaClDescSeekNotImplemented,
+  NaClDescIoctlNotImplemented,
+  NaClDescFstatNotImplemented,
+  NaClDescSockRingClose,
+  NaClDescGetdentsNotImplemented,
+  NACL_DESC_SOCK_RING,
+  NaClDescExternalizeSizeNotImplemented,
+  NaClDescExternalizeNotImplemented,
+  NaClDescLockNotImplemented,
+  NaClDescTryLockNotImplemented,
+  NaClDescUnlockNotImplemented,
+  NaClDescWaitNotImplemented,
+  NaClDescTimedWaitAbsNotImplemented,
+  NaClDescSignalNotImplemented,
+  NaClDescBroadcastNotImplemented,
+  NaClDescSendMsgNotImplemented,
+  NaClDescRecvMsgNotImplemented,
+  NaClDescConnectAddrNotImplemented,
+  NaClDescAcceptConnNotImplemented,
+  NaClDescPostNotImplemented,
+  NaClDescSemWaitNotImplemented,
+  NaClDescGetValueNotImplemented,
+};
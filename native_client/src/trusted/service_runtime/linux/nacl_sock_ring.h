@@ -0,0 +1,151 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime socket rings.  NaClDescSockRing subclass of
+ * NaClDesc.  Linux only.
+ *
+ * A ring is a submission and a completion queue in an IMC shared
+ * memory object that the app also maps (see include/sys/nacl_sockring.h
+ * for the layout).  Each ring has a service runtime worker thread
+ * that takes submissions, performs them non-blocking through the
+ * socket system calls, so that they get exactly the checks the
+ * calls would, and posts the results.  An operation that would block
+ * is parked, holding a reference to its descriptor, and retried when
+ * poll says its socket is ready; operations in the same direction on
+ * the same descriptor queue behind it, so a stream's data stays in
+ * order.  A submission is only taken while the completion queue has
+ * room for it and everything parked, so no result is ever dropped.
+ *
+ * When it runs out of work the worker sets NACL_ABI_SOCKRING_NEED_WAKEUP
+ * in the shared header and sleeps in poll on the parked sockets and an
+ * eventfd; sockring_enter writes the eventfd.  While the worker is
+ * busy the app submits with no system call at all.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCK_RING_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCK_RING_H_
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_sync.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+
+#include "native_client/src/trusted/desc/nacl_desc_base.h"
+
+#include "native_client/src/trusted/service_runtime/include/sys/nacl_sockring.h"
+
+EXTERN_C_BEGIN
+
+struct NaClApp;
+struct NaClAppThread;
+struct pollfd;
+
+extern struct NaClDescVtbl const kNaClDescSockRingVtbl;
+
+/*
+ * Performs one submission as the system call would, on behalf of the
+ * app of natp, without blocking: returns the call's result, or
+ * -NACL_ABI_EAGAIN.
+ */
+typedef int32_t (*NaClSockRingPerformFn)(
+    struct NaClAppThread                *natp,
+    struct nacl_abi_sockring_sqe const  *sqe);
+
+struct NaClSockRingParked {
+  struct nacl_abi_sockring_sqe  sqe;
+  struct NaClDesc               *ndp;  /* keeps the host socket open */
+  int                           pfd;   /* index in pfds, or -1 */
+};
+
+struct NaClDescSockRing {
+  struct NaClDesc                 base;
+
+  struct NaClDesc                 *shm;
+  void                            *map;
+  size_t                          map_bytes;
+  struct nacl_abi_sockring_hdr    *hdr;
+  struct nacl_abi_sockring_sqe    *sqes;
+  struct nacl_abi_sockring_cqe    *cqes;
+  uint32_t                        entries;
+  uint32_t                        sq_head;  /* trusted copies */
+  uint32_t                        cq_tail;
+
+  NaClSockRingPerformFn           perform;
+  struct NaClAppThread            *natp;  /* stand-in for perform */
+  int                             event_fd;
+
+  struct NaClSockRingParked       *parked;  /* oldest first */
+  uint32_t                        nparked;
+  struct pollfd                   *pfds;   /* the event fd, then sockets */
+
+  struct NaClMutex                mu;
+  struct NaClCondVar              cv;
+  uint32_t                        cq_posted;  /* cq_tail, under mu */
+  int                             exiting;
+  int                             exited;
+  struct NaClThread               thread;
+};
+
+/*
+ * Maps the shared memory object shm (which must be an IMC shm of at
+ * least NACL_ABI_SOCKRING_BYTES(entries) bytes), initializes the
+ * header and starts the worker, which performs submissions for nap.
+ * Returns 0 on success and a negative NACL_ABI_ errno value on failure.
+ */
+int NaClDescSockRingCtor(struct NaClDescSockRing  *self,
+                         struct NaClApp           *nap,
+                         struct NaClDesc          *shm,
+                         uint32_t                 entries,
+                         NaClSockRingPerformFn    perform);
+
+/*
+ * Stops the worker, completing nothing further, and drops the
+ * references held by parked operations.
+ */
+void NaClDescSockRingDtor(struct NaClDesc *vself);
+
+/*
+ * Wakes the worker, then waits up to timeout_ms (-1: no limit) until
+ * the completion queue holds at least min_complete unconsumed
+ * entries.  Returns how many it holds.
+ */
+int NaClDescSockRingEnter(struct NaClDescSockRing *self,
+                          uint32_t                min_complete,
+                          int                     timeout_ms);
+
+int NaClDescSockRingClose(struct NaClDesc          *vself,
+                          struct NaClDescEffector  *effp);
+
+EXTERN_C_END
+
+#endif
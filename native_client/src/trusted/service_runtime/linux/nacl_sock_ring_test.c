@@ -0,0 +1,321 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise socket rings: ordering of parked operations, NOWAIT,
+ * back-pressure from the completion queue, and closing a ring with
+ * operations still parked.  The operations are performed by a stand-in
+ * for the system calls that sends and receives on the host socket.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/imc/nacl_imc_c.h"
+#include "native_client/src/shared/platform/nacl_host_desc.h"
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+
+#include "native_client/src/trusted/desc/nacl_desc_imc_shm.h"
+#include "native_client/src/trusted/desc/nacl_desc_socket.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_ring.h"
+#include "native_client/src/trusted/service_runtime/nacl_app_thread.h"
+#include "native_client/src/trusted/service_runtime/nacl_config.h"
+#include "native_client/src/trusted/service_runtime/sel_ldr.h"
+
+static struct NaClApp app;  /* just its descriptor table */
+static char           test_buf[4096];  /* addr is an offset in here */
+static int            peer;  /* the host socket at the other end */
+
+
+static int32_t TestPerform(struct NaClAppThread               *natp,
+                           struct nacl_abi_sockring_sqe const *sqe) {
+  struct NaClDesc *ndp;
+  ssize_t         r;
+  int             fd;
+
+  if (NACL_ABI_SOCKRING_OP_NOP == sqe->opcode) {
+    return 0;
+  }
+  if (sqe->addr + sqe->len > sizeof test_buf) {
+    return -NACL_ABI_EFAULT;
+  }
+  if (NULL == (ndp = NaClGetDesc(natp->nap, sqe->fd))) {
+    return -NACL_ABI_EBADF;
+  }
+  fd = NaClDescSocketHostFd(ndp);
+  if (NACL_ABI_SOCKRING_OP_SEND == sqe->opcode) {
+    r = send(fd, test_buf + sqe->addr, sqe->len, MSG_DONTWAIT);
+  } else {
+    r = recv(fd, test_buf + sqe->addr, sqe->len, MSG_DONTWAIT);
+  }
+  NaClDescUnref(ndp);
+  return (r < 0) ? -NaClXlateErrno(errno) : (int32_t) r;
+}
+
+
+struct TestRing {
+  struct NaClDescSockRing       *ring;
+  struct nacl_abi_sockring_hdr  *hdr;  /* the app's mapping */
+  struct nacl_abi_sockring_sqe  *sqes;
+  struct nacl_abi_sockring_cqe  *cqes;
+  uint32_t                      entries;
+};
+
+
+static int TestRingCtor(struct TestRing *tr, uint32_t entries) {
+  struct NaClDescImcShm *shm;
+  NaClHandle            h;
+  int                   r;
+
+  h = NaClCreateMemoryObject(NACL_MAP_PAGESIZE);
+  shm = malloc(sizeof *shm);
+  tr->ring = malloc(sizeof *tr->ring);
+  if (NACL_INVALID_HANDLE == h || NULL == shm || NULL == tr->ring ||
+      !NaClDescImcShmCtor(shm, h, NACL_MAP_PAGESIZE)) {
+    printf("ERROR: no shared memory\n");
+    return 1;
+  }
+  tr->hdr = mmap(NULL, NACL_MAP_PAGESIZE, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, h, 0);
+  if (MAP_FAILED == tr->hdr) {
+    printf("ERROR: mmap failed\n");
+    return 1;
+  }
+  tr->sqes = (struct nacl_abi_sockring_sqe *) (tr->hdr + 1);
+  tr->cqes = (struct nacl_abi_sockring_cqe *) (tr->sqes + entries);
+  tr->entries = entries;
+  r = NaClDescSockRingCtor(tr->ring, &app, (struct NaClDesc *) shm, entries,
+                           TestPerform);
+  NaClDescUnref((struct NaClDesc *) shm);  /* the ring keeps its own */
+  if (0 != r) {
+    printf("ERROR: NaClDescSockRingCtor: %d\n", r);
+    return 1;
+  }
+  return 0;
+}
+
+
+static void TestRingDtor(struct TestRing *tr) {
+  NaClDescUnref((struct NaClDesc *) tr->ring);
+  (void) munmap(tr->hdr, NACL_MAP_PAGESIZE);
+}
+
+
+static int Submit(struct TestRing *tr, int opcode, int ioflags, int fd,
+                  uint32_t addr, uint32_t len, uint64_t user_data) {
+  struct nacl_abi_sockring_sqe *sqe;
+
+  if (tr->hdr->sq_tail - tr->hdr->sq_head >= tr->entries) {
+    return 0;
+  }
+  sqe = &tr->sqes[tr->hdr->sq_tail & (tr->entries - 1)];
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = opcode;
+  sqe->ioflags = ioflags;
+  sqe->fd = fd;
+  sqe->addr = addr;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  __sync_synchronize();
+  ++tr->hdr->sq_tail;
+  __sync_synchronize();
+  if (0 != (tr->hdr->flags & NACL_ABI_SOCKRING_NEED_WAKEUP)) {
+    (void) NaClDescSockRingEnter(tr->ring, 0, 0);
+  }
+  return 1;
+}
+
+
+/*
+ * Waits for the next completion and checks it against what is expected.
+ */
+static int Reap(struct TestRing *tr, uint64_t user_data, int32_t res) {
+  struct nacl_abi_sockring_cqe *cqe;
+  int                          errors = 0;
+
+  if (NaClDescSockRingEnter(tr->ring, 1, 2000) < 1) {
+    printf("ERROR: no completion for %u\n", (unsigned) user_data);
+    return 1;
+  }
+  cqe = &tr->cqes[tr->hdr->cq_head & (2 * tr->entries - 1)];
+  if (cqe->user_data != user_data || cqe->res != res) {
+    printf("ERROR: completion %u: %d, expected %u: %d\n",
+           (unsigned) cqe->user_data, cqe->res, (unsigned) user_data, res);
+    ++errors;
+  }
+  __sync_synchronize();
+  ++tr->hdr->cq_head;
+  return errors;
+}
+
+
+int OrderTest(int d) {
+  struct TestRing tr;
+  int             errors = 0;
+
+  printf("\nOrderTest\n");
+  if (0 != TestRingCtor(&tr, 8)) {
+    return 1;
+  }
+  /* both park; the second behind the first */
+  Submit(&tr, NACL_ABI_SOCKRING_OP_RECV, 0, d, 0, 3, 1);
+  Submit(&tr, NACL_ABI_SOCKRING_OP_RECV, 0, d, 100, 3, 2);
+  /* would wait behind them */
+  Submit(&tr, NACL_ABI_SOCKRING_OP_RECV, NACL_ABI_SOCKRING_NOWAIT, d, 200, 3,
+         3);
+  errors += Reap(&tr, 3, -NACL_ABI_EAGAIN);
+  /* not a socket operation, so not held up */
+  Submit(&tr, NACL_ABI_SOCKRING_OP_NOP, 0, d, 0, 0, 4);
+  errors += Reap(&tr, 4, 0);
+  /* nor is the other direction */
+  memcpy(test_buf + 300, "xy", 2);
+  Submit(&tr, NACL_ABI_SOCKRING_OP_SEND, 0, d, 300, 2, 5);
+  errors += Reap(&tr, 5, 2);
+
+  if (6 != send(peer, "abcdef", 6, 0)) {
+    printf("ERROR: send failed\n");
+    ++errors;
+  }
+  errors += Reap(&tr, 1, 3);
+  errors += Reap(&tr, 2, 3);
+  if (0 != memcmp(test_buf, "abc", 3) ||
+      0 != memcmp(test_buf + 100, "def", 3)) {
+    printf("ERROR: received out of order\n");
+    ++errors;
+  }
+  Submit(&tr, NACL_ABI_SOCKRING_OP_SEND, 0, d, sizeof test_buf, 1, 6);
+  errors += Reap(&tr, 6, -NACL_ABI_EFAULT);
+
+  TestRingDtor(&tr);
+  (void) recv(peer, test_buf, sizeof test_buf, MSG_DONTWAIT);
+  return errors;
+}
+
+
+int BackPressureTest(int d) {
+  struct TestRing tr;
+  uint32_t        i;
+  int             errors = 0;
+  char            data[12];
+
+  printf("\nBackPressureTest\n");
+  if (0 != TestRingCtor(&tr, 4)) {
+    return 1;
+  }
+  /* 8 parked fill the completion queue; the last 4 must stay queued */
+  for (i = 0; i < 12; ++i) {
+    while (!Submit(&tr, NACL_ABI_SOCKRING_OP_RECV, 0, d, i, 1, i)) {
+      (void) NaClDescSockRingEnter(tr.ring, 0, 0);  /* let the worker in */
+    }
+  }
+  (void) NaClDescSockRingEnter(tr.ring, 1, 100);
+  if (8 != tr.hdr->sq_head || 12 != tr.hdr->sq_tail) {
+    printf("ERROR: took %u of %u\n", tr.hdr->sq_head, tr.hdr->sq_tail);
+    ++errors;
+  }
+
+  for (i = 0; i < 12; ++i) {
+    data[i] = 'a' + i;
+  }
+  if (12 != send(peer, data, 12, 0)) {
+    printf("ERROR: send failed\n");
+    ++errors;
+  }
+  for (i = 0; i < 12; ++i) {
+    errors += Reap(&tr, i, 1);
+  }
+  if (0 != memcmp(test_buf, data, 12)) {
+    printf("ERROR: received out of order\n");
+    ++errors;
+  }
+
+  TestRingDtor(&tr);
+  return errors;
+}
+
+
+int CloseTest(int d) {
+  struct TestRing tr;
+
+  printf("\nCloseTest\n");
+  if (0 != TestRingCtor(&tr, 4)) {
+    return 1;
+  }
+  Submit(&tr, NACL_ABI_SOCKRING_OP_RECV, 0, d, 0, 1, 1);
+  (void) NaClDescSockRingEnter(tr.ring, 1, 50);
+  TestRingDtor(&tr);  /* must not wait for the parked receive */
+  return 0;
+}
+
+
+int main(int ac, char **av) {
+  int sv[2];
+  int d;
+  int errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+  if (!NaClMutexCtor(&app.desc_mu) || !DynArrayCtor(&app.desc_tbl, 4)) {
+    printf("ERROR: no descriptor table\n");
+    return 1;
+  }
+  if (0 != socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+    printf("ERROR: socketpair failed\n");
+    return 1;
+  }
+  d = NaClSetAvail(&app, (struct NaClDesc *) NaClDescSocketMake(sv[0]));
+  peer = sv[1];
+
+  errors += OrderTest(d);
+  errors += BackPressureTest(d);
+  errors += CloseTest(d);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime per-socket record of validated peers.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_state.h"
+
+#define NACL_SOCK_STATE_CHUNK_SIZE  (1 << NACL_SOCK_STATE_CHUNK_BITS)
+
+static struct NaClMutex           nacl_sock_state_mu;  /* chunk allocation */
+static struct NaClMutex           nacl_sock_state_stripe[
+    NACL_SOCK_STATE_STRIPES];
+static struct NaClSockState       *volatile nacl_sock_state_chunk[
+    NACL_SOCK_STATE_MAX_CHUNKS];
+
+
+void NaClSockStateModuleInit(void) {
+  int i;
+
+  if (!NaClMutexCtor(&nacl_sock_state_mu)) {
+    NaClLog(LOG_FATAL, "NaClSockStateModuleInit: mutex ctor failed\n");
+  }
+  for (i = 0; i < NACL_SOCK_STATE_STRIPES; ++i) {
+    if (!NaClMutexCtor(&nacl_sock_state_stripe[i])) {
+      NaClLog(LOG_FATAL, "NaClSockStateModuleInit: mutex ctor failed\n");
+    }
+  }
+}
+
+
+void NaClSockStateModuleFini(void) {
+  int i;
+
+  for (i = 0; i < NACL_SOCK_STATE_MAX_CHUNKS; ++i) {
+    free(nacl_sock_state_chunk[i]);
+    nacl_sock_state_chunk[i] = NULL;
+  }
+  for (i = 0; i < NACL_SOCK_STATE_STRIPES; ++i) {
+    NaClMutexDtor(&nacl_sock_state_stripe[i]);
+  }
+  NaClMutexDtor(&nacl_sock_state_mu);
+}
+
+
+/*
+ * Returns fd's state, allocating its chunk if create is set, or NULL.
+ */
+static struct NaClSockState *NaClSockStateGet(int fd, int create) {
+  struct NaClSockState  *chunk;
+  uint32_t              ix;
+
+  if (fd < 0) {
+    return NULL;
+  }
+  ix = (uint32_t) fd >> NACL_SOCK_STATE_CHUNK_BITS;
+  if (ix >= NACL_SOCK_STATE_MAX_CHUNKS) {
+    return NULL;
+  }
+  chunk = nacl_sock_state_chunk[ix];
+  if (NULL == chunk && create) {
+    NaClXMutexLock(&nacl_sock_state_mu);
+    chunk = nacl_sock_state_chunk[ix];
+    if (NULL == chunk) {
+      chunk = calloc(NACL_SOCK_STATE_CHUNK_SIZE, sizeof *chunk);
+      /* zeroed memory must be visible before the chunk is */
+      __sync_synchronize();
+      nacl_sock_state_chunk[ix] = chunk;
+    }
+    NaClXMutexUnlock(&nacl_sock_state_mu);
+  }
+  if (NULL == chunk) {
+    return NULL;
+  }
+  return &chunk[fd & (NACL_SOCK_STATE_CHUNK_SIZE - 1)];
+}
+
+
+static INLINE struct NaClMutex *NaClSockStateStripe(int fd) {
+  return &nacl_sock_state_stripe[fd % NACL_SOCK_STATE_STRIPES];
+}
+
+
+static INLINE int NaClSockPeerIs(struct NaClSockPeer const  *p,
+                                 struct sockaddr_in const   *addr) {
+  return (p->valid && p->ip == addr->sin_addr.s_addr
+          && p->port == addr->sin_port);
+}
+
+
+static INLINE uint32_t NaClSockStateSlot(struct sockaddr_in const *addr) {
+  uint32_t h = (addr->sin_addr.s_addr ^ addr->sin_port) * 2654435761U;
+
+  return (h >> 16) & (NACL_SOCK_STATE_CLEARED - 1);
+}
+
+
+static void NaClSockPeerSet(struct NaClSockPeer       *p,
+                            struct sockaddr_in const  *addr,
+                            uint32_t                  expires) {
+  p->ip = addr->sin_addr.s_addr;
+  p->port = addr->sin_port;
+  p->expires = expires;
+  p->valid = 1;
+}
+
+
+void NaClSockStateReset(int fd) {
+  struct NaClSockState  *s = NaClSockStateGet(fd, 0);
+
+  if (NULL != s) {
+    NaClXMutexLock(NaClSockStateStripe(fd));
+    memset(s, 0, sizeof *s);
+    NaClXMutexUnlock(NaClSockStateStripe(fd));
+  }
+}
+
+
+void NaClSockStateSetPeer(int fd, struct sockaddr_in const *addr) {
+  struct NaClSockState  *s = NaClSockStateGet(fd, 1);
+
+  if (NULL != s) {
+    NaClXMutexLock(NaClSockStateStripe(fd));
+    NaClSockPeerSet(&s->peer, addr, 0);
+    NaClXMutexUnlock(NaClSockStateStripe(fd));
+  }
+}
+
+
+int NaClSockStateCheck(int fd, struct sockaddr_in const *addr, uint32_t now) {
+  struct NaClSockState  *s = NaClSockStateGet(fd, 0);
+  struct NaClSockPeer   *p;
+  int                   ok;
+
+  if (NULL == s) {
+    return 0;
+  }
+  NaClXMutexLock(NaClSockStateStripe(fd));
+  p = &s->cleared[NaClSockStateSlot(addr)];
+  ok = (NaClSockPeerIs(&s->peer, addr)
+        || (NaClSockPeerIs(p, addr) && (int32_t) (now - p->expires) < 0));
+  NaClXMutexUnlock(NaClSockStateStripe(fd));
+  return ok;
+}
+
+
+void NaClSockStateClear(int fd, struct sockaddr_in const *addr,
+                        uint32_t expires) {
+  struct NaClSockState  *s = NaClSockStateGet(fd, 1);
+
+  if (NULL != s) {
+    NaClXMutexLock(NaClSockStateStripe(fd));
+    NaClSockPeerSet(&s->cleared[NaClSockStateSlot(addr)], addr, expires);
+    NaClXMutexUnlock(NaClSockStateStripe(fd));
+  }
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl service runtime per-socket record of validated peers.
+ *
+ * Checking a peer against its validation server's policy costs a
+ * peer cache search at best and a handshake at worst, which is too
+ * much to pay per packet.  So each socket, indexed by its host
+ * descriptor, remembers the peer it was validated for at connect
+ * time, and a small direct-mapped set of (ip, port) tuples that
+ * sendto/recvfrom have already been cleared for.  Checking either is
+ * O(1).  Connected peers stay cleared for the life of the connection;
+ * tuples expire so that policy changes reach unconnected sockets.
+ *
+ * State for a descriptor number must be reset whenever a new socket
+ * is created with that number.  Memory is allocated in chunks of
+ * descriptors on first use and never freed while the module is live,
+ * so the lookup path needs no table lock; each socket's state is
+ * protected by one of a set of striped mutexes.
+ */
+
+#ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCK_STATE_H_
+#define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCK_STATE_H_
+
+#include <netinet/in.h>
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_SOCK_STATE_CHUNK_BITS  10
+#define NACL_SOCK_STATE_MAX_CHUNKS  1024  /* descriptors below 1 << 20 */
+#define NACL_SOCK_STATE_CLEARED     8     /* tuples per socket, power of 2 */
+#define NACL_SOCK_STATE_STRIPES     64
+
+struct NaClSockPeer {
+  uint32_t  ip;       /* network byte order */
+  uint16_t  port;     /* network byte order */
+  uint16_t  valid;
+  uint32_t  expires;  /* NaClSocksClientNow() time; unused for the peer */
+};
+
+struct NaClSockState {
+  struct NaClSockPeer peer;  /* validated at connect */
+  struct NaClSockPeer cleared[NACL_SOCK_STATE_CLEARED];
+};
+
+void NaClSockStateModuleInit(void);
+
+void NaClSockStateModuleFini(void);
+
+/*
+ * Forget everything about descriptor fd; called when a new socket is
+ * created with that number.
+ */
+void NaClSockStateReset(int fd);
+
+/*
+ * Record that fd was connected to the validated peer addr.
+ */
+void NaClSockStateSetPeer(int fd, struct sockaddr_in const *addr);
+
+/*
+ * Returns non-zero if addr is fd's connected peer, or was cleared
+ * for fd and has not expired as of now.
+ */
+int NaClSockStateCheck(int fd, struct sockaddr_in const *addr, uint32_t now);
+
+/*
+ * Remember until expires that addr is cleared for fd, displacing
+ * whatever tuple shared its slot.
+ */
+void NaClSockStateClear(int fd, struct sockaddr_in const *addr,
+                        uint32_t expires);
+
+EXTERN_C_END
+
+#endif
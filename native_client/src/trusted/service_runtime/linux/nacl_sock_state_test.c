@@ -0,0 +1,152 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise per-socket peer state: connected peers, cleared tuples
+ * and their expiry, slot collisions, and reset on descriptor reuse.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_state.h"
+
+#define TEST_NOW  1000
+#define TEST_TTL  60
+
+
+static struct sockaddr_in Addr(uint32_t ip, uint16_t port) {
+  struct sockaddr_in a;
+
+  memset(&a, 0, sizeof a);
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = htonl(ip);
+  a.sin_port = htons(port);
+  return a;
+}
+
+
+static int Expect(int fd, uint32_t ip, uint16_t port, uint32_t now, int want) {
+  struct sockaddr_in  a = Addr(ip, port);
+  int                 got = NaClSockStateCheck(fd, &a, now);
+
+  if (got != want) {
+    printf("ERROR: fd %d 0x%08x:%u at %u: %s, expected %s\n",
+           fd, ip, port, now, got ? "cleared" : "not cleared",
+           want ? "cleared" : "not cleared");
+    return 1;
+  }
+  return 0;
+}
+
+
+int PeerTest(void) {
+  struct sockaddr_in  a = Addr(0x0a000001, 80);
+  int                 errors = 0;
+
+  printf("\nPeerTest\n");
+  errors += Expect(3, 0x0a000001, 80, TEST_NOW, 0);
+  NaClSockStateSetPeer(3, &a);
+  /* the connected peer never expires, and is specific to its fd */
+  errors += Expect(3, 0x0a000001, 80, TEST_NOW + 1000000, 1);
+  errors += Expect(3, 0x0a000001, 81, TEST_NOW, 0);
+  errors += Expect(4, 0x0a000001, 80, TEST_NOW, 0);
+  /* descriptors beyond the first chunk work too */
+  NaClSockStateSetPeer(5000, &a);
+  errors += Expect(5000, 0x0a000001, 80, TEST_NOW, 1);
+
+  /* a new socket with the same number starts out clean */
+  NaClSockStateReset(3);
+  errors += Expect(3, 0x0a000001, 80, TEST_NOW, 0);
+  return errors;
+}
+
+
+int ClearedTest(void) {
+  struct sockaddr_in  a;
+  uint32_t            ip;
+  int                 cleared = 0;
+  int                 errors = 0;
+
+  printf("\nClearedTest\n");
+  a = Addr(0x0a000002, 53);
+  NaClSockStateClear(7, &a, TEST_NOW + TEST_TTL);
+  errors += Expect(7, 0x0a000002, 53, TEST_NOW, 1);
+  errors += Expect(7, 0x0a000002, 53, TEST_NOW + TEST_TTL, 0);
+
+  /* more tuples than slots: the set stays bounded, the last one sticks */
+  for (ip = 0; ip < 4 * NACL_SOCK_STATE_CLEARED; ++ip) {
+    a = Addr(0x0b000000 + ip, 53);
+    NaClSockStateClear(7, &a, TEST_NOW + TEST_TTL);
+  }
+  for (ip = 0; ip < 4 * NACL_SOCK_STATE_CLEARED; ++ip) {
+    a = Addr(0x0b000000 + ip, 53);
+    cleared += NaClSockStateCheck(7, &a, TEST_NOW);
+  }
+  if (cleared < 1 || cleared > NACL_SOCK_STATE_CLEARED) {
+    printf("ERROR: %d tuples cleared\n", cleared);
+    ++errors;
+  }
+  errors += Expect(7, 0x0b000000 + 4 * NACL_SOCK_STATE_CLEARED - 1, 53,
+                   TEST_NOW, 1);
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  int errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+  NaClSockStateModuleInit();
+
+  errors += PeerTest();
+  errors += ClearedTest();
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClSockStateModuleFini();
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
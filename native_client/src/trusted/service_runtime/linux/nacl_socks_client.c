@@ -8,152 +8,620 @@
 #include <netdb.h>
 #include <string.h>
 #include <stdio.h>
-#include <sys/mman.h>
+#include <stdlib.h>
 #include <errno.h>
-
+#include <poll.h>
+#include <time.h>
+
+#include "native_client/src/shared/platform/nacl_host_desc.h"
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_sync_checked.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_hash_store.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_peer_cache.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_peer_store.h"
 #include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
 #include "native_client/src/trusted/service_runtime/nacl_app_thread.h"
 #include "native_client/src/trusted/service_runtime/sel_ldr.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
+
+/*A validation handshake in progress; later askers for the same ip wait on it*/
+struct NaClPendingHandshake {
+  struct NaClPendingHandshake *next;
+  uint32_t ip;
+  int refs;     /* the thread doing the handshake plus the waiters */
+  int done;
+  int result;   /* valid iff done */
+  struct NaClRemoteServerPorts ports;  /* valid iff done && 0 == result */
+};
+
+static struct NaClPeerCache nacl_peer_cache;
+static uint32_t nacl_peer_allow_ttl = NACL_PEER_CACHE_DEFAULT_ALLOW_TTL;
+static uint32_t nacl_peer_deny_ttl = NACL_PEER_CACHE_DEFAULT_DENY_TTL;
+/*Optional on-disk second level, shared with other sel_ldrs; see nacl_peer_store.h*/
+static struct NaClPeerStore nacl_peer_store;
+static int nacl_peer_store_ok = 0;
+static uint64_t nacl_validate_timeout_usec = NACL_VALIDATE_DEFAULT_TIMEOUT_MS * 1000;
+static uint16_t nacl_validate_port = NACL_VALIDATE_SERVERPORT;
+
+/*nacl_pending_mu protects the pending list and the handshake stats*/
+static struct NaClMutex nacl_pending_mu;
+static struct NaClCondVar nacl_pending_cv;
+static struct NaClPendingHandshake *nacl_pending = NULL;
+static struct NaClHandshakeStats nacl_handshake_stats;
+
+
+static uint64_t NaClSocksClientMicroTime(void) {
+  struct timespec ts;
+
+  if (0 != clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    NaClLog(LOG_FATAL, "NaClSocksClientMicroTime: clock_gettime failed\n");
+  }
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-#define NUM_REMOTE_SERVER_PORTS 20
-struct NaClRemoteServerPorts remoteServerPortsRingbuffer[NUM_REMOTE_SERVER_PORTS];
-int rsprb_index = 0;
+
+/*Seconds on the monotonic clock, so TTLs are immune to wall clock changes*/
+uint32_t NaClSocksClientNow(void) {
+  return (uint32_t) (NaClSocksClientMicroTime() / 1000000);
+}
 
 
-int verifyServerPort(struct NaClRemoteServerPorts *p, uint16_t port) {
-  return (((p->ports[port/8]) & (1 << (port % 8))) != 0);
+uint32_t NaClSocksClientAllowTtl(void) {
+  return nacl_peer_allow_ttl;
 }
 
 
-int NaClIsConnectionOk(const struct sockaddr *addr, unsigned char* hash) {
-  // We've verified that this must (well, is supposed to) be an inet struct
-  struct sockaddr_in *addr_in = (struct sockaddr_in *)addr;
+static unsigned long NaClSocksClientEnv(const char *name, unsigned long dflt) {
+  char *env;
 
-  int i, r;
+  if (NULL != (env = getenv(name))) {
+    return strtoul(env, (char **) 0, 0);
+  }
+  return dflt;
+}
 
-  unsigned char buf[24];
-  char ret_buf[8200];
-  struct NaClRemoteServerPorts *remote_ports;
 
-  struct sockaddr_in to;
-  int sockfd;
+void NaClSocksClientModuleInit(void) {
+  unsigned long entries;
+  char *store_path;
+
+  entries = NaClSocksClientEnv("NACL_PEER_CACHE_ENTRIES",
+                               NACL_PEER_CACHE_DEFAULT_ENTRIES);
+  nacl_peer_allow_ttl = NaClSocksClientEnv("NACL_PEER_CACHE_ALLOW_TTL",
+                                           NACL_PEER_CACHE_DEFAULT_ALLOW_TTL);
+  nacl_peer_deny_ttl = NaClSocksClientEnv("NACL_PEER_CACHE_DENY_TTL",
+                                          NACL_PEER_CACHE_DEFAULT_DENY_TTL);
+  nacl_validate_timeout_usec = 1000 * (uint64_t) NaClSocksClientEnv(
+      "NACL_VALIDATE_TIMEOUT_MS", NACL_VALIDATE_DEFAULT_TIMEOUT_MS);
+  nacl_validate_port = (uint16_t) NaClSocksClientEnv("NACL_VALIDATE_PORT",
+                                                     NACL_VALIDATE_SERVERPORT);
+  if (!NaClPeerCacheCtor(&nacl_peer_cache, (uint32_t) entries)) {
+    NaClLog(LOG_FATAL, "Could not allocate peer policy cache\n");
+  }
+  if (!NaClMutexCtor(&nacl_pending_mu) ||
+      !NaClCondVarCtor(&nacl_pending_cv)) {
+    NaClLog(LOG_FATAL, "Could not create handshake synchronization objects\n");
+  }
+  memset(&nacl_handshake_stats, 0, sizeof nacl_handshake_stats);
+
+  // Runs without the store if it can't be used; NaClPeerStoreCtor logs why
+  if (NULL != (store_path = getenv("NACL_PEER_STORE"))) {
+    nacl_peer_store_ok = NaClPeerStoreCtor(
+        &nacl_peer_store, store_path,
+        NaClSocksClientEnv("NACL_PEER_STORE_SLOTS",
+                           NACL_PEER_STORE_DEFAULT_SLOTS));
+  }
+}
 
-  if (addr->sa_family != AF_INET) {
-    return -1; // We don't support anything != IPv4 at this time
+
+void NaClSocksClientModuleFini(void) {
+  struct NaClPeerCacheStats stats;
+  struct NaClHandshakeStats hs;
+
+  NaClPeerCacheGetStats(&nacl_peer_cache, &stats);
+  NaClLog(1, ("peer cache: %"PRIuPTR" hits, %"PRIuPTR" misses,"
+              " %"PRIuPTR" expired, %"PRIuPTR" inserts,"
+              " %"PRIuPTR" evictions\n"),
+          stats.hits, stats.misses, stats.expirations, stats.inserts,
+          stats.evictions);
+  NaClSocksClientGetHandshakeStats(&hs);
+  NaClLog(1, ("validation handshakes: %"PRIuPTR" done, %"PRIuPTR" failed,"
+              " %"PRIuPTR" timed out, %"PRIuPTR" coalesced,"
+              " %"PRIuPTR" from store,"
+              " %"PRIu64" usec total, %"PRIu64" usec max\n"),
+          hs.handshakes, hs.failures, hs.timeouts, hs.coalesced,
+          hs.store_hits, hs.total_usec, hs.max_usec);
+  if (nacl_peer_store_ok) {
+    NaClPeerStoreDtor(&nacl_peer_store);
+    nacl_peer_store_ok = 0;
   }
+  NaClCondVarDtor(&nacl_pending_cv);
+  NaClMutexDtor(&nacl_pending_mu);
+  NaClPeerCacheDtor(&nacl_peer_cache);
+}
 
-  // See if we already know what to do with this IP
-  for (i = 0; i < NUM_REMOTE_SERVER_PORTS; i++) {
-    if (remoteServerPortsRingbuffer[i].ip == addr_in->sin_addr.s_addr) {
-      return verifyServerPort(&remoteServerPortsRingbuffer[i], addr_in->sin_port);
+
+void NaClSocksClientGetHandshakeStats(struct NaClHandshakeStats *stats) {
+  NaClXMutexLock(&nacl_pending_mu);
+  *stats = nacl_handshake_stats;
+  NaClXMutexUnlock(&nacl_pending_mu);
+}
+
+
+/*Wait until fd is ready for events, or fail once the deadline (NaClSocksClientMicroTime) passes*/
+static int NaClHandshakeWait(int fd, short events, uint64_t deadline) {
+  struct pollfd pfd;
+  uint64_t now;
+  int r;
+
+  for (;;) {
+    now = NaClSocksClientMicroTime();
+    if (now >= deadline) {
+      return -NACL_ABI_ETIMEDOUT;
+    }
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    r = poll(&pfd, 1, (int) ((deadline - now + 999) / 1000));
+    if (r > 0) {
+      return 0;
+    }
+    if (r < 0 && EINTR != errno) {
+      return -NaClXlateErrno(errno);
+    }
+  }
+}
+
+
+/*Run the handshake over non-blocking sockfd; every step is bounded by deadline*/
+/*The reply, of at most NACL_VALIDATE_RESP_MAX_BYTES, goes to resp and its length to *resp_len*/
+static int NaClHandshakeExchange(int sockfd, const struct sockaddr_in *to,
+                                 const unsigned char *req, size_t req_len,
+                                 char *resp, uint32_t *resp_len,
+                                 uint64_t deadline) {
+  size_t done;
+  uint32_t want;
+  ssize_t n;
+  int err;
+  socklen_t err_len = sizeof(err);
+  int r;
+
+  if (connect(sockfd, (const struct sockaddr *) to, sizeof(*to)) < 0) {
+    if (EINPROGRESS != errno) {
+      return -NaClXlateErrno(errno);
+    }
+    if ((r = NaClHandshakeWait(sockfd, POLLOUT, deadline)) != 0) {
+      return r;
+    }
+    if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
+      return -NaClXlateErrno(errno);
+    }
+    if (0 != err) {
+      return -NaClXlateErrno(err);
+    }
+  }
+
+  for (done = 0; done < req_len; done += n) {
+    n = send(sockfd, req + done, req_len - done, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (EAGAIN != errno && EINTR != errno) {
+        return -NaClXlateErrno(errno);
+      }
+      if ((r = NaClHandshakeWait(sockfd, POLLOUT, deadline)) != 0) {
+        return r;
+      }
+      n = 0;
+    }
+  }
+
+  // The reply may arrive in many segments; read until it is complete,
+  // which its header tells us, or the server closes the connection.
+  want = NACL_VALIDATE_RESP_MAX_BYTES;
+  for (done = 0; done < want; done += n, want = NaClHashRespBytes(resp, done)) {
+    n = recv(sockfd, resp + done, want - done, 0);
+    if (0 == n) {
+      break;
+    }
+    if (n < 0) {
+      if (EAGAIN != errno && EINTR != errno) {
+        return -NaClXlateErrno(errno);
+      }
+      if ((r = NaClHandshakeWait(sockfd, POLLIN, deadline)) != 0) {
+        return r;
+      }
+      n = 0;
     }
   }
+  *resp_len = (uint32_t) done;
+  return 0;
+}
+
+
+/*Ask the validation server on addr_in's host which ports we may use*/
+/*Returns 0 and fills in *remote_ports on success; a negative NACL_ABI_ errno otherwise*/
+static int NaClFetchServerPorts(const struct sockaddr_in *addr_in, unsigned char *hash,
+                                struct NaClRemoteServerPorts *remote_ports) {
+  int r;
+  unsigned char buf[NACL_VALIDATE_REQ_BYTES];
+  char ret_buf[NACL_VALIDATE_RESP_MAX_BYTES];
+  uint32_t ret_len;
+  uint32_t nonce = NACL_VALIDATE_VERSION << 24;
+
+  struct sockaddr_in to;
+  int sockfd;
+
+  MakeNaClHashReq(&buf[0], hash, nonce);
 
-  // We don't.  So, go fetch a response, and use it.
-  MakeNaClHashReq(&buf[0], hash, 0);
-  
   // Set up the remote server to send to
-  to.sin_port = htons(NACL_VALIDATE_SERVERPORT);
+  memset(&to, 0, sizeof(to));
+  to.sin_port = htons(nacl_validate_port);
   to.sin_family = AF_INET;
   to.sin_addr = addr_in->sin_addr;
-  
+
   if ((sockfd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0)  {
-    return sockfd;
+    return -NaClXlateErrno(errno);
+  }
+  if (fcntl(sockfd, F_SETFD, FD_CLOEXEC) < 0 ||
+      fcntl(sockfd, F_SETFL, O_NONBLOCK) < 0) {
+    r = -NaClXlateErrno(errno);
+    close(sockfd);
+    return r;
   }
 
-  if ((r = connect(sockfd, &to, sizeof(to))) < 0) {
+  r = NaClHandshakeExchange(sockfd, &to, buf, sizeof(buf), ret_buf, &ret_len,
+                            NaClSocksClientMicroTime() + nacl_validate_timeout_usec);
+  close(sockfd);
+  if (0 != r) {
     return r;
   }
-  
-  if ((r = send(sockfd, &buf, sizeof(buf), 0)) < 0) {
-    return -1;
+
+  if (0 != ParseNaClHashResp(&ret_buf[0], ret_len, addr_in->sin_addr.s_addr, remote_ports, nonce)) {
+    // Refused, or not a well formed answer; either way no ports are open
+    return -NACL_ABI_EACCES;
   }
+  return 0;
+}
 
-  // Zero ret_buf, so that on the off chance the server
-  // is broken and sends us too little data,
-  // we're conservative and assume not to use unspecified ports.
-  memset(&ret_buf[0], 0, sizeof(ret_buf));
-  if ((r = recv(sockfd, &ret_buf[0], sizeof(ret_buf), 0)) < 0) {
-    return r;
+
+/*Worth remembering: failures due to the peer, not local resource shortages*/
+static int NaClHandshakeErrorCacheable(int r) {
+  return (-NACL_ABI_EMFILE != r && -NACL_ABI_ENFILE != r &&
+          -NACL_ABI_ENOBUFS != r && -NACL_ABI_ENOMEM != r);
+}
+
+
+/*Answer p from the shared store if another sel_ldr has asked recently*/
+static int NaClStoreLookup(struct NaClPendingHandshake *p, unsigned char *hash) {
+  int32_t error;
+  uint32_t ttl;
+
+  if (!nacl_peer_store_ok ||
+      !NaClPeerStoreLookup(&nacl_peer_store, hash, p->ip, time(NULL),
+                           &p->ports, &error, &ttl)) {
+    return 0;
   }
-  
-  close(sockfd);
+  if (0 == error) {
+    (void) NaClPeerCacheInsert(&nacl_peer_cache, &p->ports,
+                               NaClSocksClientNow(), ttl);
+  } else {
+    (void) NaClPeerCacheInsertError(&nacl_peer_cache, p->ip, error,
+                                    NaClSocksClientNow(), ttl);
+  }
+  NaClXMutexLock(&nacl_pending_mu);
+  ++nacl_handshake_stats.store_hits;
+  p->result = error;
+  p->done = 1;
+  NaClXCondVarBroadcast(&nacl_pending_cv);
+  NaClXMutexUnlock(&nacl_pending_mu);
+  return 1;
+}
 
-  if ((r = ParseNaClHashResp(&ret_buf[0], sizeof(ret_buf), addr_in->sin_addr.s_addr, &remote_ports, 0)) != 0) {
+
+/*Do the handshake for p->ip, cache the outcome, and record how long it took*/
+static void NaClRunHandshake(struct NaClPendingHandshake *p,
+                             const struct sockaddr_in *addr_in,
+                             unsigned char *hash) {
+  uint64_t start;
+  uint64_t usec;
+  int r;
+
+  if (NaClStoreLookup(p, hash)) {
+    return;
+  }
+
+  start = NaClSocksClientMicroTime();
+  r = NaClFetchServerPorts(addr_in, hash, &p->ports);
+  usec = NaClSocksClientMicroTime() - start;
+
+  // Failing to cache only costs another handshake next time
+  if (0 == r) {
+    (void) NaClPeerCacheInsert(&nacl_peer_cache, &p->ports,
+                               NaClSocksClientNow(), nacl_peer_allow_ttl);
+  } else if (NaClHandshakeErrorCacheable(r)) {
+    (void) NaClPeerCacheInsertError(&nacl_peer_cache, p->ip, r,
+                                    NaClSocksClientNow(), nacl_peer_deny_ttl);
+  }
+  if (nacl_peer_store_ok && (0 == r || NaClHandshakeErrorCacheable(r))) {
+    (void) NaClPeerStoreInsert(&nacl_peer_store, hash, p->ip, r, &p->ports,
+                               time(NULL),
+                               0 == r ? nacl_peer_allow_ttl : nacl_peer_deny_ttl);
+  }
+  NaClLog(2, "validation handshake with 0x%08x: %d after %"PRIu64" usec\n",
+          ntohl(p->ip), r, usec);
+
+  NaClXMutexLock(&nacl_pending_mu);
+  ++nacl_handshake_stats.handshakes;
+  if (0 != r) {
+    ++nacl_handshake_stats.failures;
+  }
+  if (-NACL_ABI_ETIMEDOUT == r) {
+    ++nacl_handshake_stats.timeouts;
+  }
+  nacl_handshake_stats.total_usec += usec;
+  if (usec > nacl_handshake_stats.max_usec) {
+    nacl_handshake_stats.max_usec = usec;
+  }
+  p->result = r;
+  p->done = 1;
+  NaClXCondVarBroadcast(&nacl_pending_cv);
+  NaClXMutexUnlock(&nacl_pending_mu);
+}
+
+
+int NaClIsConnectionOk(const struct sockaddr *addr, unsigned char* hash) {
+  // We've verified that this must (well, is supposed to) be an inet struct
+  const struct sockaddr_in *addr_in = (const struct sockaddr_in *)addr;
+  struct NaClPendingHandshake *p;
+  struct NaClPendingHandshake **pp;
+  uint32_t ip;
+  uint16_t port;
+  int r;
+
+  if (addr->sa_family != AF_INET) {
+    return -1; // We don't support anything != IPv4 at this time
+  }
+  ip = addr_in->sin_addr.s_addr;
+  port = ntohs(addr_in->sin_port);
+
+  // See if we already know what to do with this IP
+  if (NaClPeerCacheLookup(&nacl_peer_cache, ip, port, NaClSocksClientNow(), &r)) {
     return r;
   }
 
-  return verifyServerPort(remote_ports, addr_in->sin_port);
+  // We don't.  Join the handshake for this IP if one is running,
+  // otherwise start one; either way only one goes over the wire.
+  NaClXMutexLock(&nacl_pending_mu);
+  for (p = nacl_pending; NULL != p && p->ip != ip; p = p->next) {
+  }
+  if (NULL != p) {
+    ++p->refs;
+    ++nacl_handshake_stats.coalesced;
+  } else {
+    // A handshake may have completed since we looked
+    if (NaClPeerCacheLookup(&nacl_peer_cache, ip, port, NaClSocksClientNow(), &r)) {
+      NaClXMutexUnlock(&nacl_pending_mu);
+      return r;
+    }
+    if (NULL == (p = malloc(sizeof *p))) {
+      NaClXMutexUnlock(&nacl_pending_mu);
+      return -NACL_ABI_ENOMEM;
+    }
+    p->ip = ip;
+    p->refs = 1;
+    p->done = 0;
+    p->next = nacl_pending;
+    nacl_pending = p;
+    NaClXMutexUnlock(&nacl_pending_mu);
+
+    NaClRunHandshake(p, addr_in, hash);
+
+    NaClXMutexLock(&nacl_pending_mu);
+    for (pp = &nacl_pending; *pp != p; pp = &(*pp)->next) {
+    }
+    *pp = p->next;
+  }
+  while (!p->done) {
+    NaClXCondVarWait(&nacl_pending_cv, &nacl_pending_mu);
+  }
+
+  r = p->result;
+  if (0 == r) {
+    r = NaClPortPolicyAllows(&p->ports, port) ? 0 : -NACL_ABI_EACCES;
+  }
+  if (0 == --p->refs) {
+    free(p);
+  }
+  NaClXMutexUnlock(&nacl_pending_mu);
+  return r;
 }
 
 
 /*Given a hash & nonce, fill in the buf with the message that needs to be sent to server*/
-/*The buffer must have a length of 24 bytes.  The response will be 24 bytes long.*/
+/*The buffer must have a length of 24 bytes.*/
 void MakeNaClHashReq(unsigned char *buf, unsigned char *hash, uint32_t nonce) {
+  uint32_t net_nonce = htonl(nonce);
+
   memcpy(buf, hash, 20);
-  memcpy(buf+20, &nonce, 4);
+  memcpy(buf+20, &net_nonce, 4);
 }
 
-/*Given the response from the server, fills in and sets ports to point to the NaClRemoteServerPorts struct*/
+static uint32_t NaClHashRespWord(const char *buf, uint32_t i) {
+  uint32_t w;
+
+  memcpy(&w, buf + 4 * i, 4);
+  return ntohl(w);
+}
+
+uint32_t NaClHashRespBytes(const char *buf, uint32_t have) {
+  uint32_t count;
+
+  if (have < 4) {
+    return NACL_VALIDATE_RESP_MAX_BYTES;
+  }
+  if (NaClHashRespWord(buf, 0) != NACL_VALIDATE_REPLY_V2_MAGIC) {
+    return NACL_VALIDATE_RESP_BYTES;
+  }
+  if (have < NACL_VALIDATE_REPLY_V2_HDR_BYTES) {
+    return NACL_VALIDATE_RESP_MAX_BYTES;
+  }
+  count = NaClHashRespWord(buf, 3);
+  if (NACL_PORT_POLICY_BITMAP == count || count > NACL_PORT_POLICY_MAX_RANGES) {
+    // An oversized count is rejected by the parser; stop reading regardless
+    return NACL_VALIDATE_RESP_MAX_BYTES;
+  }
+  return NACL_VALIDATE_REPLY_V2_HDR_BYTES + 4 * count;
+}
+
+/*Given the response from the server, fills in *ports for server_ip*/
 /*returns 0 on success nonzero on error*/
-int ParseNaClHashResp(const char* buf, uint32_t buf_len, uint32_t server_ip, struct NaClRemoteServerPorts **ports, uint32_t nonce) {
-  /* Format is as follows:
-   * 
-   * First 32 bits: success code (4-byte integer, in network order) -- 0 indicates success
-   * Next 32 bits: Nonce that we sent to the server initially
-   * Next 65536 bits: Bitmask of allowed ports
-   */
-  uint32_t *int_ptr;
+int ParseNaClHashResp(const char* buf, uint32_t buf_len, uint32_t server_ip, struct NaClRemoteServerPorts *ports, uint32_t nonce) {
+  /* See nacl_socks_client.h for the formats */
   uint32_t success;
   uint32_t new_nonce;
-  struct NaClRemoteServerPorts *p;
+  uint32_t count;
+
+  ports->ip = server_ip;
+  if (buf_len >= NACL_VALIDATE_REPLY_V2_HDR_BYTES &&
+      NaClHashRespWord(buf, 0) == NACL_VALIDATE_REPLY_V2_MAGIC) {
+    success = NaClHashRespWord(buf, 1);
+    new_nonce = NaClHashRespWord(buf, 2);
+    count = NaClHashRespWord(buf, 3);
+    if (success != 0) {
+      return success;
+    }
+    if (new_nonce != nonce || buf_len != NaClHashRespBytes(buf, buf_len)) {
+      return -1;
+    }
+    if (NACL_PORT_POLICY_BITMAP == count) {
+      NaClPortPolicySetBitmap(ports, (const uint8_t *) buf + NACL_VALIDATE_REPLY_V2_HDR_BYTES,
+                              NACL_PORT_POLICY_BITMAP_BYTES);
+      return 0;
+    }
+    return NaClPortPolicySetRanges(ports, (const uint8_t *) buf + NACL_VALIDATE_REPLY_V2_HDR_BYTES,
+                                   count);
+  }
 
-  if (buf_len < 8200) {
-    return -1; // We have to be able to parse out at least our three integers of interest
+  if (buf_len < 8) {
+    return -1; // We have to be able to parse out at least our two integers of interest
   }
 
-  int_ptr = (uint32_t*)buf;
-  success = ntohl(int_ptr[0]);
-  new_nonce = ntohl(int_ptr[1]);
+  success = NaClHashRespWord(buf, 0);
+  new_nonce = NaClHashRespWord(buf, 1);
 
   if (success != 0) {
     return success;
   }
 
-  if (new_nonce != nonce) {
+  // Version 1 servers may not echo the version byte, as it used to be 0
+  if (new_nonce != nonce && new_nonce != (nonce & 0x00ffffff)) {
     return -1;
   }
 
-  p = &remoteServerPortsRingbuffer[rsprb_index++ % NUM_REMOTE_SERVER_PORTS];
+  // On the off chance the server is broken and sends us too little data,
+  // we're conservative and assume not to use unspecified ports.
+  NaClPortPolicySetBitmap(ports, (const uint8_t *) buf + 8, buf_len - 8);
 
-  p->ip = server_ip;
-  memcpy(&p->ports[0], buf + 8, 8192);
+  return 0;
+}
 
-  *ports = p;
+void NaClAppHashInit(struct NaClAppHashCtx *ctx) {
+  SHA1_Init(&ctx->sha);
+}
 
-  return 0;
+void NaClAppHashUpdate(void *vctx, void const *buf, size_t count) {
+  struct NaClAppHashCtx *ctx = (struct NaClAppHashCtx *) vctx;
+
+  SHA1_Update(&ctx->sha, buf, count);
+}
+
+void NaClAppHashFinal(struct NaClAppHashCtx *ctx, unsigned char *hash) {
+  SHA1_Final(hash, &ctx->sha);
 }
 
 /*Given the filename of nexe, create a hash*/
 /*"hash" must point to a 20-bytes buffer into which the hash will be written.*/
 /*returns 0 on success nonzero on error*/
 int MakeNaClHash(const char* nexe_file, unsigned char *hash) {
+  struct NaClAppHashCtx ctx;
+  char buf[64 << 10];
+  ssize_t n;
   int fd;
-  struct stat filstat;
-  int r;
-  void *addr = 0;  
 
   if ((fd = open(nexe_file, O_RDONLY)) < 0) {
     return fd;
   }
-  
-  if ((r = fstat(fd, &filstat)) < 0) {
-    return r;
+
+  NaClAppHashInit(&ctx);
+  while ((n = read(fd, buf, sizeof(buf))) != 0) {
+    if (n < 0) {
+      if (EINTR == errno) {
+        continue;
+      }
+      close(fd);
+      return -1;
+    }
+    NaClAppHashUpdate(&ctx, buf, n);
   }
+  close(fd);
+  NaClAppHashFinal(&ctx, hash);
 
-  addr = mmap(addr, filstat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  return 0;
+}
 
-  SHA1((const unsigned char *)addr, filstat.st_size, hash);
+/*Identity of the file open on iop, for the hash store; 0 if it has none worth storing*/
+static int NaClAppHashKey(FILE *iop, struct NaClHashStoreKey *key) {
+  struct stat st;
 
-  return 0;
+  if (0 != fstat(fileno(iop), &st) || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+  NaClHashStoreKeyFromStat(key, &st);
+  return 1;
+}
+
+int NaClAppHashLoadFile(struct GioMemoryFileSnapshot *gf, char *nexe_file, unsigned char *hash) {
+  struct NaClAppHashCtx ctx;
+  struct NaClHashStore store;
+  struct NaClHashStoreKey before;
+  struct NaClHashStoreKey after;
+  char *store_path;
+  FILE *iop;
+  int store_ok = 0;
+  int cached = 0;
+  int unchanged;
+  int ok;
+
+  if (NULL == (iop = fopen(nexe_file, "rb"))) {
+    return 0;
+  }
+  // Keyed on the open file, so a rename between lookup and read can't swap contents
+  if (NaClAppHashKey(iop, &before) &&
+      NULL != (store_path = getenv("NACL_APP_HASH_STORE"))) {
+    store_ok = NaClHashStoreCtor(&store, store_path,
+                                 NaClSocksClientEnv("NACL_APP_HASH_STORE_SLOTS",
+                                                    NACL_HASH_STORE_DEFAULT_SLOTS));
+    cached = store_ok && NaClHashStoreLookup(&store, &before, hash);
+  }
+
+  NaClAppHashInit(&ctx);
+  ok = GioMemoryFileSnapshotStreamCtor(gf, iop, cached ? NULL : NaClAppHashUpdate, &ctx);
+  unchanged = (ok && store_ok && NaClAppHashKey(iop, &after) &&
+               0 == memcmp(&before, &after, sizeof before));
+  (void) fclose(iop);
+
+  if (ok && cached && !unchanged) {
+    // Written while we read it; the stored hash may not match what we have
+    NaClAppHashUpdate(&ctx, gf->base.buffer, gf->base.len);
+    cached = 0;
+  }
+  if (ok && !cached) {
+    NaClAppHashFinal(&ctx, hash);
+    if (unchanged && !NaClHashStoreKeyRacy(&after, time(NULL))) {
+      (void) NaClHashStoreInsert(&store, &after, hash);
+    }
+  }
+  if (store_ok) {
+    NaClHashStoreDtor(&store);
+  }
+  return ok;
 }
@@ -1,31 +1,114 @@
-#include <sys/socket.h>
-
 #ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCKS_CLIENT_H_
 #define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCKS_CLIENT_H_
 
+#include <sys/socket.h>
+#include <openssl/sha.h>
+
+#include "native_client/src/include/portability.h"
+#include "native_client/src/trusted/service_runtime/gio.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_port_policy.h"
+
+/*Port peers answer handshakes on; NACL_VALIDATE_PORT overrides, for tests and benchmarks*/
 #define NACL_VALIDATE_SERVERPORT 1123
 
-/*Struct indicating what ports on a given IP address we are allowed to connect to*/
-struct NaClRemoteServerPorts {
-  unsigned int ip;
-  unsigned char ports[8192];
+/*
+ * Handshake wire format.  All integers are in network byte order.
+ *
+ * Request, 24 bytes: the 20-byte application hash, then a 32-bit nonce.
+ * The nonce's top byte is the highest reply version the client accepts;
+ * version 1 servers echo the nonce, with or without that byte, and so
+ * keep working.
+ *
+ * Version 1 reply, 8200 bytes: 32-bit status (0 on success), the nonce,
+ * then a bitmap of allowed ports (bit port % 8 of byte port / 8).
+ *
+ * Version 2 reply: NACL_VALIDATE_REPLY_V2_MAGIC, status, nonce, then a
+ * 32-bit count.  If the count is NACL_PORT_POLICY_BITMAP the version 1
+ * bitmap follows; otherwise that many (16-bit lo, 16-bit hi) inclusive
+ * port ranges follow, sorted and disjoint.  A server allowing a few
+ * ports thus replies in a few dozen bytes.
+ */
+#define NACL_VALIDATE_REQ_BYTES 24
+#define NACL_VALIDATE_RESP_BYTES 8200
+#define NACL_VALIDATE_REPLY_V2_MAGIC 0x4e565232  /* "NVR2" */
+#define NACL_VALIDATE_REPLY_V2_HDR_BYTES 16
+#define NACL_VALIDATE_RESP_MAX_BYTES \
+  (NACL_VALIDATE_REPLY_V2_HDR_BYTES + NACL_PORT_POLICY_BITMAP_BYTES)
+#define NACL_VALIDATE_VERSION 2
+#define NACL_VALIDATE_NONCE_VERSION(nonce) ((nonce) >> 24)
+
+/*Upper bound on one handshake, connect to last byte; NACL_VALIDATE_TIMEOUT_MS overrides*/
+#define NACL_VALIDATE_DEFAULT_TIMEOUT_MS 2000
+
+/*Counters for handshakes; all but store_hits count ones that went over the wire*/
+struct NaClHandshakeStats {
+  uintptr_t handshakes;
+  uintptr_t failures;    /* includes timeouts */
+  uintptr_t timeouts;
+  uintptr_t coalesced;   /* callers that waited on another thread's handshake */
+  uintptr_t store_hits;  /* answered from the on-disk store instead */
+  uint64_t total_usec;
+  uint64_t max_usec;
 };
 
+/*Set up / tear down the peer policy cache.  Called from NaClAllModulesInit.*/
+/*The cache size may be overridden with the NACL_PEER_CACHE_ENTRIES environment variable,*/
+/*and the lifetime in seconds of allowed and failed/refused handshake outcomes with*/
+/*NACL_PEER_CACHE_ALLOW_TTL and NACL_PEER_CACHE_DENY_TTL.  A TTL of 0 disables caching.*/
+/*If NACL_PEER_STORE names a file, outcomes are also shared through it with other*/
+/*sel_ldr processes (NACL_PEER_STORE_SLOTS sizes a new one); see nacl_peer_store.h.*/
+void NaClSocksClientModuleInit(void);
+
+void NaClSocksClientModuleFini(void);
+
+void NaClSocksClientGetHandshakeStats(struct NaClHandshakeStats *stats);
+
+/*Seconds on the clock used for policy expiry, and how long an allowed verdict may be reused*/
+uint32_t NaClSocksClientNow(void);
+
+uint32_t NaClSocksClientAllowTtl(void);
+
 /*Given a hash & nonce, fill in the buf with the message that needs to be sent to server*/
 void MakeNaClHashReq(unsigned char *buf, unsigned char *hash, uint32_t nonce);
 
-/*Given the response from the server, fills in udpPorts, tcpPorts, sets global and nonce*/
+/*Given the first have bytes of a reply, return its full length, or NACL_VALIDATE_RESP_MAX_BYTES if that isn't known yet*/
+uint32_t NaClHashRespBytes(const char *buf, uint32_t have);
+
+/*Given the buf_len byte response from the server, of either version, fills in *ports for server_ip*/
+/*A short version 1 reply is treated as denying the missing ports.*/
 /*returns 0 on success nonzero on error*/
-int ParseNaClHashResp(const char* buf, uint32_t buf_len, uint32_t server_ip, struct NaClRemoteServerPorts **ports, uint32_t nonce);
+int ParseNaClHashResp(const char* buf, uint32_t buf_len, uint32_t server_ip, struct NaClRemoteServerPorts *ports, uint32_t nonce);
+
+/*Incremental form of the application hash, so it can be computed while the nexe is loaded*/
+/*OpenSSL picks the fastest SHA-1 the CPU supports (SHA extensions, AVX2, SSSE3) at run time.*/
+struct NaClAppHashCtx {
+  SHA_CTX sha;
+};
+
+void NaClAppHashInit(struct NaClAppHashCtx *ctx);
+
+/*vctx is a struct NaClAppHashCtx; the signature suits GioMemoryFileSnapshotDigestCtor*/
+void NaClAppHashUpdate(void *vctx, void const *buf, size_t count);
 
-/*Given the data of nexe, create a hash*/
+/*"hash" must point to a 20-bytes buffer into which the hash will be written.*/
+void NaClAppHashFinal(struct NaClAppHashCtx *ctx, unsigned char *hash);
+
+/*Given the filename of nexe, create a hash by reading the whole file*/
 /*"hash" must point to a 20-bytes buffer into which the hash will be written.*/
 /*returns 0 on success nonzero on error*/
 int MakeNaClHash(const char* nexe_file, unsigned char *hash);
 
+/*Snapshot nexe_file into *gf as GioMemoryFileSnapshotCtor does, and write its application hash to "hash".*/
+/*If NACL_APP_HASH_STORE names a file, the hash is taken from it when the nexe is unchanged since it was*/
+/*last hashed, and recorded in it otherwise (NACL_APP_HASH_STORE_SLOTS sizes a new one); see nacl_hash_store.h.*/
+/*returns non-zero on success*/
+int NaClAppHashLoadFile(struct GioMemoryFileSnapshot *gf, char *nexe_file, unsigned char *hash);
+
 /*Given a 'struct sockaddr' object, determine if it's making a valid connection.*/
 /*returns 0 if it would be ok to make this connection; nonzero on error (including permissiond failure).*/
 /*This function may open a connection to the specified server in order to determine permissions.*/
+/*That handshake is bounded by a deadline, and concurrent callers for the same IP share one.*/
+/*Results are cached per peer IP; see nacl_peer_cache.h.*/
 int NaClIsConnectionOk(const struct sockaddr *addr, unsigned char *hash);
 
 #endif
@@ -1,38 +1,917 @@
-#include <openssl/sha.h>
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
 
-/*Parse the request coming from the client*/
-/*0 on success*/
-int ParseNaClHashReq(const char* buf, int* nonce, unsigned int hash[20]) {
-  memcpy(&hash, buf, 20);
-  memcpy(nonce, buf+20, 4);
+/*
+ * NaCl validation server.  See nacl_socks_server.h.
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_server.h"
+
+#define NACL_VALIDATE_MIN_BUCKETS     64
+#define NACL_VALIDATE_EPOLL_EVENTS    256
+#define NACL_VALIDATE_RELOAD_CHECK_MS 1000
+
+struct NaClValidateConn {
+  struct NaClValidateConn *next;  /* newer, or next free */
+  struct NaClValidateConn *prev;
+  int                     fd;
+  uint32_t                got;          /* request bytes read */
+  uint32_t                sent;
+  uint32_t                reply_bytes;  /* 0 until the request is in */
+  uint64_t                deadline_ms;
+  unsigned char           req[NACL_VALIDATE_REQ_BYTES];
+  char                    reply[NACL_VALIDATE_RESP_MAX_BYTES];
+};
+
+/* epoll tags for the two fds that are not connections */
+static char kListenTag;
+static char kSignalTag;
+
+
+static uint64_t NaClValidateNowMs(void) {
+  struct timespec ts;
+
+  if (0 != clock_gettime(CLOCK_MONOTONIC, &ts)) {
+    NaClLog(LOG_FATAL, "NaClValidateNowMs: clock_gettime failed\n");
+  }
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static INLINE uint32_t NaClValidateBucket(
+    struct NaClValidatePolicyTable const  *table,
+    uint8_t const                         *app_hash) {
+  uint32_t h;
+
+  /* the key is a SHA-1, so any four bytes of it are well mixed */
+  memcpy(&h, app_hash, sizeof h);
+  return h & (table->num_buckets - 1);
+}
+
+
+static void NaClValidatePolicyFree(struct NaClValidatePolicy *p) {
+  free(p->ports);
+  free(p);
+}
+
+
+void NaClValidatePolicyTableDtor(struct NaClValidatePolicyTable *table) {
+  struct NaClValidatePolicy *p;
+  uint32_t                  i;
+
+  for (i = 0; i < table->num_buckets; ++i) {
+    while (NULL != (p = table->buckets[i])) {
+      table->buckets[i] = p->next;
+      NaClValidatePolicyFree(p);
+    }
+  }
+  free(table->buckets);
+  if (NULL != table->dflt) {
+    NaClValidatePolicyFree(table->dflt);
+  }
+  memset(table, 0, sizeof *table);
+}
+
+
+static struct NaClValidatePolicy *NaClValidatePolicyTableFind(
+    struct NaClValidatePolicyTable const  *table,
+    uint8_t const                         *app_hash) {
+  struct NaClValidatePolicy *p;
+
+  if (0 == table->num_buckets) {
+    return NULL;
+  }
+  for (p = table->buckets[NaClValidateBucket(table, app_hash)];
+       NULL != p; p = p->next) {
+    if (0 == memcmp(p->app_hash, app_hash, sizeof p->app_hash)) {
+      return p;
+    }
+  }
+  return NULL;
 }
 
-/*make a response*/
-void MakeNaClHashResp(char* buf, const int* tcpports, const int* udpports, int nonce, int global, int ok) {
-  memcpy(buf, &ok, 4);
-  memset(buf + 4, 0, 16384); // The tcpports and udpports buffers
 
+struct NaClValidatePolicy *NaClValidatePolicyTableLookup(
+    struct NaClValidatePolicyTable const  *table,
+    uint8_t const                         *app_hash) {
+  struct NaClValidatePolicy *p = NaClValidatePolicyTableFind(table, app_hash);
+
+  return (NULL != p) ? p : table->dflt;
+}
+
+
+/* Keep the load factor at most one. */
+static int NaClValidatePolicyTableGrow(struct NaClValidatePolicyTable *table) {
+  struct NaClValidatePolicyTable  bigger;
+  struct NaClValidatePolicy       *p;
+  uint32_t                        i;
+  uint32_t                        b;
+
+  if (table->num_entries < table->num_buckets) {
+    return 1;
+  }
+  bigger.num_buckets = (0 == table->num_buckets)
+      ? NACL_VALIDATE_MIN_BUCKETS : 2 * table->num_buckets;
+  bigger.buckets = calloc(bigger.num_buckets, sizeof *bigger.buckets);
+  if (NULL == bigger.buckets) {
+    return 0;
+  }
+  for (i = 0; i < table->num_buckets; ++i) {
+    while (NULL != (p = table->buckets[i])) {
+      table->buckets[i] = p->next;
+      b = NaClValidateBucket(&bigger, p->app_hash);
+      p->next = bigger.buckets[b];
+      bigger.buckets[b] = p;
+    }
+  }
+  free(table->buckets);
+  table->buckets = bigger.buckets;
+  table->num_buckets = bigger.num_buckets;
+  return 1;
+}
+
+
+static int NaClValidateHexDigit(int c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c = tolower(c);
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+
+/* Parse 40 hex digits at *s into app_hash; returns 0 on success. */
+static int NaClValidateParseHash(char const **s, uint8_t *app_hash) {
   int i;
-  unsigned char *ports;
+  int hi;
+  int lo;
+
+  for (i = 0; i < 20; ++i) {
+    hi = NaClValidateHexDigit((*s)[2 * i]);
+    lo = (hi < 0) ? -1 : NaClValidateHexDigit((*s)[2 * i + 1]);
+    if (lo < 0) {
+      return -1;
+    }
+    app_hash[i] = (uint8_t) (hi << 4 | lo);
+  }
+  *s += 40;
+  return 0;
+}
+
+
+static int NaClValidateParsePort(char const **s, uint32_t *port) {
+  char          *end;
+  unsigned long v;
+
+  if (!isdigit((unsigned char) **s)) {
+    return -1;
+  }
+  errno = 0;
+  v = strtoul(*s, &end, 10);
+  if (0 != errno || v > 65535) {
+    return -1;
+  }
+  *s = end;
+  *port = (uint32_t) v;
+  return 0;
+}
+
+
+static void NaClValidateSetBits(uint8_t *bitmap, uint32_t lo, uint32_t hi) {
+  for (; lo <= hi && 0 != (lo & 7); ++lo) {
+    bitmap[lo / 8] |= (uint8_t) (1 << (lo % 8));
+  }
+  if (lo + 7 <= hi) {
+    memset(bitmap + lo / 8, 0xff, (hi + 1 - lo) / 8);
+    lo += (hi + 1 - lo) & ~7U;
+  }
+  for (; lo <= hi; ++lo) {
+    bitmap[lo / 8] |= (uint8_t) (1 << (lo % 8));
+  }
+}
+
+
+/*
+ * Parse "deny" or a list of ports and lo-hi ranges, separated by
+ * commas or blanks, into p.  bitmap is scratch space.  Returns 0 on
+ * success.
+ */
+static int NaClValidateParsePorts(char const                 *s,
+                                  struct NaClValidatePolicy  *p,
+                                  uint8_t                    *bitmap) {
+  struct NaClRemoteServerPorts  *ports;
+  uint32_t                      lo;
+  uint32_t                      hi;
+
+  while (isspace((unsigned char) *s)) {
+    ++s;
+  }
+  if (0 == strncmp(s, "deny", 4)) {
+    for (s += 4; isspace((unsigned char) *s); ++s) {
+    }
+    p->status = NACL_VALIDATE_STATUS_DENIED;
+    return ('\0' == *s) ? 0 : -1;
+  }
+
+  memset(bitmap, 0, NACL_PORT_POLICY_BITMAP_BYTES);
+  while ('\0' != *s) {
+    if (0 != NaClValidateParsePort(&s, &lo)) {
+      return -1;
+    }
+    hi = lo;
+    if ('-' == *s) {
+      ++s;
+      if (0 != NaClValidateParsePort(&s, &hi) || hi < lo) {
+        return -1;
+      }
+    }
+    NaClValidateSetBits(bitmap, lo, hi);
+    while (',' == *s || isspace((unsigned char) *s)) {
+      ++s;
+    }
+  }
+
+  if (NULL == (ports = malloc(sizeof *ports))) {
+    return -1;
+  }
+  NaClPortPolicySetBitmap(ports, bitmap, NACL_PORT_POLICY_BITMAP_BYTES);
+  /* most policies are a few ranges; keep only what they use */
+  p->ports = realloc(ports, NaClPortPolicyBytes(ports));
+  if (NULL == p->ports) {
+    p->ports = ports;
+  }
+  p->status = 0;
+  return 0;
+}
+
+
+/* Add or replace the policy on one non-blank line; returns 0 on success. */
+static int NaClValidateParseLine(struct NaClValidatePolicyTable  *table,
+                                 char const                      *line,
+                                 uint8_t                         *bitmap) {
+  struct NaClValidatePolicy *p;
+  struct NaClValidatePolicy *old;
+  int                       is_default = 0;
+  uint32_t                  b;
+
+  if (NULL == (p = calloc(1, sizeof *p))) {
+    return -1;
+  }
+  if ('*' == *line) {
+    is_default = 1;
+    ++line;
+  } else if (0 != NaClValidateParseHash(&line, p->app_hash)) {
+    free(p);
+    return -1;
+  }
+  if (!isspace((unsigned char) *line)
+      || 0 != NaClValidateParsePorts(line, p, bitmap)) {
+    NaClValidatePolicyFree(p);
+    return -1;
+  }
+
+  if (is_default) {
+    old = table->dflt;
+    table->dflt = p;
+  } else if (NULL != (old = NaClValidatePolicyTableFind(table, p->app_hash))) {
+    /* later lines win; keep old's place in its chain */
+    free(old->ports);
+    old->ports = p->ports;
+    old->status = p->status;
+    free(p);
+    return 0;
+  } else {
+    if (!NaClValidatePolicyTableGrow(table)) {
+      NaClValidatePolicyFree(p);
+      return -1;
+    }
+    b = NaClValidateBucket(table, p->app_hash);
+    p->next = table->buckets[b];
+    table->buckets[b] = p;
+    ++table->num_entries;
+  }
+  if (NULL != old) {
+    NaClValidatePolicyFree(old);
+  }
+  return 0;
+}
+
+
+int NaClValidatePolicyTableLoad(struct NaClValidatePolicyTable  *table,
+                                char const                      *path) {
+  FILE      *iop;
+  char      *line = NULL;
+  size_t    line_cap = 0;
+  ssize_t   len;
+  char      *s;
+  uint8_t   *bitmap;
+  unsigned  line_num = 0;
+  int       rv = 0;
+
+  memset(table, 0, sizeof *table);
+  if (NULL == (iop = fopen(path, "r"))) {
+    NaClLog(LOG_ERROR, "NaClValidatePolicyTableLoad: open %s: errno %d\n",
+            path, errno);
+    return -1;
+  }
+  if (NULL == (bitmap = malloc(NACL_PORT_POLICY_BITMAP_BYTES))) {
+    (void) fclose(iop);
+    return -1;
+  }
+  while ((len = getline(&line, &line_cap, iop)) >= 0) {
+    ++line_num;
+    while (len > 0 && isspace((unsigned char) line[len - 1])) {
+      line[--len] = '\0';
+    }
+    for (s = line; isspace((unsigned char) *s); ++s) {
+    }
+    if ('\0' == *s || '#' == *s) {
+      continue;
+    }
+    if (0 != NaClValidateParseLine(table, s, bitmap)) {
+      NaClLog(LOG_ERROR, "NaClValidatePolicyTableLoad: %s:%u: bad line\n",
+              path, line_num);
+      rv = -1;
+      break;
+    }
+  }
+  if (0 == rv && ferror(iop)) {
+    NaClLog(LOG_ERROR, "NaClValidatePolicyTableLoad: read %s failed\n", path);
+    rv = -1;
+  }
+  free(line);
+  free(bitmap);
+  (void) fclose(iop);
+  if (0 != rv) {
+    NaClValidatePolicyTableDtor(table);
+  }
+  return rv;
+}
+
+
+static INLINE void NaClValidatePutWord(char *buf, int word, uint32_t v) {
+  v = htonl(v);
+  memcpy(buf + 4 * word, &v, sizeof v);
+}
+
+
+uint32_t NaClValidateMakeReply(char                             *buf,
+                               struct NaClValidatePolicy const  *policy,
+                               uint32_t                         nonce) {
+  struct NaClRemoteServerPorts const  *ports = NULL;
+  uint32_t                            status = NACL_VALIDATE_STATUS_DENIED;
+  uint32_t                            i;
+  uint16_t                            port;
+  char                                *out;
+
+  if (NULL != policy && 0 == policy->status) {
+    ports = policy->ports;
+    status = 0;
+  }
+
+  if (NACL_VALIDATE_NONCE_VERSION(nonce) >= 2) {
+    NaClValidatePutWord(buf, 0, NACL_VALIDATE_REPLY_V2_MAGIC);
+    NaClValidatePutWord(buf, 1, status);
+    NaClValidatePutWord(buf, 2, nonce);
+    out = buf + NACL_VALIDATE_REPLY_V2_HDR_BYTES;
+    if (NULL == ports) {
+      NaClValidatePutWord(buf, 3, 0);
+      return NACL_VALIDATE_REPLY_V2_HDR_BYTES;
+    }
+    NaClValidatePutWord(buf, 3, ports->num_ranges);
+    if (NACL_PORT_POLICY_BITMAP == ports->num_ranges) {
+      memcpy(out, ports->u.bitmap, NACL_PORT_POLICY_BITMAP_BYTES);
+      return NACL_VALIDATE_RESP_MAX_BYTES;
+    }
+    for (i = 0; i < ports->num_ranges; ++i) {
+      port = htons(ports->u.ranges[i].lo);
+      memcpy(out + 4 * i, &port, 2);
+      port = htons(ports->u.ranges[i].hi);
+      memcpy(out + 4 * i + 2, &port, 2);
+    }
+    return NACL_VALIDATE_REPLY_V2_HDR_BYTES + 4 * ports->num_ranges;
+  }
+
+  /* version 1: always the full bitmap */
+  NaClValidatePutWord(buf, 0, status);
+  NaClValidatePutWord(buf, 1, nonce);
+  out = buf + 8;
+  memset(out, 0, NACL_PORT_POLICY_BITMAP_BYTES);
+  if (NULL != ports) {
+    if (NACL_PORT_POLICY_BITMAP == ports->num_ranges) {
+      memcpy(out, ports->u.bitmap, NACL_PORT_POLICY_BITMAP_BYTES);
+    } else {
+      for (i = 0; i < ports->num_ranges; ++i) {
+        NaClValidateSetBits((uint8_t *) out, ports->u.ranges[i].lo,
+                            ports->u.ranges[i].hi);
+      }
+    }
+  }
+  return NACL_VALIDATE_RESP_BYTES;
+}
+
+
+static void NaClValidateCountReply(struct NaClValidateHashStats     *stats,
+                                   struct NaClValidatePolicy const  *policy,
+                                   uint32_t                         nonce) {
+  ++stats->requests;
+  if (NULL == policy || 0 != policy->status) {
+    ++stats->denied;
+  }
+  if (NACL_VALIDATE_NONCE_VERSION(nonce) >= 2) {
+    ++stats->v2_replies;
+  } else {
+    ++stats->v1_replies;
+  }
+}
+
+
+static void NaClValidateConnClose(struct NaClValidateServer *srv,
+                                  struct NaClValidateConn   *c) {
+  (void) close(c->fd);
+  if (NULL != c->prev) {
+    c->prev->next = c->next;
+  } else {
+    srv->oldest = c->next;
+  }
+  if (NULL != c->next) {
+    c->next->prev = c->prev;
+  } else {
+    srv->newest = c->prev;
+  }
+  c->next = srv->free_conns;
+  srv->free_conns = c;
+  --srv->num_conns;
+}
+
+
+static void NaClValidateConnWrite(struct NaClValidateServer *srv,
+                                  struct NaClValidateConn   *c) {
+  struct epoll_event  ev;
+  ssize_t             n;
+
+  while (c->sent < c->reply_bytes) {
+    n = send(c->fd, c->reply + c->sent, c->reply_bytes - c->sent,
+             MSG_NOSIGNAL);
+    if (n > 0) {
+      c->sent += (uint32_t) n;
+    } else if (n < 0 && EINTR == errno) {
+      continue;
+    } else if (n < 0 && EAGAIN == errno) {
+      ev.events = EPOLLOUT;
+      ev.data.ptr = c;
+      if (0 == epoll_ctl(srv->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev)) {
+        return;
+      }
+      ++srv->stats.errors;
+      NaClValidateConnClose(srv, c);
+      return;
+    } else {
+      ++srv->stats.errors;
+      NaClValidateConnClose(srv, c);
+      return;
+    }
+  }
+  ++srv->stats.handshakes;
+  NaClValidateConnClose(srv, c);
+}
+
+
+static void NaClValidateConnAnswer(struct NaClValidateServer  *srv,
+                                   struct NaClValidateConn    *c) {
+  struct NaClValidatePolicy *policy;
+  struct NaClValidatePolicy *exact;
+  uint32_t                  nonce;
+
+  memcpy(&nonce, c->req + 20, sizeof nonce);
+  nonce = ntohl(nonce);
+  exact = NaClValidatePolicyTableFind(&srv->table, c->req);
+  policy = (NULL != exact) ? exact : srv->table.dflt;
+  NaClValidateCountReply((NULL != exact) ? &exact->stats : &srv->unknown,
+                         policy, nonce);
+  c->reply_bytes = NaClValidateMakeReply(c->reply, policy, nonce);
+  NaClValidateConnWrite(srv, c);
+}
+
+
+static void NaClValidateConnRead(struct NaClValidateServer  *srv,
+                                 struct NaClValidateConn    *c) {
+  ssize_t n;
+
+  while (c->got < NACL_VALIDATE_REQ_BYTES) {
+    n = recv(c->fd, c->req + c->got, NACL_VALIDATE_REQ_BYTES - c->got, 0);
+    if (n > 0) {
+      c->got += (uint32_t) n;
+    } else if (n < 0 && EINTR == errno) {
+      continue;
+    } else if (n < 0 && EAGAIN == errno) {
+      return;
+    } else {
+      /* closed or reset before the request was complete */
+      ++srv->stats.errors;
+      NaClValidateConnClose(srv, c);
+      return;
+    }
+  }
+  NaClValidateConnAnswer(srv, c);
+}
+
+
+static void NaClValidateAccept(struct NaClValidateServer *srv) {
+  struct NaClValidateConn *c;
+  struct epoll_event      ev;
+  int                     fd;
+
+  for (;;) {
+    fd = accept4(srv->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (EINTR == errno || ECONNABORTED == errno) {
+        continue;
+      }
+      if (EAGAIN != errno) {
+        NaClLog(LOG_WARNING, "NaClValidateAccept: errno %d\n", errno);
+      }
+      return;
+    }
+    ++srv->stats.accepted;
+    if (srv->num_conns >= srv->cfg.max_conns) {
+      ++srv->stats.overflows;
+      (void) close(fd);
+      continue;
+    }
+    if (NULL != (c = srv->free_conns)) {
+      srv->free_conns = c->next;
+    } else if (NULL == (c = malloc(sizeof *c))) {
+      ++srv->stats.overflows;
+      (void) close(fd);
+      continue;
+    }
+    c->fd = fd;
+    c->got = 0;
+    c->sent = 0;
+    c->reply_bytes = 0;
+    c->deadline_ms = NaClValidateNowMs() + srv->cfg.idle_ms;
+    /* deadlines only grow, so appending keeps the list sorted */
+    c->next = NULL;
+    c->prev = srv->newest;
+    if (NULL != srv->newest) {
+      srv->newest->next = c;
+    } else {
+      srv->oldest = c;
+    }
+    srv->newest = c;
+    ++srv->num_conns;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (0 != epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+      ++srv->stats.errors;
+      NaClValidateConnClose(srv, c);
+      continue;
+    }
+    /* with TCP_DEFER_ACCEPT the request is usually here already */
+    NaClValidateConnRead(srv, c);
+  }
+}
+
+
+static void NaClValidateExpire(struct NaClValidateServer *srv) {
+  uint64_t now = NaClValidateNowMs();
+
+  while (NULL != srv->oldest && srv->oldest->deadline_ms <= now) {
+    ++srv->stats.timeouts;
+    NaClValidateConnClose(srv, srv->oldest);
+  }
+}
+
+
+static void NaClValidateSignal(struct NaClValidateServer *srv) {
+  struct signalfd_siginfo si;
+
+  while (sizeof si == read(srv->signal_fd, &si, sizeof si)) {
+    switch (si.ssi_signo) {
+      case SIGHUP:
+        (void) NaClValidateServerReload(srv);
+        break;
+      case SIGUSR1:
+        NaClValidateServerDumpStats(srv, stdout);
+        break;
+      default:
+        srv->stop = 1;
+        break;
+    }
+  }
+}
+
+
+static int NaClValidatePolicyFileChanged(struct NaClValidateServer *srv) {
+  struct stat st;
+
+  if (0 != stat(srv->cfg.policy_path, &st)) {
+    return 0;
+  }
+  return (st.st_ino != srv->policy_st.st_ino
+          || st.st_dev != srv->policy_st.st_dev
+          || st.st_size != srv->policy_st.st_size
+          || st.st_mtim.tv_sec != srv->policy_st.st_mtim.tv_sec
+          || st.st_mtim.tv_nsec != srv->policy_st.st_mtim.tv_nsec);
+}
+
+
+int NaClValidateServerReload(struct NaClValidateServer *srv) {
+  struct NaClValidatePolicyTable  table;
+  struct NaClValidatePolicy       *p;
+  struct NaClValidatePolicy       *old;
+  struct stat                     st;
+  uint32_t                        i;
+
+  /* stat first, so a write racing the load is seen next time */
+  if (0 != stat(srv->cfg.policy_path, &st)
+      || 0 != NaClValidatePolicyTableLoad(&table, srv->cfg.policy_path)) {
+    ++srv->stats.reload_failures;
+    NaClLog(LOG_ERROR, "NaClValidateServerReload: keeping the old policy\n");
+    /* don't retry until the file changes again */
+    (void) stat(srv->cfg.policy_path, &srv->policy_st);
+    return -1;
+  }
+  /* counters follow the hash, not the policy */
+  for (i = 0; i < table.num_buckets; ++i) {
+    for (p = table.buckets[i]; NULL != p; p = p->next) {
+      if (NULL != (old = NaClValidatePolicyTableFind(&srv->table,
+                                                     p->app_hash))) {
+        p->stats = old->stats;
+      }
+    }
+  }
+  NaClValidatePolicyTableDtor(&srv->table);
+  srv->table = table;
+  srv->policy_st = st;
+  ++srv->stats.reloads;
+  NaClLog(LOG_INFO, "NaClValidateServerReload: %u hashes from %s\n",
+          table.num_entries, srv->cfg.policy_path);
+  return 0;
+}
+
+
+static int NaClValidateListen(struct NaClValidateServer *srv) {
+  struct sockaddr_in  addr;
+  socklen_t           len = sizeof addr;
+  int                 one = 1;
+  int                 defer_secs = 1;
+
+  srv->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          0);
+  if (srv->listen_fd < 0) {
+    NaClLog(LOG_ERROR, "NaClValidateListen: socket: errno %d\n", errno);
+    return 0;
+  }
+  (void) setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+  /* wake for a connection only once its request has arrived */
+  (void) setsockopt(srv->listen_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                    &defer_secs, sizeof defer_secs);
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = srv->cfg.bind_ip;
+  addr.sin_port = htons(srv->cfg.port);
+  if (0 != bind(srv->listen_fd, (struct sockaddr *) &addr, sizeof addr)
+      || 0 != listen(srv->listen_fd, SOMAXCONN)
+      || 0 != getsockname(srv->listen_fd, (struct sockaddr *) &addr, &len)) {
+    NaClLog(LOG_ERROR, "NaClValidateListen: port %u: errno %d\n",
+            srv->cfg.port, errno);
+    return 0;
+  }
+  srv->port = ntohs(addr.sin_port);
+  return 1;
+}
+
+
+static int NaClValidateWatchSignals(struct NaClValidateServer *srv) {
+  sigset_t  mask;
+
+  (void) sigemptyset(&mask);
+  (void) sigaddset(&mask, SIGHUP);
+  (void) sigaddset(&mask, SIGUSR1);
+  (void) sigaddset(&mask, SIGINT);
+  (void) sigaddset(&mask, SIGTERM);
+  if (0 != sigprocmask(SIG_BLOCK, &mask, NULL)) {
+    return 0;
+  }
+  srv->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  return srv->signal_fd >= 0;
+}
+
+
+int NaClValidateServerCtor(struct NaClValidateServer              *srv,
+                           struct NaClValidateServerConfig const  *cfg) {
+  struct epoll_event  ev;
+
+  memset(srv, 0, sizeof *srv);
+  srv->cfg = *cfg;
+  srv->listen_fd = -1;
+  srv->signal_fd = -1;
+  srv->epoll_fd = -1;
+  if (0 == srv->cfg.max_conns) {
+    srv->cfg.max_conns = NACL_VALIDATE_DEFAULT_MAX_CONNS;
+  }
+  if (0 == srv->cfg.idle_ms) {
+    srv->cfg.idle_ms = NACL_VALIDATE_DEFAULT_IDLE_MS;
+  }
+
+  if (0 != stat(cfg->policy_path, &srv->policy_st)
+      || 0 != NaClValidatePolicyTableLoad(&srv->table, cfg->policy_path)) {
+    NaClLog(LOG_ERROR, "NaClValidateServerCtor: cannot load %s\n",
+            cfg->policy_path);
+    return 0;
+  }
+  srv->next_check_ms = NaClValidateNowMs() + NACL_VALIDATE_RELOAD_CHECK_MS;
+
+  if (!NaClValidateListen(srv)) {
+    goto abort;
+  }
+  if (cfg->handle_signals && !NaClValidateWatchSignals(srv)) {
+    NaClLog(LOG_ERROR, "NaClValidateServerCtor: signalfd: errno %d\n", errno);
+    goto abort;
+  }
+  if ((srv->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+    NaClLog(LOG_ERROR, "NaClValidateServerCtor: epoll: errno %d\n", errno);
+    goto abort;
+  }
+  ev.events = EPOLLIN;
+  ev.data.ptr = &kListenTag;
+  if (0 != epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->listen_fd, &ev)) {
+    goto abort;
+  }
+  if (srv->signal_fd >= 0) {
+    ev.data.ptr = &kSignalTag;
+    if (0 != epoll_ctl(srv->epoll_fd, EPOLL_CTL_ADD, srv->signal_fd, &ev)) {
+      goto abort;
+    }
+  }
+  return 1;
+
+ abort:
+  NaClValidateServerDtor(srv);
+  return 0;
+}
 
-  // tcpports
-  i = 0;
-  ports = buf + 4;
-  while (tcpports[i] != 0) {
-    ports[tcpports[i]/8] |= 1 << (tcpports[i]%8);
+
+void NaClValidateServerDtor(struct NaClValidateServer *srv) {
+  struct NaClValidateConn *c;
+
+  while (NULL != srv->oldest) {
+    NaClValidateConnClose(srv, srv->oldest);
+  }
+  while (NULL != (c = srv->free_conns)) {
+    srv->free_conns = c->next;
+    free(c);
   }
+  if (srv->epoll_fd >= 0) {
+    (void) close(srv->epoll_fd);
+  }
+  if (srv->signal_fd >= 0) {
+    (void) close(srv->signal_fd);
+  }
+  if (srv->listen_fd >= 0) {
+    (void) close(srv->listen_fd);
+  }
+  NaClValidatePolicyTableDtor(&srv->table);
+  srv->epoll_fd = srv->signal_fd = srv->listen_fd = -1;
+}
+
 
+void NaClValidateServerPoll(struct NaClValidateServer *srv, int timeout_ms) {
+  struct epoll_event      events[NACL_VALIDATE_EPOLL_EVENTS];
+  struct NaClValidateConn *c;
+  uint64_t                now;
+  int                     n;
+  int                     i;
 
-  // udpports
-  i = 0;
-  ports = buf + 4 + 8192;
-  while (tcpports[i] != 0) {
-    ports[udpports[i]/8] |= 1 << (udpports[i]%8);
+  if (NULL != srv->oldest) {
+    now = NaClValidateNowMs();
+    if (srv->oldest->deadline_ms <= now) {
+      timeout_ms = 0;
+    } else if (timeout_ms < 0
+               || srv->oldest->deadline_ms - now < (uint64_t) timeout_ms) {
+      timeout_ms = (int) (srv->oldest->deadline_ms - now);
+    }
+  }
+  n = epoll_wait(srv->epoll_fd, events, NACL_VALIDATE_EPOLL_EVENTS,
+                 timeout_ms);
+  for (i = 0; i < n; ++i) {
+    if (&kListenTag == events[i].data.ptr) {
+      NaClValidateAccept(srv);
+    } else if (&kSignalTag == events[i].data.ptr) {
+      NaClValidateSignal(srv);
+    } else {
+      c = (struct NaClValidateConn *) events[i].data.ptr;
+      if (0 == c->reply_bytes) {
+        NaClValidateConnRead(srv, c);
+      } else {
+        NaClValidateConnWrite(srv, c);
+      }
+    }
+  }
+  NaClValidateExpire(srv);
+
+  now = NaClValidateNowMs();
+  if (now >= srv->next_check_ms) {
+    srv->next_check_ms = now + NACL_VALIDATE_RELOAD_CHECK_MS;
+    if (NaClValidatePolicyFileChanged(srv)) {
+      (void) NaClValidateServerReload(srv);
+    }
+  }
+}
+
+
+void NaClValidateServerRun(struct NaClValidateServer *srv) {
+  while (!srv->stop) {
+    NaClValidateServerPoll(srv, NACL_VALIDATE_RELOAD_CHECK_MS);
   }
 }
 
-/*optional: create and return hash given the data of nexe, developer can use if her nexes are really small*/
-/*If "nexeData" points to an mmap'ed file, this function should return the same hash as would running "sha1sum" on that file.*/
-void MakeNaClHash(const void* nexeData, int nexeDataLength, unsigned char hash[20]) {
-  SHA1(nexeData, nexeDataLength, &hash);
+
+static void NaClValidatePrintHash(FILE                                *out,
+                                  char const                          *name,
+                                  struct NaClValidateHashStats const  *s) {
+  fprintf(out, "%-40s %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+          name, s->requests, s->denied, s->v1_replies, s->v2_replies);
+}
+
+
+void NaClValidateServerDumpStats(struct NaClValidateServer  *srv,
+                                 FILE                       *out) {
+  struct NaClValidatePolicy const *p;
+  char                            name[41];
+  uint32_t                        i;
+  int                             j;
+
+  fprintf(out, "accepted %"PRIu64" handshakes %"PRIu64" overflows %"PRIu64
+          " timeouts %"PRIu64" errors %"PRIu64" reloads %"PRIu64
+          " reload_failures %"PRIu64" open %u\n",
+          srv->stats.accepted, srv->stats.handshakes, srv->stats.overflows,
+          srv->stats.timeouts, srv->stats.errors, srv->stats.reloads,
+          srv->stats.reload_failures, srv->num_conns);
+  fprintf(out, "%-40s %10s %10s %10s %10s\n",
+          "hash", "requests", "denied", "v1", "v2");
+  for (i = 0; i < srv->table.num_buckets; ++i) {
+    for (p = srv->table.buckets[i]; NULL != p; p = p->next) {
+      if (0 == p->stats.requests) {
+        continue;
+      }
+      for (j = 0; j < 20; ++j) {
+        snprintf(name + 2 * j, 3, "%02x", p->app_hash[j]);
+      }
+      NaClValidatePrintHash(out, name, &p->stats);
+    }
+  }
+  NaClValidatePrintHash(out, "(unlisted)", &srv->unknown);
+  fflush(out);
 }
@@ -1,10 +1,190 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl validation server: the peer side of the handshake in
+ * nacl_socks_client.h.
+ *
+ * A host runs one of these on NACL_VALIDATE_SERVERPORT next to the
+ * services that NaCl applications may reach.  It answers each
+ * request with the ports the requesting application, identified by
+ * its hash, may use on this host, as listed in a policy file:
+ *
+ *   # comments and blank lines are ignored
+ *   <40 hex digit SHA-1>  80,443,8000-8099
+ *   <40 hex digit SHA-1>  deny
+ *   *                     7
+ *
+ * The "*" line, if any, applies to applications not otherwise listed;
+ * without it they are refused.  A later line for the same hash
+ * replaces an earlier one.  The file is reloaded when it changes or
+ * on SIGHUP; a file that does not parse is logged and the old policy
+ * kept.
+ *
+ * The server is a single thread around epoll.  Each connection reads
+ * the 24-byte request, writes one reply, sized by the version the
+ * client accepts, and is closed; connections that stall are dropped.
+ * Per-hash counters are printed on SIGUSR1 and at exit.
+ */
+
 #ifndef NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCKS_SERVER_H_
 #define NATIVE_CLIENT_SERVICE_RUNTIME_LINUX_NACL_SOCKS_SERVER_H_
-/*Parse the request coming from the client*/
-/*0 on success*/
-int ParseNaClHashReq(const char* buf, int* nonce, unsigned int hash[20]);
-/*make a response*/
-void MakeNaClHashResp(char* buf, const int* tcpports, const int* udpports, int nonce, int global, int ok);
-/*optional: create and return hash given the data of nexe, developer can use if her nexes are really small*/
-void MakeNaClHash(const void* nexeData, int nexeDataLength, unsigned int hash[20]);
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "native_client/src/include/nacl_base.h"
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+
+EXTERN_C_BEGIN
+
+#define NACL_VALIDATE_STATUS_DENIED     1
+
+#define NACL_VALIDATE_DEFAULT_MAX_CONNS 4096
+#define NACL_VALIDATE_DEFAULT_IDLE_MS   5000
+
+struct NaClValidateHashStats {
+  uint64_t  requests;
+  uint64_t  denied;
+  uint64_t  v1_replies;
+  uint64_t  v2_replies;
+};
+
+/* One line of the policy file. */
+struct NaClValidatePolicy {
+  struct NaClValidatePolicy     *next;  /* hash chain */
+  uint8_t                       app_hash[20];
+  uint32_t                      status;  /* 0, or NACL_VALIDATE_STATUS_DENIED */
+  struct NaClValidateHashStats  stats;
+  struct NaClRemoteServerPorts  *ports;  /* NaClPortPolicyBytes() long */
+};
+
+struct NaClValidatePolicyTable {
+  struct NaClValidatePolicy **buckets;
+  uint32_t                  num_buckets;
+  uint32_t                  num_entries;
+  struct NaClValidatePolicy *dflt;  /* the "*" line, or NULL */
+};
+
+/*
+ * Parse the policy file at path into *table.  Returns 0 on success;
+ * on failure logs the offending line and returns -1, leaving *table
+ * empty but safe to destroy.
+ */
+int NaClValidatePolicyTableLoad(struct NaClValidatePolicyTable  *table,
+                                char const                      *path);
+
+void NaClValidatePolicyTableDtor(struct NaClValidatePolicyTable *table);
+
+/* Entry for app_hash, else the default entry, else NULL. */
+struct NaClValidatePolicy *NaClValidatePolicyTableLookup(
+    struct NaClValidatePolicyTable const  *table,
+    uint8_t const                         *app_hash);
+
+/*
+ * Write the reply to a request carrying nonce into buf, which holds
+ * NACL_VALIDATE_RESP_MAX_BYTES; policy NULL or with a non-zero status
+ * refuses.  The version is the highest both sides know.  Returns the
+ * reply's length.
+ */
+uint32_t NaClValidateMakeReply(char                             *buf,
+                               struct NaClValidatePolicy const  *policy,
+                               uint32_t                         nonce);
+
+struct NaClValidateServerConfig {
+  char const  *policy_path;
+  uint32_t    bind_ip;      /* network byte order; INADDR_LOOPBACK for tests */
+  uint16_t    port;         /* host byte order; 0 picks a free port */
+  uint32_t    max_conns;    /* more are accepted and closed at once */
+  uint32_t    idle_ms;      /* a connection idle this long is dropped */
+  int         handle_signals;  /* SIGHUP, SIGUSR1, SIGINT and SIGTERM */
+};
+
+struct NaClValidateServerStats {
+  uint64_t  accepted;
+  uint64_t  handshakes;
+  uint64_t  overflows;     /* closed because max_conns were open */
+  uint64_t  timeouts;
+  uint64_t  errors;        /* connections that failed mid-handshake */
+  uint64_t  reloads;
+  uint64_t  reload_failures;
+};
+
+struct NaClValidateConn;
+
+struct NaClValidateServer {
+  struct NaClValidateServerConfig cfg;
+  int                             listen_fd;
+  int                             epoll_fd;
+  int                             signal_fd;   /* -1 unless handle_signals */
+  uint16_t                        port;        /* as bound */
+  int                             stop;
+  struct NaClValidatePolicyTable  table;
+  struct stat                     policy_st;   /* file as last loaded */
+  uint64_t                        next_check_ms;
+  struct NaClValidateHashStats    unknown;     /* hashes with no entry */
+  struct NaClValidateServerStats  stats;
+  uint32_t                        num_conns;
+  struct NaClValidateConn         *oldest;     /* open, by deadline */
+  struct NaClValidateConn         *newest;
+  struct NaClValidateConn         *free_conns;
+};
+
+/*
+ * Load the policy, bind and listen.  Returns non-zero on success;
+ * failure is logged.
+ */
+int NaClValidateServerCtor(struct NaClValidateServer              *srv,
+                           struct NaClValidateServerConfig const  *cfg);
+
+void NaClValidateServerDtor(struct NaClValidateServer *srv);
+
+/*
+ * Handle whatever is ready, waiting up to timeout_ms for something
+ * to be.  Also reloads the policy if the file has changed.
+ */
+void NaClValidateServerPoll(struct NaClValidateServer *srv, int timeout_ms);
+
+/* Poll until SIGINT or SIGTERM, or srv->stop is set. */
+void NaClValidateServerRun(struct NaClValidateServer *srv);
+
+/* Re-read the policy file; returns 0 on success. */
+int NaClValidateServerReload(struct NaClValidateServer *srv);
+
+void NaClValidateServerDumpStats(struct NaClValidateServer  *srv,
+                                 FILE                       *out);
+
+EXTERN_C_END
+
 #endif
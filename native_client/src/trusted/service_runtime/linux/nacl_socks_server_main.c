@@ -0,0 +1,118 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * NaCl validation server command line.  See nacl_socks_server.h.
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_server.h"
+
+
+static void Usage(char const *argv0) {
+  fprintf(stderr,
+          "Usage: %s -f policy_file [-p port] [-l] [-c max_conns]"
+          " [-t idle_ms]\n"
+          "  -p  port to listen on (default %d; 0 picks one)\n"
+          "  -l  listen on the loopback interface only\n"
+          "SIGHUP reloads the policy, SIGUSR1 prints per-hash counters.\n",
+          argv0, NACL_VALIDATE_SERVERPORT);
+}
+
+
+int main(int ac, char **av) {
+  struct NaClValidateServerConfig cfg;
+  struct NaClValidateServer       srv;
+  int                             opt;
+
+  cfg.policy_path = NULL;
+  cfg.bind_ip = htonl(INADDR_ANY);
+  cfg.port = NACL_VALIDATE_SERVERPORT;
+  cfg.max_conns = NACL_VALIDATE_DEFAULT_MAX_CONNS;
+  cfg.idle_ms = NACL_VALIDATE_DEFAULT_IDLE_MS;
+  cfg.handle_signals = 1;
+
+  while (-1 != (opt = getopt(ac, av, "f:p:lc:t:"))) {
+    switch (opt) {
+      case 'f':
+        cfg.policy_path = optarg;
+        break;
+      case 'p':
+        cfg.port = (uint16_t) strtoul(optarg, (char **) 0, 0);
+        break;
+      case 'l':
+        cfg.bind_ip = htonl(INADDR_LOOPBACK);
+        break;
+      case 'c':
+        cfg.max_conns = strtoul(optarg, (char **) 0, 0);
+        break;
+      case 't':
+        cfg.idle_ms = strtoul(optarg, (char **) 0, 0);
+        break;
+      default:
+        Usage(av[0]);
+        return 1;
+    }
+  }
+  if (NULL == cfg.policy_path || optind != ac) {
+    Usage(av[0]);
+    return 1;
+  }
+
+  NaClLogModuleInit();
+  if (!NaClValidateServerCtor(&srv, &cfg)) {
+    NaClLogModuleFini();
+    return 1;
+  }
+  /* scripts starting us with -p 0 read the port from here */
+  printf("listening on port %u\n", srv.port);
+  fflush(stdout);
+
+  NaClValidateServerRun(&srv);
+
+  NaClValidateServerDumpStats(&srv, stdout);
+  NaClValidateServerDtor(&srv);
+  NaClLogModuleFini();
+  return 0;
+}
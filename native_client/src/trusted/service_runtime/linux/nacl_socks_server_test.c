@@ -0,0 +1,309 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the validation server over loopback: policy file parsing,
+ * both reply versions as read by the client's parser, refusals, hot
+ * reload, per-hash counters, and dropping a client that stalls.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+
+#include "native_client/src/trusted/service_runtime/linux/nacl_socks_server.h"
+
+#define LISTED_HASH   "0123456789abcdef0123456789abcdef01234567"
+
+static char gPath[] = "/tmp/nacl_socks_server_test.XXXXXX";
+static unsigned char gListed[20];
+static unsigned char gUnlisted[20] = "unlisted application";
+static struct NaClRemoteServerPorts gPorts;
+
+
+static void WritePolicy(char const *text) {
+  FILE *iop = fopen(gPath, "w");
+
+  fputs(text, iop);
+  fclose(iop);
+}
+
+
+static int Connect(struct NaClValidateServer *srv) {
+  struct sockaddr_in  addr;
+  int                 fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&addr, 0, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(srv->port);
+  if (fd < 0 || 0 != connect(fd, (struct sockaddr *) &addr, sizeof addr)) {
+    printf("ERROR: connect failed\n");
+    exit(1);
+  }
+  return fd;
+}
+
+
+/*
+ * One handshake, served by polling srv from this thread.  Returns the
+ * client parser's verdict, with the policy in gPorts.
+ */
+static int Handshake(struct NaClValidateServer  *srv,
+                     unsigned char              *hash,
+                     uint32_t                   nonce) {
+  unsigned char req[NACL_VALIDATE_REQ_BYTES];
+  char          reply[NACL_VALIDATE_RESP_MAX_BYTES];
+  uint32_t      got = 0;
+  ssize_t       n;
+  int           fd = Connect(srv);
+  int           polls;
+
+  MakeNaClHashReq(req, hash, nonce);
+  if (sizeof req != send(fd, req, sizeof req, 0)) {
+    printf("ERROR: send failed\n");
+    exit(1);
+  }
+  for (polls = 0; polls < 100; ++polls) {
+    NaClValidateServerPoll(srv, 10);
+    while ((n = recv(fd, reply + got, sizeof reply - got, MSG_DONTWAIT)) > 0) {
+      got += (uint32_t) n;
+    }
+    if (0 == n) {
+      break;
+    }
+  }
+  close(fd);
+  return ParseNaClHashResp(reply, got, htonl(INADDR_LOOPBACK), &gPorts, nonce);
+}
+
+
+static int ExpectPorts(char const *what, uint16_t const *allowed,
+                       uint16_t const *denied) {
+  int errors = 0;
+
+  for (; 0 != *allowed; ++allowed) {
+    if (!NaClPortPolicyAllows(&gPorts, *allowed)) {
+      printf("ERROR: %s: port %u denied\n", what, *allowed);
+      ++errors;
+    }
+  }
+  for (; 0 != *denied; ++denied) {
+    if (NaClPortPolicyAllows(&gPorts, *denied)) {
+      printf("ERROR: %s: port %u allowed\n", what, *denied);
+      ++errors;
+    }
+  }
+  return errors;
+}
+
+
+int ParseTest(void) {
+  struct NaClValidatePolicyTable  table;
+  int                             errors = 0;
+
+  printf("\nParseTest\n");
+  WritePolicy("# comment\n\n"
+              LISTED_HASH " 80,443 8000-8099\n"
+              "*\tdeny\n");
+  if (0 != NaClValidatePolicyTableLoad(&table, gPath)) {
+    printf("ERROR: good file rejected\n");
+    return 1;
+  }
+  if (1 != table.num_entries || NULL == table.dflt
+      || 0 == table.dflt->status
+      || NULL == NaClValidatePolicyTableLookup(&table, gListed)
+      || table.dflt != NaClValidatePolicyTableLookup(&table, gUnlisted)) {
+    printf("ERROR: wrong table\n");
+    ++errors;
+  }
+  NaClValidatePolicyTableDtor(&table);
+
+  WritePolicy(LISTED_HASH " 80-79\n");
+  if (0 == NaClValidatePolicyTableLoad(&table, gPath)) {
+    printf("ERROR: backwards range accepted\n");
+    ++errors;
+  }
+  WritePolicy(LISTED_HASH " 65536\n");
+  if (0 == NaClValidatePolicyTableLoad(&table, gPath)) {
+    printf("ERROR: bad port accepted\n");
+    ++errors;
+  }
+  WritePolicy("0123 80\n");
+  if (0 == NaClValidatePolicyTableLoad(&table, gPath)) {
+    printf("ERROR: short hash accepted\n");
+    ++errors;
+  }
+  return errors;
+}
+
+
+int HandshakeTest(void) {
+  struct NaClValidateServerConfig cfg;
+  struct NaClValidateServer       srv;
+  static uint16_t const           allowed[] = { 80, 443, 8000, 8099, 0 };
+  static uint16_t const           denied[] = { 81, 7999, 8100, 65535, 0 };
+  static uint16_t const           reloaded[] = { 81, 0 };
+  static uint16_t const           none[] = { 0 };
+  struct NaClValidateHashStats    *stats;
+  int                             errors = 0;
+  int                             fd;
+  int                             polls;
+
+  printf("\nHandshakeTest\n");
+  WritePolicy(LISTED_HASH " 80,443 8000-8099\n");
+  memset(&cfg, 0, sizeof cfg);
+  cfg.policy_path = gPath;
+  cfg.bind_ip = htonl(INADDR_LOOPBACK);
+  cfg.idle_ms = 100;
+  if (!NaClValidateServerCtor(&srv, &cfg)) {
+    printf("ERROR: ctor failed\n");
+    return 1;
+  }
+
+  /* a client accepting version 2 gets ranges */
+  if (0 != Handshake(&srv, gListed, NACL_VALIDATE_VERSION << 24 | 5)) {
+    printf("ERROR: v2 handshake refused\n");
+    ++errors;
+  }
+  errors += ExpectPorts("v2", allowed, denied);
+  if (3 != gPorts.num_ranges) {
+    printf("ERROR: v2 reply has %u ranges\n", gPorts.num_ranges);
+    ++errors;
+  }
+  /* an old client gets the bitmap */
+  if (0 != Handshake(&srv, gListed, 6)) {
+    printf("ERROR: v1 handshake refused\n");
+    ++errors;
+  }
+  errors += ExpectPorts("v1", allowed, denied);
+  /* no entry and no default refuses */
+  if (0 == Handshake(&srv, gUnlisted, NACL_VALIDATE_VERSION << 24)) {
+    printf("ERROR: unlisted hash allowed\n");
+    ++errors;
+  }
+
+  /* a bad file is ignored; a good one takes over */
+  WritePolicy("garbage\n");
+  if (0 == NaClValidateServerReload(&srv)) {
+    printf("ERROR: bad reload accepted\n");
+    ++errors;
+  }
+  errors += (0 != Handshake(&srv, gListed, NACL_VALIDATE_VERSION << 24));
+  WritePolicy(LISTED_HASH " deny\n* 81\n");
+  if (0 != NaClValidateServerReload(&srv)) {
+    printf("ERROR: good reload rejected\n");
+    ++errors;
+  }
+  if (0 == Handshake(&srv, gListed, NACL_VALIDATE_VERSION << 24)) {
+    printf("ERROR: denied hash allowed\n");
+    ++errors;
+  }
+  if (0 != Handshake(&srv, gUnlisted, NACL_VALIDATE_VERSION << 24)) {
+    printf("ERROR: default refused\n");
+    ++errors;
+  }
+  errors += ExpectPorts("default", reloaded, none);
+
+  /* counters follow the hash across reloads */
+  stats = &NaClValidatePolicyTableLookup(&srv.table, gListed)->stats;
+  if (4 != stats->requests || 1 != stats->denied
+      || 1 != stats->v1_replies || 3 != stats->v2_replies
+      || 2 != srv.unknown.requests || 1 != srv.unknown.denied) {
+    printf("ERROR: wrong per-hash counts\n");
+    ++errors;
+  }
+
+  /* a client that stops halfway through its request is dropped */
+  fd = Connect(&srv);
+  if (10 != send(fd, gListed, 10, 0)) {
+    printf("ERROR: send failed\n");
+    ++errors;
+  }
+  for (polls = 0; polls < 100 && 0 == srv.stats.timeouts; ++polls) {
+    NaClValidateServerPoll(&srv, 10);
+  }
+  close(fd);
+  if (1 != srv.stats.timeouts || 0 != srv.num_conns) {
+    printf("ERROR: %"PRIu64" timeouts, %u open\n",
+           srv.stats.timeouts, srv.num_conns);
+    ++errors;
+  }
+
+  NaClValidateServerDtor(&srv);
+  return errors;
+}
+
+
+int main(int ac, char **av) {
+  char const  *s = LISTED_HASH;
+  int         errors = 0;
+  int         fd;
+  int         i;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+
+  for (i = 0; i < 20; ++i) {
+    sscanf(s + 2 * i, "%2hhx", &gListed[i]);
+  }
+  if ((fd = mkstemp(gPath)) < 0) {
+    printf("ERROR: could not create a temporary file\n");
+    return 1;
+  }
+  close(fd);
+
+  errors += ParseTest();
+  errors += HandshakeTest();
+
+  unlink(gPath);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
@@ -43,11 +43,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <limits.h>
 #include <arpa/inet.h>
 
 #include "native_client/src/include/portability.h"
 #include "native_client/src/include/nacl_platform.h"
 
+#include "native_client/src/shared/platform/nacl_host_desc.h"
 #include "native_client/src/shared/platform/nacl_log.h"
 #include "native_client/src/shared/platform/nacl_sync_checked.h"
 #include "native_client/src/shared/platform/nacl_time.h"
@@ -58,6 +62,8 @@
 #include "native_client/src/trusted/desc/nacl_desc_imc_bound_desc.h"
 #include "native_client/src/trusted/desc/nacl_desc_imc_shm.h"
 #include "native_client/src/trusted/desc/nacl_desc_io.h"
+#include "native_client/src/trusted/desc/nacl_desc_socket.h"
+#include "native_client/src/trusted/desc/linux/nacl_desc_epoll.h"
 
 #include "native_client/src/trusted/service_runtime/nacl_app_thread.h"
 #include "native_client/src/trusted/service_runtime/nacl_closure.h"
@@ -73,13 +79,20 @@
 #include "native_client/src/trusted/service_runtime/include/bits/mman.h"
 #include "native_client/src/trusted/service_runtime/include/bits/nacl_syscalls.h"
 #include "native_client/src/trusted/service_runtime/include/machine/_types.h"
+#include "native_client/src/trusted/service_runtime/include/sys/epoll.h"
 #include "native_client/src/trusted/service_runtime/include/sys/errno.h"
 #include "native_client/src/trusted/service_runtime/include/sys/fcntl.h"
+#include "native_client/src/trusted/service_runtime/include/sys/nacl_batch.h"
 #include "native_client/src/trusted/service_runtime/include/sys/nacl_imc_api.h"
+#include "native_client/src/trusted/service_runtime/include/sys/sendfile.h"
 #include "native_client/src/trusted/service_runtime/include/sys/stat.h"
 #include "native_client/src/trusted/service_runtime/include/sys/time.h"
 #include "native_client/src/trusted/service_runtime/include/sys/unistd.h"
 
+#include "native_client/src/trusted/service_runtime/linux/nacl_futex.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_resolver.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_ring.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_state.h"
 #include "native_client/src/trusted/service_runtime/linux/nacl_syscall_inl.h"
 
 #if defined(HAVE_SDL)
@@ -604,202 +617,1510 @@ cleanup:
   return retval;
 }
 
+/*
+ * Calls a batch may not make: the exits do not return to the batch,
+ * leaving x_sp pointing at its argument array, and the memory calls
+ * could unmap the records the batch still has to write.  A nested
+ * batch is refused too.
+ */
+static int NaClSysBatchAllowed(uint32_t sysnum) {
+  switch (sysnum) {
+    case NACL_sys_sysbrk:
+    case NACL_sys_mmap:
+    case NACL_sys_munmap:
+    case NACL_sys_exit:
+    case NACL_sys_thread_exit:
+    case NACL_sys_batch:
+      return 0;
+    default:
+      return sysnum < NACL_MAX_SYSCALLS;
+  }
+}
+
+/*
+ * Runs each record's call through the decoder the trampoline would
+ * have used, with the decoder reading its arguments from a trusted
+ * copy of the record instead of the user stack.
+ */
+int32_t NaClSysBatch(struct NaClAppThread           *natp,
+                     struct nacl_abi_syscall_record *records,
+                     unsigned int                   n,
+                     int                            flags) {
+  struct nacl_abi_syscall_record  *sysrecords;
+  uint32_t                        args[NACL_ABI_BATCH_MAX_ARGS];
+  uint32_t                        *user_sp;
+  uint32_t                        sysnum;
+  unsigned int                    i;
+  int32_t                         r;
+
+  if (n > NACL_ABI_BATCH_MAX || 0 != (flags & ~NACL_ABI_BATCH_CONTINUE)) {
+    return -NACL_ABI_EINVAL;
+  }
+  if (0 == n) {
+    return 0;
+  }
+  sysrecords = (struct nacl_abi_syscall_record *)
+      NaClUserToSysAddrRange(natp->nap, (uintptr_t) records,
+                             n * sizeof(*sysrecords));
+  if (kNaClBadAddress == (uintptr_t) sysrecords) {
+    return -NACL_ABI_EFAULT;
+  }
+
+  user_sp = natp->x_sp;
+  for (i = 0; i < n; ) {
+    /* Read once; other untrusted threads may change them */
+    sysnum = sysrecords[i].sysnum;
+    memcpy(args, sysrecords[i].args, sizeof(args));
+    if (!NaClSysBatchAllowed(sysnum)) {
+      r = -NACL_ABI_EINVAL;
+    } else {
+      natp->x_sp = args;
+      r = (*nacl_syscall[sysnum].handler)(natp);
+    }
+    sysrecords[i++].result = r;
+    if (r < 0 && 0 == (flags & NACL_ABI_BATCH_CONTINUE)) {
+      break;
+    }
+  }
+  natp->x_sp = user_sp;
+  return i;
+}
+
 //@author: nizam following are the wrappers around socket lib functions
 //that are outside the sandbox
-int32_t NaClSysAccept(struct NaClAppThread  *natp, int fd, struct sockaddr* addr,
+//Sockets live in the app's descriptor table as NaClDescSocket objects, so
+//the fd arguments below are table indices, not host descriptors.
+
+/*Look up socket d; returns its host descriptor, with a reference in *ndpp for the caller to drop*/
+static int NaClSysGetSocket(struct NaClAppThread *natp, int d,
+			    struct NaClDesc **ndpp) {
+	struct NaClDesc *ndp;
+	int fd;
+
+	ndp = NaClGetDesc(natp->nap, d);
+	if (NULL == ndp) {
+	  return -NACL_ABI_EBADF;
+	}
+	if ((fd = NaClDescSocketHostFd(ndp)) < 0) {
+	  NaClDescUnref(ndp);
+	  return -NACL_ABI_ENOTSOCK;
+	}
+	*ndpp = ndp;
+	return fd;
+}
+
+/*Enter the new host socket fd in the descriptor table; returns its index*/
+static int32_t NaClSysSetSocket(struct NaClAppThread *natp, int fd) {
+	// The number may have been used before
+	NaClSockStateReset(fd);
+	return NaClSetAvail(natp->nap, (struct NaClDesc *) NaClDescSocketMake(fd));
+}
+
+//Message headers.  The app's headers are copied in once per call, and every
+//buffer, name and control message in them is translated, so gather and
+//scatter I/O runs straight from the app's memory.
+
+/*The app's struct iovec, msghdr and mmsghdr: pointers and sizes are 32 bits*/
+struct NaClAbiIoVec {
+	uint32_t base;
+	uint32_t len;
+};
+
+struct NaClAbiMsgHdr {
+	uint32_t name;
+	uint32_t namelen;
+	uint32_t iov;
+	uint32_t iovlen;
+	uint32_t control;
+	uint32_t controllen;
+	int32_t flags;
+};
+
+struct NaClAbiMMsgHdr {
+	struct NaClAbiMsgHdr hdr;
+	uint32_t len;
+};
+
+/*The app's struct cmsghdr is 3 32-bit words, and its messages are 4-byte aligned*/
+#define NACL_ABI_CMSG_HDR_BYTES 12
+#define NACL_ABI_CMSG_ALIGN(len) (((len) + 3) & ~(uint32_t) 3)
+
+#define NACL_MSG_IOV 64             /* buffers per call */
+#define NACL_MSG_CONTROL_BYTES 128  /* host control data per message */
+
+/*Trusted side of one message, on the kernel stack*/
+struct NaClMsgBuf {
+	struct sockaddr_storage name;
+	union {
+	  size_t align;  /* cmsghdr's alignment, that of its cmsg_len */
+	  char bytes[NACL_MSG_CONTROL_BYTES];
+	} control;
+	void *uname;          /* receiving: where the app wants the source */
+	socklen_t unamelen;
+	char *ucontrol;       /* and its control data */
+	uint32_t ucontrollen;
+};
+
+/*Re-encode the app's len bytes of control data at ucontrol into buf for the host*/
+static int NaClSysCmsgCopyIn(char const *ucontrol, uint32_t len,
+			     struct msghdr *m, struct NaClMsgBuf *buf) {
+	struct cmsghdr *c;
+	uint32_t off = 0;
+	uint32_t clen;
+	uint32_t dlen;
+	int32_t level;
+	int32_t type;
+	size_t out = 0;
+
+	while (off + NACL_ABI_CMSG_HDR_BYTES <= len) {
+	  // Each byte is read once; other untrusted threads may change it
+	  memcpy(&clen, ucontrol + off, sizeof(clen));
+	  memcpy(&level, ucontrol + off + 4, sizeof(level));
+	  memcpy(&type, ucontrol + off + 8, sizeof(type));
+	  if (clen < NACL_ABI_CMSG_HDR_BYTES || clen > len - off) {
+	    return -NACL_ABI_EINVAL;
+	  }
+	  // Rights and credentials would name host descriptors and processes
+	  if (SOL_SOCKET == level) {
+	    return -NACL_ABI_EPERM;
+	  }
+	  dlen = clen - NACL_ABI_CMSG_HDR_BYTES;
+	  if (CMSG_SPACE(dlen) > sizeof(buf->control) - out) {
+	    return -NACL_ABI_ENOBUFS;
+	  }
+	  c = (struct cmsghdr *) (buf->control.bytes + out);
+	  c->cmsg_len = CMSG_LEN(dlen);
+	  c->cmsg_level = level;
+	  c->cmsg_type = type;
+	  memcpy(CMSG_DATA(c), ucontrol + off + NACL_ABI_CMSG_HDR_BYTES, dlen);
+	  out += CMSG_SPACE(dlen);
+	  off += NACL_ABI_CMSG_ALIGN(clen);
+	}
+	if (out > 0) {
+	  m->msg_control = buf->control.bytes;
+	  m->msg_controllen = out;
+	}
+	return 0;
+}
+
+/*Close any descriptors the host passed in m; the app could not use them*/
+static void NaClSysCmsgCloseRights(struct msghdr *m) {
+	struct cmsghdr *c;
+	int *fdp;
+	size_t i;
+
+	for (c = CMSG_FIRSTHDR(m); NULL != c; c = CMSG_NXTHDR(m, c)) {
+	  if (SOL_SOCKET == c->cmsg_level && SCM_RIGHTS == c->cmsg_type) {
+	    fdp = (int *) CMSG_DATA(c);
+	    for (i = 0; i < (c->cmsg_len - CMSG_LEN(0)) / sizeof(int); ++i) {
+	      close(fdp[i]);
+	    }
+	  }
+	}
+}
+
+/*Re-encode the host's control data in m for the app; returns the bytes written*/
+/*SOL_SOCKET messages hold host descriptors, credentials or host-sized times, and are dropped*/
+static uint32_t NaClSysCmsgCopyOut(struct msghdr *m, struct NaClMsgBuf *buf) {
+	struct cmsghdr *c;
+	uint32_t hdr[3];
+	uint32_t dlen;
+	uint32_t out = 0;
+
+	for (c = CMSG_FIRSTHDR(m); NULL != c; c = CMSG_NXTHDR(m, c)) {
+	  dlen = c->cmsg_len - CMSG_LEN(0);
+	  if (SOL_SOCKET == c->cmsg_level ||
+	      NACL_ABI_CMSG_HDR_BYTES + dlen > buf->ucontrollen - out) {
+	    m->msg_flags |= MSG_CTRUNC;
+	    continue;
+	  }
+	  hdr[0] = NACL_ABI_CMSG_HDR_BYTES + dlen;
+	  hdr[1] = c->cmsg_level;
+	  hdr[2] = c->cmsg_type;
+	  memcpy(buf->ucontrol + out, hdr, sizeof(hdr));
+	  memcpy(buf->ucontrol + out + sizeof(hdr), CMSG_DATA(c), dlen);
+	  out += NACL_ABI_CMSG_ALIGN(hdr[0]);
+	  if (out > buf->ucontrollen) {
+	    out = buf->ucontrollen;
+	  }
+	}
+	return out;
+}
+
+/*Translate the app's header h, already copied in, into m; iov has room for niov buffers*/
+/*Sending, the name and control data are copied into buf so what is checked is what is sent*/
+/*Receiving, they are taken into buf, to be checked and copied out by NaClSysMsgCopyOut*/
+static int NaClSysMsgCopyIn(struct NaClAppThread *natp,
+			    struct NaClAbiMsgHdr const *h, struct msghdr *m,
+			    struct iovec *iov, uint32_t niov,
+			    struct NaClMsgBuf *buf, int sending) {
+	struct NaClAbiIoVec *uiov;
+	struct NaClAbiIoVec v;
+	uintptr_t sysaddr;
+	uint32_t j;
+
+	memset(m, 0, sizeof(*m));
+	if (h->iovlen > niov) {
+	  return -NACL_ABI_EMSGSIZE;
+	}
+	// With no buffers the vector may be NULL, which never translates
+	if (h->iovlen > 0) {
+	  uiov = (void *)NaClUserToSysAddrRange(natp->nap, h->iov,
+						h->iovlen * sizeof(*uiov));
+	  if (kNaClBadAddress == (uintptr_t)uiov) {
+	    return -NACL_ABI_EFAULT;
+	  }
+	  for (j = 0; j < h->iovlen; ++j) {
+	    v = uiov[j];  // Read once; other untrusted threads may change it
+	    sysaddr = 0;  // likewise an empty buffer's base; the host ignores it
+	    if (v.len > 0 &&
+		kNaClBadAddress == (sysaddr = NaClUserToSysAddrRange(natp->nap,
+								     v.base,
+								     v.len))) {
+	      return -NACL_ABI_EFAULT;
+	    }
+	    iov[j].iov_base = (void *) sysaddr;
+	    iov[j].iov_len = v.len;
+	  }
+	}
+	m->msg_iov = iov;
+	m->msg_iovlen = h->iovlen;
+
+	if (sending) {
+	  if (0 != h->name) {
+	    if (h->namelen > sizeof(buf->name)) {
+	      return -NACL_ABI_EINVAL;
+	    }
+	    sysaddr = NaClUserToSysAddrRange(natp->nap, h->name, h->namelen);
+	    if (kNaClBadAddress == sysaddr) {
+	      return -NACL_ABI_EFAULT;
+	    }
+	    memcpy(&buf->name, (void *) sysaddr, h->namelen);
+	    m->msg_name = &buf->name;
+	    m->msg_namelen = h->namelen;
+	  }
+	  if (0 != h->controllen) {
+	    sysaddr = NaClUserToSysAddrRange(natp->nap, h->control, h->controllen);
+	    if (kNaClBadAddress == sysaddr) {
+	      return -NACL_ABI_EFAULT;
+	    }
+	    return NaClSysCmsgCopyIn((char const *) sysaddr, h->controllen, m, buf);
+	  }
+	  return 0;
+	}
+
+	// Always learn the source, so that it can be checked
+	buf->uname = NULL;
+	buf->unamelen = h->namelen;
+	if (0 != h->name) {
+	  buf->uname = (void *)NaClUserToSysAddrRange(natp->nap, h->name,
+						      h->namelen);
+	  if (kNaClBadAddress == (uintptr_t)buf->uname) {
+	    return -NACL_ABI_EFAULT;
+	  }
+	}
+	m->msg_name = &buf->name;
+	m->msg_namelen = sizeof(buf->name);
+	buf->ucontrol = NULL;
+	buf->ucontrollen = h->controllen;
+	if (0 != h->controllen) {
+	  buf->ucontrol = (void *)NaClUserToSysAddrRange(natp->nap, h->control,
+							 h->controllen);
+	  if (kNaClBadAddress == (uintptr_t)buf->ucontrol) {
+	    return -NACL_ABI_EFAULT;
+	  }
+	  m->msg_control = buf->control.bytes;
+	  m->msg_controllen = sizeof(buf->control);
+	}
+	return 0;
+}
+
+/*Write what the host reported for received message m back to the app's header uh*/
+static void NaClSysMsgCopyOut(struct NaClAbiMsgHdr *uh, struct msghdr *m,
+			      struct NaClMsgBuf *buf) {
+	uint32_t controllen = NaClSysCmsgCopyOut(m, buf);
+
+	if (NULL != buf->uname) {
+	  memcpy(buf->uname, m->msg_name,
+		 (m->msg_namelen < buf->unamelen) ? m->msg_namelen : buf->unamelen);
+	  uh->namelen = m->msg_namelen;
+	}
+	uh->controllen = controllen;
+	uh->flags = m->msg_flags & ~MSG_CMSG_CLOEXEC;  // ours, echoed by the host
+}
+
+#define NACL_ACCEPT_FLAGS (SOCK_NONBLOCK | SOCK_CLOEXEC)  /* the app's values are Linux's */
+#define NACL_ACCEPT_BATCH 64  /* connections per call; the rest wait for the next */
+
+/*Accept a connection on listening socket fd and check it; returns its index*/
+/*Inbound connections are checked against the policy for the local address and port they*/
+/*arrived on, not the peer's: its source port is ephemeral and its host runs no policy server*/
+/*The clearance is kept on fd, so later accepts on the same address cost O(1)*/
+/*A refused connection is hung up on, and reported as a connection aborted before accept*/
+static int32_t NaClSysAcceptOne(struct NaClAppThread *natp, int fd, int flags,
+				struct sockaddr_storage *peer,
+				socklen_t *peer_len) {
+	int s;
+	int r;
+	struct sockaddr_storage local;
+	socklen_t local_len = sizeof(local);
+
+	*peer_len = sizeof(*peer);
+	s = accept4(fd, (struct sockaddr *)peer, peer_len, flags);
+	if (s < 0) {
+	  return -NaClXlateErrno(errno);
+	}
+	// The number may have been used before; its clearances must not apply
+	NaClSockStateReset(s);
+	if (getsockname(s, (struct sockaddr *)&local, &local_len) < 0 ||
+	    NaClValidateSockAddr(natp, fd, (struct sockaddr *)&local, local_len) != 0) {
+	  close(s);
+	  return -NACL_ABI_ECONNABORTED;
+	}
+	r = NaClSysSetSocket(natp, s);
+	if (r >= 0 && AF_INET == peer->ss_family) {
+	  // Traffic to this peer needs no further checks
+	  NaClSockStateSetPeer(s, (struct sockaddr_in *)peer);
+	}
+	return r;
+}
+
+int32_t NaClSysAccept4(struct NaClAppThread  *natp, int d, struct sockaddr* addr,
+		   socklen_t *addr_len, int flags) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+        void *newaddr = NULL;
+	socklen_t *newaddr_len = NULL;
+	socklen_t cap = 0;
+	struct sockaddr_storage peer;
+	socklen_t peer_len;
+
+	if (0 != (flags & ~NACL_ACCEPT_FLAGS)) {
+	  return -NACL_ABI_EINVAL;
+	}
+	if (NULL != addr_len) {
+	  newaddr_len = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr_len, sizeof(socklen_t));
+	  if (kNaClBadAddress == (uintptr_t)newaddr_len) {
+	    return -NACL_ABI_EFAULT;	 
+	  }
+	  cap = *newaddr_len; // Read once; other untrusted threads may change it
+	  newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, cap);
+	  if (kNaClBadAddress == (uintptr_t)newaddr) {
+	    return -NACL_ABI_EFAULT;	 
+	  }
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClSysAcceptOne(natp, fd, flags, &peer, &peer_len);
+	NaClDescUnref(ndp);
+	if (r >= 0 && NULL != newaddr_len) {
+	  memcpy(newaddr, &peer, (peer_len < cap) ? peer_len : cap);
+	  *newaddr_len = peer_len;
+	}
+	return r;
+}
+
+int32_t NaClSysAccept(struct NaClAppThread  *natp, int d, struct sockaddr* addr,
 		   socklen_t *addr_len) {
+	return NaClSysAccept4(natp, d, addr, addr_len, 0);
+}
+
+/*Accept up to n pending connections on d into fds[]; returns how many*/
+/*Only the first may wait, and only if d blocks; the rest are those already pending*/
+int32_t NaClSysAccept_Batch(struct NaClAppThread  *natp, int d, int *fds,
+		unsigned int n, int flags) {
 	int r;
-	if ((r = NaClValidateIp(natp, addr)) != 0) {
-	  return r;
+	int fd;
+	int i = 0;
+	struct NaClDesc *ndp;
+	int *newfds;
+	struct sockaddr_storage peer;
+	socklen_t peer_len;
+
+	if (0 != (flags & ~NACL_ACCEPT_FLAGS)) {
+	  return -NACL_ABI_EINVAL;
+	}
+	if (n > NACL_ACCEPT_BATCH) {
+	  n = NACL_ACCEPT_BATCH;
+	}
+	newfds = (int *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) fds, n * sizeof(int));
+	if (kNaClBadAddress == (uintptr_t)newfds) {
+	  return -NACL_ABI_EFAULT;	 
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	while ((unsigned int) i < n) {
+	  r = NaClSysAcceptOne(natp, fd, flags, &peer, &peer_len);
+	  if (-NACL_ABI_ECONNABORTED == r && i > 0) {
+	    continue;  // refused; the next may be pending too
+	  }
+	  if (r < 0) {
+	    break;  // EAGAIN once the backlog is empty
+	  }
+	  newfds[i++] = r;
+	  // A blocking listener would wait for the next; the app has work already
+	  if (1 == i && 0 == (fcntl(fd, F_GETFL) & O_NONBLOCK)) {
+	    break;
+	  }
 	}
-	return accept(fd, addr, addr_len);
+	NaClDescUnref(ndp);
+	return (i > 0) ? i : r;
 }
 
-int32_t NaClSysBind(struct NaClAppThread  *natp, int fd,
+/*Copy the app's len-byte socket address at addr to copy, which is all that may be checked and used*/
+static int NaClSysCopyInSockAddr(struct NaClAppThread *natp,
+				 const struct sockaddr *addr, socklen_t len,
+				 struct sockaddr_storage *copy) {
+	uintptr_t sysaddr;
+
+	if (len > sizeof(*copy)) {
+	  return -NACL_ABI_EINVAL;
+	}
+	sysaddr = NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, len);
+	if (kNaClBadAddress == sysaddr) {
+	  return -NACL_ABI_EFAULT;
+	}
+	// Other untrusted threads may change the original after it is checked
+	memset(copy, 0, sizeof(*copy));
+	memcpy(copy, (void *) sysaddr, len);
+	return 0;
+}
+
+int32_t NaClSysBind(struct NaClAppThread  *natp, int d,
 		const struct sockaddr * addr, socklen_t len) {
 	int r;
-        struct sockaddr *newaddr = (struct sockaddr *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, len);
-	if (kNaClBadAddress == (uintptr_t)addr) {
-	  return -NACL_ABI_EFAULT;	 
+	int fd;
+	struct NaClDesc *ndp;
+	struct sockaddr_storage newaddr;
+
+	if ((r = NaClSysCopyInSockAddr(natp, addr, len, &newaddr)) != 0) {
+	  return r;
 	}
-	if ((r = NaClValidateIp(natp, newaddr)) != 0) {
+	if ((r = NaClValidateIp(natp, (struct sockaddr *)&newaddr)) != 0) {
 	  return r;
 	}
-	return bind(fd, newaddr, len);
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClXlateSysRet(bind(fd, (struct sockaddr *)&newaddr, len));
+	NaClDescUnref(ndp);
+	return r;
 }
  
-int32_t NaClSysConnect(struct NaClAppThread  *natp, int fd,
+int32_t NaClSysConnect(struct NaClAppThread  *natp, int d,
 		const struct sockaddr* addr, socklen_t len) {
 	int r;
-	struct sockaddr_in *addr_in;
+	int fd;
+	struct NaClDesc *ndp;
+	struct sockaddr_storage newaddr;
 
 
 	NaClLog(4, "nacl_syscall_impl.c:NaclSysConnect\n");
-	addr_in = (struct sockaddr_in *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, len); /* Echo server address */
-	NaClLog(4, "Addr: 0x%x\tLen: %d\n", (uint32_t)addr, (uint32_t)len);
-	
-
-	addr_in = (struct sockaddr_in *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, len); /* Echo server address */
+	NaClLog(4, "Addr: 0x%"PRIxPTR"\tLen: %d\n", (uintptr_t)addr, (uint32_t)len);
 
+	if ((r = NaClSysCopyInSockAddr(natp, addr, len, &newaddr)) != 0) {
+	  return r;
+	}
 
-	if (kNaClBadAddress == (uintptr_t)addr_in) {
-	  return -NACL_ABI_EFAULT;	 
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
 	}
 
-	if ((r = NaClValidateIp(natp, (struct sockaddr *)addr_in)) != 0) {
+	if ((r = NaClValidateSockAddr(natp, fd, (struct sockaddr *)&newaddr, len)) != 0) {
+	  NaClDescUnref(ndp);
 	  return r;
 	}
 
-	r = connect(fd, (struct sockaddr *)addr_in, len);
+	r = connect(fd, (struct sockaddr *)&newaddr, len);
+	if (0 == r || EINPROGRESS == errno) {
+	  // Traffic to this peer needs no further checks
+	  NaClSockStateSetPeer(fd, (struct sockaddr_in *)&newaddr);
+	}
+	r = NaClXlateSysRet(r);
 
+	NaClDescUnref(ndp);
 	return r;
 }
 
-int32_t NaClSysGetpeername(struct NaClAppThread  *natp, int fd,
+int32_t NaClSysGetpeername(struct NaClAppThread  *natp, int d,
 		struct sockaddr* addr, socklen_t *len) {
 	int r;
+	int fd;
+	struct NaClDesc *ndp;
         void *newaddr;
 	socklen_t *newlen;
+	socklen_t cap;
+	struct sockaddr_storage peer;
+	socklen_t peer_len = sizeof(peer);
+
 	newlen = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) len, sizeof(socklen_t));
 	if (kNaClBadAddress == (uintptr_t)newlen) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, *newlen);
+	cap = *newlen; // Read once; other untrusted threads may change it
+	newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, cap);
 	if (kNaClBadAddress == (uintptr_t)newaddr) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	if ((r = NaClValidateIp(natp, addr)) != 0) {
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	if (getpeername(fd, (struct sockaddr *)&peer, &peer_len) < 0) {
+	  r = -NaClXlateErrno(errno);
+	  NaClDescUnref(ndp);
 	  return r;
 	}
-	return getpeername(fd, addr, len);
+	// Normally the peer fd was connected to, which needs no lookup
+	r = NaClValidateSockAddr(natp, fd, (struct sockaddr *)&peer, peer_len);
+	NaClDescUnref(ndp);
+	if (r != 0) {
+	  return r;
+	}
+	memcpy(newaddr, &peer, (peer_len < cap) ? peer_len : cap);
+	*newlen = peer_len;
+	return 0;
 }
 
-int32_t NaClSysGetsockname(struct NaClAppThread  *natp, int fd,
+int32_t NaClSysGetsockname(struct NaClAppThread  *natp, int d,
 		struct sockaddr* addr, socklen_t *len) {
 	int r;
+	int fd;
+	struct NaClDesc *ndp;
         void *newaddr;
 	socklen_t *newlen;
+	socklen_t l;
 	newlen = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) len, sizeof(socklen_t));
 	if (kNaClBadAddress == (uintptr_t)newlen) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, *newlen);
+	l = *newlen; // Read once; other untrusted threads may change it
+	newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, l);
 	if (kNaClBadAddress == (uintptr_t)newaddr) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	if ((r = NaClValidateIp(natp, addr)) != 0) {
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	// Our own address; there's no remote policy to check it against
+	r = NaClXlateSysRet(getsockname(fd, newaddr, &l));
+	NaClDescUnref(ndp);
+	if (r < 0) {
 	  return r;
 	}
-	return getsockname(fd, newaddr, newlen);
+	*newlen = l;
+	return 0;
 }
 
-int32_t NaClSysGetsockopt(struct NaClAppThread  *natp, int fd, int level,
+int32_t NaClSysGetsockopt(struct NaClAppThread  *natp, int d, int level,
 		   int optname,
 	       void *optval,
 	       socklen_t *optlen) {
-	UNREFERENCED_PARAMETER(natp);
-	return getsockopt(fd, level, optname, optval, optlen);
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+        void *newoptval;
+	socklen_t *newoptlen;
+	socklen_t l;
+	newoptlen = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) optlen, sizeof(socklen_t));
+	if (kNaClBadAddress == (uintptr_t)newoptlen) {
+	  return -NACL_ABI_EFAULT;	 
+	}
+	l = *newoptlen; // Read once; other untrusted threads may change it
+	newoptval = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) optval, l);
+	if (kNaClBadAddress == (uintptr_t)newoptval) {
+	  return -NACL_ABI_EFAULT;	 
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	// The host writes at most l bytes, all inside the translated range
+	r = NaClXlateSysRet(getsockopt(fd, level, optname, newoptval, &l));
+	NaClDescUnref(ndp);
+	if (r < 0) {
+	  return r;
+	}
+	*newoptlen = l;
+	return 0;
 }
 
-int32_t NaClSysListen(struct NaClAppThread  *natp, int fd, int n) {
-	UNREFERENCED_PARAMETER(natp);
-	return listen(fd, n);
+int32_t NaClSysListen(struct NaClAppThread  *natp, int d, int n) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClXlateSysRet(listen(fd, n));
+	NaClDescUnref(ndp);
+	return r;
 }
 
-int32_t NaClSysRecv(struct NaClAppThread  *natp, int fd, void *buf,
+int32_t NaClSysRecv(struct NaClAppThread  *natp, int d, void *buf,
 		size_t n, int flags) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
         void *newbuf = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) buf, n);
 	if (kNaClBadAddress == (uintptr_t)newbuf) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	return recv(fd, newbuf, n, flags);
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClXlateSysRet(recv(fd, newbuf, n, flags));
+	NaClDescUnref(ndp);
+	return r;
 }
 
-int32_t NaClSysRecvfrom(struct NaClAppThread  *natp, int fd, void *buf, size_t n,
+int32_t NaClSysRecvfrom(struct NaClAppThread  *natp, int d, void *buf, size_t n,
 		 int flags, struct sockaddr* addr,
 		 socklen_t *addr_len) {
 	int r;
-        void *newaddr;
-	socklen_t *newaddr_len;
-	newaddr_len = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr_len, sizeof(socklen_t));
-	if (kNaClBadAddress == (uintptr_t)newaddr_len) {
+	int fd;
+	struct NaClDesc *ndp;
+	ssize_t got;
+        void *newbuf;
+        void *newaddr = NULL;
+	socklen_t *newaddr_len = NULL;
+	socklen_t cap = 0;
+	struct sockaddr_storage from;
+	socklen_t from_len = sizeof(from);
+
+	newbuf = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) buf, n);
+	if (kNaClBadAddress == (uintptr_t)newbuf) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, *newaddr_len);
-	if (kNaClBadAddress == (uintptr_t)newaddr) {
-	  return -NACL_ABI_EFAULT;	 
+	if (NULL != addr_len) {
+	  newaddr_len = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr_len, sizeof(socklen_t));
+	  if (kNaClBadAddress == (uintptr_t)newaddr_len) {
+	    return -NACL_ABI_EFAULT;	 
+	  }
+	  cap = *newaddr_len; // Read once; other untrusted threads may change it
+	  newaddr = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) addr, cap);
+	  if (kNaClBadAddress == (uintptr_t)newaddr) {
+	    return -NACL_ABI_EFAULT;	 
+	  }
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+
+	// Always learn the source, so that it can be checked
+	got = recvfrom(fd, newbuf, n, flags, (struct sockaddr *)&from, &from_len);
+	if (got < 0) {
+	  r = -NaClXlateErrno(errno);
+	  NaClDescUnref(ndp);
+	  return r;
 	}
-	if ((r = NaClValidateIp(natp, addr)) != 0) {
+	// Stream sockets report no source; their peer was checked at connect
+	r = (from_len > 0)
+	    ? NaClValidateSockAddr(natp, fd, (struct sockaddr *)&from, from_len)
+	    : 0;
+	NaClDescUnref(ndp);
+	if (r != 0) {
 	  return r;
 	}
-	return recvfrom(fd, buf, n, flags, newaddr, newaddr_len);
+	if (NULL != newaddr_len) {
+	  memcpy(newaddr, &from, (from_len < cap) ? from_len : cap);
+	  *newaddr_len = from_len;
+	}
+	return (int32_t) got;
 }
 
-int32_t NaClSysRecvmsg(struct NaClAppThread  *natp, int fd,
-		struct msghdr *message, int flags) {
-        struct msghdr *newmessage = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) message, sizeof(struct msghdr));
+int32_t NaClSysRecvmsg(struct NaClAppThread  *natp, int d,
+		struct NaClAbiMsgHdr *message, int flags) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+	ssize_t got;
+	struct NaClAbiMsgHdr *newmessage;
+	struct NaClAbiMsgHdr h;
+	struct msghdr m;
+	struct iovec iov[NACL_MSG_IOV];
+	struct NaClMsgBuf buf;
+
+	newmessage = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) message, sizeof(*newmessage));
 	if (kNaClBadAddress == (uintptr_t)newmessage) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	return recvmsg(fd, newmessage, flags);
+	h = *newmessage;  // Read once; other untrusted threads may change it
+	if ((r = NaClSysMsgCopyIn(natp, &h, &m, iov, NACL_MSG_IOV, &buf, 0)) != 0) {
+	  return r;
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+
+	got = recvmsg(fd, &m, flags | MSG_CMSG_CLOEXEC);
+	if (got < 0) {
+	  r = -NaClXlateErrno(errno);
+	  NaClDescUnref(ndp);
+	  return r;
+	}
+	NaClSysCmsgCloseRights(&m);
+	// Stream sockets report no source; their peer was checked at connect
+	r = (m.msg_namelen > 0)
+	    ? NaClValidateSockAddr(natp, fd, m.msg_name, m.msg_namelen)
+	    : 0;
+	NaClDescUnref(ndp);
+	if (r != 0) {
+	  return r;
+	}
+	NaClSysMsgCopyOut(newmessage, &m, &buf);
+	return (int32_t) got;
 }
 
-int32_t NaClSysSend(struct NaClAppThread  *natp, int fd,
+int32_t NaClSysSend(struct NaClAppThread  *natp, int d,
 		const void *buf, size_t n, int flags) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
         void *newbuf = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) buf, n);
 	if (kNaClBadAddress == (uintptr_t)newbuf) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	return send(fd, newbuf, n, flags);
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClXlateSysRet(send(fd, newbuf, n, flags));
+	NaClDescUnref(ndp);
+	return r;
 }
 
-int32_t NaClSysSendMsg(struct NaClAppThread  *natp, int fd,
-		const struct msghdr *message,
+int32_t NaClSysSendMsg(struct NaClAppThread  *natp, int d,
+		const struct NaClAbiMsgHdr *message,
 		int flags) {
-        void *newmessage = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) message, sizeof(struct msghdr));
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+	const struct NaClAbiMsgHdr *newmessage;
+	struct NaClAbiMsgHdr h;
+	struct msghdr m;
+	struct iovec iov[NACL_MSG_IOV];
+	struct NaClMsgBuf buf;
+
+	newmessage = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) message, sizeof(*newmessage));
 	if (kNaClBadAddress == (uintptr_t)newmessage) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	return sendmsg(fd, newmessage, flags);
+	h = *newmessage;  // Read once; other untrusted threads may change it
+	if ((r = NaClSysMsgCopyIn(natp, &h, &m, iov, NACL_MSG_IOV, &buf, 1)) != 0) {
+	  return r;
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	// No address means fd's connected peer, which was checked at connect
+	if (NULL != m.msg_name &&
+	    (r = NaClValidateSockAddr(natp, fd, m.msg_name, m.msg_namelen)) != 0) {
+	  NaClDescUnref(ndp);
+	  return r;
+	}
+	r = NaClXlateSysRet(sendmsg(fd, &m, flags));
+	NaClDescUnref(ndp);
+	return r;
 }
 
-int32_t NaClSysSendto(struct NaClAppThread  *natp, int fd,
+int32_t NaClSysSendto(struct NaClAppThread  *natp, int d,
 		   const void *buf, size_t n,
 	       int flags, const struct sockaddr* addr,
 	       socklen_t addr_len) {
 	int r;
+	int fd;
+	struct NaClDesc *ndp;
+	struct sockaddr_storage copy;
+        struct sockaddr *newaddr = NULL;
         void *newbuf = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) buf, n);
 	if (kNaClBadAddress == (uintptr_t)newbuf) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	if ((r = NaClValidateIp(natp, addr)) != 0) {
+	if (NULL != addr) {
+	  if ((r = NaClSysCopyInSockAddr(natp, addr, addr_len, &copy)) != 0) {
+	    return r;
+	  }
+	  newaddr = (struct sockaddr *)&copy;
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	// No address means fd's connected peer, which was checked at connect
+	if (NULL != addr &&
+	    (r = NaClValidateSockAddr(natp, fd, newaddr, addr_len)) != 0) {
+	  NaClDescUnref(ndp);
 	  return r;
 	}
-	return sendto(fd, newbuf, n, flags, addr, addr_len);
+	r = NaClXlateSysRet(sendto(fd, newbuf, n, flags, newaddr, addr_len));
+	NaClDescUnref(ndp);
+	return r;
 }
 
-int32_t NaClSysSetsockopt(struct NaClAppThread  *natp, int fd, int level,
+int32_t NaClSysSetsockopt(struct NaClAppThread  *natp, int d, int level,
 		int optname, const void *optval, socklen_t optlen) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
         void *newoptval = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) optval, optlen);
 	if (kNaClBadAddress == (uintptr_t)newoptval) {
 	  return -NACL_ABI_EFAULT;	 
 	}
-	return setsockopt(fd, level, optname, newoptval, optlen);
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClXlateSysRet(setsockopt(fd, level, optname, newoptval, optlen));
+	NaClDescUnref(ndp);
+	return r;
 }
 
-int32_t NaClSysShutdown(struct NaClAppThread  *natp, int fd, int how) {
-	UNREFERENCED_PARAMETER(natp);
-	return shutdown(fd, how);
+int32_t NaClSysShutdown(struct NaClAppThread  *natp, int d, int how) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	r = NaClXlateSysRet(shutdown(fd, how));
+	NaClDescUnref(ndp);
+	return r;
 }
 
 int32_t NaClSysSocket(struct NaClAppThread  *natp, int domain, int type,
 		int protocol) {
-	UNREFERENCED_PARAMETER(natp);
-	return socket(domain, type, protocol);
+	int fd;
+	fd = socket(domain, type, protocol);
+	if (fd < 0) {
+	  return -NaClXlateErrno(errno);
+	}
+	return NaClSysSetSocket(natp, fd);
 }
 
 int32_t NaClSysSocketpair(struct NaClAppThread  *natp, int domain, int type,
 		int protocol, int fds[2]) {
-	UNREFERENCED_PARAMETER(natp);
-	return socketpair(domain, type, protocol, fds);
+	int host[2];
+	int32_t d0;
+	int32_t d1;
+        int *newfds = (int *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) fds, 2 * sizeof(int));
+	if (kNaClBadAddress == (uintptr_t)newfds) {
+	  return -NACL_ABI_EFAULT;	 
+	}
+	if (socketpair(domain, type, protocol, host) < 0) {
+	  return -NaClXlateErrno(errno);
+	}
+	if ((d0 = NaClSysSetSocket(natp, host[0])) < 0) {
+	  close(host[0]);
+	  close(host[1]);
+	  return d0;
+	}
+	if ((d1 = NaClSysSetSocket(natp, host[1])) < 0) {
+	  // Dropping the table's reference closes host[0]
+	  NaClSetDesc(natp->nap, d0, NULL);
+	  close(host[1]);
+	  return d1;
+	}
+	newfds[0] = d0;
+	newfds[1] = d1;
+	return 0;
+}
+
+//Batched datagrams.  Each message is translated as for sendmsg and recvmsg,
+//and each distinct peer is checked once however many of the messages go to
+//or come from it.
+
+#define NACL_MMSG_BATCH 16  /* messages per call; the rest wait for the next */
+
+/*Host copy of one call's messages, on the kernel stack*/
+struct NaClMmsgBatch {
+	struct mmsghdr msg[NACL_MMSG_BATCH];
+	struct iovec iov[NACL_MSG_IOV];
+	struct NaClMsgBuf buf[NACL_MMSG_BATCH];
+	struct sockaddr_in peer[NACL_MMSG_BATCH];  /* checked during this call */
+	int npeers;
+};
+
+/*Copy in the app's vlen headers at vmsg; returns how many messages fit in the batch,*/
+/*or an error if not even the first does*/
+static int NaClSysMmsgCopyIn(struct NaClAppThread *natp,
+			     struct NaClMmsgBatch *b,
+			     struct NaClAbiMMsgHdr *vmsg, unsigned int vlen,
+			     int sending) {
+	struct NaClAbiMsgHdr h;
+	unsigned int i;
+	uint32_t niov = 0;
+	int r = 0;
+
+	for (i = 0; i < vlen; ++i) {
+	  h = vmsg[i].hdr;  // Read once; other untrusted threads may change it
+	  if (i > 0 && h.iovlen > NACL_MSG_IOV - niov) {
+	    break;  // a batch of its own next time
+	  }
+	  r = NaClSysMsgCopyIn(natp, &h, &b->msg[i].msg_hdr, &b->iov[niov],
+			       NACL_MSG_IOV - niov, &b->buf[i], sending);
+	  if (r != 0) {
+	    break;
+	  }
+	  niov += h.iovlen;
+	}
+	// Like the host, report the error with the next call if some messages fit
+	return (0 == i) ? r : (int) i;
+}
+
+/*0 if fd may exchange datagrams with addr; an IPv4 peer is looked up once per batch*/
+static int NaClSysMmsgCheckPeer(struct NaClAppThread *natp, int fd,
+				struct NaClMmsgBatch *b,
+				const struct sockaddr *addr, socklen_t len) {
+	const struct sockaddr_in *addr_in = (const struct sockaddr_in *)addr;
+	int is_in = (len >= sizeof(*addr_in) && AF_INET == addr->sa_family);
+	int i;
+	int r;
+
+	if (is_in) {
+	  for (i = 0; i < b->npeers; ++i) {
+	    if (b->peer[i].sin_addr.s_addr == addr_in->sin_addr.s_addr &&
+		b->peer[i].sin_port == addr_in->sin_port) {
+	      return 0;
+	    }
+	  }
+	}
+	r = NaClValidateSockAddr(natp, fd, addr, len);
+	if (0 == r && is_in && b->npeers < NACL_MMSG_BATCH) {
+	  b->peer[b->npeers++] = *addr_in;
+	}
+	return r;
+}
+
+/*Zero the first len bytes received into m's buffers*/
+static void NaClSysIovZero(struct msghdr *m, size_t len) {
+	size_t i;
+	size_t chunk;
+
+	for (i = 0; i < m->msg_iovlen && len > 0; ++i) {
+	  chunk = (m->msg_iov[i].iov_len < len) ? m->msg_iov[i].iov_len : len;
+	  memset(m->msg_iov[i].iov_base, 0, chunk);
+	  len -= chunk;
+	}
+}
+
+/*Copy the first len bytes received into src's buffers to dst's; returns how many fit*/
+static size_t NaClSysIovCopy(struct msghdr *dst, struct msghdr const *src,
+			     size_t len) {
+	size_t di = 0;
+	size_t doff = 0;
+	size_t si = 0;
+	size_t soff = 0;
+	size_t chunk;
+	size_t copied = 0;
+
+	while (copied < len && di < dst->msg_iovlen && si < src->msg_iovlen) {
+	  chunk = len - copied;
+	  if (chunk > dst->msg_iov[di].iov_len - doff) {
+	    chunk = dst->msg_iov[di].iov_len - doff;
+	  }
+	  if (chunk > src->msg_iov[si].iov_len - soff) {
+	    chunk = src->msg_iov[si].iov_len - soff;
+	  }
+	  // Both are the app's buffers; it may have made them overlap
+	  memmove((char *) dst->msg_iov[di].iov_base + doff,
+		  (char *) src->msg_iov[si].iov_base + soff, chunk);
+	  copied += chunk;
+	  if ((doff += chunk) == dst->msg_iov[di].iov_len) {
+	    ++di;
+	    doff = 0;
+	  }
+	  if ((soff += chunk) == src->msg_iov[si].iov_len) {
+	    ++si;
+	    soff = 0;
+	  }
+	}
+	return copied;
+}
+
+int32_t NaClSysRecvmmsg(struct NaClAppThread  *natp, int d,
+		struct NaClAbiMMsgHdr *vmessages, unsigned int vlen,
+		int flags, struct nacl_abi_timespec *timeout) {
+	int r;
+	int fd;
+	int i;
+	int n;
+	int kept = 0;
+	int keep[NACL_MMSG_BATCH];  /* messages from allowed peers, in order */
+	size_t len;
+	struct NaClDesc *ndp;
+	struct NaClAbiMMsgHdr *newvmessages;
+	struct nacl_abi_timespec *newtimeout;
+	struct timespec ts;
+	struct timespec *tsp = NULL;
+	struct NaClMmsgBatch b;
+
+	if (vlen > NACL_MMSG_BATCH) {
+	  vlen = NACL_MMSG_BATCH;
+	}
+	newvmessages = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) vmessages,
+						      vlen * sizeof(*newvmessages));
+	if (kNaClBadAddress == (uintptr_t)newvmessages) {
+	  return -NACL_ABI_EFAULT;
+	}
+	if (NULL != timeout) {
+	  newtimeout = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) timeout,
+						      sizeof(*newtimeout));
+	  if (kNaClBadAddress == (uintptr_t)newtimeout) {
+	    return -NACL_ABI_EFAULT;
+	  }
+	  ts.tv_sec = newtimeout->tv_sec;
+	  ts.tv_nsec = newtimeout->tv_nsec;
+	  tsp = &ts;
+	}
+	b.npeers = 0;
+	if ((n = NaClSysMmsgCopyIn(natp, &b, newvmessages, vlen, 0)) < 0) {
+	  return n;
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+
+	n = recvmmsg(fd, b.msg, n, flags | MSG_CMSG_CLOEXEC, tsp);
+	if (n < 0) {
+	  r = -NaClXlateErrno(errno);
+	  NaClDescUnref(ndp);
+	  return r;
+	}
+	for (i = 0; i < n; ++i) {
+	  NaClSysCmsgCloseRights(&b.msg[i].msg_hdr);
+	}
+	r = 0;
+	for (i = 0; i < n; ++i) {
+	  // Stream sockets report no source; their peer was checked at connect
+	  if (b.msg[i].msg_hdr.msg_namelen > 0) {
+	    r = NaClSysMmsgCheckPeer(natp, fd, &b, b.msg[i].msg_hdr.msg_name,
+				     b.msg[i].msg_hdr.msg_namelen);
+	    if (r != 0) {
+	      // Dropped; the host already wrote its payload into the app's buffers
+	      NaClSysIovZero(&b.msg[i].msg_hdr, b.msg[i].msg_len);
+	      continue;
+	    }
+	  }
+	  keep[kept++] = i;
+	}
+	NaClDescUnref(ndp);
+	if (0 == kept) {
+	  return r;
+	}
+
+	// Kept messages move down over dropped ones, into the app's earlier headers
+	for (i = 0; i < kept; ++i) {
+	  len = b.msg[keep[i]].msg_len;
+	  if (keep[i] != i) {
+	    len = NaClSysIovCopy(&b.msg[i].msg_hdr, &b.msg[keep[i]].msg_hdr, len);
+	    if (len < b.msg[keep[i]].msg_len) {
+	      b.msg[keep[i]].msg_hdr.msg_flags |= MSG_TRUNC;
+	    }
+	  }
+	  NaClSysMsgCopyOut(&newvmessages[i].hdr, &b.msg[keep[i]].msg_hdr,
+			    &b.buf[i]);
+	  newvmessages[i].len = len;
+	}
+	return kept;
+}
+
+int32_t NaClSysSendmmsg(struct NaClAppThread  *natp, int d,
+		struct NaClAbiMMsgHdr *vmessages, unsigned int vlen,
+		int flags) {
+	int r;
+	int fd;
+	int i;
+	int n;
+	struct NaClDesc *ndp;
+	struct NaClAbiMMsgHdr *newvmessages;
+	struct NaClMmsgBatch b;
+
+	if (vlen > NACL_MMSG_BATCH) {
+	  vlen = NACL_MMSG_BATCH;
+	}
+	newvmessages = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) vmessages,
+						      vlen * sizeof(*newvmessages));
+	if (kNaClBadAddress == (uintptr_t)newvmessages) {
+	  return -NACL_ABI_EFAULT;
+	}
+	b.npeers = 0;
+	if ((n = NaClSysMmsgCopyIn(natp, &b, newvmessages, vlen, 1)) < 0) {
+	  return n;
+	}
+	if ((fd = NaClSysGetSocket(natp, d, &ndp)) < 0) {
+	  return fd;
+	}
+	for (i = 0; i < n; ++i) {
+	  // No address means fd's connected peer, which was checked at connect
+	  if (NULL != b.msg[i].msg_hdr.msg_name &&
+	      (r = NaClSysMmsgCheckPeer(natp, fd, &b, b.msg[i].msg_hdr.msg_name,
+					b.msg[i].msg_hdr.msg_namelen)) != 0) {
+	    if (0 == i) {
+	      NaClDescUnref(ndp);
+	      return r;
+	    }
+	    n = i;  // send those before it; the app learns why with the next call
+	    break;
+	  }
+	}
+	r = NaClXlateSysRet(sendmmsg(fd, b.msg, n, flags));
+	NaClDescUnref(ndp);
+
+	for (i = 0; i < r; ++i) {
+	  newvmessages[i].len = b.msg[i].msg_len;
+	}
+	return r;
+}
+
+//File to socket copies, done by the host kernel.  The socket's peer was
+//checked at connect, and a socket with none cannot send.
+
+int32_t NaClSysSendfile(struct NaClAppThread  *natp, int out_d, int in_d,
+		nacl_abi_off_t *offset, size_t count) {
+	int r;
+	int fd;
+	struct NaClDesc *ndp;
+	struct NaClDesc *in;
+	nacl_abi_off_t *newoffset = NULL;
+	off_t off = 0;
+	ssize_t sent;
+
+	if (NULL != offset) {
+	  newoffset = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) offset, sizeof(*newoffset));
+	  if (kNaClBadAddress == (uintptr_t)newoffset) {
+	    return -NACL_ABI_EFAULT;
+	  }
+	  off = *newoffset;  // Read once; other untrusted threads may change it
+	  if (off < 0) {
+	    return -NACL_ABI_EINVAL;
+	  }
+	  // The app's off_t is 32 bits; stop where it would wrap
+	  if (count > (size_t) (INT32_MAX - off)) {
+	    count = INT32_MAX - off;
+	  }
+	}
+	if (count > INT32_MAX) {
+	  count = INT32_MAX;  // the count comes back in an int32_t
+	}
+
+	in = NaClGetDesc(natp->nap, in_d);
+	if (NULL == in) {
+	  return -NACL_ABI_EBADF;
+	}
+	if (NACL_DESC_HOST_IO != in->vtbl->typeTag) {
+	  NaClDescUnref(in);
+	  return -NACL_ABI_EINVAL;  // as Linux says of sources it cannot map
+	}
+	if ((fd = NaClSysGetSocket(natp, out_d, &ndp)) < 0) {
+	  NaClDescUnref(in);
+	  return fd;
+	}
+
+	sent = sendfile(fd, ((struct NaClDescIoDesc *) in)->hd->d,
+			(NULL != newoffset) ? &off : NULL, count);
+	r = (sent < 0) ? -NaClXlateErrno(errno) : (int32_t) sent;
+	NaClDescUnref(ndp);
+	NaClDescUnref(in);
+	if (NULL != newoffset && r >= 0) {
+	  *newoffset = (nacl_abi_off_t) off;
+	}
+	return r;
+}
+
+//Readiness notification.  Instances are NaClDescEpoll objects in the
+//descriptor table, and descriptors are registered by their host
+//descriptor; the app's event data is stored by the host kernel as is.
+
+#define NACL_EPOLL_EVENTS (NACL_ABI_EPOLLIN | NACL_ABI_EPOLLPRI | \
+			   NACL_ABI_EPOLLOUT | NACL_ABI_EPOLLERR | \
+			   NACL_ABI_EPOLLHUP | NACL_ABI_EPOLLRDNORM | \
+			   NACL_ABI_EPOLLRDBAND | NACL_ABI_EPOLLWRNORM | \
+			   NACL_ABI_EPOLLWRBAND | NACL_ABI_EPOLLMSG | \
+			   NACL_ABI_EPOLLRDHUP | NACL_ABI_EPOLLONESHOT | \
+			   NACL_ABI_EPOLLET)
+#define NACL_EPOLL_MAX_EVENTS ((int) (INT_MAX / sizeof(struct nacl_abi_epoll_event)))
+#define NACL_EPOLL_BOUNCE_EVENTS 64  /* on the kernel stack */
+
+/*Look up epoll instance epfd; on success *epp holds a reference for the caller to drop*/
+static int NaClSysGetEpoll(struct NaClAppThread *natp, int epfd,
+			   struct NaClDescEpoll **epp) {
+	struct NaClDesc *ndp;
+
+	ndp = NaClGetDesc(natp->nap, epfd);
+	if (NULL == ndp) {
+	  return -NACL_ABI_EBADF;
+	}
+	if (NACL_DESC_HOST_EPOLL != ndp->vtbl->typeTag) {
+	  NaClDescUnref(ndp);
+	  return -NACL_ABI_EINVAL;
+	}
+	*epp = (struct NaClDescEpoll *) ndp;
+	return 0;
+}
+
+int32_t NaClSysEpoll_Create(struct NaClAppThread  *natp, int flags) {
+	struct NaClDescEpoll *ep;
+	if (0 != (flags & ~NACL_ABI_EPOLL_CLOEXEC)) {
+	  return -NACL_ABI_EINVAL;
+	}
+	if (NULL == (ep = NaClDescEpollMake())) {
+	  return -NaClXlateErrno(errno);
+	}
+	return NaClSetAvail(natp->nap, (struct NaClDesc *) ep);
+}
+
+int32_t NaClSysEpoll_Ctl(struct NaClAppThread  *natp, int epfd, int op,
+		int d, struct nacl_abi_epoll_event *event) {
+	int r;
+	int fd;
+	int hostop;
+	struct NaClDescEpoll *ep;
+	struct NaClDesc *ndp;
+	struct nacl_abi_epoll_event *newevent;
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	switch (op) {
+	  case NACL_ABI_EPOLL_CTL_ADD:
+	    hostop = EPOLL_CTL_ADD;
+	    break;
+	  case NACL_ABI_EPOLL_CTL_MOD:
+	    hostop = EPOLL_CTL_MOD;
+	    break;
+	  case NACL_ABI_EPOLL_CTL_DEL:
+	    hostop = EPOLL_CTL_DEL;
+	    break;
+	  default:
+	    return -NACL_ABI_EINVAL;
+	}
+	// DEL ignores the event, which may be NULL
+	if (EPOLL_CTL_DEL != hostop) {
+	  newevent = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) event, sizeof(*newevent));
+	  if (kNaClBadAddress == (uintptr_t)newevent) {
+	    return -NACL_ABI_EFAULT;
+	  }
+	  // Read once; other untrusted threads may change it
+	  ev.events = newevent->events;
+	  ev.data.u64 = newevent->data.u64;
+	  if (0 != (ev.events & ~NACL_EPOLL_EVENTS)) {
+	    return -NACL_ABI_EINVAL;
+	  }
+	}
+
+	if ((r = NaClSysGetEpoll(natp, epfd, &ep)) != 0) {
+	  return r;
+	}
+	ndp = NaClGetDesc(natp->nap, d);
+	if (NULL == ndp) {
+	  NaClDescUnref((struct NaClDesc *) ep);
+	  return -NACL_ABI_EBADF;
+	}
+	if (ndp == (struct NaClDesc *) ep) {
+	  r = -NACL_ABI_EINVAL;
+	} else if ((fd = NaClDescEpollTargetFd(ndp)) < 0) {
+	  r = -NACL_ABI_EPERM;  // as Linux says of descriptors it cannot poll
+	} else {
+	  r = NaClDescEpollCtl(ep, hostop, fd, &ev);
+	}
+	NaClDescUnref(ndp);
+	NaClDescUnref((struct NaClDesc *) ep);
+	return r;
+}
+
+int32_t NaClSysEpoll_Wait(struct NaClAppThread  *natp, int epfd,
+		struct nacl_abi_epoll_event *events, int maxevents,
+		int timeout) {
+	int r;
+	int i;
+	struct NaClDescEpoll *ep;
+	struct nacl_abi_epoll_event *newevents;
+
+	if (maxevents <= 0 || maxevents > NACL_EPOLL_MAX_EVENTS) {
+	  return -NACL_ABI_EINVAL;
+	}
+	newevents = (void *)NaClUserToSysAddrRange(natp->nap, (uintptr_t) events,
+						   maxevents * sizeof(*newevents));
+	if (kNaClBadAddress == (uintptr_t)newevents) {
+	  return -NACL_ABI_EFAULT;
+	}
+	if ((r = NaClSysGetEpoll(natp, epfd, &ep)) != 0) {
+	  return r;
+	}
+
+	if (sizeof(struct epoll_event) == sizeof(struct nacl_abi_epoll_event)) {
+	  // The host's layout (x86): its kernel fills in the app's array itself
+	  r = NaClDescEpollWait(ep, (struct epoll_event *) newevents, maxevents,
+				timeout);
+	} else {
+	  struct epoll_event host[NACL_EPOLL_BOUNCE_EVENTS];
+
+	  if (maxevents > NACL_EPOLL_BOUNCE_EVENTS) {
+	    maxevents = NACL_EPOLL_BOUNCE_EVENTS;  // the rest wait for the next call
+	  }
+	  r = NaClDescEpollWait(ep, host, maxevents, timeout);
+	  for (i = 0; i < r; ++i) {
+	    newevents[i].events = host[i].events;
+	    newevents[i].data.u64 = host[i].data.u64;
+	  }
+	}
+	NaClDescUnref((struct NaClDesc *) ep);
+	return r;
+}
+
+//Socket rings.  The ring's worker performs each submission through the
+//call the app could have made, without blocking, so a ring gets no
+//checks the calls don't.
+
+static int32_t NaClSysSockringPerform(struct NaClAppThread *natp,
+		struct nacl_abi_sockring_sqe const *sqe) {
+	void *p = (void *)(uintptr_t) sqe->addr;
+	int flags = sqe->msg_flags | MSG_DONTWAIT;
+
+	switch (sqe->opcode) {
+	  case NACL_ABI_SOCKRING_OP_NOP:
+	    return 0;
+	  case NACL_ABI_SOCKRING_OP_SEND:
+	    return NaClSysSend(natp, sqe->fd, p, sqe->len, flags);
+	  case NACL_ABI_SOCKRING_OP_RECV:
+	    return NaClSysRecv(natp, sqe->fd, p, sqe->len, flags);
+	  case NACL_ABI_SOCKRING_OP_SENDMSG:
+	    return NaClSysSendMsg(natp, sqe->fd, p, flags);
+	  case NACL_ABI_SOCKRING_OP_RECVMSG:
+	    return NaClSysRecvmsg(natp, sqe->fd, p, flags);
+	  default:
+	    return -NACL_ABI_EINVAL;
+	}
+}
+
+int32_t NaClSysSockring_Create(struct NaClAppThread  *natp, int shm_d,
+		unsigned int entries) {
+	int r;
+	struct NaClDesc *shm;
+	struct NaClDescSockRing *ring;
+
+	shm = NaClGetDesc(natp->nap, shm_d);
+	if (NULL == shm) {
+	  return -NACL_ABI_EBADF;
+	}
+	if (NULL == (ring = malloc(sizeof(*ring)))) {
+	  r = -NACL_ABI_ENOMEM;
+	} else if ((r = NaClDescSockRingCtor(ring, natp->nap, shm, entries,
+					     NaClSysSockringPerform)) != 0) {
+	  free(ring);
+	}
+	NaClDescUnref(shm);
+	if (r != 0) {
+	  return r;
+	}
+	return NaClSetAvail(natp->nap, (struct NaClDesc *) ring);
+}
+
+int32_t NaClSysSockring_Enter(struct NaClAppThread  *natp, int ring_d,
+		unsigned int min_complete, int timeout_ms) {
+	int r;
+	struct NaClDesc *ndp;
+
+	ndp = NaClGetDesc(natp->nap, ring_d);
+	if (NULL == ndp) {
+	  return -NACL_ABI_EBADF;
+	}
+	if (NACL_DESC_SOCK_RING != ndp->vtbl->typeTag) {
+	  r = -NACL_ABI_EINVAL;
+	} else {
+	  r = NaClDescSockRingEnter((struct NaClDescSockRing *) ndp,
+				    min_complete, timeout_ms);
+	}
+	NaClDescUnref(ndp);
+	return r;
+}
+
+//Resolves a host name to up to max IPv4 addresses (network order) via the
+//service runtime's caching resolver; returns how many were stored
+int32_t NaClSysGetaddrinfo(struct NaClAppThread  *natp, const char *name,
+		uint32_t *addrs, unsigned int max) {
+	char sysname[NACL_RESOLVER_MAX_NAME + 2];
+	uint32_t found[NACL_RESOLVER_MAX_ADDRS];
+	uintptr_t sysaddr;
+	uintptr_t span;
+	char *p;
+	int r;
+
+	// Copy the name without reading past what NaClUserToSysAddrRange allows
+	span = ((uintptr_t) 1U << natp->nap->addr_bits) - 1;
+	if ((uintptr_t) name >= span) {
+	  return -NACL_ABI_EFAULT;
+	}
+	span -= (uintptr_t) name;
+	if (span > sizeof sysname) {
+	  span = sizeof sysname;
+	}
+	p = (char*) NaClUserToSysAddrRange(natp->nap, (uintptr_t) name, span);
+	if (kNaClBadAddress == (uintptr_t) p) {
+	  return -NACL_ABI_EFAULT;
+	}
+	memcpy(sysname, p, span);
+	if (NULL == memchr(sysname, '\0', span)) {
+	  return (span == sizeof sysname) ? -NACL_ABI_EINVAL : -NACL_ABI_EFAULT;
+	}
+
+	if (max > NACL_RESOLVER_MAX_ADDRS) {
+	  max = NACL_RESOLVER_MAX_ADDRS;
+	}
+	sysaddr = NaClUserToSysAddrRange(natp->nap, (uintptr_t) addrs,
+					 max * sizeof *addrs);
+	if (kNaClBadAddress == sysaddr) {
+	  return -NACL_ABI_EFAULT;
+	}
+	r = NaClResolverModuleLookup(sysname, found, max, natp->nap->app_hash);
+	if (r > 0) {
+	  memcpy((void*) sysaddr, found, r * sizeof *found);
+	}
+	return r;
+}
+
+// The address of a futex word, or kNaClBadAddress if it is out of the
+// sandbox or not 4-byte aligned
+static uintptr_t NaClFutexAddr(struct NaClApp *nap, int32_t *addr) {
+	if (0 != ((uintptr_t) addr & 3)) {
+	  return kNaClBadAddress;
+	}
+	return NaClUserToSysAddrRange(nap, (uintptr_t) addr, sizeof *addr);
+}
+
+int32_t NaClSysFutex_Wait(struct NaClAppThread  *natp, int32_t *addr,
+		int32_t val, struct nacl_abi_timespec *abstime) {
+	struct nacl_abi_timespec sysabstime;
+	uintptr_t sysaddr;
+	uintptr_t systs;
+
+	sysaddr = NaClFutexAddr(natp->nap, addr);
+	if (kNaClBadAddress == sysaddr) {
+	  return ((uintptr_t) addr & 3) ? -NACL_ABI_EINVAL : -NACL_ABI_EFAULT;
+	}
+	if (NULL == abstime) {
+	  return NaClFutexModuleWait((volatile int32_t*) sysaddr, val, NULL);
+	}
+	systs = NaClUserToSysAddrRange(natp->nap, (uintptr_t) abstime,
+				       sizeof *abstime);
+	if (kNaClBadAddress == systs) {
+	  return -NACL_ABI_EFAULT;
+	}
+	memcpy(&sysabstime, (void*) systs, sizeof sysabstime);
+	if (sysabstime.tv_nsec < 0 || sysabstime.tv_nsec >= 1000000000) {
+	  return -NACL_ABI_EINVAL;
+	}
+	return NaClFutexModuleWait((volatile int32_t*) sysaddr, val, &sysabstime);
+}
+
+int32_t NaClSysFutex_Wake(struct NaClAppThread  *natp, int32_t *addr,
+		int32_t nwake) {
+	uintptr_t sysaddr;
+
+	sysaddr = NaClFutexAddr(natp->nap, addr);
+	if (kNaClBadAddress == sysaddr) {
+	  return ((uintptr_t) addr & 3) ? -NACL_ABI_EINVAL : -NACL_ABI_EFAULT;
+	}
+	if (nwake < 0) {
+	  return -NACL_ABI_EINVAL;
+	}
+	return NaClFutexModuleWake((volatile int32_t*) sysaddr, nwake);
 }
@@ -83,4 +83,7 @@ static INLINE int32_t NaClXlateSysRetAddr(struct NaClApp  *nap,
 
 int NaClValidateIp(struct NaClAppThread  *natp, const struct sockaddr* addr);
 
+int NaClValidateSockAddr(struct NaClAppThread *natp, int fd,
+                         const struct sockaddr *addr, socklen_t len);
+
 #endif
@@ -1,10 +1,13 @@
 #include <sys/socket.h>
+#include <netinet/in.h>
 
 #include "native_client/src/include/portability.h"
 
 #include "native_client/src/trusted/service_runtime/sel_ldr.h"
 #include "native_client/src/trusted/service_runtime/nacl_app_thread.h"
+#include "native_client/src/trusted/service_runtime/linux/nacl_sock_state.h"
 #include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+#include "native_client/src/trusted/service_runtime/include/sys/errno.h"
 
 //#define IGNORE_CHECKS
 //#define ALLOW_PRIVILEGED_FULL_NETWORK
@@ -27,3 +30,32 @@ int NaClValidateIp(struct NaClAppThread *natp, const struct sockaddr* addr) {
 	return NaClIsConnectionOk(addr, &(natp->nap->app_hash[0]));	
 #endif // IGNORE_CHECKS
 }
+
+/*Like NaClValidateIp, for traffic on socket fd; addr must be a trusted copy of len bytes,*/
+/*not app memory, and the host call must be given that same copy*/
+/*Peers fd was connected to or already cleared for are accepted in O(1), see nacl_sock_state.h*/
+int NaClValidateSockAddr(struct NaClAppThread *natp, int fd,
+			 const struct sockaddr *addr, socklen_t len) {
+	const struct sockaddr_in *addr_in = (const struct sockaddr_in *)addr;
+	uint32_t now;
+	int r;
+
+	if (len < sizeof(addr->sa_family)) {
+		return -NACL_ABI_EINVAL;
+	}
+	if (addr->sa_family != AF_INET) {
+		return NaClValidateIp(natp, addr); // Only IPv4 is supported; this rejects the rest
+	}
+	if (len < sizeof(struct sockaddr_in)) {
+		return -NACL_ABI_EINVAL;
+	}
+
+	now = NaClSocksClientNow();
+	if (NaClSockStateCheck(fd, addr_in, now)) {
+		return 0;
+	}
+	if ((r = NaClValidateIp(natp, addr)) == 0) {
+		NaClSockStateClear(fd, addr_in, now + NaClSocksClientAllowTtl());
+	}
+	return r;
+}
@@ -38,6 +38,12 @@
 #include "native_client/src/trusted/service_runtime/nacl_syscall_handlers.h"
 #include "native_client/src/trusted/service_runtime/nacl_thread_nice.h"
 #include "native_client/src/trusted/service_runtime/nacl_tls.h"
+#if NACL_LINUX
+# include "native_client/src/trusted/service_runtime/linux/nacl_futex.h"
+# include "native_client/src/trusted/service_runtime/linux/nacl_resolver.h"
+# include "native_client/src/trusted/service_runtime/linux/nacl_sock_state.h"
+# include "native_client/src/trusted/service_runtime/linux/nacl_socks_client.h"
+#endif
 
 
 void  NaClAllModulesInit(void) {
@@ -49,10 +55,22 @@ void  NaClAllModulesInit(void) {
 #endif
   NaClSyscallTableInit();
   NaClThreadNiceInit();
+#if NACL_LINUX
+  NaClFutexModuleInit();
+  NaClSocksClientModuleInit();
+  NaClResolverModuleInit();
+  NaClSockStateModuleInit();
+#endif
 }
 
 
 void NaClAllModulesFini(void) {
+#if NACL_LINUX
+  NaClSockStateModuleFini();
+  NaClResolverModuleFini();
+  NaClSocksClientModuleFini();
+  NaClFutexModuleFini();
+#endif
 #if defined(HAVE_SDL)
   NaClMultimediaModuleFini();
 #endif
@@ -44,6 +44,11 @@ void WINAPI NaClThreadLauncher(void *state) {
 
   NaClLog(4, "NaClThreadLauncher: entered\n");
   natp = (struct NaClAppThread *) state;
+  /*
+   * A thread reused from the pool comes back here from deep inside its
+   * old thread_exit call, which resets its host stack.
+   */
+  (void) setjmp(natp->launch_env);
   NaClLog(4, "natp = 0x%08"PRIxPTR"\n", (uintptr_t) natp);
   NaClLog(4, "prog_ctr  = 0x%08"PRIx32"\n", natp->user.prog_ctr);
 
@@ -118,6 +123,9 @@ int NaClAppThreadCtor(struct NaClAppThread  *natp,
 
   natp->thread_num = -1;  /* illegal index */
 
+  natp->pool_state = NACL_APP_THREAD_RUNNING;
+  natp->pool_next = NULL;
+
   thread_idx = NaClGetThreadIdx(natp);
 
   nacl_thread[thread_idx] = natp;
@@ -194,6 +202,121 @@ int NaClAppThreadAllocSegCtor(struct NaClAppThread  *natp,
 }
 
 
+int NaClAppThreadPark(struct NaClAppThread *natp) {
+  struct NaClApp  *nap = natp->nap;
+
+  NaClXMutexLock(&nap->threads_mu);
+  NaClXMutexLock(&natp->mu);
+  if (nap->thread_pool_size >= nap->thread_pool_max || 1 != natp->refcount) {
+    NaClXMutexUnlock(&natp->mu);
+    NaClXMutexUnlock(&nap->threads_mu);
+    return 0;
+  }
+  natp->pool_state = NACL_APP_THREAD_PARKED;
+  natp->pool_next = nap->thread_pool;
+  nap->thread_pool = natp;
+  ++nap->thread_pool_size;
+  /*
+   * Keep our slot in nacl_thread taken, as on ARM a new thread's index
+   * is the first empty slot.  No syscall can come in on it while we are
+   * parked.
+   */
+  nacl_thread[NaClGetThreadIdx(natp)] = natp;
+  NaClXMutexUnlock(&nap->threads_mu);
+  NaClLog(3, "NaClAppThreadPark: parked 0x%08"PRIxPTR"\n", (uintptr_t) natp);
+
+  while (NACL_APP_THREAD_PARKED == natp->pool_state) {
+    NaClXCondVarWait(&natp->cv, &natp->mu);
+  }
+  if (NACL_APP_THREAD_RETIRED == natp->pool_state) {
+    nacl_thread[NaClGetThreadIdx(natp)] = NULL;
+    NaClXMutexUnlock(&natp->mu);
+    return 0;
+  }
+  natp->pool_state = NACL_APP_THREAD_RUNNING;
+  NaClXMutexUnlock(&natp->mu);
+  longjmp(natp->launch_env, 1);
+  /* NOTREACHED */
+  return 0;
+}
+
+
+static void NaClAppThreadRetire(struct NaClAppThread *natp) {
+  NaClXMutexLock(&natp->mu);
+  natp->pool_state = NACL_APP_THREAD_RETIRED;
+  NaClXCondVarSignal(&natp->cv);
+  NaClXMutexUnlock(&natp->mu);
+}
+
+
+int NaClAppThreadUnpark(struct NaClApp  *nap,
+                        uintptr_t       usr_entry,
+                        uintptr_t       usr_stack_ptr,
+                        uintptr_t       sys_tdb_base,
+                        size_t          tdb_size) {
+  struct NaClAppThread  *natp;
+  uint32_t              tls_idx;
+  uint32_t              thread_idx;
+
+  NaClXMutexLock(&nap->threads_mu);
+  natp = nap->thread_pool;
+  if (NULL != natp) {
+    nap->thread_pool = natp->pool_next;
+    --nap->thread_pool_size;
+  }
+  NaClXMutexUnlock(&nap->threads_mu);
+  if (NULL == natp) {
+    return 0;
+  }
+
+  /* Point the thread's existing selector at the new tdb */
+  tls_idx = NaClTlsChange(natp, (void *) sys_tdb_base, tdb_size);
+  if (0 == tls_idx) {
+    NaClAppThreadRetire(natp);
+    return 0;
+  }
+  NaClLog(3,
+          "NaClAppThreadUnpark: reusing 0x%08"PRIxPTR", tls_idx 0x%02x\n",
+          (uintptr_t) natp, tls_idx);
+
+  NaClThreadContextCtor(&natp->user, nap, usr_entry, usr_stack_ptr, tls_idx);
+  natp->sysret = 0;
+  natp->holding_sr_locks = 0;
+  natp->state = NACL_APP_THREAD_ALIVE;
+  natp->thread_num = -1;
+
+  thread_idx = NaClGetThreadIdx(natp);
+
+  nacl_thread[thread_idx] = natp;
+  nacl_user[thread_idx] = &natp->user;
+  nacl_sys[thread_idx] = &natp->sys;
+
+  NaClXMutexLock(&natp->mu);
+  natp->pool_state = NACL_APP_THREAD_REUSED;
+  NaClXCondVarSignal(&natp->cv);
+  NaClXMutexUnlock(&natp->mu);
+  return 1;
+}
+
+
+void NaClAppThreadPoolDrain(struct NaClApp *nap) {
+  struct NaClAppThread  *natp;
+
+  NaClXMutexLock(&nap->threads_mu);
+  natp = nap->thread_pool;
+  nap->thread_pool = NULL;
+  nap->thread_pool_size = 0;
+  NaClXMutexUnlock(&nap->threads_mu);
+
+  while (NULL != natp) {
+    struct NaClAppThread *next = natp->pool_next;
+
+    NaClAppThreadRetire(natp);
+    natp = next;
+  }
+}
+
+
 int NaClAppThreadIncRef(struct NaClAppThread *natp) {
   int refcount;
 
@@ -36,6 +36,8 @@
 #ifndef NATIVE_CLIENT_SERVICE_RUNTIME_NACL_APP_THREAD_H__
 #define NATIVE_CLIENT_SERVICE_RUNTIME_NACL_APP_THREAD_H__ 1
 
+#include <setjmp.h>
+
 #include "native_client/src/shared/platform/nacl_threads.h"
 #include "native_client/src/trusted/service_runtime/nacl_bottom_half.h"
 #include "native_client/src/trusted/service_runtime/sel_rt.h"
@@ -52,6 +54,16 @@ enum NaClThreadState {
   NACL_APP_THREAD_DEAD
 };
 
+enum NaClThreadPoolState {
+  NACL_APP_THREAD_RUNNING,
+  NACL_APP_THREAD_PARKED,   /* in nap->thread_pool */
+  NACL_APP_THREAD_REUSED,   /* handed a new context by thread_create */
+  NACL_APP_THREAD_RETIRED   /* told to exit for good */
+};
+
+/* Default for NaClApp thread_pool_max; NACL_THREAD_POOL_MAX overrides */
+#define NACL_THREAD_POOL_DEFAULT_MAX  8
+
 /*
  * Generally, only the thread itself will need to manipulate this
  * structure, but occasionally we may need to blow away a thread for
@@ -67,6 +79,7 @@ struct NaClAppThread {
   uint32_t                  refcount;
 
   struct NaClClosureResult  result;
+  struct NaClAsyncOpSlot    async_op;  /* see NaClStartAsyncOp */
 
   uint32_t                  sysret;
 
@@ -151,6 +164,18 @@ struct NaClAppThread {
    * user's sp translated to system address, used for accessing syscall
    * arguments
    */
+
+  /*
+   * A thread that calls thread_exit may park in its app's thread pool
+   * rather than go away, keeping its host thread and its TLS selector,
+   * so that the next thread_create only has to fill in a new user
+   * context.  A parked thread sleeps on cv, under mu, until pool_state
+   * changes; if reused, it unwinds its host stack by longjmp'ing to
+   * launch_env, set in NaClThreadLauncher.
+   */
+  enum NaClThreadPoolState  pool_state;
+  struct NaClAppThread      *pool_next;   /* under nap->threads_mu */
+  jmp_buf                   launch_env;
 };
 
 int NaClAppThreadCtor(struct NaClAppThread  *natp,
@@ -178,6 +203,31 @@ int NaClAppThreadAllocSegCtor(struct NaClAppThread  *natp,
                               uintptr_t             sys_tdb_base,
                               size_t                tdb_size) NACL_WUR;
 
+/*
+ * Called by an exiting thread, which is already off the thread
+ * tables.  Returns 0 if the thread could not be parked, or was retired
+ * from the pool; the caller then drops its reference and exits.
+ * Otherwise does not return: a later NaClAppThreadUnpark restarts the
+ * thread in the app.
+ */
+int NaClAppThreadPark(struct NaClAppThread *natp);
+
+/*
+ * Restarts a parked thread of nap, if there is one, with the given
+ * validated values as for NaClAppThreadAllocSegCtor.  Returns non-zero
+ * if it did.
+ */
+int NaClAppThreadUnpark(struct NaClApp  *nap,
+                        uintptr_t       usr_entry,
+                        uintptr_t       usr_stack_ptr,
+                        uintptr_t       sys_tdb_base,
+                        size_t          tdb_size);
+
+/*
+ * Retires all of nap's parked threads.
+ */
+void NaClAppThreadPoolDrain(struct NaClApp *nap);
+
 int NaClAppThreadIncRef(struct NaClAppThread *natp);
 
 int NaClAppThreadDecRef(struct NaClAppThread *natp);
@@ -99,7 +99,12 @@ void NaClStartAsyncOp(struct NaClAppThread  *natp,
   NaClLog(4, "NaClStartAsyncOp(0x%08"PRIxPTR", 0x%08"PRIxPTR")\n",
           (uintptr_t) natp,
           (uintptr_t) ncp);
-  NaClSyncQueueInsert(&natp->nap->work_queue, ncp);
+  if ((void *) ncp == (void *) &natp->async_op.closure) {
+    NaClSyncQueueInsertItem(&natp->nap->work_queue, &natp->async_op.link,
+                            ncp);
+  } else {
+    NaClSyncQueueInsert(&natp->nap->work_queue, ncp);
+  }
   NaClLog(4, "Done\n");
 }
 
@@ -39,9 +39,10 @@
 #include "native_client/src/include/portability.h"  /* uintptr_t */
 #include "native_client/src/shared/platform/nacl_sync.h"
 #include "native_client/src/trusted/service_runtime/include/sys/audio_video.h"
+#include "native_client/src/trusted/service_runtime/nacl_closure.h"
+#include "native_client/src/trusted/service_runtime/nacl_sync_queue.h"
 
 struct NaClAppThread;
-struct NaClClosure;
 
 struct NaClClosureResult {
   struct NaClMutex    mu;
@@ -59,6 +60,26 @@ void *NaClClosureResultWait(struct NaClClosureResult *self);
 void NaClClosureResultDone(struct NaClClosureResult *self,
                            void                     *rv);
 
+/*
+ * Storage for the one bottom-half request a thread can have
+ * outstanding -- it waits for the result before making another -- so
+ * that making a request allocates nothing.  Build the closure in place
+ * with a NaClClosureNPlacementCtor.
+ */
+struct NaClAsyncOpSlot {
+  struct NaClSyncQueueItem  link;
+  union {
+    struct NaClClosure1     c1;
+    struct NaClClosure2     c2;
+    struct NaClClosure3     c3;
+    struct NaClClosure4     c4;
+  } closure;
+};
+
+/*
+ * Queues ncp for the bottom half.  A closure in natp's async_op slot
+ * is queued without allocating; any other is a heap closure.
+ */
 void NaClStartAsyncOp(struct NaClAppThread  *natp,
                       struct NaClClosure    *ncp);
 
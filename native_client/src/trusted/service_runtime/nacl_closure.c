@@ -198,6 +198,112 @@ void NaClClosure4Run(struct NaClClosure *vself) {
   NaClClosure4Dtor(vself);
 }
 
+static void NaClClosure1PlacementDtor(struct NaClClosure *vself) {
+  UNREFERENCED_PARAMETER(vself);
+}
+
+static void NaClClosure1PlacementRun(struct NaClClosure *vself) {
+  struct NaClClosure1 *self = (struct NaClClosure1 *) vself;
+  (*self->fn)(self->arg1);
+}
+
+static struct NaClClosureVtbl const kNaClClosure1PlacementVtbl = {
+  NaClClosure1PlacementDtor,
+  NaClClosure1PlacementRun,
+};
+
+struct NaClClosure1 *NaClClosure1PlacementCtor(struct NaClClosure1  *self,
+                                               void  (*fn)(void *),
+                                               void  *arg1) {
+  self->base.vtbl = &kNaClClosure1PlacementVtbl;
+  self->fn = fn;
+  self->arg1 = arg1;
+  return self;
+}
+
+static void NaClClosure2PlacementDtor(struct NaClClosure *vself) {
+  UNREFERENCED_PARAMETER(vself);
+}
+
+static void NaClClosure2PlacementRun(struct NaClClosure *vself) {
+  struct NaClClosure2 *self = (struct NaClClosure2 *) vself;
+  (*self->fn)(self->arg1, self->arg2);
+}
+
+static struct NaClClosureVtbl const kNaClClosure2PlacementVtbl = {
+  NaClClosure2PlacementDtor,
+  NaClClosure2PlacementRun,
+};
+
+struct NaClClosure2 *NaClClosure2PlacementCtor(struct NaClClosure2  *self,
+                                               void  (*fn)(void *, void *),
+                                               void  *arg1,
+                                               void  *arg2) {
+  self->base.vtbl = &kNaClClosure2PlacementVtbl;
+  self->fn = fn;
+  self->arg1 = arg1;
+  self->arg2 = arg2;
+  return self;
+}
+
+static void NaClClosure3PlacementDtor(struct NaClClosure *vself) {
+  UNREFERENCED_PARAMETER(vself);
+}
+
+static void NaClClosure3PlacementRun(struct NaClClosure *vself) {
+  struct NaClClosure3 *self = (struct NaClClosure3 *) vself;
+  (*self->fn)(self->arg1, self->arg2, self->arg3);
+}
+
+static struct NaClClosureVtbl const kNaClClosure3PlacementVtbl = {
+  NaClClosure3PlacementDtor,
+  NaClClosure3PlacementRun,
+};
+
+struct NaClClosure3 *NaClClosure3PlacementCtor(struct NaClClosure3  *self,
+                                               void  (*fn)(void *, void *,
+                                                           void *),
+                                               void  *arg1,
+                                               void  *arg2,
+                                               void  *arg3) {
+  self->base.vtbl = &kNaClClosure3PlacementVtbl;
+  self->fn = fn;
+  self->arg1 = arg1;
+  self->arg2 = arg2;
+  self->arg3 = arg3;
+  return self;
+}
+
+static void NaClClosure4PlacementDtor(struct NaClClosure *vself) {
+  UNREFERENCED_PARAMETER(vself);
+}
+
+static void NaClClosure4PlacementRun(struct NaClClosure *vself) {
+  struct NaClClosure4 *self = (struct NaClClosure4 *) vself;
+  (*self->fn)(self->arg1, self->arg2, self->arg3, self->arg4);
+}
+
+static struct NaClClosureVtbl const kNaClClosure4PlacementVtbl = {
+  NaClClosure4PlacementDtor,
+  NaClClosure4PlacementRun,
+};
+
+struct NaClClosure4 *NaClClosure4PlacementCtor(struct NaClClosure4  *self,
+                                               void  (*fn)(void *, void *,
+                                                           void *, void *),
+                                               void  *arg1,
+                                               void  *arg2,
+                                               void  *arg3,
+                                               void  *arg4) {
+  self->base.vtbl = &kNaClClosure4PlacementVtbl;
+  self->fn = fn;
+  self->arg1 = arg1;
+  self->arg2 = arg2;
+  self->arg3 = arg3;
+  self->arg4 = arg4;
+  return self;
+}
+
 static struct NaClClosureVtbl const kNaClClosure5Vtbl = {
   NaClClosure5Dtor,
   NaClClosure5Run,
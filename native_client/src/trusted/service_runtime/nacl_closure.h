@@ -138,6 +138,41 @@ struct NaClClosure4 *NaClClosure4Ctor(void  (*fn)(void *arg1,
 void NaClClosure4Dtor(struct NaClClosure *self);
 void NaClClosure4Run(struct NaClClosure *vself);
 
+/*
+ * Placement versions of the one to four argument ctors, for closures
+ * in storage the caller owns, such as a thread's bottom-half request
+ * slot.  They return self.  Run does not touch the closure once fn has
+ * been entered and Dtor does not free, so the storage may be reused as
+ * soon as fn has published its result.
+ */
+struct NaClClosure1 *NaClClosure1PlacementCtor(struct NaClClosure1  *self,
+                                               void  (*fn)(void *arg1),
+                                               void  *arg1);
+
+struct NaClClosure2 *NaClClosure2PlacementCtor(struct NaClClosure2  *self,
+                                               void  (*fn)(void *arg1,
+                                                           void *arg2),
+                                               void  *arg1,
+                                               void  *arg2);
+
+struct NaClClosure3 *NaClClosure3PlacementCtor(struct NaClClosure3  *self,
+                                               void  (*fn)(void *arg1,
+                                                           void *arg2,
+                                                           void *arg3),
+                                               void  *arg1,
+                                               void  *arg2,
+                                               void  *arg3);
+
+struct NaClClosure4 *NaClClosure4PlacementCtor(struct NaClClosure4  *self,
+                                               void  (*fn)(void *arg1,
+                                                           void *arg2,
+                                                           void *arg3,
+                                                           void *arg4),
+                                               void  *arg1,
+                                               void  *arg2,
+                                               void  *arg3,
+                                               void  *arg4);
+
 struct NaClClosure5 {
   struct NaClClosure  base;
   void                (*fn)(void *, void *, void *, void *,
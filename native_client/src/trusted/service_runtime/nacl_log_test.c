@@ -0,0 +1,234 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise buffered logging: the level check, messages from many
+ * threads surviving the rings in per-thread order, errors written
+ * after what is buffered, and the binary record format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+#include "native_client/src/trusted/service_runtime/gio.h"
+
+#define TEST_STACK_BYTES  (128 << 10)
+#define TEST_THREADS      8
+#define TEST_MESSAGES     2000  /* per thread */
+#define TEST_LOG_BYTES    (4 << 20)
+
+static char                 log_buffer[TEST_LOG_BYTES];
+static struct GioMemoryFile log_gio;
+
+struct Logger {
+  struct NaClThread thread;
+  int               id;
+  int               done;
+};
+
+static void ResetLog(void) {
+  NaClLogFlush();
+  memset(log_buffer, 0, sizeof log_buffer);
+  (void) GioMemoryFileCtor(&log_gio, log_buffer, sizeof log_buffer);
+  NaClLogSetGio((struct Gio *) &log_gio);
+}
+
+static int LevelTest(void) {
+  int errors = 0;
+
+  NaClLogSetVerbosity(2);
+  if (!NaClLogLevelEnabled(2) || NaClLogLevelEnabled(3)
+      || !NaClLogLevelEnabled(LOG_ERROR)) {
+    printf("ERROR: NaClLogLevelEnabled disagrees with verbosity 2\n");
+    ++errors;
+  }
+  ResetLog();
+  NaClLog(3, "too detailed\n");
+  NaClLog(2, "detailed enough\n");
+  NaClLogFlush();
+  if (0 != strcmp(log_buffer, "detailed enough\n")) {
+    printf("ERROR: level filter wrote \"%s\"\n", log_buffer);
+    ++errors;
+  }
+  return errors;
+}
+
+static void WINAPI LoggerThread(void *arg) {
+  struct Logger *l = (struct Logger *) arg;
+  int           i;
+
+  for (i = 0; i < TEST_MESSAGES; ++i) {
+    NaClLog(1, "logger %d message %d\n", l->id, i);
+  }
+  (void) __sync_add_and_fetch(&l->done, 1);
+}
+
+static int ThreadTest(void) {
+  struct Logger loggers[TEST_THREADS];
+  int           next[TEST_THREADS];
+  char          *line;
+  char          *end;
+  int           id;
+  int           msg;
+  unsigned      dropped;
+  int           seen = 0;
+  int           lost = 0;
+  int           errors = 0;
+  int           i;
+
+  ResetLog();
+  for (i = 0; i < TEST_THREADS; ++i) {
+    loggers[i].id = i;
+    loggers[i].done = 0;
+    next[i] = 0;
+    if (!NaClThreadCtor(&loggers[i].thread, LoggerThread, &loggers[i],
+                        TEST_STACK_BYTES)) {
+      printf("ERROR: NaClThreadCtor failed\n");
+      return 1;
+    }
+  }
+  for (i = 0; i < TEST_THREADS; ++i) {
+    while (0 == __sync_fetch_and_add(&loggers[i].done, 0)) {
+      NaClLogFlush();
+    }
+  }
+  NaClLogFlush();
+
+  for (line = log_buffer; '\0' != *line; line = end + 1) {
+    end = strchr(line, '\n');
+    if (NULL == end) {
+      printf("ERROR: unterminated line \"%s\"\n", line);
+      ++errors;
+      break;
+    }
+    if (2 == sscanf(line, "logger %d message %d", &id, &msg)
+        && 0 <= id && id < TEST_THREADS) {
+      /* a full ring drops messages, so only the order is certain */
+      if (msg < next[id]) {
+        printf("ERROR: logger %d message %d after %d\n", id, msg, next[id]);
+        ++errors;
+      }
+      next[id] = msg + 1;
+      ++seen;
+    } else if (1 == sscanf(line, "NaClLog: dropped %u", &dropped)) {
+      lost += dropped;
+    } else {
+      printf("ERROR: unexpected line \"%.*s\"\n", (int) (end - line), line);
+      ++errors;
+    }
+  }
+  if (TEST_THREADS * TEST_MESSAGES != seen + lost) {
+    printf("ERROR: %d messages written and %d dropped, expected %d\n",
+           seen, lost, TEST_THREADS * TEST_MESSAGES);
+    ++errors;
+  }
+  return errors;
+}
+
+static int ErrorOrderTest(void) {
+  int errors = 0;
+
+  ResetLog();
+  NaClLog(1, "buffered first\n");
+  NaClLog(LOG_ERROR, "error second\n");
+  if (0 != strcmp(log_buffer, "buffered first\nerror second\n")) {
+    printf("ERROR: error was not written after buffered output: \"%s\"\n",
+           log_buffer);
+    ++errors;
+  }
+  return errors;
+}
+
+static int BinaryTest(void) {
+  struct NaClLogRecord  rec;
+  static char const     kText[] = "binary 42\n";
+  int                   errors = 0;
+
+  if (!NaClLogEnableBuffering(1)) {
+    printf("ERROR: could not switch to binary records\n");
+    return 1;
+  }
+  ResetLog();
+  NaClLog(1, "binary %d\n", 42);
+  NaClLogFlush();
+  memcpy(&rec, log_buffer, sizeof rec);
+  if (NACL_LOG_RECORD_MAGIC != rec.magic
+      || 1 != rec.detail_level
+      || NaClThreadId() != rec.thread_id
+      || sizeof kText - 1 != rec.length
+      || 0 != memcmp(log_buffer + sizeof rec, kText, rec.length)
+      || '\0' != log_buffer[sizeof rec + rec.length]) {
+    printf("ERROR: bad binary record: magic 0x%x level %d length %u\n",
+           rec.magic, rec.detail_level, rec.length);
+    ++errors;
+  }
+  return errors;
+}
+
+int main(int ac, char **av) {
+  struct Gio  *stderr_gio;
+  int         errors = 0;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+  stderr_gio = NaClLogGetGio();
+  NaClLogDisableTimestamp();
+  if (!NaClLogEnableBuffering(0)) {
+    printf("ERROR: NaClLogEnableBuffering failed\n");
+    return 1;
+  }
+
+  errors += LevelTest();
+  errors += ThreadTest();
+  errors += ErrorOrderTest();
+  errors += BinaryTest();
+
+  NaClLogDisableBuffering();
+  NaClLogSetGio(stderr_gio);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
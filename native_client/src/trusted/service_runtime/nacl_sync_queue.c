@@ -29,34 +29,105 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 /*
  * NaCl service runtime synchronized queue.
+ *
+ * The list is Vyukov's intrusive MPSC queue: producers atomically swap
+ * their link into head and then point the old head at it, and the
+ * consumer follows next pointers from tail.  The stub link keeps the
+ * list non-empty, so that the consumer can hand out the last real
+ * link; a producer preempted between its swap and its store leaves
+ * the list briefly broken at that point, which the consumer treats as
+ * empty until the store lands.
  */
 
+#include "native_client/src/include/portability.h"
 #include "native_client/src/shared/platform/nacl_log.h"
 #include "native_client/src/shared/platform/nacl_sync_checked.h"
 
 #include "native_client/src/trusted/service_runtime/nacl_sync_queue.h"
 #include "native_client/src/trusted/service_runtime/nacl_check.h"
 
-struct NaClSyncQueueItem {
-  struct NaClSyncQueueItem  *next;
-  void                      *item;  /* arbitrary object */
-};
+#if NACL_WINDOWS
+static struct NaClSyncQueueItem *NaClSyncQueueSwap(
+    struct NaClSyncQueueItem *volatile  *p,
+    struct NaClSyncQueueItem            *v) {
+  return (struct NaClSyncQueueItem *)
+      InterlockedExchangePointer((PVOID volatile *) p, v);
+}
+# define NaClSyncQueueBarrier() MemoryBarrier()
+#else
+static struct NaClSyncQueueItem *NaClSyncQueueSwap(
+    struct NaClSyncQueueItem *volatile  *p,
+    struct NaClSyncQueueItem            *v) {
+  /* __sync_lock_test_and_set is only an acquire barrier */
+  __sync_synchronize();
+  return __sync_lock_test_and_set(p, v);
+}
+# define NaClSyncQueueBarrier() __sync_synchronize()
+#endif
 
 
-int NaClSyncQueueEmptyMu(struct NaClSyncQueue *nsqp) {
-  return NULL == nsqp->head;
+static void NaClSyncQueuePush(struct NaClSyncQueue      *nsqp,
+                              struct NaClSyncQueueItem  *nsqip) {
+  struct NaClSyncQueueItem  *prev;
+
+  nsqip->next = NULL;
+  prev = NaClSyncQueueSwap(&nsqp->head, nsqip);
+  prev->next = nsqip;
 }
 
 
-int NaClSyncQueueEmpty(struct NaClSyncQueue *nsqp) {
-  int empty;
+/*
+ * Consumer only.  Returns NULL if the queue is empty or its oldest
+ * link is still being inserted.
+ */
+static struct NaClSyncQueueItem *NaClSyncQueuePop(
+    struct NaClSyncQueue *nsqp) {
+  struct NaClSyncQueueItem  *tail = nsqp->tail;
+  struct NaClSyncQueueItem  *next = tail->next;
+
+  if (&nsqp->stub == tail) {
+    if (NULL == next) {
+      return NULL;
+    }
+    nsqp->tail = next;
+    tail = next;
+    next = next->next;
+  }
+  if (NULL != next) {
+    nsqp->tail = next;
+    return tail;
+  }
+  if (tail != nsqp->head) {
+    return NULL;
+  }
+  NaClSyncQueuePush(nsqp, &nsqp->stub);
+  next = tail->next;
+  if (NULL != next) {
+    nsqp->tail = next;
+    return tail;
+  }
+  return NULL;
+}
 
-  NaClXMutexLock(&nsqp->mu);
-  empty = NaClSyncQueueEmptyMu(nsqp);
-  NaClXMutexUnlock(&nsqp->mu);
-  return empty;
+
+/*
+ * Consumer only.  Non-zero if NaClSyncQueuePop would return a link.
+ */
+static int NaClSyncQueueReady(struct NaClSyncQueue *nsqp) {
+  struct NaClSyncQueueItem  *tail = nsqp->tail;
+
+  if (&nsqp->stub == tail) {
+    return NULL != tail->next;
+  }
+  return NULL != tail->next || tail == nsqp->head;
+}
+
+
+int NaClSyncQueueEmpty(struct NaClSyncQueue *nsqp) {
+  return &nsqp->stub == nsqp->tail && &nsqp->stub == nsqp->head;
 }
 
 
@@ -68,8 +139,12 @@ int NaClSyncQueueCtor(struct NaClSyncQueue *nsqp) {
     NaClMutexDtor(&nsqp->mu);
     return 0;
   }
-  nsqp->head = NULL;
-  nsqp->insert_pt = &nsqp->head;
+  nsqp->stub.next = NULL;
+  nsqp->stub.item = NULL;
+  nsqp->stub.allocated = 0;
+  nsqp->head = &nsqp->stub;
+  nsqp->tail = &nsqp->stub;
+  nsqp->sleeping = 0;
   nsqp->quit = 0;
 
   /* post-condition: NaClSyncQueueEmpty(nsqp) != 0 */
@@ -79,11 +154,11 @@ int NaClSyncQueueCtor(struct NaClSyncQueue *nsqp) {
 
 void NaClSyncQueueDtor(struct NaClSyncQueue *nsqp) {
   /*
-   * NB: sanity check is not complete, since after dropping the lock
-   * and prior to deallocating the mutex, another (confused) thread
-   * could come along and insert an object.  Since such a confused
-   * thread might try to insert an object into the queue even after
-   * the mutex and condvar is dtor'd, we're pretty much stuck.
+   * NB: sanity check is not complete, since another (confused) thread
+   * could come along and insert an object after the check.  Since such
+   * a confused thread might try to insert an object into the queue
+   * even after the mutex and condvar is dtor'd, we're pretty much
+   * stuck.
    */
   CHECK(NaClSyncQueueEmpty(nsqp));
   NaClMutexDtor(&nsqp->mu);
@@ -91,25 +166,45 @@ void NaClSyncQueueDtor(struct NaClSyncQueue *nsqp) {
 }
 
 
-void NaClSyncQueueInsert(struct NaClSyncQueue *nsqp, void *item) {
-  struct NaClSyncQueueItem  *nsqip;
-
+static void NaClSyncQueueEnqueue(struct NaClSyncQueue      *nsqp,
+                                 struct NaClSyncQueueItem  *nsqip,
+                                 void                      *item) {
   NaClLog(3, "NaClSyncQueueInsert(0x%08"PRIxPTR",0x%08"PRIxPTR")\n",
           (uintptr_t) nsqp,
           (uintptr_t) item);
 
+  nsqip->item = item;
+  NaClSyncQueuePush(nsqp, nsqip);
+  /*
+   * Pairs with the barrier in NaClSyncQueueDequeue: either the
+   * consumer sees our link before sleeping, or we see it sleeping.
+   */
+  NaClSyncQueueBarrier();
+  if (nsqp->sleeping) {
+    NaClXMutexLock(&nsqp->mu);
+    NaClXCondVarSignal(&nsqp->cv);  /* non-empty */
+    NaClXMutexUnlock(&nsqp->mu);
+  }
+}
+
+
+void NaClSyncQueueInsert(struct NaClSyncQueue *nsqp, void *item) {
+  struct NaClSyncQueueItem  *nsqip;
+
   nsqip = malloc(sizeof *nsqip);
   if (NULL == nsqip) {
     NaClLog(LOG_FATAL, "Out of memory for NaClSyncQueue item\n");
   }
-  nsqip->next = NULL;
-  nsqip->item = item;
-  NaClXMutexLock(&nsqp->mu);
-  *nsqp->insert_pt = nsqip;
-  nsqp->insert_pt = &nsqip->next;
-  NaClXCondVarSignal(&nsqp->cv);  /* non-empty or quit*/
-  NaClXMutexUnlock(&nsqp->mu);
+  nsqip->allocated = 1;
+  NaClSyncQueueEnqueue(nsqp, nsqip, item);
+}
+
 
+void NaClSyncQueueInsertItem(struct NaClSyncQueue     *nsqp,
+                             struct NaClSyncQueueItem *nsqip,
+                             void                     *item) {
+  nsqip->allocated = 0;
+  NaClSyncQueueEnqueue(nsqp, nsqip, item);
 }
 
 
@@ -127,28 +222,31 @@ void *NaClSyncQueueDequeue(struct NaClSyncQueue *nsqp) {
 
   NaClLog(3, "NaClSyncQueueDequeue: waiting on queue 0x%08"PRIxPTR"\n",
           (uintptr_t) nsqp);
-  NaClXMutexLock(&nsqp->mu);
-  while (NaClSyncQueueEmptyMu(nsqp) && !nsqp->quit) {
-    NaClLog(3, "NaClSyncQueueDequeue: waiting\n");
-    NaClCondVarWait(&nsqp->cv, &nsqp->mu);
-  }
-
-  if (nsqp->quit) {
-    item = NULL;
-  } else {
-    CHECK(!NaClSyncQueueEmptyMu(nsqp));
+  for (;;) {
+    if (nsqp->quit) {
+      item = NULL;
+      break;
+    }
+    qitem = NaClSyncQueuePop(nsqp);
+    if (NULL != qitem) {
+      item = qitem->item;
+      if (qitem->allocated) {
+        free(qitem);
+      }
+      break;
+    }
 
-    qitem = nsqp->head;
-    nsqp->head = qitem->next;
-    if (NULL == nsqp->head) {
-      nsqp->insert_pt = &nsqp->head;
+    NaClXMutexLock(&nsqp->mu);
+    nsqp->sleeping = 1;
+    NaClSyncQueueBarrier();
+    if (!nsqp->quit && !NaClSyncQueueReady(nsqp)) {
+      NaClLog(3, "NaClSyncQueueDequeue: waiting\n");
+      NaClXCondVarWait(&nsqp->cv, &nsqp->mu);
     }
-    item = qitem->item;
-    free(qitem);
+    nsqp->sleeping = 0;
+    NaClXMutexUnlock(&nsqp->mu);
   }
 
-  NaClXMutexUnlock(&nsqp->mu);
-
   NaClLog(3, "NaClSyncQueueDequeue: returning item 0x%08"PRIxPTR"\n",
           (uintptr_t) item);
   return item;
@@ -40,20 +40,36 @@
 #include "native_client/src/trusted/service_runtime/nacl_closure.h"
 
 /**
- * This module implements a thread-safe queue.
+ * This module implements a thread-safe multi-producer, single-consumer
+ * queue.  Inserting is lock-free: producers swap themselves onto the
+ * head of an intrusive list.  The mutex and condition variable are
+ * only used to put the consumer to sleep when the queue is empty, and
+ * producers only take the mutex to wake a sleeping consumer.  Only one
+ * thread at a time may dequeue.
  *
  * It internally uses nacl_sync_checked, so any failure returns from
  * synchronization objects will result in a fatal error.
  */
 
-struct NaClSyncQueueItem;  /* opaque */
+/*
+ * Queue link.  NaClSyncQueueInsert allocates one per item and
+ * NaClSyncQueueDequeue frees it; NaClSyncQueueInsertItem uses one the
+ * caller owns, which may be reused once its item has been dequeued.
+ */
+struct NaClSyncQueueItem {
+  struct NaClSyncQueueItem  *volatile next;
+  void                      *item;  /* arbitrary object */
+  int                       allocated;
+};
 
 struct NaClSyncQueue {
+  struct NaClSyncQueueItem  *volatile head;  /* newest; producers */
+  struct NaClSyncQueueItem  *tail;  /* oldest; consumer only */
+  struct NaClSyncQueueItem  stub;
   struct NaClMutex          mu;
   struct NaClCondVar        cv;  /* wake on not empty */
-  struct NaClSyncQueueItem  *head;
-  struct NaClSyncQueueItem  **insert_pt;
-  int                       quit;
+  volatile int              sleeping;  /* consumer waiting on cv */
+  volatile int              quit;
 };
 
 int NaClSyncQueueEmpty(struct NaClSyncQueue *nsqp);
@@ -68,6 +84,10 @@ void NaClSyncQueueDtor(struct NaClSyncQueue *nsqp);
 void NaClSyncQueueInsert(struct NaClSyncQueue *nsqp,
                          void                 *item);
 
+void NaClSyncQueueInsertItem(struct NaClSyncQueue     *nsqp,
+                             struct NaClSyncQueueItem *nsqip,
+                             void                     *item);
+
 /*
  * Tell blocked threads to unblock.
  */
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Exercise the lock-free work queue: producers that reuse one link
+ * each, the way bottom-half requests do, racing producers that let the
+ * queue allocate links, with a single consumer checking that nothing
+ * is lost and that each producer's items arrive in order.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_SDL)
+# include <SDL.h>
+#endif
+
+#include "native_client/src/include/portability.h"
+
+#include "native_client/src/shared/platform/nacl_log.h"
+#include "native_client/src/shared/platform/nacl_threads.h"
+#include "native_client/src/trusted/service_runtime/nacl_sync_queue.h"
+
+#define TEST_STACK_BYTES  (128 << 10)
+#define TEST_PRODUCERS    6      /* even ones reuse a link, odd allocate */
+#define TEST_ITEMS        20000  /* per producer */
+
+struct Producer {
+  struct NaClThread         thread;
+  int                       id;
+  struct NaClSyncQueueItem  link;
+  volatile int              acked;  /* items the consumer has taken */
+  int                       next;   /* consumer's next expected item */
+};
+
+/* items encode the producer and a sequence number */
+struct Item {
+  int id;
+  int seq;
+};
+
+static struct NaClSyncQueue queue;
+static struct Producer      producers[TEST_PRODUCERS];
+static struct Item          items[TEST_PRODUCERS][TEST_ITEMS];
+
+static void WINAPI ProducerThread(void *arg) {
+  struct Producer *p = (struct Producer *) arg;
+  int             i;
+
+  for (i = 0; i < TEST_ITEMS; ++i) {
+    items[p->id][i].id = p->id;
+    items[p->id][i].seq = i;
+    if (0 == (p->id & 1)) {
+      /* one link, reused once the consumer is done with it */
+      while (__sync_fetch_and_add(&p->acked, 0) < i) {
+        sched_yield();
+      }
+      NaClSyncQueueInsertItem(&queue, &p->link, &items[p->id][i]);
+    } else {
+      NaClSyncQueueInsert(&queue, &items[p->id][i]);
+    }
+  }
+}
+
+int main(int ac, char **av) {
+  struct Item *item;
+  int         remaining = TEST_PRODUCERS * TEST_ITEMS;
+  int         errors = 0;
+  int         i;
+
+  /* main's type signature is constrained by SDL */
+  UNREFERENCED_PARAMETER(ac);
+  UNREFERENCED_PARAMETER(av);
+
+  NaClLogModuleInit();
+  if (!NaClSyncQueueCtor(&queue)) {
+    printf("ERROR: NaClSyncQueueCtor failed\n");
+    return 1;
+  }
+  if (!NaClSyncQueueEmpty(&queue)) {
+    printf("ERROR: new queue not empty\n");
+    ++errors;
+  }
+
+  for (i = 0; i < TEST_PRODUCERS; ++i) {
+    producers[i].id = i;
+    producers[i].acked = 0;
+    producers[i].next = 0;
+    if (!NaClThreadCtor(&producers[i].thread, ProducerThread, &producers[i],
+                        TEST_STACK_BYTES)) {
+      printf("ERROR: NaClThreadCtor failed\n");
+      return 1;
+    }
+  }
+
+  while (remaining > 0) {
+    item = (struct Item *) NaClSyncQueueDequeue(&queue);
+    if (NULL == item || item->id < 0 || item->id >= TEST_PRODUCERS) {
+      printf("ERROR: bad item %p\n", (void *) item);
+      ++errors;
+      break;
+    }
+    if (item->seq != producers[item->id].next) {
+      printf("ERROR: producer %d item %d, expected %d\n",
+             item->id, item->seq, producers[item->id].next);
+      ++errors;
+    }
+    producers[item->id].next = item->seq + 1;
+    (void) __sync_add_and_fetch(&producers[item->id].acked, 1);
+    --remaining;
+  }
+
+  if (!NaClSyncQueueEmpty(&queue)) {
+    printf("ERROR: queue not empty after draining it\n");
+    ++errors;
+  }
+  NaClSyncQueueQuit(&queue);
+  if (NULL != NaClSyncQueueDequeue(&queue)) {
+    printf("ERROR: dequeue after quit returned an item\n");
+    ++errors;
+  }
+  NaClSyncQueueDtor(&queue);
+
+  printf("\n%d errors\n", errors);
+  printf("%s\n", (0 == errors) ? "PASSED" : "FAILED");
+
+  NaClLogModuleFini();
+  return (0 == errors) ? 0 : 1;
+}
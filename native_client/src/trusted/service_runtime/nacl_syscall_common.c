@@ -69,9 +69,9 @@ static INLINE size_t  size_min(size_t a, size_t b) {
 }
 
 /*
- * natp should be thread_self(), called while holding no locks.
+ * Marks natp dead and takes it off the thread tables.
  */
-void NaClSysCommonThreadSuicide(struct NaClAppThread  *natp) {
+static void NaClSysCommonThreadRemove(struct NaClAppThread  *natp) {
   struct NaClApp  *nap;
   uint16_t        thread_idx;
 
@@ -79,7 +79,7 @@ void NaClSysCommonThreadSuicide(struct NaClAppThread  *natp) {
    * mark this thread as dead; doesn't matter if some other thread is
    * asking us to commit suicide.
    */
-  NaClLog(3, "NaClSysCommonThreadSuicide(0x%08"PRIxPTR")\n", (uintptr_t) natp);
+  NaClLog(3, "NaClSysCommonThreadRemove(0x%08"PRIxPTR")\n", (uintptr_t) natp);
   nap = natp->nap;
   NaClLog(3, " getting thread table lock\n");
   NaClXMutexLock(&nap->threads_mu);
@@ -105,6 +105,9 @@ void NaClSysCommonThreadSuicide(struct NaClAppThread  *natp) {
   NaClXCondVarBroadcast(&nap->threads_cv);
   NaClLog(3, " unlocking thread table\n");
   NaClXMutexUnlock(&nap->threads_mu);
+}
+
+static NORETURN void NaClSysCommonThreadDie(struct NaClAppThread  *natp) {
   NaClLog(3, " decref'ing thread object (from count %d)\n", natp->refcount);
   NaClAppThreadDecRef(natp);
   NaClLog(3, " NaClThreadExit\n");
@@ -114,6 +117,14 @@ void NaClSysCommonThreadSuicide(struct NaClAppThread  *natp) {
   /* NOTREACHED */
 }
 
+/*
+ * natp should be thread_self(), called while holding no locks.
+ */
+void NaClSysCommonThreadSuicide(struct NaClAppThread  *natp) {
+  NaClSysCommonThreadRemove(natp);
+  NaClSysCommonThreadDie(natp);
+}
+
 void NaClSysCommonThreadSyscallEnter(struct NaClAppThread *natp) {
   NaClLog(4, "NaClSysCommonThreadSyscallEnter: locking 0x%08"PRIxPTR"\n",
           (uintptr_t) &natp->mu);
@@ -404,7 +415,10 @@ int32_t NaClCommonSysThreadExit(struct NaClAppThread  *natp,
     }
   }
 
-  NaClSysCommonThreadSuicide(natp);
+  NaClSysCommonThreadRemove(natp);
+  /* Does not return if a later thread_create reuses this thread */
+  NaClAppThreadPark(natp);
+  NaClSysCommonThreadDie(natp);
   /* NOTREACHED */
   return -NACL_ABI_EINVAL;
 }
@@ -2024,10 +2038,11 @@ int32_t NaClCommonSysMultimedia_Init(struct NaClAppThread *natp,
   }
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure2Ctor(((void (*)(void *, void *))
-                                      NaClBotSysMultimedia_Init),
-                                     (void *) natp,
-                                     (void *) subsys_arg)));
+                    NaClClosure2PlacementCtor(
+                        &natp->async_op.closure.c2,
+                        ((void (*)(void *, void *)) NaClBotSysMultimedia_Init),
+                        (void *) natp,
+                        (void *) subsys_arg)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2052,9 +2067,10 @@ int32_t NaClCommonSysMultimedia_Shutdown(struct NaClAppThread *natp) {
 
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure1Ctor(((void (*)(void *))
-                                      NaClBotSysMultimedia_Shutdown),
-                                     (void *) natp)));
+                    NaClClosure1PlacementCtor(
+                        &natp->async_op.closure.c1,
+                        ((void (*)(void *)) NaClBotSysMultimedia_Shutdown),
+                        (void *) natp)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2103,11 +2119,13 @@ int32_t NaClCommonSysVideo_Init(struct NaClAppThread *natp,
           (uintptr_t) NaClClosure4Run);
   NaClStartAsyncOp(natp,
                  ((struct NaClClosure *)
-                  NaClClosure3Ctor(((void (*)(void *, void *, void *))
-                                     NaClBotSysVideo_Init),
-                                   (void *) natp,
-                                   (void *) width_arg,
-                                   (void *) height_arg)));
+                  NaClClosure3PlacementCtor(
+                      &natp->async_op.closure.c3,
+                      ((void (*)(void *, void *, void *))
+                       NaClBotSysVideo_Init),
+                      (void *) natp,
+                      (void *) width_arg,
+                      (void *) height_arg)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2126,9 +2144,10 @@ int32_t NaClCommonSysVideo_Shutdown(struct NaClAppThread *natp) {
 
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure1Ctor(((void (*)(void *))
-                                      NaClBotSysVideo_Shutdown),
-                                     (void *) natp)));
+                    NaClClosure1PlacementCtor(
+                        &natp->async_op.closure.c1,
+                        ((void (*)(void *)) NaClBotSysVideo_Shutdown),
+                        (void *) natp)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2152,10 +2171,11 @@ int32_t NaClCommonSysVideo_Update(struct NaClAppThread *natp,
    */
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure2Ctor(((void (*)(void *, void *))
-                                       NaClBotSysVideo_Update),
-                                      (void *) natp,
-                                      (void *) data)));
+                    NaClClosure2PlacementCtor(
+                        &natp->async_op.closure.c2,
+                        ((void (*)(void *, void *)) NaClBotSysVideo_Update),
+                        (void *) natp,
+                        (void *) data)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2189,10 +2209,11 @@ int32_t NaClCommonSysVideo_Poll_Event(struct NaClAppThread      *natp,
   }
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure2Ctor(((void (*)(void *, void *))
-                                      NaClBotSysVideo_Poll_Event),
-                                     (void *) natp,
-                                     (void *) sysaddr)));
+                    NaClClosure2PlacementCtor(
+                        &natp->async_op.closure.c2,
+                        ((void (*)(void *, void *)) NaClBotSysVideo_Poll_Event),
+                        (void *) natp,
+                        (void *) sysaddr)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2232,13 +2253,14 @@ int32_t NaClCommonSysAudio_Init(struct NaClAppThread  *natp,
   }
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure4Ctor(((void (*)(void *, void *,
-                                                void *, void *))
-                                      NaClBotSysAudio_Init),
-                                     (void *) natp,
-                                     (void *) format,
-                                     (void *) desired_samples_arg,
-                                     (void *) sysaddr)));
+                    NaClClosure4PlacementCtor(
+                        &natp->async_op.closure.c4,
+                        ((void (*)(void *, void *, void *, void *))
+                         NaClBotSysAudio_Init),
+                        (void *) natp,
+                        (void *) format,
+                        (void *) desired_samples_arg,
+                        (void *) sysaddr)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
@@ -2263,9 +2285,10 @@ int32_t NaClCommonSysAudio_Shutdown(struct NaClAppThread *natp) {
 
   NaClStartAsyncOp(natp,
                    ((struct NaClClosure *)
-                    NaClClosure1Ctor(((void (*)(void *))
-                                      NaClBotSysAudio_Shutdown),
-                                     (void *) natp)));
+                    NaClClosure1PlacementCtor(
+                        &natp->async_op.closure.c1,
+                        ((void (*)(void *)) NaClBotSysAudio_Shutdown),
+                        (void *) natp)));
   retval = NaClWaitForAsyncOp(natp);
 cleanup:
   NaClSysCommonThreadSyscallLeave(natp);
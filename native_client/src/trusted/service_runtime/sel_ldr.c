@@ -32,6 +32,8 @@
 /*
  * NaCl Simple/secure ELF loader (NaCl SEL).
  */
+#include <stdlib.h>
+
 #include "native_client/src/include/portability_io.h"
 #include "native_client/src/include/portability_string.h"
 #include "native_client/src/shared/platform/nacl_sync_checked.h"
@@ -48,6 +50,7 @@
 #include "native_client/src/trusted/service_runtime/include/sys/stat.h"
 
 int NaClAppCtor(struct NaClApp  *nap) {
+  char  *pool_max;
 
   nap->addr_bits = NACL_MAX_ADDR_BITS;
 
@@ -99,6 +102,12 @@ int NaClAppCtor(struct NaClApp  *nap) {
     goto cleanup_threads_mu;
   }
   nap->num_threads = 0;
+  nap->thread_pool = NULL;
+  nap->thread_pool_size = 0;
+  nap->thread_pool_max = NACL_THREAD_POOL_DEFAULT_MAX;
+  if (NULL != (pool_max = getenv("NACL_THREAD_POOL_MAX"))) {
+    nap->thread_pool_max = strtol(pool_max, (char **) NULL, 0);
+  }
   if (!NaClMutexCtor(&nap->desc_mu)) {
     goto cleanup_threads_cv;
   }
@@ -177,6 +186,8 @@ void NaClAppDtor(struct NaClApp  *nap) {
     }
   }
 
+  NaClAppThreadPoolDrain(nap);
+
   for (i = 0; i < nap->desc_tbl.num_entries; ++i) {
     ndp = (struct NaClDesc *) DynArrayGet(&nap->desc_tbl, i);
     if (NULL != ndp) {
@@ -260,6 +260,13 @@ struct NaClApp {
   struct NaClCondVar        threads_cv;
   struct DynArray           threads;   /* NaClAppThread pointers */
   int                       num_threads;  /* number actually running */
+  /*
+   * Exited threads kept for reuse by thread_create, also under
+   * threads_mu; see NaClAppThreadPark.
+   */
+  struct NaClAppThread      *thread_pool;
+  int                       thread_pool_size;
+  int                       thread_pool_max;
 
   struct NaClMutex          desc_mu;
   struct DynArray           desc_tbl;  /* NaClDesc pointers */
@@ -657,6 +657,9 @@ int32_t NaClCreateAdditionalThread(struct NaClApp *nap,
                                    size_t         tdb_size) {
   struct NaClAppThread  *natp;
 
+  if (NaClAppThreadUnpark(nap, prog_ctr, stack_ptr, sys_tdb, tdb_size)) {
+    return 0;
+  }
   natp = malloc(sizeof *natp);
   if (NULL == natp) {
     return -NACL_ABI_ENOMEM;
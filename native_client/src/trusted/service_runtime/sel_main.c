@@ -421,13 +421,11 @@ int main(int  ac,
     return 1;
   }
   
-  /* We have the file; go get a hash of its contents */
-  MakeNaClHash(nacl_file, &(state.app_hash[0]));
-
   /* to be passed to NaClMain, eventually... */
   av[--optind] = "NaClMain";
 
-  if (0 == GioMemoryFileSnapshotCtor(&gf, nacl_file)) {
+  /* read in the nexe and get its hash, for the network ACLs */
+  if (0 == NaClAppHashLoadFile(&gf, nacl_file, &(state.app_hash[0]))) {
     perror("sel_main");
     fprintf(stderr, "Cannot open \"%s\".\n", nacl_file);
     return 1;
@@ -1,5 +1,5 @@
 /*
- * Copyright 2008, Google Inc.
+ * Copyright 2009, Google Inc.
  * All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
@@ -29,29 +29,37 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-
 /*
- * Stub routines for select/pselect for porting support.
+ * Wrappers for syscall.
  */
 
-/* #include <sys/select.h> */
-#include <sys/time.h>
-#include <sys/types.h>
-#include <unistd.h>
 #include <errno.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
 
-int select(int n, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
-           struct timeval *timeout) {
-  /* NOTE(sehr): NOT IMPLEMENTED: select */
-  errno = ENOMEM;
-  return -1;
-}
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+int epoll_create(int size) {
+  int retval;
 
-typedef unsigned int sigset_t;
+  /* size is only a hint, but must be positive */
+  if (size <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  retval = NACL_SYSCALL(epoll_create)(0);
+  if (retval < 0) {
+    errno = -retval;
+    return -1;
+  }
+  return retval;
+}
 
-int pselect(int n, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
-           const struct timespec *timeout, const sigset_t *sigmask) {
-  /* NOTE(sehr): NOT IMPLEMENTED: pselect */
-  errno = ENOMEM;
-  return -1;
+int epoll_create1(int flags) {
+  int retval = NACL_SYSCALL(epoll_create)(flags);
+  if (retval < 0) {
+    errno = -retval;
+    return -1;
+  }
+  return retval;
 }
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * poll, on top of the epoll syscalls.
+ *
+ * Each call registers the descriptors with a private epoll instance,
+ * waits once and closes it.  Descriptors epoll cannot watch, such as
+ * regular files, are always ready, as POSIX has it.  A descriptor
+ * listed more than once is registered once for the union of its
+ * entries' events.  The poll and epoll event bits are the same.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/poll.h>
+
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+#define POLL_STACK_FDS  32
+#define POLL_REQUESTS   (POLLIN | POLLPRI | POLLOUT | POLLRDNORM | \
+                         POLLRDBAND | POLLWRNORM | POLLWRBAND)
+#define POLL_ALWAYS     (POLLIN | POLLOUT | POLLRDNORM | POLLWRNORM)
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  struct epoll_event  stack_events[POLL_STACK_FDS];
+  int                 stack_owner[POLL_STACK_FDS];
+  struct epoll_event  *events = stack_events;
+  int                 *owner = stack_owner;  /* registered entry, or -1 */
+  struct epoll_event  ev;
+  int                 epfd = -1;
+  int                 registered = 0;
+  int                 ready = 0;
+  int                 retval = -1;
+  int                 r;
+  nfds_t              i;
+  nfds_t              j;
+
+  if (nfds > POLL_STACK_FDS) {
+    events = malloc(nfds * sizeof *events);
+    owner = malloc(nfds * sizeof *owner);
+    if (NULL == events || NULL == owner) {
+      errno = ENOMEM;
+      goto cleanup;
+    }
+  }
+  if ((epfd = NACL_SYSCALL(epoll_create)(0)) < 0) {
+    errno = -epfd;
+    goto cleanup;
+  }
+
+  for (i = 0; i < nfds; ++i) {
+    fds[i].revents = 0;
+    owner[i] = -1;
+    if (fds[i].fd < 0) {
+      continue;
+    }
+    ev.events = fds[i].events & POLL_REQUESTS;
+    ev.data.u32 = i;
+    r = NACL_SYSCALL(epoll_ctl)(epfd, EPOLL_CTL_ADD, fds[i].fd, &ev);
+    if (-EEXIST == r) {
+      /* widen the first entry's registration; events[] holds its mask */
+      for (j = 0; fds[j].fd != fds[i].fd; ++j) {
+      }
+      owner[i] = j;
+      events[j].events |= ev.events;
+      ev = events[j];
+      ev.data.u32 = j;
+      r = NACL_SYSCALL(epoll_ctl)(epfd, EPOLL_CTL_MOD, fds[i].fd, &ev);
+    } else if (0 == r) {
+      owner[i] = i;
+      events[i].events = ev.events;
+      ++registered;
+    } else if (-EPERM == r) {
+      fds[i].revents = fds[i].events & POLL_ALWAYS;
+      r = 0;
+    } else if (-EBADF == r) {
+      fds[i].revents = POLLNVAL;
+      r = 0;
+    }
+    if (r < 0) {
+      errno = -r;
+      goto cleanup;
+    }
+    if (0 != fds[i].revents) {
+      timeout = 0;  /* something is ready already */
+    }
+  }
+
+  /* with nothing registered this is just a sleep, which still needs room */
+  r = NACL_SYSCALL(epoll_wait)(epfd, events, registered ? registered : 1,
+                               timeout);
+  if (r < 0) {
+    errno = -r;
+    goto cleanup;
+  }
+  for (i = 0; i < (nfds_t) r; ++i) {
+    fds[events[i].data.u32].revents = events[i].events;
+  }
+  /* backwards: an entry's owner precedes it, so is still unmasked */
+  for (i = nfds; i-- > 0; ) {
+    if (-1 != owner[i]) {
+      fds[i].revents = fds[owner[i]].revents
+                       & (fds[i].events | POLLERR | POLLHUP);
+    }
+    if (0 != fds[i].revents) {
+      ++ready;
+    }
+  }
+  retval = ready;
+
+cleanup:
+  if (epfd >= 0) {
+    (void) NACL_SYSCALL(close)(epfd);
+  }
+  if (stack_events != events) {
+    free(events);
+    free(owner);
+  }
+  return retval;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * select and pselect, on top of poll.  There are no signals to mask,
+ * so pselect's sigmask is ignored.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/poll.h>
+#include <sys/select.h>
+#include <time.h>
+
+static int SelectMs(int nfds, fd_set *readfds, fd_set *writefds,
+                    fd_set *exceptfds, int timeout_ms) {
+  struct pollfd pfds[FD_SETSIZE];
+  int           n = 0;
+  int           ready = 0;
+  int           fd;
+  int           i;
+
+  if (nfds < 0 || nfds > FD_SETSIZE) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (fd = 0; fd < nfds; ++fd) {
+    short events = 0;
+
+    if (NULL != readfds && FD_ISSET(fd, readfds)) {
+      events |= POLLIN;
+    }
+    if (NULL != writefds && FD_ISSET(fd, writefds)) {
+      events |= POLLOUT;
+    }
+    if (NULL != exceptfds && FD_ISSET(fd, exceptfds)) {
+      events |= POLLPRI;
+    }
+    if (0 != events) {
+      pfds[n].fd = fd;
+      pfds[n].events = events;
+      ++n;
+    }
+  }
+
+  if (poll(pfds, n, timeout_ms) < 0) {
+    return -1;
+  }
+  for (i = 0; i < n; ++i) {
+    if (0 != (pfds[i].revents & POLLNVAL)) {
+      errno = EBADF;
+      return -1;
+    }
+  }
+
+  if (NULL != readfds) {
+    FD_ZERO(readfds);
+  }
+  if (NULL != writefds) {
+    FD_ZERO(writefds);
+  }
+  if (NULL != exceptfds) {
+    FD_ZERO(exceptfds);
+  }
+  for (i = 0; i < n; ++i) {
+    short revents = pfds[i].revents;
+
+    /* errors and hangups make reads and writes not block, as on Linux */
+    if (0 != (pfds[i].events & POLLIN)
+        && 0 != (revents & (POLLIN | POLLHUP | POLLERR))) {
+      FD_SET(pfds[i].fd, readfds);
+      ++ready;
+    }
+    if (0 != (pfds[i].events & POLLOUT)
+        && 0 != (revents & (POLLOUT | POLLERR))) {
+      FD_SET(pfds[i].fd, writefds);
+      ++ready;
+    }
+    if (0 != (pfds[i].events & POLLPRI) && 0 != (revents & POLLPRI)) {
+      FD_SET(pfds[i].fd, exceptfds);
+      ++ready;
+    }
+  }
+  return ready;
+}
+
+/* milliseconds, rounded up so as not to return early; -1 waits forever */
+static int TimeoutMs(long sec, long nsec) {
+  if (sec >= INT_MAX / 1000 - 1) {
+    return INT_MAX;
+  }
+  return (int) (sec * 1000 + (nsec + 999999) / 1000000);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout) {
+  int ms = -1;
+
+  if (NULL != timeout) {
+    if (timeout->tv_sec < 0 || timeout->tv_usec < 0
+        || timeout->tv_usec >= 1000000) {
+      errno = EINVAL;
+      return -1;
+    }
+    ms = TimeoutMs(timeout->tv_sec, timeout->tv_usec * 1000);
+  }
+  return SelectMs(nfds, readfds, writefds, exceptfds, ms);
+}
+
+int pselect(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+            const struct timespec *timeout, const sigset_t *sigmask) {
+  int ms = -1;
+
+  (void) sigmask;
+  if (NULL != timeout) {
+    if (timeout->tv_sec < 0 || timeout->tv_nsec < 0
+        || timeout->tv_nsec >= 1000000000) {
+      errno = EINVAL;
+      return -1;
+    }
+    ms = TimeoutMs(timeout->tv_sec, timeout->tv_nsec);
+  }
+  return SelectMs(nfds, readfds, writefds, exceptfds, ms);
+}
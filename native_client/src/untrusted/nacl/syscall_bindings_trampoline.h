@@ -141,6 +141,14 @@ typedef int (*TYPE_nacl_sem_create) (int32_t value);
 typedef int (*TYPE_nacl_sem_wait) (int sem);
 typedef int (*TYPE_nacl_sem_post) (int sem);
 
+/* ============================================================ */
+/* futex */
+/* ============================================================ */
+
+typedef int (*TYPE_nacl_futex_wait) (volatile int *addr, int val,
+                                     struct timespec *abstime);
+typedef int (*TYPE_nacl_futex_wake) (volatile int *addr, int nwake);
+
 /* ============================================================ */
 /* misc */
 /* ============================================================ */
@@ -172,6 +180,9 @@ typedef int (*TYPE_nacl_srpc_get_fd) (void);
 /* ============================================================ */
 
 typedef int (*TYPE_nacl_accept) (int fd, struct sockaddr* addr, socklen_t *addr_len);
+typedef int (*TYPE_nacl_accept4) (int fd, struct sockaddr* addr, socklen_t *addr_len,
+		int flags);
+typedef int (*TYPE_nacl_accept_batch) (int fd, int *fds, unsigned int n, int flags);
 typedef int (*TYPE_nacl_bind) (int fd, const struct sockaddr * addr, socklen_t len);
 typedef int (*TYPE_nacl_connect) (int fd, const struct sockaddr* addr, socklen_t len);
 typedef int (*TYPE_nacl_getpeername) (int fd, struct sockaddr* addr, socklen_t *len);
@@ -185,7 +196,13 @@ typedef int (*TYPE_nacl_recvfrom) (int fd, void *buf, size_t n,
 		 int flags, struct sockaddr* addr,
 		 socklen_t *addr_len);
 typedef int (*TYPE_nacl_recvmsg) (int fd, struct msghdr *message, int flags);
+typedef int (*TYPE_nacl_recvmmsg) (int fd, struct mmsghdr *vmessages,
+		unsigned int vlen, int flags, struct timespec *tmo);
 typedef int (*TYPE_nacl_send) (int fd, const void *buf, size_t n, int flags);
+typedef int (*TYPE_nacl_sendfile) (int out_fd, int in_fd, off_t *offset,
+		size_t count);
+typedef int (*TYPE_nacl_sendmmsg) (int fd, struct mmsghdr *vmessages,
+		unsigned int vlen, int flags);
 typedef int (*TYPE_nacl_sendmsg) (int fd, const struct msghdr *message,
 		int flags);
 typedef int (*TYPE_nacl_sendto) (int fd, const void *buf, size_t n,
@@ -196,6 +213,32 @@ typedef int (*TYPE_nacl_setsockopt) (int fd, int level, int optname,
 typedef int (*TYPE_nacl_shutdown) (int fd, int how);
 typedef int (*TYPE_nacl_socket) (int domain, int type, int protocol);
 typedef int (*TYPE_nacl_socketpair) (int domain, int type, int protocol, int fds[2]);
+typedef int (*TYPE_nacl_sockring_create) (int shm_d, unsigned int entries);
+typedef int (*TYPE_nacl_sockring_enter) (int ring_d, unsigned int min_complete,
+		int timeout_ms);
+typedef int (*TYPE_nacl_getaddrinfo) (const char *name, unsigned int *addrs,
+		unsigned int max);
+
+/* ============================================================ */
+/* readiness notification */
+/* ============================================================ */
+
+struct epoll_event;
+
+typedef int (*TYPE_nacl_epoll_create) (int flags);
+typedef int (*TYPE_nacl_epoll_ctl) (int epfd, int op, int fd,
+                                    struct epoll_event *event);
+typedef int (*TYPE_nacl_epoll_wait) (int epfd, struct epoll_event *events,
+                                     int maxevents, int timeout);
+
+/* ============================================================ */
+/* batches */
+/* ============================================================ */
+
+struct syscall_record;
+
+typedef int (*TYPE_nacl_batch) (struct syscall_record *records,
+                                unsigned int n, int flags);
 #if __cplusplus
 }
 #endif
@@ -34,7 +34,8 @@
  * Native Client condition variable API
  */
 
-#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
 
 #include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
 
@@ -42,17 +43,13 @@
 #include "native_client/src/untrusted/pthread/pthread_types.h"
 
 
-/* TODO(gregoryd): make this static?  */
-void pthread_cond_validate(pthread_cond_t* cond) {
-  nc_spinlock_lock(&cond->spinlock);
-
-  if (NC_INVALID_HANDLE == cond->handle) {
-    pthread_cond_init(cond, NULL);
-  }
-
-  nc_spinlock_unlock(&cond->spinlock);
-}
-
+/*
+ * A waiter samples sequence, releases the mutex and sleeps in
+ * futex_wait as long as sequence still holds that value; signal and
+ * broadcast bump it before waking, so a wake-up that comes between the
+ * release and the sleep is not lost.  waiters lets signal and broadcast
+ * skip the system call when nobody is waiting.
+ */
 
 /*
  * Initialize condition variable COND using attributes ATTR, or use
@@ -60,54 +57,73 @@ void pthread_cond_validate(pthread_cond_t* cond) {
  */
 int pthread_cond_init (pthread_cond_t *cond,
                        pthread_condattr_t *cond_attr) {
-  cond->handle = NACL_SYSCALL(cond_create)();
-
-  /* 0 for success, 1 for failure */
-  return (cond->handle < 0);
+  cond->sequence = 0;
+  cond->waiters = 0;
+  return 0;
 }
 
 /*
  * Destroy condition variable COND.
  */
 int pthread_cond_destroy (pthread_cond_t *cond) {
-  int retval;
-  pthread_cond_validate(cond);
-  retval = close(cond->handle);
-  cond->handle = NC_INVALID_HANDLE;
-  return retval;
+  if (0 != cond->waiters) {
+    return EBUSY;
+  }
+  return 0;
 }
 
 /*
  * Wake up one thread waiting for condition variable COND.
  */
 int pthread_cond_signal (pthread_cond_t *cond) {
-  pthread_cond_validate(cond);
-  return NACL_SYSCALL(cond_signal)(cond->handle);
+  if (0 != cond->waiters) {
+    AtomicIncrement(&cond->sequence, 1);
+    NACL_SYSCALL(futex_wake)(&cond->sequence, 1);
+  }
+  return 0;
 }
 
 
 int pthread_cond_broadcast (pthread_cond_t *cond) {
-  pthread_cond_validate(cond);
-  return NACL_SYSCALL(cond_broadcast)(cond->handle);
+  if (0 != cond->waiters) {
+    AtomicIncrement(&cond->sequence, 1);
+    NACL_SYSCALL(futex_wake)(&cond->sequence, INT_MAX);
+  }
+  return 0;
+}
+
+static int nc_cond_wait(pthread_cond_t *cond,
+                        pthread_mutex_t *mutex,
+                        struct timespec *abstime) {
+  AtomicWord sequence;
+  uint32_t recursion_counter = mutex->recursion_counter;
+  int rv;
+
+  AtomicIncrement(&cond->waiters, 1);
+  sequence = cond->sequence;
+  /* A recursive mutex is released however many times it is held */
+  mutex->recursion_counter = 1;
+  pthread_mutex_unlock(mutex);
+  rv = NACL_SYSCALL(futex_wait)(&cond->sequence, sequence, abstime);
+  pthread_mutex_lock(mutex);
+  mutex->recursion_counter = recursion_counter;
+  AtomicIncrement(&cond->waiters, -1);
+  return (-ETIMEDOUT == rv) ? ETIMEDOUT : 0;
 }
 
 int pthread_cond_wait (pthread_cond_t *cond,
                        pthread_mutex_t *mutex) {
-  pthread_cond_validate(cond);
-  return NACL_SYSCALL(cond_wait)(cond->handle, mutex->mutex_handle);
+  return nc_cond_wait(cond, mutex, NULL);
 }
 
 int pthread_cond_timedwait_abs(pthread_cond_t *cond,
                                pthread_mutex_t *mutex,
                                struct timespec *abstime) {
-  pthread_cond_validate(cond);
-  return NACL_SYSCALL(cond_timed_wait_abs)(cond->handle,
-                                           mutex->mutex_handle,
-                                           abstime);
+  return nc_cond_wait(cond, mutex, abstime);
 }
 
 int nc_pthread_condvar_ctor(pthread_cond_t *cond) {
-  cond->handle = NC_INVALID_HANDLE;
-  cond->spinlock = 0;
+  cond->sequence = 0;
+  cond->waiters = 0;
   return 1;
 }
@@ -35,7 +35,6 @@
  */
 
 #include <errno.h>
-#include <unistd.h>
 
 #include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
 
@@ -44,26 +43,23 @@
 
 /* Mutex functions */
 
+/*
+ * The lock itself is mutex_state, changed with atomic instructions:
+ * taking a free mutex or releasing one nobody waits for stays in the
+ * sandbox.  A thread that finds the mutex taken marks it contended and
+ * sleeps in futex_wait; releasing a contended mutex wakes one sleeper.
+ * See "Futexes Are Tricky" by Ulrich Drepper (mutex3).
+ */
+#define NC_MUTEX_UNLOCKED   0
+#define NC_MUTEX_LOCKED     1
+#define NC_MUTEX_CONTENDED  2
+
 static int nc_thread_mutex_init(pthread_mutex_t *mutex) {
+  mutex->mutex_state = NC_MUTEX_UNLOCKED;
   mutex->owner_thread_id = NACL_PTHREAD_ILLEGAL_THREAD_ID;
   mutex->recursion_counter = 0;
-  mutex->mutex_handle = NACL_SYSCALL(mutex_create)();
-
-  /* 0 for success, 1 for failure */
-  return (mutex->mutex_handle < 0);
-}
-
-int pthread_mutex_validate(pthread_mutex_t *mutex) {
-  int rv = 0;
-  nc_spinlock_lock(&mutex->spinlock);
-
-  if (NC_INVALID_HANDLE == mutex->mutex_handle) {
-    /* Mutex_type is set by the initializer */
-    rv = nc_thread_mutex_init(mutex);
-  }
-
-  nc_spinlock_unlock(&mutex->spinlock);
-  return rv;
+  mutex->reserved = NC_INVALID_HANDLE;
+  return 0;
 }
 
 int pthread_mutex_init (pthread_mutex_t *mutex,
@@ -77,22 +73,27 @@ int pthread_mutex_init (pthread_mutex_t *mutex,
 }
 
 int pthread_mutex_destroy (pthread_mutex_t *mutex) {
-  int retval;
-  pthread_mutex_validate(mutex);
-  if (NACL_PTHREAD_ILLEGAL_THREAD_ID != mutex->owner_thread_id) {
+  if (NC_MUTEX_UNLOCKED != mutex->mutex_state) {
     /* the mutex is still locked - cannot destroy */
     return EBUSY;
   }
-  retval = close(mutex->mutex_handle);
-  mutex->mutex_handle = NC_INVALID_HANDLE;
-  mutex->owner_thread_id = NACL_PTHREAD_ILLEGAL_THREAD_ID;
-  mutex->recursion_counter = 0;
-  return retval;
+  return nc_thread_mutex_init(mutex);
+}
+
+static void nc_mutex_lock_contended(pthread_mutex_t *mutex,
+                                    AtomicWord state) {
+  if (NC_MUTEX_CONTENDED != state) {
+    state = AtomicExchange(&mutex->mutex_state, NC_MUTEX_CONTENDED);
+  }
+  while (NC_MUTEX_UNLOCKED != state) {
+    /* Returns at once if the mutex was released in the meantime */
+    NACL_SYSCALL(futex_wait)(&mutex->mutex_state, NC_MUTEX_CONTENDED, NULL);
+    state = AtomicExchange(&mutex->mutex_state, NC_MUTEX_CONTENDED);
+  }
 }
 
 static int nc_thread_mutex_lock(pthread_mutex_t *mutex, int try_only) {
-  int rv;
-  pthread_mutex_validate(mutex);
+  AtomicWord state;
   /*
    * Checking mutex's owner thread id without synchronization is safe:
    * - We are checking whether the owner's id is equal to the current thread id,
@@ -116,13 +117,13 @@ static int nc_thread_mutex_lock(pthread_mutex_t *mutex, int try_only) {
       return 0;
     }
   }
-  if (try_only) {
-    rv = NACL_SYSCALL(mutex_trylock)(mutex->mutex_handle);
-  } else {
-    rv = NACL_SYSCALL(mutex_lock)(mutex->mutex_handle);
-  }
-  if (rv) {
-    return rv;
+  state = CompareAndSwap(&mutex->mutex_state,
+                         NC_MUTEX_UNLOCKED, NC_MUTEX_LOCKED);
+  if (NC_MUTEX_UNLOCKED != state) {
+    if (try_only) {
+      return EBUSY;
+    }
+    nc_mutex_lock_contended(mutex, state);
   }
 
   mutex->owner_thread_id = pthread_self();
@@ -140,7 +141,6 @@ int pthread_mutex_lock (pthread_mutex_t *mutex) {
 }
 
 int pthread_mutex_unlock (pthread_mutex_t *mutex) {
-  pthread_mutex_validate(mutex);
   if (mutex->mutex_type != PTHREAD_MUTEX_FAST_NP) {
     if ((PTHREAD_MUTEX_RECURSIVE_NP == mutex->mutex_type) &&
         (0 != (--mutex->recursion_counter))) {
@@ -159,7 +159,12 @@ int pthread_mutex_unlock (pthread_mutex_t *mutex) {
   }
   mutex->owner_thread_id = NACL_PTHREAD_ILLEGAL_THREAD_ID;
   mutex->recursion_counter = 0;
-  return NACL_SYSCALL(mutex_unlock)(mutex->mutex_handle);
+  if (NC_MUTEX_UNLOCKED != AtomicIncrement(&mutex->mutex_state, -1)) {
+    /* It was contended: release it and wake one of the waiters */
+    mutex->mutex_state = NC_MUTEX_UNLOCKED;
+    NACL_SYSCALL(futex_wake)(&mutex->mutex_state, 1);
+  }
+  return 0;
 }
 
 /*
@@ -34,7 +34,6 @@
 * Native Client semaphore API
 */
 
-#include <unistd.h>
 #include <errno.h>
 
 #include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
@@ -43,6 +42,13 @@
 #include "native_client/src/untrusted/pthread/pthread_types.h"
 #include "native_client/src/untrusted/pthread/semaphore.h"
 
+/*
+ * The value lives in count and is taken and given back with atomic
+ * instructions; only a thread that finds it zero goes to sleep, in
+ * futex_wait on count, and sem_post only wakes it if waiters says
+ * somebody may be asleep.
+ */
+
 /* Initialize semaphore  */
 int sem_init (sem_t *sem, int pshared, unsigned int value) {
   if (pshared) {
@@ -50,25 +56,62 @@ int sem_init (sem_t *sem, int pshared, unsigned int value) {
     errno = EINVAL;
     return -1;
   }
-  sem->handle = NACL_SYSCALL(sem_create)(value);
-  return (sem->handle < 0);
+  if (value > SEM_VALUE_MAX) {
+    errno = EINVAL;
+    return -1;
+  }
+  sem->count = value;
+  sem->waiters = 0;
+  return 0;
 }
 
 int sem_destroy (sem_t *sem) {
-  int retval = close(sem->handle);
-  sem->handle = NC_INVALID_HANDLE;
-  return retval;
+  if (0 != sem->waiters) {
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+int sem_trywait (sem_t *sem) {
+  AtomicWord count;
+
+  while (0 < (count = sem->count)) {
+    if (count == CompareAndSwap(&sem->count, count, count - 1)) {
+      return 0;
+    }
+  }
+  errno = EAGAIN;
+  return -1;
 }
 
 int sem_wait (sem_t *sem) {
-  return NACL_SYSCALL(sem_wait)(sem->handle);
+  while (0 != sem_trywait(sem)) {
+    AtomicIncrement(&sem->waiters, 1);
+    /* Returns at once if a post came after sem_trywait looked */
+    NACL_SYSCALL(futex_wait)(&sem->count, 0, NULL);
+    AtomicIncrement(&sem->waiters, -1);
+  }
+  return 0;
 }
 
 int sem_post (sem_t *sem) {
-  int32_t rv = NACL_SYSCALL(sem_post)(sem->handle);
-  if (0 != rv) {
-    errno = rv;
-    return -1;
+  AtomicWord count;
+
+  do {
+    count = sem->count;
+    if (SEM_VALUE_MAX == count) {
+      errno = EOVERFLOW;
+      return -1;
+    }
+  } while (count != CompareAndSwap(&sem->count, count, count + 1));
+  if (0 != sem->waiters) {
+    NACL_SYSCALL(futex_wake)(&sem->count, 1);
   }
-  return rv;
+  return 0;
+}
+
+int sem_getvalue (sem_t *sem, int *sval) {
+  *sval = sem->count;
+  return 0;
 }
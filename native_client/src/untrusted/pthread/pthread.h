@@ -77,8 +77,11 @@ struct timespec;
  * opaque record; the names of the fields can change anytime.
  */
 typedef struct {
-  /** Initialization spinlock */
-  int spinlock;
+  /**
+   * Lock state, a futex word: 0 if unlocked, 1 if locked, 2 if locked
+   * and other threads may be waiting for it
+   */
+  volatile AtomicWord mutex_state;
 
   /**
    * The kind of mutex:
@@ -93,8 +96,8 @@ typedef struct {
   /** Recursion depth counter for recursive mutexes */
   uint32_t recursion_counter;
 
-  /** Handle to the system-side mutex */
-  int mutex_handle;
+  /** Unused; keeps the layout mirrored in newlib's sys/lock.h */
+  int reserved;
 } pthread_mutex_t;
 
 /**
@@ -115,8 +118,8 @@ typedef struct {
  * opaque record; the names of the fields can change anytime.
  */
 typedef struct {
-  int spinlock; /**< Initialization spinlock */
-  int handle; /**< Handle to the system-side condition variable */
+  volatile AtomicWord sequence; /**< Futex word, bumped on every wake-up */
+  volatile AtomicWord waiters; /**< Number of threads waiting */
 } pthread_cond_t;
 
 /**
@@ -149,7 +152,7 @@ typedef struct {
 #define PTHREAD_ERRORCHECK_MUTEX_INITIALIZER_NP \
     {0, 2, NACL_PTHREAD_ILLEGAL_THREAD_ID, 0, NC_INVALID_HANDLE}
 /** Statically initializes a condition variable (pthread_cond_t). */
-#define PTHREAD_COND_INITIALIZER {0, NC_INVALID_HANDLE}
+#define PTHREAD_COND_INITIALIZER {0, 0}
 
 
 
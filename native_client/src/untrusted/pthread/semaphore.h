@@ -39,10 +39,13 @@
 
 #include <sys/types.h>
 
+#include "atomic_ops.h"
 
-/* A handle to a semaphore object */
+
+/* A semaphore object */
 typedef struct {
-  int32_t handle;
+  volatile AtomicWord count;  /* The value; a futex word */
+  volatile AtomicWord waiters;  /* Number of threads waiting */
 } sem_t;
 
 /* Maximum value the semaphore can have.  */
@@ -0,0 +1,14 @@
+ //@author nizam
+#include <errno.h>
+#include <sys/types.h>
+#include "native_client/src/trusted/service_runtime/include/sys/socket.h"
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+int accept_batch (int fd, int *fds, unsigned int n, int flags) {
+	int retval = NACL_SYSCALL(accept_batch)(fd, fds, n, flags);
+	if (retval < 0) {
+		errno = -retval;
+		return -1;
+	}
+	return retval;
+}
@@ -0,0 +1,16 @@
+ //@author nizam
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+//Each entry and its address are one block, as getaddrinfo allocates them
+void freeaddrinfo(struct addrinfo *ai) {
+	struct addrinfo *next;
+
+	for (; NULL != ai; ai = next) {
+		next = ai->ai_next;
+		free(ai->ai_canonname);
+		free(ai);
+	}
+}
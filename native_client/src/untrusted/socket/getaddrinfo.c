@@ -0,0 +1,128 @@
+ //@author nizam
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+//Names are resolved by the service runtime, which keeps this many
+//IPv4 addresses per name; there is no services database, so services
+//must be port numbers
+#define GAI_MAX_ADDRS 8
+
+static const struct {
+	int socktype;
+	int protocol;
+} gai_types[] = {
+	{ SOCK_STREAM, IPPROTO_TCP },
+	{ SOCK_DGRAM, IPPROTO_UDP },
+};
+
+static int gai_resolve(const char *node, int flags, unsigned int *addrs) {
+	int n;
+
+	if (NULL == node) {
+		addrs[0] = htonl((flags & AI_PASSIVE) ? INADDR_ANY : INADDR_LOOPBACK);
+		return 1;
+	}
+	if (1 == inet_pton(AF_INET, node, &addrs[0])) {
+		return 1;
+	}
+	if (flags & AI_NUMERICHOST) {
+		return EAI_NONAME;
+	}
+	n = NACL_SYSCALL(getaddrinfo)(node, addrs, GAI_MAX_ADDRS);
+	if (n >= 0) {
+		return n;
+	}
+	switch (-n) {
+	case ENOENT:
+	case EINVAL:
+		return EAI_NONAME;
+	case ETIMEDOUT:
+		return EAI_AGAIN;
+	case EIO:
+		return EAI_FAIL;
+	default:
+		errno = -n;
+		return EAI_SYSTEM;
+	}
+}
+
+int getaddrinfo(const char *node, const char *service,
+		const struct addrinfo *hints, struct addrinfo **res) {
+	unsigned int addrs[GAI_MAX_ADDRS];
+	struct addrinfo *head = NULL;
+	struct addrinfo **tail = &head;
+	struct addrinfo *ai;
+	struct sockaddr_in *sin;
+	int family = AF_UNSPEC, socktype = 0, protocol = 0, flags = 0;
+	unsigned long port = 0;
+	char *end;
+	int n, i, t;
+
+	if (NULL == node && NULL == service) {
+		return EAI_NONAME;
+	}
+	if (NULL != hints) {
+		family = hints->ai_family;
+		socktype = hints->ai_socktype;
+		protocol = hints->ai_protocol;
+		flags = hints->ai_flags;
+	}
+	if (AF_UNSPEC != family && AF_INET != family) {
+		return EAI_FAMILY;
+	}
+	if (0 != socktype && SOCK_STREAM != socktype && SOCK_DGRAM != socktype) {
+		return EAI_SOCKTYPE;
+	}
+	if (NULL != service) {
+		port = strtoul(service, &end, 10);
+		if ('\0' == *service || '\0' != *end || port > 0xffff) {
+			return EAI_SERVICE;
+		}
+	}
+	if ((n = gai_resolve(node, flags, addrs)) < 0) {
+		return n;
+	}
+	if (0 == n) {
+		return EAI_NONAME;
+	}
+
+	for (i = 0; i < n; i++) {
+		for (t = 0; t < (int) (sizeof gai_types / sizeof gai_types[0]); t++) {
+			if (0 != socktype && socktype != gai_types[t].socktype) {
+				continue;
+			}
+			// The address lives in the same block, for freeaddrinfo
+			ai = calloc(1, sizeof *ai + sizeof *sin);
+			if (NULL == ai) {
+				freeaddrinfo(head);
+				return EAI_MEMORY;
+			}
+			sin = (struct sockaddr_in *) (ai + 1);
+			sin->sin_family = AF_INET;
+			sin->sin_port = htons((uint16_t) port);
+			sin->sin_addr.s_addr = addrs[i];
+			ai->ai_family = AF_INET;
+			ai->ai_socktype = gai_types[t].socktype;
+			ai->ai_protocol = (0 != protocol) ? protocol : gai_types[t].protocol;
+			ai->ai_addrlen = sizeof *sin;
+			ai->ai_addr = (struct sockaddr *) sin;
+			*tail = ai;
+			tail = &ai->ai_next;
+		}
+	}
+	if ((flags & AI_CANONNAME) && NULL != node) {
+		if (NULL == (head->ai_canonname = strdup(node))) {
+			freeaddrinfo(head);
+			return EAI_MEMORY;
+		}
+	}
+	*res = head;
+	return 0;
+}
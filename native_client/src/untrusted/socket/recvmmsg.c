@@ -0,0 +1,16 @@
+ //@author nizam
+#include <errno.h>
+#include <sys/types.h>
+#include <time.h>
+#include "native_client/src/trusted/service_runtime/include/sys/socket.h"
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+int recvmmsg (int fd, struct mmsghdr *vmessages, unsigned int vlen,
+		     int flags, struct timespec *tmo) {
+	int retval = NACL_SYSCALL(recvmmsg)(fd, vmessages, vlen, flags, tmo);
+	if (retval < 0) {
+		errno = -retval;
+		return -1;
+	}
+	return retval;
+}
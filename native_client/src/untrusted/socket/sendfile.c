@@ -0,0 +1,14 @@
+ //@author nizam
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/sendfile.h>
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+ssize_t sendfile (int out_fd, int in_fd, off_t *offset, size_t count) {
+	int retval = NACL_SYSCALL(sendfile)(out_fd, in_fd, offset, count);
+	if (retval < 0) {
+		errno = -retval;
+		return -1;
+	}
+	return retval;
+}
@@ -0,0 +1,15 @@
+ //@author nizam
+#include <errno.h>
+#include <sys/types.h>
+#include "native_client/src/trusted/service_runtime/include/sys/socket.h"
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+int sendmmsg (int fd, struct mmsghdr *vmessages, unsigned int vlen,
+		     int flags) {
+	int retval = NACL_SYSCALL(sendmmsg)(fd, vmessages, vlen, flags);
+	if (retval < 0) {
+		errno = -retval;
+		return -1;
+	}
+	return retval;
+}
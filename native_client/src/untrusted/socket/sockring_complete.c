@@ -0,0 +1,36 @@
+ //@author nizam
+#include <errno.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/nacl_sockring.h>
+
+struct sockring_cqe *nacl_sockring_peek_cqe (struct nacl_sockring *ring) {
+	uint32_t head = ring->hdr->cq_head;
+
+	if (head == ring->hdr->cq_tail) {
+		return NULL;
+	}
+	// The entry after the tail
+	__sync_synchronize();
+	return &ring->cqes[head & (2 * ring->mask + 1)];
+}
+
+void nacl_sockring_cqe_seen (struct nacl_sockring *ring) {
+	// Done with the entry before the service runtime may reuse it
+	__sync_synchronize();
+	++ring->hdr->cq_head;
+}
+
+int nacl_sockring_wait_cqe (struct nacl_sockring *ring,
+		struct sockring_cqe **cqep, int timeout_ms) {
+	if (NULL == (*cqep = nacl_sockring_peek_cqe(ring))) {
+		if (sockring_enter(ring->d, 1, timeout_ms) < 0) {
+			return -1;
+		}
+		if (NULL == (*cqep = nacl_sockring_peek_cqe(ring))) {
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+ //@author nizam
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/nacl_sockring.h>
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+int sockring_create (int shm_d, unsigned int entries) {
+	int retval = NACL_SYSCALL(sockring_create)(shm_d, entries);
+	if (retval < 0) {
+		errno = -retval;
+		return -1;
+	}
+	return retval;
+}
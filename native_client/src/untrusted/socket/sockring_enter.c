@@ -0,0 +1,14 @@
+ //@author nizam
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/nacl_sockring.h>
+#include "native_client/src/untrusted/nacl/syscall_bindings_trampoline.h"
+
+int sockring_enter (int ring_d, unsigned int min_complete, int timeout_ms) {
+	int retval = NACL_SYSCALL(sockring_enter)(ring_d, min_complete, timeout_ms);
+	if (retval < 0) {
+		errno = -retval;
+		return -1;
+	}
+	return retval;
+}
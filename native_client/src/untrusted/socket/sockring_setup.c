@@ -0,0 +1,59 @@
+ //@author nizam
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/nacl_syscalls.h>
+#include <sys/nacl_sockring.h>
+
+// Shared memory objects come in multiples of NaCl's mapping page
+#define SOCKRING_MAP_PAGESIZE 0x10000
+
+static size_t sockring_map_bytes (unsigned int entries) {
+	return (SOCKRING_BYTES(entries) + SOCKRING_MAP_PAGESIZE - 1)
+		& ~(size_t) (SOCKRING_MAP_PAGESIZE - 1);
+}
+
+int nacl_sockring_setup (struct nacl_sockring *ring, unsigned int entries) {
+	int shm;
+	void *map;
+	size_t bytes;
+
+	if (0 == entries || entries > SOCKRING_MAX_ENTRIES ||
+	    0 != (entries & (entries - 1))) {
+		errno = EINVAL;
+		return -1;
+	}
+	bytes = sockring_map_bytes(entries);
+	if ((shm = imc_mem_obj_create(bytes)) < 0) {
+		return -1;
+	}
+	map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+	if (MAP_FAILED == map) {
+		close(shm);
+		return -1;
+	}
+	// The ring holds its own reference to the memory
+	ring->d = sockring_create(shm, entries);
+	close(shm);
+	if (ring->d < 0) {
+		munmap(map, bytes);
+		return -1;
+	}
+	ring->hdr = (struct sockring_hdr *) map;
+	ring->sqes = (struct sockring_sqe *) (ring->hdr + 1);
+	ring->cqes = (struct sockring_cqe *) (ring->sqes + entries);
+	ring->mask = entries - 1;
+	ring->sq_local_tail = 0;
+	return 0;
+}
+
+void nacl_sockring_teardown (struct nacl_sockring *ring) {
+	size_t bytes = sockring_map_bytes(ring->mask + 1);
+
+	close(ring->d);
+	munmap(ring->hdr, bytes);
+	memset(ring, 0, sizeof(*ring));
+	ring->d = -1;
+}
@@ -0,0 +1,36 @@
+ //@author nizam
+#include <errno.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/nacl_sockring.h>
+
+struct sockring_sqe *nacl_sockring_get_sqe (struct nacl_sockring *ring) {
+	struct sockring_sqe *sqe;
+
+	// The service runtime only ever advances sq_head
+	if (ring->sq_local_tail - ring->hdr->sq_head > ring->mask) {
+		return NULL;
+	}
+	sqe = &ring->sqes[ring->sq_local_tail & ring->mask];
+	memset(sqe, 0, sizeof(*sqe));
+	++ring->sq_local_tail;
+	return sqe;
+}
+
+int nacl_sockring_submit (struct nacl_sockring *ring) {
+	int n = ring->sq_local_tail - ring->hdr->sq_tail;
+
+	if (0 == n) {
+		return 0;
+	}
+	// Entries before the tail, and the tail before the flag
+	__sync_synchronize();
+	ring->hdr->sq_tail = ring->sq_local_tail;
+	__sync_synchronize();
+	if (0 != (ring->hdr->flags & SOCKRING_NEED_WAKEUP)) {
+		if (sockring_enter(ring->d, 0, 0) < 0) {
+			return -1;
+		}
+	}
+	return n;
+}
@@ -0,0 +1,256 @@
+#include <stdio.h>      /* for printf() and fprintf() */
+#include <sys/socket.h> /* for socket(), connect(), send(), and recv() */
+#include <sys/time.h>   /* for gettimeofday() and struct timeval */
+#include <sys/select.h> /* for select() */
+#include <time.h>       /* for nanosleep() */
+#include <arpa/inet.h>  /* for sockaddr_in and inet_addr() */
+#include <netinet/tcp.h> /* for TCP_NODELAY */
+#include <stdlib.h>     /* for atoi() and exit() */
+#include <string.h>     /* for memset() and memcmp() */
+#include <unistd.h>     /* for close() */
+#include <pthread.h>    /* for POSIX threads */
+
+/*
+ * Load generator for the echo servers: conns closed-loop clients, one
+ * thread and one connection each, send size-byte requests and wait for
+ * the whole echo, for secs seconds after a short warm-up.  Prints one
+ * line of name=value pairs for run_bench.py to collect.  Built both as
+ * a native program and as a nexe, so the same client measures either
+ * side of the sandbox.
+ */
+
+#define MAXCONNS      256     /* Most client threads */
+#define MAXMSG        65536   /* Largest request */
+#define WARMUP        100     /* Unmeasured requests per connection */
+#define UDP_TIMEOUT   1       /* Seconds before a datagram counts as lost */
+
+#define HIST_SUB      64                /* Buckets per power of two: <2% error */
+#define HIST_BUCKETS  (27 * HIST_SUB)   /* Up to 2^32 microseconds */
+
+#ifdef __native_client__
+# define BUILD "nacl"
+#else
+# define BUILD "native"
+#endif
+
+void DieWithError(char *errorMessage);  /* Error handling function */
+
+struct Client
+{
+    pthread_t thread;
+    int sock;                           /* Connected socket */
+    unsigned long requests;             /* Measured round trips */
+    unsigned long errors;               /* Lost or mangled echoes */
+    unsigned long hist[HIST_BUCKETS];   /* Latencies, see HistIndex() */
+};
+
+static struct sockaddr_in servAddr;     /* Echo server address */
+static int udp;                         /* 1 for UDP, 0 for TCP */
+static int msgSize;                     /* Bytes per request */
+static double runSecs;                  /* Measured seconds */
+static volatile int stop;               /* Set when time is up */
+static int started;                     /* Clients past warm-up */
+static pthread_mutex_t mu;
+static pthread_cond_t cv;
+
+static double Now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/* Linear below HIST_SUB microseconds, then HIST_SUB buckets per doubling */
+static int HistIndex(unsigned long us)
+{
+    int shift = 0;
+
+    if (us < HIST_SUB)
+        return (int) us;
+    while ((us >> shift) >= 2 * HIST_SUB)
+        shift++;
+    return (shift + 1) * HIST_SUB + (int) ((us >> shift) - HIST_SUB);
+}
+
+/* Lowest latency that lands in bucket i */
+static unsigned long HistValue(int i)
+{
+    if (i < HIST_SUB)
+        return i;
+    return (unsigned long) (HIST_SUB + i % HIST_SUB) << (i / HIST_SUB - 1);
+}
+
+static unsigned long Percentile(unsigned long *hist, unsigned long total,
+                                double p)
+{
+    unsigned long rank = (unsigned long) (p * total);
+    unsigned long seen = 0;
+    int i;
+
+    if (rank >= total && total > 0)
+        rank = total - 1;               /* p = 1 is the maximum */
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+    {
+        seen += hist[i];
+        if (seen > rank)
+            return HistValue(i);
+    }
+    return HistValue(HIST_BUCKETS - 1);
+}
+
+/* One request and its echo; returns 0, or -1 if the echo was lost or wrong */
+static int RoundTrip(struct Client *c, char *msg, char *echo, unsigned long seq)
+{
+    int got, n;
+    fd_set readSet;
+    struct timeval tv;
+
+    memcpy(msg, &seq, sizeof seq);      /* So a late UDP echo can't match */
+    if (send(c->sock, msg, msgSize, 0) != msgSize)
+        DieWithError("send() failed");
+    if (udp)
+    {
+        FD_ZERO(&readSet);
+        FD_SET(c->sock, &readSet);
+        tv.tv_sec = UDP_TIMEOUT;
+        tv.tv_usec = 0;
+        if (select(c->sock + 1, &readSet, NULL, NULL, &tv) <= 0)
+            return -1;
+    }
+    for (got = 0; got < msgSize; got += n)
+    {
+        if ((n = recv(c->sock, echo + got, msgSize - got, 0)) <= 0)
+            DieWithError("recv() failed or connection closed prematurely");
+        if (udp && n != msgSize)
+            return -1;
+    }
+    return (0 == memcmp(msg, echo, msgSize)) ? 0 : -1;
+}
+
+static void *ClientMain(void *arg)
+{
+    struct Client *c = (struct Client *) arg;
+    char *msg, *echo;
+    unsigned long seq = 0;
+    double start;
+
+    if (NULL == (msg = malloc(msgSize)) || NULL == (echo = malloc(msgSize)))
+        DieWithError("malloc() failed");
+    memset(msg, 'x', msgSize);
+
+    for (seq = 0; seq < WARMUP; seq++)
+        (void) RoundTrip(c, msg, echo, seq);
+
+    /* Measure from when every client is warm */
+    pthread_mutex_lock(&mu);
+    started++;
+    pthread_cond_broadcast(&cv);
+    pthread_mutex_unlock(&mu);
+
+    while (!stop)
+    {
+        start = Now();
+        if (0 != RoundTrip(c, msg, echo, seq++))
+        {
+            c->errors++;
+            continue;
+        }
+        c->hist[HistIndex((unsigned long) ((Now() - start) * 1e6))]++;
+        c->requests++;
+    }
+    free(msg);
+    free(echo);
+    return NULL;
+}
+
+static int Connect(void)
+{
+    int sock;
+    int on = 1;
+
+    if (udp)
+        sock = socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    else
+        sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0)
+        DieWithError("socket() failed");
+    if (!udp && setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+        DieWithError("setsockopt() failed");
+    /* A connected UDP socket only hears from the server */
+    if (connect(sock, (struct sockaddr *) &servAddr, sizeof(servAddr)) < 0)
+        DieWithError("connect() failed");
+    return sock;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct Client clients[MAXCONNS];
+    static unsigned long hist[HIST_BUCKETS];
+    unsigned long requests = 0, errors = 0;
+    int conns, i, j;
+    double start, secs;
+    struct timespec ts;
+
+    if (argc != 7)
+    {
+        fprintf(stderr, "Usage: %s <Server IP> <Port> <tcp|udp> <Msg bytes>"
+                " <Conns> <Secs>\n", argv[0]);
+        exit(1);
+    }
+
+    memset(&servAddr, 0, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_addr.s_addr = inet_addr(argv[1]);
+    servAddr.sin_port = htons(atoi(argv[2]));
+    udp = (0 == strcmp(argv[3], "udp"));
+    msgSize = atoi(argv[4]);
+    conns = atoi(argv[5]);
+    runSecs = atof(argv[6]);
+    if (msgSize < (int) sizeof(unsigned long) || msgSize > MAXMSG)
+        DieWithError("bad message size");
+    if (conns < 1 || conns > MAXCONNS)
+        DieWithError("bad number of connections");
+
+    pthread_mutex_init(&mu, NULL);
+    pthread_cond_init(&cv, NULL);
+    for (i = 0; i < conns; i++)
+    {
+        clients[i].sock = Connect();
+        if (pthread_create(&clients[i].thread, NULL, ClientMain, &clients[i]) != 0)
+            DieWithError("pthread_create() failed");
+    }
+
+    pthread_mutex_lock(&mu);
+    while (started < conns)
+        pthread_cond_wait(&cv, &mu);
+    pthread_mutex_unlock(&mu);
+    start = Now();
+    ts.tv_sec = (time_t) runSecs;
+    ts.tv_nsec = (long) ((runSecs - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+    stop = 1;
+
+    /* Requests in flight when time is up still count, so wait for them */
+    for (i = 0; i < conns; i++)
+    {
+        pthread_join(clients[i].thread, NULL);
+        close(clients[i].sock);
+        requests += clients[i].requests;
+        errors += clients[i].errors;
+        for (j = 0; j < HIST_BUCKETS; j++)
+            hist[j] += clients[i].hist[j];
+    }
+    secs = Now() - start;
+
+    printf("build=%s proto=%s size=%d conns=%d secs=%.3f requests=%lu"
+           " errors=%lu rps=%.1f mbps=%.2f p50_us=%lu p90_us=%lu"
+           " p99_us=%lu p999_us=%lu max_us=%lu\n",
+           BUILD, udp ? "udp" : "tcp", msgSize, conns, secs, requests,
+           errors, requests / secs, requests * (double) msgSize * 8 / secs / 1e6,
+           Percentile(hist, requests, 0.50), Percentile(hist, requests, 0.90),
+           Percentile(hist, requests, 0.99), Percentile(hist, requests, 0.999),
+           Percentile(hist, requests, 1.0));
+    return 0;
+}
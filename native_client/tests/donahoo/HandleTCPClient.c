@@ -1,5 +1,7 @@
 #include <stdio.h>      /* for printf() and fprintf() */
 #include <sys/socket.h> /* for recv() and send() */
+#include <netinet/in.h> /* for IPPROTO_TCP */
+#include <netinet/tcp.h> /* for TCP_NODELAY */
 #include <unistd.h>     /* for close() */
 
 #define RCVBUFSIZE 32   /* Size of receive buffer */
@@ -10,6 +12,11 @@ void HandleTCPClient(int clntSocket)
 {
     char echoBuffer[RCVBUFSIZE];        /* Buffer for echo string */
     int recvMsgSize;                    /* Size of received message */
+    int on = 1;
+
+    /* Echo each piece at once: with Nagle's algorithm, the second piece of a
+       message waits for the client's delayed ACK of the first */
+    setsockopt(clntSocket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
 
     /* Receive message from client */
     if ((recvMsgSize = recv(clntSocket, echoBuffer, RCVBUFSIZE, 0)) < 0)
@@ -0,0 +1,294 @@
+#!/usr/bin/python
+# Copyright 2009, Google Inc.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are
+# met:
+#
+#     * Redistributions of source code must retain the above copyright
+# notice, this list of conditions and the following disclaimer.
+#     * Redistributions in binary form must reproduce the above
+# copyright notice, this list of conditions and the following disclaimer
+# in the documentation and/or other materials provided with the
+# distribution.
+#     * Neither the name of Google Inc. nor the names of its
+# contributors may be used to endorse or promote products derived from
+# this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+# A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+# OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+# DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+# THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+# (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+
+"""Loopback performance regression suite for the socket system calls.
+
+Runs EchoBench against the echo servers in this directory on 127.0.0.1,
+once with everything built natively (make) and once with everything
+sandboxed (the scons nexes under sel_ldr), for each server variant,
+message size and number of connections.  Sandboxed programs validate
+their peers, so a nacl_validate_server allowing every port stands in
+for the one a real host runs.
+
+Each measurement is printed, and with --out appended to a file, as a
+line of JSON.  --baseline compares against such a file and exits 1 if
+requests/sec fell, or p99 latency rose, by more than --tolerance.
+
+  ./run_bench.py --out today.json
+  ./run_bench.py --baseline today.json --sizes 64 --conns 1,16
+"""
+
+import json
+import optparse
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+sys.path.append("../../common")
+import nacl_util
+
+# server name -> (program, arguments before the port, protocol,
+#                 most connections, builds it exists in)
+# The select server serves one connection at a time, and the
+# sandbox has no fork.
+SERVERS = {
+  "thread": ("TCPEchoServer-Thread", [], "tcp", None, ("native", "nacl")),
+  "select": ("TCPEchoServer-Select", ["3600"], "tcp", 1, ("native", "nacl")),
+  "fork": ("TCPEchoServer-Fork", [], "tcp", None, ("native",)),
+  "udp": ("UDPEchoServer", [], "udp", None, ("native", "nacl")),
+}
+UDP_MAX = 255  # UDPEchoServer's ECHOMAX; larger datagrams get cut short
+KEY = ("build", "server", "proto", "size", "conns")
+NATIVE_PROGS = ["EchoBench.out"] + [s[0] + ".out" for s in SERVERS.values()]
+
+
+def FreePort(kind):
+  s = socket.socket(socket.AF_INET, kind)
+  s.bind(("127.0.0.1", 0))
+  port = s.getsockname()[1]
+  s.close()
+  return port
+
+
+def WaitForServer(port, proto, proc):
+  """Returns once the server on port answers, or raises."""
+  deadline = time.time() + 10
+  while time.time() < deadline:
+    if proc.poll() is not None:
+      raise RuntimeError("server exited with %d" % proc.returncode)
+    if proto == "tcp":
+      s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    else:
+      s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.settimeout(0.2)
+    try:
+      try:
+        s.connect(("127.0.0.1", port))
+        if proto == "udp":
+          s.send("ping")
+          s.recv(16)
+        return
+      except socket.error:
+        time.sleep(0.1)
+    finally:
+      s.close()
+  raise RuntimeError("server on port %d never answered" % port)
+
+
+class Runner(object):
+  def __init__(self, options):
+    self.options = options
+    self.env = dict(os.environ)
+    self.validate = None
+
+  def Command(self, build, prog, args):
+    if build == "native":
+      return [os.path.join(".", prog + ".out")] + args
+    return ([self.options.sel_ldr, "-f", nacl_util.GetExe(prog + ".nexe"),
+             "--"] + args)
+
+  def StartValidateServer(self):
+    fd, self.policy = tempfile.mkstemp(suffix=".policy")
+    os.write(fd, "# every app may use every port\n*  1-65535\n")
+    os.close(fd)
+    self.validate = subprocess.Popen(
+        [self.options.validate_server, "-f", self.policy, "-l", "-p", "0"],
+        stdout=subprocess.PIPE)
+    line = self.validate.stdout.readline()
+    if not line.startswith("listening on port "):
+      raise RuntimeError("nacl_validate_server did not start")
+    self.env["NACL_VALIDATE_PORT"] = line.split()[-1]
+
+  def Measure(self, build, server, size, conns):
+    prog, args, proto = SERVERS[server][:3]
+    port = FreePort(proto == "tcp" and socket.SOCK_STREAM or
+                    socket.SOCK_DGRAM)
+    devnull = open(os.devnull, "w")
+    srv = subprocess.Popen(self.Command(build, prog, args + [str(port)]),
+                           stdin=subprocess.PIPE, stdout=devnull,
+                           stderr=devnull, env=self.env)
+    try:
+      WaitForServer(port, proto, srv)
+      out = subprocess.Popen(
+          self.Command(build, "EchoBench",
+                       ["127.0.0.1", str(port), proto, str(size), str(conns),
+                        str(self.options.secs)]),
+          stdout=subprocess.PIPE, env=self.env).communicate()[0]
+    finally:
+      if srv.poll() is None:
+        srv.kill()
+      srv.wait()
+      devnull.close()
+    fields = [line for line in out.splitlines() if line.startswith("build=")]
+    if not fields:
+      raise RuntimeError("EchoBench printed no result")
+    result = {"server": server}
+    for pair in fields[-1].split():
+      name, value = pair.split("=", 1)
+      for kind in (int, float):
+        try:
+          value = kind(value)
+          break
+        except ValueError:
+          pass
+      result[name] = value
+    return result
+
+  def Run(self):
+    results = []
+    if "native" in self.options.builds:
+      # -B: the checked in .out files were built elsewhere
+      subprocess.check_call(["make", "-B"] + NATIVE_PROGS)
+    if "nacl" in self.options.builds:
+      self.StartValidateServer()
+    try:
+      for server in self.options.servers:
+        proto, max_conns, builds = SERVERS[server][2:]
+        for size in self.options.sizes:
+          if proto == "udp" and size > UDP_MAX:
+            continue
+          for conns in self.options.conns:
+            if max_conns is not None and conns > max_conns:
+              continue
+            for build in self.options.builds:
+              if build not in builds:
+                continue
+              result = self.Measure(build, server, size, conns)
+              print json.dumps(result, sort_keys=True)
+              sys.stdout.flush()
+              results.append(result)
+    finally:
+      if self.validate is not None:
+        self.validate.kill()
+        self.validate.wait()
+        os.unlink(self.policy)
+    return results
+
+
+def Key(result):
+  return tuple([result[k] for k in KEY])
+
+
+def Summarize(results):
+  """Prints sandboxed over native for each configuration run both ways."""
+  by_key = dict([(Key(r), r) for r in results])
+  print "%-8s %-5s %6s %5s %12s %12s" % (
+      "server", "proto", "size", "conns", "rps ratio", "p99 ratio")
+  for r in results:
+    if r["build"] != "nacl":
+      continue
+    native = by_key.get(("native",) + Key(r)[1:])
+    if native is None or not native["rps"] or not native["p99_us"]:
+      continue
+    print "%-8s %-5s %6d %5d %12.2f %12.2f" % (
+        r["server"], r["proto"], r["size"], r["conns"],
+        r["rps"] / native["rps"], float(r["p99_us"]) / native["p99_us"])
+
+
+def Compare(results, baseline_path, tolerance):
+  """Returns the number of measurements worse than the baseline's."""
+  baseline = {}
+  for line in open(baseline_path):
+    if line.strip():
+      r = json.loads(line)
+      baseline[Key(r)] = r
+  regressions = 0
+  for r in results:
+    old = baseline.get(Key(r))
+    if old is None:
+      continue
+    if r["rps"] < old["rps"] * (1 - tolerance):
+      print "REGRESSION %s: rps %.1f, was %.1f" % (Key(r), r["rps"], old["rps"])
+      regressions += 1
+    if r["p99_us"] > old["p99_us"] * (1 + tolerance):
+      print "REGRESSION %s: p99_us %d, was %d" % (Key(r), r["p99_us"],
+                                                   old["p99_us"])
+      regressions += 1
+  return regressions
+
+
+def Ints(option, opt, value, parser):
+  setattr(parser.values, option.dest, [int(v) for v in value.split(",")])
+
+
+def Names(option, opt, value, parser):
+  setattr(parser.values, option.dest, value.split(","))
+
+
+def main():
+  parser = optparse.OptionParser(usage=__doc__)
+  parser.add_option("--builds", type="string", action="callback",
+                    callback=Names, default=["native", "nacl"])
+  parser.add_option("--servers", type="string", action="callback",
+                    callback=Names, default=["thread", "select", "fork", "udp"])
+  parser.add_option("--sizes", type="string", action="callback",
+                    callback=Ints, default=[64, 1024, 16384])
+  parser.add_option("--conns", type="string", action="callback",
+                    callback=Ints, default=[1, 4, 16])
+  parser.add_option("--secs", type="float", default=2.0,
+                    help="measured seconds per run")
+  parser.add_option("--sel_ldr", default=None)
+  parser.add_option("--validate_server", default=None)
+  parser.add_option("--out", default=None, help="append results here")
+  parser.add_option("--baseline", default=None)
+  parser.add_option("--tolerance", type="float", default=0.10)
+  options, args = parser.parse_args()
+  if args:
+    parser.error("unexpected arguments")
+  for server in options.servers:
+    if server not in SERVERS:
+      parser.error("unknown server %s" % server)
+  if "nacl" in options.builds:
+    if options.sel_ldr is None:
+      options.sel_ldr = nacl_util.FindSelLdr(None)
+    if options.validate_server is None:
+      options.validate_server = os.path.join(
+          os.path.dirname(options.sel_ldr), "nacl_validate_server")
+    if not options.sel_ldr or not os.path.exists(options.validate_server):
+      print "ERROR: build sel_ldr and nacl_validate_server with scons first"
+      return 1
+
+  results = Runner(options).Run()
+  Summarize(results)
+  if options.out:
+    f = open(options.out, "a")
+    for r in results:
+      f.write(json.dumps(r, sort_keys=True) + "\n")
+    f.close()
+  if options.baseline and Compare(results, options.baseline,
+                                  options.tolerance):
+    return 1
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2009, Google Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ * copyright notice, this list of conditions and the following disclaimer
+ * in the documentation and/or other materials provided with the
+ * distribution.
+ *     * Neither the name of Google Inc. nor the names of its
+ * contributors may be used to endorse or promote products derived from
+ * this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Thread churn test: threads that exit are parked by the service
+ * runtime and handed to later thread creates, so check that a reused
+ * thread starts with fresh thread-local storage and its own arguments.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+
+#define kNumRounds 200
+#define kBurst 16
+
+__thread int tls_data = 666;
+__thread int tls_bss;
+
+static int errors = 0;
+static pthread_mutex_t errors_mu = PTHREAD_MUTEX_INITIALIZER;
+
+static void Fail(const char *what, int arg) {
+  printf("ERROR: %s (arg %d)\n", what, arg);
+  pthread_mutex_lock(&errors_mu);
+  errors++;
+  pthread_mutex_unlock(&errors_mu);
+}
+
+static void *Worker(void *arg) {
+  int n = (int) arg;
+
+  if (666 != tls_data) {
+    Fail("stale tls data", n);
+  }
+  if (0 != tls_bss) {
+    Fail("stale tls bss", n);
+  }
+  tls_data = n;
+  tls_bss = n + 1;
+  return (void *) (n * 2);
+}
+
+static void Spawn(int first, int count) {
+  pthread_t tids[kBurst];
+  void *result;
+  int i;
+
+  for (i = 0; i < count; ++i) {
+    if (0 != pthread_create(&tids[i], NULL, Worker, (void *) (first + i))) {
+      Fail("pthread_create", first + i);
+      return;
+    }
+  }
+  for (i = 0; i < count; ++i) {
+    if (0 != pthread_join(tids[i], &result)) {
+      Fail("pthread_join", first + i);
+    } else if ((int) result != (first + i) * 2) {
+      Fail("wrong result", first + i);
+    }
+  }
+}
+
+int main(void) {
+  int round;
+
+  /* one at a time, so every create after the first can reuse a thread */
+  for (round = 0; round < kNumRounds; ++round) {
+    Spawn(round, 1);
+  }
+  /* bursts wider than the default pool */
+  for (round = 0; round < kNumRounds / 10; ++round) {
+    Spawn(round * kBurst, kBurst);
+  }
+
+  if (0 != errors) {
+    printf("FAILED\n");
+    return 1;
+  }
+  printf("PASSED\n");
+  return 0;
+}